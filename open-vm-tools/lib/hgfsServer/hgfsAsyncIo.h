@@ -0,0 +1,57 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsAsyncIo.h --
+ *
+ *	Asynchronous file I/O for the HGFS server. Operations are submitted
+ *	without blocking the calling thread and their completion callbacks are
+ *	run on a completion reactor thread.
+ */
+
+#ifndef _HGFS_ASYNC_IO_H
+#define _HGFS_ASYNC_IO_H
+
+#include "hgfsUtil.h"       // for HgfsInternalStatus
+#include "hgfsServerInt.h"  // for HgfsPlatformIoCallback
+
+/* Maximum number of operations in flight. */
+#define HGFS_ASYNC_IO_QUEUE_DEPTH 128
+
+Bool HgfsAsyncIo_Init(void);
+void HgfsAsyncIo_Exit(void);
+Bool HgfsAsyncIo_Read(int fd,
+                      uint64 offset,
+                      const HgfsVmxIov *vmxIov,
+                      uint32 vmxIovCount,
+                      uint32 size,
+                      HgfsPlatformIoCallback callback,
+                      void *data);
+Bool HgfsAsyncIo_Write(int fd,
+                       uint64 offset,
+                       const HgfsVmxIov *vmxIov,
+                       uint32 vmxIovCount,
+                       uint32 size,
+                       HgfsPlatformIoCallback callback,
+                       void *data);
+Bool HgfsAsyncIo_Fsync(int fd,
+                       Bool dataOnly,
+                       HgfsPlatformIoCallback callback,
+                       void *data);
+
+#endif // _HGFS_ASYNC_IO_H
@@ -0,0 +1,815 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsAsyncIoLinux.c --
+ *
+ *	Asynchronous file I/O for the Linux platform, using io_uring.
+ *
+ *	Operations are queued on the submission ring by the threads processing
+ *	the requests, which then move on to other requests. A single completion
+ *	reactor thread waits for the completion ring and runs the callbacks.
+ *	No more than HGFS_ASYNC_IO_QUEUE_DEPTH operations are in flight, so the
+ *	completion ring, which is twice as large, never overflows.
+ *
+ *	Like write(2), a write may complete having written part of the data.
+ *	The reactor then submits the rest, so that callbacks only see short
+ *	writes on failure.
+ *
+ *	Support is detected at run time: if the kernel has no io_uring, or it
+ *	is disabled or not permitted, HgfsAsyncIo_Init fails and the callers
+ *	keep doing blocking I/O on their own threads.
+ */
+
+#define _GNU_SOURCE // for IOV_MAX
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>       // for IOV_MAX
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "vmware.h"
+#include "vm_basic_types.h"
+#include "util.h"
+#include "err.h"
+#include "userlock.h"
+#include "mutexRankLib.h"
+
+#include "hgfsServerInt.h"
+#include "hgfsAsyncIo.h"
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && \
+    (!defined(USING_AUTOCONF) || defined(HAVE_LINUX_IO_URING_H))
+#define HGFS_ASYNC_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+
+#ifdef HGFS_ASYNC_IO_URING
+/*
+ * Local data
+ */
+
+/*
+ * An operation in flight. The iovecs have to stay valid until the
+ * operation completes.
+ */
+typedef struct HgfsAsyncIoRequest {
+   HgfsPlatformIoCallback callback;
+   void *data;
+   int fd;                  /* Duplicated descriptor of a write, or -1. */
+   uint64 offset;           /* File offset of the iovecs. */
+   uint32 size;             /* Size of the operation. */
+   uint32 doneSize;         /* Bytes transferred so far. */
+   uint32 iovCount;
+   struct iovec iov[1];
+} HgfsAsyncIoRequest;
+
+typedef struct HgfsAsyncIoState {
+   MXUserExclLock *lock;              /* Serializes submissions. */
+   int ringFd;
+   void *sqRing;
+   size_t sqRingSize;
+   void *cqRing;
+   size_t cqRingSize;
+   struct io_uring_sqe *sqes;
+   size_t sqesSize;
+   unsigned *sqHead;
+   unsigned *sqTail;
+   unsigned *sqMask;
+   unsigned *sqArray;
+   unsigned *cqHead;
+   unsigned *cqTail;
+   unsigned *cqMask;
+   struct io_uring_cqe *cqes;
+   pthread_t reactor;
+   uint32 numInFlight;                /* Operations submitted, not reaped. */
+   Bool exiting;                      /* The reactor should terminate. */
+} HgfsAsyncIoState;
+
+static HgfsAsyncIoState *gHgfsAsyncIo = NULL;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsAsyncIoEnter --
+ *
+ *    Submits the queued operations and optionally waits for a completion.
+ *
+ * Results:
+ *    The number of operations submitted, -1 with errno set on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsAsyncIoEnter(HgfsAsyncIoState *aio,  // IN: async I/O state
+                 unsigned toSubmit,      // IN: operations to submit
+                 unsigned minComplete)   // IN: completions to wait for
+{
+   int ret;
+
+   do {
+      ret = syscall(__NR_io_uring_enter, aio->ringFd, toSubmit, minComplete,
+                    minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+   } while (ret < 0 && errno == EINTR);
+
+   return ret;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsAsyncIoSubmit --
+ *
+ *    Queues one operation on the submission ring and submits it. Must be
+ *    called with the lock held.
+ *
+ * Results:
+ *    TRUE if the operation was submitted, FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsAsyncIoSubmit(HgfsAsyncIoState *aio,          // IN: async I/O state
+                  const struct io_uring_sqe *op)  // IN: operation
+{
+   unsigned tail = *aio->sqTail;
+   unsigned index = tail & *aio->sqMask;
+
+   aio->sqes[index] = *op;
+   aio->sqArray[index] = index;
+   /* The entry must be visible to the kernel before the new tail. */
+   __atomic_store_n(aio->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+   if (HgfsAsyncIoEnter(aio, 1, 0) == 1) {
+      return TRUE;
+   }
+
+   /*
+    * The kernel only consumes entries in io_uring_enter, take the entry
+    * back if it was not consumed so that it is not submitted later.
+    */
+   LOG(4, "%s: submit failed: %s\n", __FUNCTION__,
+       Err_Errno2String(errno));
+   if (__atomic_load_n(aio->sqHead, __ATOMIC_ACQUIRE) == tail) {
+      __atomic_store_n(aio->sqTail, tail, __ATOMIC_RELEASE);
+   }
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsAsyncIoQueue --
+ *
+ *    Submits an operation unless too many are in flight or the reactor is
+ *    exiting.
+ *
+ * Results:
+ *    TRUE if the operation was submitted, FALSE otherwise.
+ *
+ * Side effects:
+ *    The request is freed if the operation was not submitted.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsAsyncIoQueue(HgfsAsyncIoState *aio,          // IN: async I/O state
+                 const struct io_uring_sqe *op,  // IN: operation
+                 HgfsAsyncIoRequest *request)    // IN: request of the operation
+{
+   Bool submitted = FALSE;
+
+   MXUser_AcquireExclLock(aio->lock);
+   if (!aio->exiting && aio->numInFlight < HGFS_ASYNC_IO_QUEUE_DEPTH) {
+      submitted = HgfsAsyncIoSubmit(aio, op);
+      if (submitted) {
+         aio->numInFlight++;
+      }
+   }
+   MXUser_ReleaseExclLock(aio->lock);
+
+   if (!submitted) {
+      if (request->fd >= 0) {
+         close(request->fd);
+      }
+      free(request);
+   }
+   return submitted;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsAsyncIoWriteRest --
+ *
+ *    Submits the rest of a write which completed having written only part
+ *    of its data. Called by the reactor, the write is still in flight.
+ *
+ * Results:
+ *    TRUE if the rest of the write was submitted, FALSE otherwise.
+ *
+ * Side effects:
+ *    The iovecs of the request are advanced past the written data.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsAsyncIoWriteRest(HgfsAsyncIoState *aio,        // IN: async I/O state
+                     HgfsAsyncIoRequest *request,  // IN/OUT: short write
+                     uint32 writtenSize)           // IN: bytes just written
+{
+   struct io_uring_sqe op;
+   Bool submitted;
+   uint32 i;
+
+   for (i = 0; writtenSize >= request->iov[i].iov_len; i++) {
+      writtenSize -= request->iov[i].iov_len;
+   }
+   ASSERT(i < request->iovCount);
+   request->iov[i].iov_base = (char *)request->iov[i].iov_base + writtenSize;
+   request->iov[i].iov_len -= writtenSize;
+   request->iovCount -= i;
+   memmove(request->iov, request->iov + i,
+           request->iovCount * sizeof request->iov[0]);
+
+   memset(&op, 0, sizeof op);
+   op.opcode = IORING_OP_WRITEV;
+   op.fd = request->fd;
+   op.off = request->offset + request->doneSize;
+   op.addr = (uintptr_t)request->iov;
+   op.len = request->iovCount;
+   op.user_data = (uintptr_t)request;
+
+   MXUser_AcquireExclLock(aio->lock);
+   submitted = HgfsAsyncIoSubmit(aio, &op);
+   MXUser_ReleaseExclLock(aio->lock);
+
+   return submitted;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsAsyncIoReactor --
+ *
+ *    Completion reactor thread. Waits for completed operations and runs
+ *    their callbacks until HgfsAsyncIo_Exit is called and all operations
+ *    have completed.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HgfsAsyncIoReactor(void *data)  // IN: async I/O state
+{
+   HgfsAsyncIoState *aio = data;
+   Bool done = FALSE;
+
+   while (!done) {
+      unsigned head;
+      unsigned tail;
+
+      if (HgfsAsyncIoEnter(aio, 0, 1) < 0) {
+         LOG(4, "%s: wait failed: %s\n", __FUNCTION__,
+             Err_Errno2String(errno));
+      }
+
+      head = *aio->cqHead;
+      tail = __atomic_load_n(aio->cqTail, __ATOMIC_ACQUIRE);
+      while (head != tail) {
+         struct io_uring_cqe *cqe = &aio->cqes[head & *aio->cqMask];
+         HgfsAsyncIoRequest *request =
+            (HgfsAsyncIoRequest *)(uintptr_t)cqe->user_data;
+         int32 res = cqe->res;
+
+         /* Release the entry before the callback, it may submit again. */
+         head++;
+         __atomic_store_n(aio->cqHead, head, __ATOMIC_RELEASE);
+
+         /* A NULL request is the wake up sent by HgfsAsyncIo_Exit. */
+         if (NULL != request) {
+            if (res >= 0) {
+               request->doneSize += res;
+            }
+            if (request->fd >= 0 && res >= 0 &&
+                request->doneSize < request->size) {
+               if (res > 0 && HgfsAsyncIoWriteRest(aio, request, res)) {
+                  continue;
+               }
+               res = -EIO;
+            }
+
+            MXUser_AcquireExclLock(aio->lock);
+            aio->numInFlight--;
+            MXUser_ReleaseExclLock(aio->lock);
+
+            if (res >= 0) {
+               request->callback(HGFS_ERROR_SUCCESS, request->doneSize,
+                                 request->data);
+            } else {
+               request->callback(-res, request->doneSize, request->data);
+            }
+            if (request->fd >= 0) {
+               close(request->fd);
+            }
+            free(request);
+         }
+      }
+
+      MXUser_AcquireExclLock(aio->lock);
+      done = aio->exiting && aio->numInFlight == 0;
+      MXUser_ReleaseExclLock(aio->lock);
+   }
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsAsyncIoUnmap --
+ *
+ *    Unmaps the rings and closes the ring file descriptor.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsAsyncIoUnmap(HgfsAsyncIoState *aio)  // IN/OUT: async I/O state
+{
+   if (NULL != aio->sqes) {
+      munmap(aio->sqes, aio->sqesSize);
+   }
+   if (NULL != aio->cqRing && aio->cqRing != aio->sqRing) {
+      munmap(aio->cqRing, aio->cqRingSize);
+   }
+   if (NULL != aio->sqRing) {
+      munmap(aio->sqRing, aio->sqRingSize);
+   }
+   close(aio->ringFd);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsAsyncIoMap --
+ *
+ *    Sets up an io_uring instance and maps its rings.
+ *
+ * Results:
+ *    TRUE on success, FALSE if io_uring is not available.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsAsyncIoMap(HgfsAsyncIoState *aio)  // IN/OUT: async I/O state
+{
+   struct io_uring_params params;
+   char *sq;
+   char *cq;
+
+   memset(&params, 0, sizeof params);
+   aio->ringFd = syscall(__NR_io_uring_setup, HGFS_ASYNC_IO_QUEUE_DEPTH,
+                         &params);
+   if (aio->ringFd < 0) {
+      LOG(4, "%s: io_uring not available: %s\n", __FUNCTION__,
+          Err_Errno2String(errno));
+      return FALSE;
+   }
+
+   aio->sqRingSize = params.sq_off.array +
+                     params.sq_entries * sizeof (unsigned);
+   aio->cqRingSize = params.cq_off.cqes +
+                     params.cq_entries * sizeof (struct io_uring_cqe);
+   if (0 != (params.features & IORING_FEAT_SINGLE_MMAP)) {
+      aio->sqRingSize = MAX(aio->sqRingSize, aio->cqRingSize);
+      aio->cqRingSize = aio->sqRingSize;
+   }
+
+   sq = mmap(NULL, aio->sqRingSize, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, aio->ringFd, IORING_OFF_SQ_RING);
+   if (MAP_FAILED == sq) {
+      goto error;
+   }
+   aio->sqRing = sq;
+
+   if (0 != (params.features & IORING_FEAT_SINGLE_MMAP)) {
+      cq = sq;
+   } else {
+      cq = mmap(NULL, aio->cqRingSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, aio->ringFd, IORING_OFF_CQ_RING);
+      if (MAP_FAILED == cq) {
+         goto error;
+      }
+   }
+   aio->cqRing = cq;
+
+   aio->sqesSize = params.sq_entries * sizeof (struct io_uring_sqe);
+   aio->sqes = mmap(NULL, aio->sqesSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, aio->ringFd, IORING_OFF_SQES);
+   if (MAP_FAILED == aio->sqes) {
+      aio->sqes = NULL;
+      goto error;
+   }
+
+   aio->sqHead = (unsigned *)(sq + params.sq_off.head);
+   aio->sqTail = (unsigned *)(sq + params.sq_off.tail);
+   aio->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+   aio->sqArray = (unsigned *)(sq + params.sq_off.array);
+   aio->cqHead = (unsigned *)(cq + params.cq_off.head);
+   aio->cqTail = (unsigned *)(cq + params.cq_off.tail);
+   aio->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+   aio->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+   return TRUE;
+
+error:
+   LOG(4, "%s: mapping the rings failed: %s\n", __FUNCTION__,
+       Err_Errno2String(errno));
+   HgfsAsyncIoUnmap(aio);
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsAsyncIoRequestAlloc --
+ *
+ *    Allocates the request of a read or a write, with the iovecs covering
+ *    size bytes of the mapped buffers.
+ *
+ * Results:
+ *    The request.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsAsyncIoRequest *
+HgfsAsyncIoRequestAlloc(uint64 offset,                   // IN: file offset
+                        const HgfsVmxIov *vmxIov,        // IN: mapped buffers
+                        uint32 vmxIovCount,              // IN: count of vmxIov
+                        uint32 size,                     // IN: length of data
+                        HgfsPlatformIoCallback callback, // IN: completion callback
+                        void *data)                      // IN: callback data
+{
+   HgfsAsyncIoRequest *request;
+   uint32 remainingSize = size;
+   uint32 i;
+
+   request = Util_SafeMalloc(sizeof *request +
+                             vmxIovCount * sizeof request->iov[0]);
+   request->callback = callback;
+   request->data = data;
+   request->fd = -1;
+   request->offset = offset;
+   request->size = size;
+   request->doneSize = 0;
+   for (i = 0; i < vmxIovCount && remainingSize > 0; i++) {
+      request->iov[i].iov_base = vmxIov[i].va;
+      request->iov[i].iov_len = MIN(vmxIov[i].len, remainingSize);
+      remainingSize -= request->iov[i].iov_len;
+   }
+   ASSERT(remainingSize == 0);
+   request->iovCount = i;
+
+   return request;
+}
+#endif // HGFS_ASYNC_IO_URING
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsAsyncIo_Init --
+ *
+ *    Initialization of the asynchronous I/O component. Starts the
+ *    completion reactor thread.
+ *
+ * Results:
+ *    TRUE if asynchronous I/O is available, FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsAsyncIo_Init(void)
+{
+#ifdef HGFS_ASYNC_IO_URING
+   HgfsAsyncIoState *aio;
+   int error;
+
+   if (NULL != gHgfsAsyncIo) {
+      return TRUE;
+   }
+
+   aio = Util_SafeCalloc(1, sizeof *aio);
+   if (!HgfsAsyncIoMap(aio)) {
+      free(aio);
+      return FALSE;
+   }
+
+   aio->lock = MXUser_CreateExclLock("HgfsAsyncIoLock", RANK_hgfsAsyncIoLock);
+   error = pthread_create(&aio->reactor, NULL, HgfsAsyncIoReactor, aio);
+   if (0 != error) {
+      LOG(4, "%s: failed to create the reactor: %s\n", __FUNCTION__,
+          Err_Errno2String(error));
+      MXUser_DestroyExclLock(aio->lock);
+      HgfsAsyncIoUnmap(aio);
+      free(aio);
+      return FALSE;
+   }
+
+   gHgfsAsyncIo = aio;
+   LOG(4, "%s: async I/O initialized\n", __FUNCTION__);
+   return TRUE;
+#else
+   return FALSE;
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsAsyncIo_Exit --
+ *
+ *    Exit for the asynchronous I/O component. Waits for the operations in
+ *    flight to complete and stops the completion reactor.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsAsyncIo_Exit(void)
+{
+#ifdef HGFS_ASYNC_IO_URING
+   HgfsAsyncIoState *aio = gHgfsAsyncIo;
+   struct io_uring_sqe op;
+
+   if (NULL == aio) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(aio->lock);
+   aio->exiting = TRUE;
+
+   /* Wake up the reactor, the completion ring always has room for it. */
+   memset(&op, 0, sizeof op);
+   op.opcode = IORING_OP_NOP;
+   op.user_data = 0;
+   if (!HgfsAsyncIoSubmit(aio, &op)) {
+      Log("%s: failed to wake up the reactor\n", __FUNCTION__);
+   }
+   MXUser_ReleaseExclLock(aio->lock);
+
+   pthread_join(aio->reactor, NULL);
+
+   gHgfsAsyncIo = NULL;
+   MXUser_DestroyExclLock(aio->lock);
+   HgfsAsyncIoUnmap(aio);
+   free(aio);
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsAsyncIo_Read --
+ *
+ *    Submits a read from a file into the mapped guest buffers. The callback
+ *    is called on the completion reactor thread with the read status and
+ *    length.
+ *
+ * Results:
+ *    TRUE if the read was submitted, FALSE if it must be done synchronously
+ *    e.g. too many operations are in flight.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsAsyncIo_Read(int fd,                          // IN: file descriptor
+                 uint64 offset,                   // IN: file offset to read from
+                 const HgfsVmxIov *vmxIov,        // IN: mapped buffers for the data
+                 uint32 vmxIovCount,              // IN: count of vmxIov
+                 uint32 size,                     // IN: length of data to read
+                 HgfsPlatformIoCallback callback, // IN: completion callback
+                 void *data)                      // IN: callback data
+{
+#ifdef HGFS_ASYNC_IO_URING
+   HgfsAsyncIoState *aio = gHgfsAsyncIo;
+   HgfsAsyncIoRequest *request;
+   struct io_uring_sqe op;
+
+   if (NULL == aio || vmxIovCount > IOV_MAX) {
+      return FALSE;
+   }
+
+   request = HgfsAsyncIoRequestAlloc(offset, vmxIov, vmxIovCount, size,
+                                     callback, data);
+
+   memset(&op, 0, sizeof op);
+   op.opcode = IORING_OP_READV;
+   op.fd = fd;
+   op.off = offset;
+   op.addr = (uintptr_t)request->iov;
+   op.len = request->iovCount;
+   op.user_data = (uintptr_t)request;
+
+   return HgfsAsyncIoQueue(aio, &op, request);
+#else
+   return FALSE;
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsAsyncIo_Write --
+ *
+ *    Submits a write of the mapped buffers to a file. The callback is
+ *    called on the completion reactor thread with the write status and
+ *    length, which is the whole data unless the write failed.
+ *
+ *    The write uses a duplicate of the file descriptor, which the caller
+ *    may close before the write completes.
+ *
+ * Results:
+ *    TRUE if the write was submitted, FALSE if it must be done
+ *    synchronously.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsAsyncIo_Write(int fd,                          // IN: file descriptor
+                  uint64 offset,                   // IN: file offset to write to
+                  const HgfsVmxIov *vmxIov,        // IN: mapped data to write
+                  uint32 vmxIovCount,              // IN: count of vmxIov
+                  uint32 size,                     // IN: length of data to write
+                  HgfsPlatformIoCallback callback, // IN: completion callback
+                  void *data)                      // IN: callback data
+{
+#ifdef HGFS_ASYNC_IO_URING
+   HgfsAsyncIoState *aio = gHgfsAsyncIo;
+   HgfsAsyncIoRequest *request;
+   struct io_uring_sqe op;
+
+   if (NULL == aio || vmxIovCount > IOV_MAX || 0 == size) {
+      return FALSE;
+   }
+
+   request = HgfsAsyncIoRequestAlloc(offset, vmxIov, vmxIovCount, size,
+                                     callback, data);
+   request->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+   if (request->fd < 0) {
+      LOG(4, "%s: failed to duplicate fd %d: %s\n", __FUNCTION__, fd,
+          Err_Errno2String(errno));
+      free(request);
+      return FALSE;
+   }
+
+   memset(&op, 0, sizeof op);
+   op.opcode = IORING_OP_WRITEV;
+   op.fd = request->fd;
+   op.off = offset;
+   op.addr = (uintptr_t)request->iov;
+   op.len = request->iovCount;
+   op.user_data = (uintptr_t)request;
+
+   return HgfsAsyncIoQueue(aio, &op, request);
+#else
+   return FALSE;
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsAsyncIo_Fsync --
+ *
+ *    Submits a flush of a file's data, and optionally metadata, to storage.
+ *    The callback is called on the completion reactor thread with the
+ *    status.
+ *
+ * Results:
+ *    TRUE if the flush was submitted, FALSE if it must be done
+ *    synchronously.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsAsyncIo_Fsync(int fd,                          // IN: file descriptor
+                  Bool dataOnly,                   // IN: like fdatasync(2)
+                  HgfsPlatformIoCallback callback, // IN: completion callback
+                  void *data)                      // IN: callback data
+{
+#ifdef HGFS_ASYNC_IO_URING
+   HgfsAsyncIoState *aio = gHgfsAsyncIo;
+   HgfsAsyncIoRequest *request;
+   struct io_uring_sqe op;
+
+   if (NULL == aio) {
+      return FALSE;
+   }
+
+   request = Util_SafeMalloc(sizeof *request);
+   request->callback = callback;
+   request->data = data;
+   request->fd = -1;
+   request->offset = 0;
+   request->size = 0;
+   request->doneSize = 0;
+   request->iovCount = 0;
+
+   memset(&op, 0, sizeof op);
+   op.opcode = IORING_OP_FSYNC;
+   op.fd = fd;
+   op.fsync_flags = dataOnly ? IORING_FSYNC_DATASYNC : 0;
+   op.user_data = (uintptr_t)request;
+
+   return HgfsAsyncIoQueue(aio, &op, request);
+#else
+   return FALSE;
+#endif
+}
@@ -0,0 +1,497 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsCache.c --
+ *
+ *    Bounded LRU cache keyed by path.
+ *
+ *    Entries are looked up through a hash table and kept on a doubly linked
+ *    list ordered from the most recently used (head) to the least recently
+ *    used (tail). All operations are protected by the cache lock. The remove
+ *    callback may call back into other modules (e.g. the oplock monitor), so
+ *    entries are unlinked under the lock and the callback is invoked after
+ *    the lock has been dropped.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vmware.h"
+#include "util.h"
+#include "hashTable.h"
+#include "userlock.h"
+#include "mutexRankLib.h"
+#include "hgfsCache.h"
+
+
+/*
+ * Local data
+ */
+
+typedef struct HgfsCacheEntry {
+   DblLnkLst_Links links;  /* LRU list, head is the most recently used. */
+   char *key;              /* Hash table key, owned by the entry. */
+   void *data;             /* Data owned by the cache. */
+} HgfsCacheEntry;
+
+
+/*
+ * Local functions
+ */
+
+static void HgfsCacheUnlinkEntry(HgfsCache *cache, HgfsCacheEntry *entry);
+static void HgfsCacheFreeEntries(HgfsCache *cache, DblLnkLst_Links *removed,
+                                 Bool invokeCallback);
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCacheUnlinkEntry --
+ *
+ *      Remove an entry from the hash table and the LRU list.
+ *      The caller must hold the cache lock.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsCacheUnlinkEntry(HgfsCache *cache,      // IN
+                     HgfsCacheEntry *entry) // IN
+{
+   ASSERT(MXUser_IsCurThreadHoldingExclLock(cache->lock));
+
+   HashTable_Delete(cache->hashTable, entry->key);
+   DblLnkLst_Unlink1(&entry->links);
+   cache->numEntries--;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCacheFreeEntries --
+ *
+ *      Release the entries on the list of unlinked entries, optionally
+ *      invoking the cache remove callback on their data first.
+ *      The caller must not hold the cache lock.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The remove callback is invoked.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsCacheFreeEntries(HgfsCache *cache,          // IN
+                     DblLnkLst_Links *removed,  // IN: unlinked entries
+                     Bool invokeCallback)       // IN
+{
+   DblLnkLst_Links *link, *nextLink;
+
+   DblLnkLst_ForEachSafe(link, nextLink, removed) {
+      HgfsCacheEntry *entry = DblLnkLst_Container(link, HgfsCacheEntry, links);
+
+      DblLnkLst_Unlink1(&entry->links);
+      if (invokeCallback && NULL != cache->callback) {
+         cache->callback(entry->data);
+      }
+      free(entry->data);
+      free(entry->key);
+      free(entry);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_Alloc --
+ *
+ *      Create a cache and the corresponding hash table/doubly linked list/lock.
+ *
+ * Results:
+ *      The new cache.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsCache *
+HgfsCache_Alloc(HgfsCacheRemoveLRUCallback callback) // IN
+{
+   HgfsCache *cache = Util_SafeCalloc(1, sizeof *cache);
+
+   cache->hashTable = HashTable_Alloc(HGFS_CACHE_MAX_ENTRIES,
+                                      HASH_STRING_KEY, NULL);
+   DblLnkLst_Init(&cache->links);
+   cache->lock = MXUser_CreateExclLock("HgfsCacheLock", RANK_hgfsCacheLock);
+   cache->callback = callback;
+   cache->numEntries = 0;
+
+   return cache;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_Destroy --
+ *
+ *      Destroy a cache and the corresponding hash table/doubly linked list/lock.
+ *      The remove callback is invoked for every entry still in the cache.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsCache_Destroy(HgfsCache *cache)                    // IN
+{
+   DblLnkLst_Links removed;
+   DblLnkLst_Links *link, *nextLink;
+
+   if (NULL == cache) {
+      return;
+   }
+
+   DblLnkLst_Init(&removed);
+
+   MXUser_AcquireExclLock(cache->lock);
+   DblLnkLst_ForEachSafe(link, nextLink, &cache->links) {
+      HgfsCacheEntry *entry = DblLnkLst_Container(link, HgfsCacheEntry, links);
+
+      HgfsCacheUnlinkEntry(cache, entry);
+      DblLnkLst_LinkLast(&removed, &entry->links);
+   }
+   MXUser_ReleaseExclLock(cache->lock);
+
+   HgfsCacheFreeEntries(cache, &removed, TRUE);
+
+   HashTable_Free(cache->hashTable);
+   MXUser_DestroyExclLock(cache->lock);
+   free(cache);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_Put --
+ *
+ *      Put an entry into a cache. The cache takes ownership of the data.
+ *      An existing entry with the same key is replaced and, if the cache is
+ *      full, the least recently used entry is evicted.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The remove callback is invoked for a replaced or evicted entry.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsCache_Put(HgfsCache *cache,                    // IN
+              const char *key,                     // IN
+              void *data)                          // IN
+{
+   HgfsCacheEntry *entry;
+   DblLnkLst_Links removed;
+
+   ASSERT(cache);
+   ASSERT(key);
+
+   DblLnkLst_Init(&removed);
+
+   MXUser_AcquireExclLock(cache->lock);
+   if (HashTable_Lookup(cache->hashTable, key, (void **)&entry)) {
+      HgfsCacheUnlinkEntry(cache, entry);
+      DblLnkLst_LinkLast(&removed, &entry->links);
+   } else if (cache->numEntries >= HGFS_CACHE_MAX_ENTRIES) {
+      ASSERT(DblLnkLst_IsLinked(&cache->links));
+      entry = DblLnkLst_Container(cache->links.prev, HgfsCacheEntry, links);
+      HgfsCacheUnlinkEntry(cache, entry);
+      DblLnkLst_LinkLast(&removed, &entry->links);
+   }
+
+   entry = Util_SafeMalloc(sizeof *entry);
+   DblLnkLst_Init(&entry->links);
+   entry->key = Util_SafeStrdup(key);
+   entry->data = data;
+   HashTable_Insert(cache->hashTable, entry->key, entry);
+   DblLnkLst_LinkFirst(&cache->links, &entry->links);
+   cache->numEntries++;
+   MXUser_ReleaseExclLock(cache->lock);
+
+   HgfsCacheFreeEntries(cache, &removed, TRUE);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_Get --
+ *
+ *      Get an entry in a cache and mark it as the most recently used.
+ *
+ *      The returned data remains owned by the cache and may be released by
+ *      another thread at any time; callers which can run concurrently with
+ *      other users of the cache should use HgfsCache_GetCopy instead.
+ *
+ * Results:
+ *      TRUE if the entry was found, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsCache_Get(HgfsCache *cache, // IN
+              const char *key,  // IN
+              void **data)      // OUT
+{
+   HgfsCacheEntry *entry;
+   Bool found;
+
+   ASSERT(cache);
+   ASSERT(key);
+   ASSERT(data);
+
+   MXUser_AcquireExclLock(cache->lock);
+   found = HashTable_Lookup(cache->hashTable, key, (void **)&entry);
+   if (found) {
+      DblLnkLst_Unlink1(&entry->links);
+      DblLnkLst_LinkFirst(&cache->links, &entry->links);
+      *data = entry->data;
+   }
+   MXUser_ReleaseExclLock(cache->lock);
+
+   return found;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_GetCopy --
+ *
+ *      Copy the data of an entry in a cache into the caller's buffer while
+ *      holding the cache lock, and mark the entry as the most recently used.
+ *
+ * Results:
+ *      TRUE if the entry was found, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsCache_GetCopy(HgfsCache *cache, // IN
+                  const char *key,  // IN
+                  void *buf,        // OUT
+                  size_t bufSize)   // IN
+{
+   HgfsCacheEntry *entry;
+   Bool found;
+
+   ASSERT(cache);
+   ASSERT(key);
+   ASSERT(buf);
+
+   MXUser_AcquireExclLock(cache->lock);
+   found = HashTable_Lookup(cache->hashTable, key, (void **)&entry);
+   if (found) {
+      DblLnkLst_Unlink1(&entry->links);
+      DblLnkLst_LinkFirst(&cache->links, &entry->links);
+      memcpy(buf, entry->data, bufSize);
+   }
+   MXUser_ReleaseExclLock(cache->lock);
+
+   return found;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_Invalidate --
+ *
+ *      Remove an entry from a cache without invoking the remove callback.
+ *      This is meant to be called from the notification which invalidated
+ *      the entry, e.g. the oplock monitor callback, which already owns
+ *      whatever the remove callback would release.
+ *
+ * Results:
+ *      TRUE if the entry was found and removed, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsCache_Invalidate(HgfsCache *cache, // IN
+                     const char *key)  // IN
+{
+   HgfsCacheEntry *entry;
+   DblLnkLst_Links removed;
+   Bool found;
+
+   ASSERT(cache);
+   ASSERT(key);
+
+   DblLnkLst_Init(&removed);
+
+   MXUser_AcquireExclLock(cache->lock);
+   found = HashTable_Lookup(cache->hashTable, key, (void **)&entry);
+   if (found) {
+      HgfsCacheUnlinkEntry(cache, entry);
+      DblLnkLst_LinkLast(&removed, &entry->links);
+   }
+   MXUser_ReleaseExclLock(cache->lock);
+
+   HgfsCacheFreeEntries(cache, &removed, FALSE);
+
+   return found;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_Remove --
+ *
+ *      Remove an entry, and optionally all entries below it in the path
+ *      hierarchy (keys starting with "key/"), from a cache.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The remove callback is invoked for every removed entry.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsCache_Remove(HgfsCache *cache,     // IN
+                 const char *key,      // IN
+                 Bool removeChildren)  // IN
+{
+   HgfsCacheEntry *entry;
+   DblLnkLst_Links removed;
+   size_t keyLen;
+
+   ASSERT(cache);
+   ASSERT(key);
+
+   DblLnkLst_Init(&removed);
+   keyLen = strlen(key);
+
+   MXUser_AcquireExclLock(cache->lock);
+   if (HashTable_Lookup(cache->hashTable, key, (void **)&entry)) {
+      HgfsCacheUnlinkEntry(cache, entry);
+      DblLnkLst_LinkLast(&removed, &entry->links);
+   }
+
+   if (removeChildren) {
+      DblLnkLst_Links *link, *nextLink;
+
+      DblLnkLst_ForEachSafe(link, nextLink, &cache->links) {
+         entry = DblLnkLst_Container(link, HgfsCacheEntry, links);
+         if (strncmp(entry->key, key, keyLen) == 0 &&
+             entry->key[keyLen] == DIRSEPC) {
+            HgfsCacheUnlinkEntry(cache, entry);
+            DblLnkLst_LinkLast(&removed, &entry->links);
+         }
+      }
+   }
+   MXUser_ReleaseExclLock(cache->lock);
+
+   HgfsCacheFreeEntries(cache, &removed, TRUE);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_RemoveMatching --
+ *
+ *      Remove all entries whose key is accepted by the match function from
+ *      a cache. The match function is called with the cache lock held and
+ *      must not call back into the cache.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The remove callback is invoked for every removed entry.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsCache_RemoveMatching(HgfsCache *cache,             // IN
+                         HgfsCacheMatchCallback match, // IN
+                         void *clientData)             // IN
+{
+   DblLnkLst_Links removed;
+   DblLnkLst_Links *link, *nextLink;
+
+   ASSERT(cache);
+   ASSERT(match);
+
+   DblLnkLst_Init(&removed);
+
+   MXUser_AcquireExclLock(cache->lock);
+   DblLnkLst_ForEachSafe(link, nextLink, &cache->links) {
+      HgfsCacheEntry *entry = DblLnkLst_Container(link, HgfsCacheEntry, links);
+
+      if (match(entry->key, clientData)) {
+         HgfsCacheUnlinkEntry(cache, entry);
+         DblLnkLst_LinkLast(&removed, &entry->links);
+      }
+   }
+   MXUser_ReleaseExclLock(cache->lock);
+
+   HgfsCacheFreeEntries(cache, &removed, TRUE);
+}
@@ -21,6 +21,12 @@
  *
  *    A customized LRU cache which is built by combining two data structures:
  *    a doubly linked list and a hash table.
+ *
+ *    The cache owns the data which is put into it: the data is released with
+ *    free() when its entry is removed. The remove callback is invoked before
+ *    that, outside of the cache lock, whenever an entry is dropped by the
+ *    cache itself (LRU eviction, replacement, HgfsCache_Remove*, destroy).
+ *    HgfsCache_Invalidate does not invoke the callback.
  */
 
 #ifndef _HGFS_CACHE_H_
@@ -29,19 +35,29 @@
 #include "dbllnklst.h"
 #include "userlock.h"
 
+/* Maximum number of entries in a cache before the LRU entry is evicted. */
+#define HGFS_CACHE_MAX_ENTRIES 1024
+
 typedef void(*HgfsCacheRemoveLRUCallback)(void *data);
+typedef Bool(*HgfsCacheMatchCallback)(const char *key, void *clientData);
 
 typedef struct HgfsCache {
    void *hashTable;
    DblLnkLst_Links links;
    MXUserExclLock *lock;
    HgfsCacheRemoveLRUCallback callback;
+   uint32 numEntries;
 } HgfsCache;
 
 HgfsCache *HgfsCache_Alloc(HgfsCacheRemoveLRUCallback callback);
 void HgfsCache_Destroy(HgfsCache *cache);
 void HgfsCache_Put(HgfsCache *cache, const char *key, void *data);
 Bool HgfsCache_Get(HgfsCache *cache, const char *key, void **data);
+Bool HgfsCache_GetCopy(HgfsCache *cache, const char *key, void *buf,
+                       size_t bufSize);
 Bool HgfsCache_Invalidate(HgfsCache *cache, const char *key);
+void HgfsCache_Remove(HgfsCache *cache, const char *key, Bool removeChildren);
+void HgfsCache_RemoveMatching(HgfsCache *cache, HgfsCacheMatchCallback match,
+                              void *clientData);
 
 #endif // ifndef _HGFS_CACHE_H_
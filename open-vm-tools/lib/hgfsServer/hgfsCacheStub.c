@@ -142,3 +142,77 @@ HgfsCache_Invalidate(HgfsCache *cache, // IN
 {
    return FALSE;
 }
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_GetCopy --
+ *
+ *      Copy an entry in a cache.
+ *
+ * Results:
+ *      Always return FALSE.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsCache_GetCopy(HgfsCache *cache, // IN
+                  const char *key,  // IN
+                  void *buf,        // OUT
+                  size_t bufSize)   // IN
+{
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_Remove --
+ *
+ *      Remove an entry and optionally its children from a cache.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsCache_Remove(HgfsCache *cache,     // IN
+                 const char *key,      // IN
+                 Bool removeChildren)  // IN
+{
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCache_RemoveMatching --
+ *
+ *      Remove all matching entries from a cache.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsCache_RemoveMatching(HgfsCache *cache,             // IN
+                         HgfsCacheMatchCallback match, // IN
+                         void *clientData)             // IN
+{
+}
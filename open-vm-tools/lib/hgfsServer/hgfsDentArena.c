@@ -0,0 +1,233 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsDentArena.c --
+ *
+ *    Chunked arena for the directory entries of a search.
+ *
+ *    A directory snapshot used to cost one allocation per entry plus a
+ *    realloc of the pointer array per entry, and one free per entry when
+ *    the search was closed. The arena packs the entries into 64KB chunks
+ *    and keeps a geometrically grown array of 32-bit offsets, so a scan of
+ *    a large directory only allocates once per chunk and is released with
+ *    a handful of frees.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vmware.h"
+#include "hgfsDentArena.h"
+
+
+/*
+ * Local data
+ */
+
+/* Entries start 8 byte aligned, they contain 64-bit fields. */
+#define HGFS_DENT_ARENA_ALIGN(_size)  (((_size) + 7) & ~(size_t)7)
+
+/* Offsets are 32 bits, which limits the number of chunks. */
+#define HGFS_DENT_ARENA_MAX_CHUNKS    (MAX_UINT32 / HGFS_DENT_ARENA_CHUNK_SIZE)
+
+#define HGFS_DENT_ARENA_MIN_DENTS     256
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDentArena_Init --
+ *
+ *    Initializes an empty arena.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsDentArena_Init(HgfsDentArena *arena)  // OUT: arena
+{
+   memset(arena, 0, sizeof *arena);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDentArena_Free --
+ *
+ *    Releases all entries of the arena and leaves it empty.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Pointers to entries of the arena are no longer valid.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsDentArena_Free(HgfsDentArena *arena)  // IN/OUT: arena
+{
+   uint32 i;
+
+   for (i = 0; i < arena->numChunks; i++) {
+      free(arena->chunks[i]);
+   }
+   free(arena->chunks);
+   free(arena->offsets);
+   HgfsDentArena_Init(arena);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDentArena_Alloc --
+ *
+ *    Appends a new entry of the given size to the arena. The caller fills
+ *    in the returned entry.
+ *
+ * Results:
+ *    Pointer to the new entry, NULL if out of memory.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void *
+HgfsDentArena_Alloc(HgfsDentArena *arena,  // IN/OUT: arena
+                    size_t size)           // IN: entry size
+{
+   size_t alignedSize = HGFS_DENT_ARENA_ALIGN(size);
+
+   ASSERT(size != 0 && alignedSize <= HGFS_DENT_ARENA_CHUNK_SIZE);
+
+   if (arena->numDents == arena->maxDents) {
+      uint32 maxDents = arena->maxDents != 0 ? arena->maxDents * 2 :
+                                               HGFS_DENT_ARENA_MIN_DENTS;
+      uint32 *offsets;
+
+      if (maxDents <= arena->maxDents) {
+         return NULL;
+      }
+      offsets = realloc(arena->offsets, maxDents * sizeof *offsets);
+      if (NULL == offsets) {
+         return NULL;
+      }
+      arena->offsets = offsets;
+      arena->maxDents = maxDents;
+   }
+
+   if (0 == arena->numChunks ||
+       arena->chunkUsed + alignedSize > HGFS_DENT_ARENA_CHUNK_SIZE) {
+      char **chunks;
+      char *chunk;
+
+      if (arena->numChunks == HGFS_DENT_ARENA_MAX_CHUNKS) {
+         return NULL;
+      }
+      chunks = realloc(arena->chunks,
+                       (arena->numChunks + 1) * sizeof *chunks);
+      if (NULL == chunks) {
+         return NULL;
+      }
+      arena->chunks = chunks;
+
+      chunk = malloc(HGFS_DENT_ARENA_CHUNK_SIZE);
+      if (NULL == chunk) {
+         return NULL;
+      }
+      arena->chunks[arena->numChunks++] = chunk;
+      arena->chunkUsed = 0;
+   }
+
+   arena->offsets[arena->numDents++] =
+      (arena->numChunks - 1) * HGFS_DENT_ARENA_CHUNK_SIZE + arena->chunkUsed;
+   arena->chunkUsed += alignedSize;
+
+   return HgfsDentArena_Get(arena, arena->numDents - 1);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDentArena_Get --
+ *
+ *    Returns the entry at the given index.
+ *
+ * Results:
+ *    Pointer to the entry, valid until the arena is freed.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void *
+HgfsDentArena_Get(const HgfsDentArena *arena,  // IN: arena
+                  uint32 index)                // IN: entry index
+{
+   uint32 offset;
+
+   ASSERT(index < arena->numDents);
+
+   offset = arena->offsets[index];
+   return arena->chunks[offset / HGFS_DENT_ARENA_CHUNK_SIZE] +
+          offset % HGFS_DENT_ARENA_CHUNK_SIZE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDentArena_Remove --
+ *
+ *    Removes the entry at the given index; the following entries are
+ *    shifted up. The storage of the entry is kept until the arena is freed.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsDentArena_Remove(HgfsDentArena *arena,  // IN/OUT: arena
+                     uint32 index)          // IN: entry index
+{
+   ASSERT(index < arena->numDents);
+
+   memmove(&arena->offsets[index], &arena->offsets[index + 1],
+           (arena->numDents - (index + 1)) * sizeof arena->offsets[0]);
+   arena->numDents--;
+}
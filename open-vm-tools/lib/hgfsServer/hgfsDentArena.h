@@ -0,0 +1,51 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsDentArena.h --
+ *
+ *    Directory entries of a search, packed into fixed size chunks owned by
+ *    the search. Entries are referenced by their offset in the arena rather
+ *    than by pointer, and an entry never spans two chunks. Removing an entry
+ *    only drops its offset; the storage is released all at once by
+ *    HgfsDentArena_Free.
+ */
+
+#ifndef _HGFS_DENT_ARENA_H_
+#define _HGFS_DENT_ARENA_H_
+
+#include "vm_basic_types.h"
+
+#define HGFS_DENT_ARENA_CHUNK_SIZE  (64 * 1024)
+
+typedef struct HgfsDentArena {
+   char **chunks;      /* Chunks holding the packed entries. */
+   uint32 numChunks;
+   uint32 chunkUsed;   /* Bytes used in the last chunk. */
+   uint32 *offsets;    /* Arena offset of each entry, in order. */
+   uint32 numDents;
+   uint32 maxDents;    /* Allocated size of the offsets array. */
+} HgfsDentArena;
+
+void HgfsDentArena_Init(HgfsDentArena *arena);
+void HgfsDentArena_Free(HgfsDentArena *arena);
+void *HgfsDentArena_Alloc(HgfsDentArena *arena, size_t size);
+void *HgfsDentArena_Get(const HgfsDentArena *arena, uint32 index);
+void HgfsDentArena_Remove(HgfsDentArena *arena, uint32 index);
+
+#endif // ifndef _HGFS_DENT_ARENA_H_
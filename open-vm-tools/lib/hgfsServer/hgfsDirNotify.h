@@ -60,6 +60,13 @@ typedef struct HgfsServerNotifyCallbacks {
    HgfsNotifyEventReceiveCb       eventReceive;
 } HgfsServerNotifyCallbacks;
 
+/* A change recorded in a change journal. */
+typedef struct HgfsNotifyChange {
+   uint64 seq;                      /* Sequence number of the change. */
+   uint32 mask;                     /* HGFS_NOTIFY_* events. */
+   char *name;                      /* Relative to the shared folder. */
+} HgfsNotifyChange;
+
 HgfsInternalStatus HgfsNotify_Init(const HgfsServerNotifyCallbacks *serverCbData);
 void HgfsNotify_Exit(void);
 void HgfsNotify_Deactivate(HgfsNotifyActivateReason mode,
@@ -79,4 +86,16 @@ Bool HgfsNotify_RemoveSharedFolder(HgfsSharedFolderHandle sharedFolder);
 Bool HgfsNotify_RemoveSubscriber(HgfsSubscriberHandle subscriber);
 void HgfsNotify_RemoveSessionSubscribers(struct HgfsSessionInfo *session);
 
+HgfsInternalStatus HgfsNotify_QueryJournal(HgfsSharedFolderHandle sharedFolder,
+                                           const char *path,
+                                           uint64 token,
+                                           uint32 maxChanges,
+                                           HgfsNotifyChange **changes,
+                                           uint32 *numChanges,
+                                           uint64 *nextToken,
+                                           Bool *resync,
+                                           Bool *more);
+void HgfsNotify_FreeChanges(HgfsNotifyChange *changes,
+                            uint32 numChanges);
+
 #endif // _HGFS_DIRNOTIFY_H
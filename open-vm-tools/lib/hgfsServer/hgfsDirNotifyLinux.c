@@ -0,0 +1,2160 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsDirNotifyLinux.c --
+ *
+ *	Directory change notification support for the Linux platform, built
+ *	on inotify.
+ *
+ *	Every subscriber (a SET_WATCH_V4 request) adds inotify watches on its
+ *	directory, and on all directories below it for recursive watches.
+ *	Watch descriptors are reference counted as subscribers may watch the
+ *	same directories. A single reactor thread reads the inotify events,
+ *	maps each watch descriptor back to its directory and the subscribers
+ *	interested in it, and queues the translated events. Content change
+ *	events for the same subscriber and name are coalesced for a short
+ *	period, then the queued events are delivered through the server
+ *	callback without holding the notification lock.
+ *
+ *	A change journal records the changes to a directory tree of a shared
+ *	folder with increasing sequence numbers, to be queried by clients
+ *	instead of being delivered. It is fed by an internal recursive
+ *	subscriber, started by the first query of the tree and bounded: the
+ *	oldest changes are dropped once it is full, and all of them when
+ *	inotify events are lost, so that queries for them require a rescan.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "vmware.h"
+#include "vm_basic_types.h"
+#include "util.h"
+#include "str.h"
+#include "hashTable.h"
+#include "hostinfo.h"
+#include "userlock.h"
+#include "mutexRankLib.h"
+
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsServerInt.h"
+#include "hgfsUtil.h"
+#include "hgfsDirNotify.h"
+
+
+/*
+ * Local data
+ */
+
+#define AS_KEY(_x)  ((const void *)(uintptr_t)(_x))
+
+/* How long content change events are held back to be coalesced. */
+#define HGFS_NOTIFY_COALESCE_MS           50
+
+/* Maximum number of queued events before they are reported as dropped. */
+#define HGFS_NOTIFY_MAX_PENDING           1024
+
+/* Number of queued events searched for an event to coalesce with. */
+#define HGFS_NOTIFY_COALESCE_WINDOW       16
+
+/* Maximum directory depth watched by a recursive subscriber. */
+#define HGFS_NOTIFY_MAX_DEPTH             64
+
+#define HGFS_NOTIFY_READ_BUFFER_SIZE      (64 * 1024)
+
+/* Events which only report a change of the contents or attributes. */
+#define HGFS_NOTIFY_CONTENT_EVENTS  (HGFS_NOTIFY_ACCESS |                     \
+                                     HGFS_NOTIFY_ATTRIB |                     \
+                                     HGFS_NOTIFY_SIZE |                       \
+                                     HGFS_NOTIFY_MTIME |                      \
+                                     HGFS_NOTIFY_CTIME |                      \
+                                     HGFS_NOTIFY_OPEN |                       \
+                                     HGFS_NOTIFY_CLOSE_WRITE |                \
+                                     HGFS_NOTIFY_CLOSE_NOWRITE |              \
+                                     HGFS_NOTIFY_MODIFY |                     \
+                                     HGFS_NOTIFY_CHANGE_SECURITY)
+
+/* Events which report a name being created, removed or renamed. */
+#define HGFS_NOTIFY_NAME_EVENTS     (HGFS_NOTIFY_CREATE_FILE |                \
+                                     HGFS_NOTIFY_CREATE_DIR |                 \
+                                     HGFS_NOTIFY_DELETE_FILE |                \
+                                     HGFS_NOTIFY_DELETE_DIR |                 \
+                                     HGFS_NOTIFY_OLD_FILE_NAME |              \
+                                     HGFS_NOTIFY_NEW_FILE_NAME |              \
+                                     HGFS_NOTIFY_OLD_DIR_NAME |               \
+                                     HGFS_NOTIFY_NEW_DIR_NAME)
+
+/* inotify events needed to keep the watches of a recursive subscriber. */
+#define HGFS_NOTIFY_TREE_INOTIFY    (IN_CREATE | IN_MOVED_FROM | IN_MOVED_TO)
+
+/* Events recorded in change journals, reads are not changes. */
+#define HGFS_NOTIFY_JOURNAL_EVENTS  (HGFS_NOTIFY_NAME_EVENTS |                \
+                                     HGFS_NOTIFY_ATTRIB |                     \
+                                     HGFS_NOTIFY_SIZE |                       \
+                                     HGFS_NOTIFY_MTIME |                      \
+                                     HGFS_NOTIFY_CTIME |                      \
+                                     HGFS_NOTIFY_MODIFY |                     \
+                                     HGFS_NOTIFY_CHANGE_SECURITY |            \
+                                     HGFS_NOTIFY_DELETE_SELF |                \
+                                     HGFS_NOTIFY_MOVE_SELF)
+
+/* Number of changes kept by a change journal. */
+#define HGFS_NOTIFY_JOURNAL_SIZE          4096
+
+/* Maximum number of change journals, the least recently queried is dropped. */
+#define HGFS_NOTIFY_MAX_JOURNALS          16
+
+#define HGFS_NOTIFY_JOURNAL_CHANGE(_journal, _seq)                            \
+   (&(_journal)->changes[(_seq) % HGFS_NOTIFY_JOURNAL_SIZE])
+
+typedef struct HgfsNotifyShare {
+   DblLnkLst_Links links;
+   HgfsSharedFolderHandle handle;
+   char *path;                      /* Host path of the share root. */
+   size_t pathLen;
+} HgfsNotifyShare;
+
+typedef struct HgfsNotifyWatch {
+   int wd;
+   uint32 refCount;                 /* Number of subscribers using it. */
+   char *path;                      /* Host path of the directory. */
+} HgfsNotifyWatch;
+
+typedef struct HgfsNotifySubscriber {
+   DblLnkLst_Links links;
+   HgfsSubscriberHandle handle;
+   HgfsNotifyShare *share;
+   char *path;                      /* Host path of the watched directory. */
+   uint32 eventFilter;              /* HGFS_NOTIFY_* events to report. */
+   uint32 inotifyMask;
+   Bool recursive;
+   Bool incomplete;                 /* Some directories are not watched. */
+   struct HgfsSessionInfo *session;
+   HashTable *wds;                  /* Watch descriptors referenced. */
+   struct HgfsNotifyJournal *journal;  /* Journal fed instead of the session. */
+} HgfsNotifySubscriber;
+
+/*
+ * The journal holds the changes with sequence numbers from firstSeq up to
+ * nextSeq, which are the tokens it accepts. Changes from issuedSeq on have
+ * not been returned by a query yet and may still be merged.
+ */
+typedef struct HgfsNotifyJournal {
+   DblLnkLst_Links links;
+   HgfsNotifySubscriber *watcher;
+   HgfsNotifyChange *changes;       /* HGFS_NOTIFY_JOURNAL_SIZE changes. */
+   uint64 firstSeq;
+   uint64 nextSeq;
+   uint64 issuedSeq;
+   uint64 lastQuery;                /* Query count of the last query. */
+} HgfsNotifyJournal;
+
+typedef struct HgfsNotifyEvent {
+   DblLnkLst_Links links;
+   HgfsSharedFolderHandle share;
+   HgfsSubscriberHandle subscriber;
+   struct HgfsSessionInfo *session;
+   char *name;                      /* Relative to the share, NULL if dropped. */
+   uint32 mask;
+} HgfsNotifyEvent;
+
+typedef struct HgfsNotifyState {
+   MXUserExclLock *lock;
+   MXUserCondVar *deliveryDone;
+   HgfsServerNotifyCallbacks callbacks;
+   int inotifyFd;
+   int wakeFd;
+   pthread_t reactor;
+
+   /* The following are protected by the lock. */
+   Bool exiting;
+   uint32 deactivateCount;          /* Events are discarded if not zero. */
+   Bool eventsDiscarded;            /* Events were discarded. */
+   Bool reportDropped;              /* Reactor must report dropped events. */
+   DblLnkLst_Links shares;
+   DblLnkLst_Links subscribers;
+   HashTable *subscriberTable;      /* Handle -> HgfsNotifySubscriber. */
+   HashTable *watches;              /* Watch descriptor -> HgfsNotifyWatch. */
+   HgfsSharedFolderHandle nextShareHandle;
+   HgfsSubscriberHandle nextSubscriberHandle;
+   struct HgfsSessionInfo *deliverySession;  /* Session being notified. */
+   DblLnkLst_Links journals;
+   uint32 numJournals;
+   uint64 numJournalQueries;
+   uint64 retiredSeq;               /* Highest token of dropped journals. */
+
+   /* The following are only used by the reactor thread (and the lock). */
+   DblLnkLst_Links pending;
+   uint32 numPending;
+   VmTimeType flushTime;
+   uint32 movedFromCookie;          /* Unpaired directory move. */
+   char *movedFromPath;
+} HgfsNotifyState;
+
+static HgfsNotifyState *gHgfsNotify = NULL;
+
+
+/*
+ * Local functions
+ */
+
+static void HgfsNotifyRemoveSubscriberInternal(HgfsNotifyState *state,
+                                               HgfsNotifySubscriber *subscriber);
+static void HgfsNotifyQueueDropped(HgfsNotifyState *state);
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyIsPathUnder --
+ *
+ *    Checks whether a path is a descendant of a directory.
+ *
+ * Results:
+ *    TRUE if the path is below the directory, FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNotifyIsPathUnder(const char *path,     // IN:
+                      const char *dirPath)  // IN:
+{
+   size_t dirPathLen = strlen(dirPath);
+
+   return strncmp(path, dirPath, dirPathLen) == 0 &&
+          path[dirPathLen] == DIRSEPC;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyHgfsToInotify --
+ *
+ *    Converts an HGFS event filter into the inotify events to watch.
+ *
+ * Results:
+ *    inotify event mask.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNotifyHgfsToInotify(uint32 eventFilter,  // IN: HGFS_NOTIFY_* events
+                        Bool recursive)      // IN: recursive watch
+{
+   uint32 mask = IN_DELETE_SELF | IN_MOVE_SELF;
+
+   if (eventFilter & HGFS_NOTIFY_ACCESS) {
+      mask |= IN_ACCESS;
+   }
+   if (eventFilter & (HGFS_NOTIFY_ATTRIB | HGFS_NOTIFY_ATIME |
+                      HGFS_NOTIFY_CTIME | HGFS_NOTIFY_CHANGE_EA |
+                      HGFS_NOTIFY_CHANGE_SECURITY)) {
+      mask |= IN_ATTRIB;
+   }
+   if (eventFilter & (HGFS_NOTIFY_SIZE | HGFS_NOTIFY_MTIME |
+                      HGFS_NOTIFY_MODIFY)) {
+      mask |= IN_MODIFY;
+   }
+   if (eventFilter & HGFS_NOTIFY_OPEN) {
+      mask |= IN_OPEN;
+   }
+   if (eventFilter & HGFS_NOTIFY_CLOSE_WRITE) {
+      mask |= IN_CLOSE_WRITE;
+   }
+   if (eventFilter & HGFS_NOTIFY_CLOSE_NOWRITE) {
+      mask |= IN_CLOSE_NOWRITE;
+   }
+   if (eventFilter & (HGFS_NOTIFY_NAME | HGFS_NOTIFY_CREATE_FILE |
+                      HGFS_NOTIFY_CREATE_DIR)) {
+      mask |= IN_CREATE;
+   }
+   if (eventFilter & (HGFS_NOTIFY_NAME | HGFS_NOTIFY_DELETE_FILE |
+                      HGFS_NOTIFY_DELETE_DIR)) {
+      mask |= IN_DELETE;
+   }
+   if (eventFilter & (HGFS_NOTIFY_NAME | HGFS_NOTIFY_OLD_FILE_NAME |
+                      HGFS_NOTIFY_NEW_FILE_NAME | HGFS_NOTIFY_OLD_DIR_NAME |
+                      HGFS_NOTIFY_NEW_DIR_NAME)) {
+      mask |= IN_MOVED_FROM | IN_MOVED_TO;
+   }
+   if (recursive) {
+      mask |= HGFS_NOTIFY_TREE_INOTIFY;
+   }
+
+   return mask;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyInotifyToHgfs --
+ *
+ *    Converts an inotify event mask into HGFS events.
+ *
+ * Results:
+ *    HGFS_NOTIFY_* event mask.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNotifyInotifyToHgfs(uint32 mask)  // IN: inotify event mask
+{
+   Bool isDir = (mask & IN_ISDIR) != 0;
+   uint32 events = 0;
+
+   if (mask & IN_ACCESS) {
+      events |= HGFS_NOTIFY_ACCESS;
+   }
+   if (mask & IN_ATTRIB) {
+      events |= HGFS_NOTIFY_ATTRIB | HGFS_NOTIFY_CTIME |
+                HGFS_NOTIFY_CHANGE_SECURITY;
+   }
+   if (mask & IN_MODIFY) {
+      events |= HGFS_NOTIFY_MODIFY | HGFS_NOTIFY_SIZE | HGFS_NOTIFY_MTIME;
+   }
+   if (mask & IN_OPEN) {
+      events |= HGFS_NOTIFY_OPEN;
+   }
+   if (mask & IN_CLOSE_WRITE) {
+      events |= HGFS_NOTIFY_CLOSE_WRITE;
+   }
+   if (mask & IN_CLOSE_NOWRITE) {
+      events |= HGFS_NOTIFY_CLOSE_NOWRITE;
+   }
+   if (mask & IN_CREATE) {
+      events |= isDir ? HGFS_NOTIFY_CREATE_DIR : HGFS_NOTIFY_CREATE_FILE;
+   }
+   if (mask & IN_DELETE) {
+      events |= isDir ? HGFS_NOTIFY_DELETE_DIR : HGFS_NOTIFY_DELETE_FILE;
+   }
+   if (mask & IN_MOVED_FROM) {
+      events |= isDir ? HGFS_NOTIFY_OLD_DIR_NAME : HGFS_NOTIFY_OLD_FILE_NAME;
+   }
+   if (mask & IN_MOVED_TO) {
+      events |= isDir ? HGFS_NOTIFY_NEW_DIR_NAME : HGFS_NOTIFY_NEW_FILE_NAME;
+   }
+   if (mask & IN_DELETE_SELF) {
+      events |= HGFS_NOTIFY_DELETE_SELF | HGFS_NOTIFY_WATCH_DELETED;
+   }
+   if (mask & IN_MOVE_SELF) {
+      events |= HGFS_NOTIFY_MOVE_SELF;
+   }
+
+   return events;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyRefWatch --
+ *
+ *    Records that a subscriber uses a watch descriptor.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyRefWatch(HgfsNotifyState *state,            // IN:
+                   HgfsNotifySubscriber *subscriber,  // IN:
+                   int wd,                            // IN: watch descriptor
+                   const char *path)                  // IN: directory path
+{
+   HgfsNotifyWatch *watch;
+
+   if (HashTable_Lookup(subscriber->wds, AS_KEY(wd), NULL)) {
+      return;
+   }
+   HashTable_Insert(subscriber->wds, AS_KEY(wd), NULL);
+
+   if (HashTable_Lookup(state->watches, AS_KEY(wd), (void **)&watch)) {
+      watch->refCount++;
+   } else {
+      watch = Util_SafeMalloc(sizeof *watch);
+      watch->wd = wd;
+      watch->refCount = 1;
+      watch->path = Util_SafeStrdup(path);
+      HashTable_Insert(state->watches, AS_KEY(wd), watch);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyUnrefWatch --
+ *
+ *    Drops a subscriber reference to a watch descriptor. The inotify watch
+ *    is removed together with the last reference.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyUnrefWatch(HgfsNotifyState *state,  // IN:
+                     int wd)                  // IN: watch descriptor
+{
+   HgfsNotifyWatch *watch;
+
+   if (HashTable_Lookup(state->watches, AS_KEY(wd), (void **)&watch) &&
+       --watch->refCount == 0) {
+      HashTable_Delete(state->watches, AS_KEY(wd));
+      inotify_rm_watch(state->inotifyFd, wd);
+      free(watch->path);
+      free(watch);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyForgetWatch --
+ *
+ *    Drops a watch record and all subscriber references to it, once the
+ *    watch was removed by the kernel or its directory left the watched
+ *    trees. The watch descriptor may be reused for another directory.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyForgetWatch(HgfsNotifyState *state,  // IN:
+                      HgfsNotifyWatch *watch)  // IN:
+{
+   DblLnkLst_Links *link;
+
+   DblLnkLst_ForEach(link, &state->subscribers) {
+      HgfsNotifySubscriber *subscriber =
+         DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+      HashTable_Delete(subscriber->wds, AS_KEY(watch->wd));
+   }
+
+   HashTable_Delete(state->watches, AS_KEY(watch->wd));
+   free(watch->path);
+   free(watch);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyAddWatchTree --
+ *
+ *    Adds an inotify watch on a directory for a subscriber and, for
+ *    recursive subscribers, on every directory below it. Symbolic links
+ *    are not followed below the subscriber's directory. The subscriber is
+ *    marked incomplete if a directory of the tree could not be watched.
+ *
+ * Results:
+ *    TRUE if the watch on the directory itself was added, FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNotifyAddWatchTree(HgfsNotifyState *state,            // IN:
+                       HgfsNotifySubscriber *subscriber,  // IN:
+                       const char *path,                  // IN: directory
+                       uint32 depth)                      // IN: depth
+{
+   uint32 mask = subscriber->inotifyMask | IN_ONLYDIR | IN_MASK_ADD;
+   DIR *dir;
+   struct dirent *entry;
+   int wd;
+
+   if (depth > 0) {
+      mask |= IN_DONT_FOLLOW;
+   }
+
+   wd = inotify_add_watch(state->inotifyFd, path, mask);
+   if (wd < 0) {
+      LOG(4, "%s: failed to watch \"%s\": %d\n", __FUNCTION__, path, errno);
+      subscriber->incomplete = TRUE;
+      return FALSE;
+   }
+   HgfsNotifyRefWatch(state, subscriber, wd, path);
+
+   if (!subscriber->recursive) {
+      return TRUE;
+   }
+
+   if (depth >= HGFS_NOTIFY_MAX_DEPTH) {
+      subscriber->incomplete = TRUE;
+      return TRUE;
+   }
+
+   dir = opendir(path);
+   if (NULL == dir) {
+      subscriber->incomplete = TRUE;
+      return TRUE;
+   }
+
+   while ((entry = readdir(dir)) != NULL) {
+      char *childPath;
+      Bool isDir;
+
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+         continue;
+      }
+
+      childPath = Str_SafeAsprintf(NULL, "%s%c%s", path, DIRSEPC,
+                                   entry->d_name);
+      if (DT_UNKNOWN == entry->d_type) {
+         struct stat st;
+
+         isDir = lstat(childPath, &st) == 0 && S_ISDIR(st.st_mode);
+      } else {
+         isDir = DT_DIR == entry->d_type;
+      }
+
+      if (isDir) {
+         HgfsNotifyAddWatchTree(state, subscriber, childPath, depth + 1);
+      }
+      free(childPath);
+   }
+   closedir(dir);
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyAppendEvent --
+ *
+ *    Appends an event to the queued events, regardless of their number.
+ *
+ *    Called by the reactor with the lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyAppendEvent(HgfsNotifyState *state,            // IN:
+                      HgfsNotifySubscriber *subscriber,  // IN:
+                      const char *name,                  // IN/OPT: file name
+                      uint32 mask)                       // IN: HGFS events
+{
+   HgfsNotifyEvent *event;
+
+   if (0 == state->numPending) {
+      state->flushTime = Hostinfo_SystemTimerMS() + HGFS_NOTIFY_COALESCE_MS;
+   }
+
+   event = Util_SafeMalloc(sizeof *event);
+   DblLnkLst_Init(&event->links);
+   event->share = subscriber->share->handle;
+   event->subscriber = subscriber->handle;
+   event->session = subscriber->session;
+   event->name = NULL != name ? Util_SafeStrdup(name) : NULL;
+   event->mask = mask;
+   DblLnkLst_LinkLast(&state->pending, &event->links);
+   state->numPending++;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyQueueEvent --
+ *
+ *    Queues an event for delivery. A content change event is merged into
+ *    a recent queued content change event for the same subscriber and name.
+ *    If too many events are queued, they are all replaced with one
+ *    "events dropped" event per subscriber.
+ *
+ *    Called by the reactor with the lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyQueueEvent(HgfsNotifyState *state,            // IN:
+                     HgfsNotifySubscriber *subscriber,  // IN:
+                     const char *name,                  // IN/OPT: file name
+                     uint32 mask)                       // IN: HGFS events
+{
+   HgfsNotifyEvent *event;
+
+   if (0 == (mask & ~HGFS_NOTIFY_CONTENT_EVENTS) && NULL != name) {
+      DblLnkLst_Links *link;
+      uint32 searched = 0;
+
+      for (link = state->pending.prev;
+           link != &state->pending && searched < HGFS_NOTIFY_COALESCE_WINDOW;
+           link = link->prev, searched++) {
+         event = DblLnkLst_Container(link, HgfsNotifyEvent, links);
+         if (event->subscriber == subscriber->handle &&
+             0 == (event->mask & ~HGFS_NOTIFY_CONTENT_EVENTS) &&
+             NULL != event->name && strcmp(event->name, name) == 0) {
+            event->mask |= mask;
+            return;
+         }
+      }
+   }
+
+   if (state->numPending >= HGFS_NOTIFY_MAX_PENDING) {
+      LOG(4, "%s: too many pending events, dropping them\n", __FUNCTION__);
+      HgfsNotifyQueueDropped(state);
+      return;
+   }
+
+   HgfsNotifyAppendEvent(state, subscriber, name, mask);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFreePending --
+ *
+ *    Frees the queued events.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyFreePending(HgfsNotifyState *state)  // IN:
+{
+   DblLnkLst_Links *link, *nextLink;
+
+   DblLnkLst_ForEachSafe(link, nextLink, &state->pending) {
+      HgfsNotifyEvent *event = DblLnkLst_Container(link, HgfsNotifyEvent, links);
+
+      DblLnkLst_Unlink1(&event->links);
+      free(event->name);
+      free(event);
+   }
+   state->numPending = 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyQueueDropped --
+ *
+ *    Replaces the queued events with an "events dropped" event for every
+ *    subscriber, which then has to rescan its directories. Change journals
+ *    have no queued events. The queue may exceed HGFS_NOTIFY_MAX_PENDING
+ *    because of the markers, in which case the next event only renews them.
+ *
+ *    Called by the reactor with the lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyQueueDropped(HgfsNotifyState *state)  // IN:
+{
+   DblLnkLst_Links *link;
+
+   HgfsNotifyFreePending(state);
+
+   DblLnkLst_ForEach(link, &state->subscribers) {
+      HgfsNotifySubscriber *subscriber =
+         DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+      /*
+       * Not HgfsNotifyQueueEvent: with HGFS_NOTIFY_MAX_PENDING subscribers
+       * or more, the markers themselves would overflow the queue again.
+       */
+      if (NULL == subscriber->journal) {
+         HgfsNotifyAppendEvent(state, subscriber, NULL,
+                               HGFS_NOTIFY_EVENTS_DROPPED);
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyJournalAppend --
+ *
+ *    Records a change in a change journal, dropping the oldest change if
+ *    the journal is full. A content change is merged into a recent content
+ *    change of the same name which no query has returned yet.
+ *
+ *    Called by the reactor with the lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyJournalAppend(HgfsNotifyJournal *journal,  // IN:
+                        const char *name,            // IN: file name
+                        uint32 mask)                 // IN: HGFS events
+{
+   HgfsNotifyChange *change;
+   uint64 seq;
+
+   if (0 == (mask & ~HGFS_NOTIFY_CONTENT_EVENTS)) {
+      uint64 mergeSeq = MAX(journal->firstSeq, journal->issuedSeq);
+      uint32 searched = 0;
+
+      for (seq = journal->nextSeq;
+           seq > mergeSeq && searched < HGFS_NOTIFY_COALESCE_WINDOW;
+           seq--, searched++) {
+         change = HGFS_NOTIFY_JOURNAL_CHANGE(journal, seq - 1);
+         if (0 != (change->mask & ~HGFS_NOTIFY_CONTENT_EVENTS)) {
+            /* Do not move a content change across a name change. */
+            break;
+         }
+         if (strcmp(change->name, name) == 0) {
+            change->mask |= mask;
+            return;
+         }
+      }
+   }
+
+   if (journal->nextSeq - journal->firstSeq == HGFS_NOTIFY_JOURNAL_SIZE) {
+      change = HGFS_NOTIFY_JOURNAL_CHANGE(journal, journal->firstSeq);
+      free(change->name);
+      change->name = NULL;
+      journal->firstSeq++;
+   }
+
+   change = HGFS_NOTIFY_JOURNAL_CHANGE(journal, journal->nextSeq);
+   change->seq = journal->nextSeq++;
+   change->mask = mask;
+   change->name = Util_SafeStrdup(name);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyJournalsOverflow --
+ *
+ *    Drops all the changes of the change journals after inotify events
+ *    were lost. A sequence number is skipped so that no token issued
+ *    before is accepted anymore.
+ *
+ *    Called by the reactor with the lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyJournalsOverflow(HgfsNotifyState *state)  // IN:
+{
+   DblLnkLst_Links *link;
+
+   DblLnkLst_ForEach(link, &state->journals) {
+      HgfsNotifyJournal *journal =
+         DblLnkLst_Container(link, HgfsNotifyJournal, links);
+
+      for (; journal->firstSeq < journal->nextSeq; journal->firstSeq++) {
+         HgfsNotifyChange *change =
+            HGFS_NOTIFY_JOURNAL_CHANGE(journal, journal->firstSeq);
+
+         free(change->name);
+         change->name = NULL;
+      }
+      journal->nextSeq++;
+      journal->firstSeq = journal->nextSeq;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyRenameWatches --
+ *
+ *    Updates the paths of the watches and subscribers after a watched
+ *    directory was renamed within the watched trees.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyRenamePath(char **path,          // IN/OUT:
+                     const char *oldPath,  // IN:
+                     const char *newPath)  // IN:
+{
+   if (strcmp(*path, oldPath) == 0 || HgfsNotifyIsPathUnder(*path, oldPath)) {
+      char *renamed = Str_SafeAsprintf(NULL, "%s%s", newPath,
+                                       *path + strlen(oldPath));
+
+      free(*path);
+      *path = renamed;
+   }
+}
+
+static void
+HgfsNotifyRenameWatches(HgfsNotifyState *state,  // IN:
+                        const char *oldPath,     // IN:
+                        const char *newPath)     // IN:
+{
+   HgfsNotifyWatch **watches;
+   DblLnkLst_Links *link;
+   size_t numWatches;
+   size_t i;
+
+   HashTable_ToArray(state->watches, (void ***)&watches, &numWatches);
+   for (i = 0; i < numWatches; i++) {
+      HgfsNotifyRenamePath(&watches[i]->path, oldPath, newPath);
+   }
+   free(watches);
+
+   DblLnkLst_ForEach(link, &state->subscribers) {
+      HgfsNotifySubscriber *subscriber =
+         DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+      HgfsNotifyRenamePath(&subscriber->path, oldPath, newPath);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyDropMovedFrom --
+ *
+ *    Handles a directory which was moved out of the watched trees: its
+ *    watches would report events with stale names, so they are removed.
+ *    Subscribers on the directory itself have been sent MOVE_SELF.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyDropMovedFrom(HgfsNotifyState *state)  // IN:
+{
+   HgfsNotifyWatch **watches;
+   size_t numWatches;
+   size_t i;
+
+   if (NULL == state->movedFromPath) {
+      return;
+   }
+
+   HashTable_ToArray(state->watches, (void ***)&watches, &numWatches);
+   for (i = 0; i < numWatches; i++) {
+      HgfsNotifyWatch *watch = watches[i];
+
+      if (strcmp(watch->path, state->movedFromPath) == 0 ||
+          HgfsNotifyIsPathUnder(watch->path, state->movedFromPath)) {
+         inotify_rm_watch(state->inotifyFd, watch->wd);
+         HgfsNotifyForgetWatch(state, watch);
+      }
+   }
+   free(watches);
+
+   free(state->movedFromPath);
+   state->movedFromPath = NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyProcessEvent --
+ *
+ *    Translates one inotify event and queues it for the subscribers which
+ *    are interested in it. Keeps the watches of recursive subscribers in
+ *    sync with the directory tree.
+ *
+ *    Called by the reactor with the lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyProcessEvent(HgfsNotifyState *state,              // IN:
+                       const struct inotify_event *event)   // IN:
+{
+   HgfsNotifyWatch *watch;
+   DblLnkLst_Links *link;
+   char *fullPath;
+   uint32 mask;
+   uint32 matchMask;
+   Bool isSelfEvent = 0 == event->len || '\0' == event->name[0];
+
+   if (event->mask & IN_Q_OVERFLOW) {
+      LOG(4, "%s: inotify queue overflow\n", __FUNCTION__);
+      HgfsNotifyQueueDropped(state);
+      HgfsNotifyJournalsOverflow(state);
+      return;
+   }
+
+   /* A directory move is complete once the paired IN_MOVED_TO is seen. */
+   if (NULL != state->movedFromPath &&
+       (0 == (event->mask & IN_MOVED_TO) ||
+        event->cookie != state->movedFromCookie)) {
+      HgfsNotifyDropMovedFrom(state);
+   }
+
+   if (!HashTable_Lookup(state->watches, AS_KEY(event->wd), (void **)&watch)) {
+      return;
+   }
+
+   if (event->mask & IN_IGNORED) {
+      /* The watch was removed by the kernel, e.g. the directory was deleted. */
+      HgfsNotifyForgetWatch(state, watch);
+      return;
+   }
+
+   fullPath = isSelfEvent ?
+              Util_SafeStrdup(watch->path) :
+              Str_SafeAsprintf(NULL, "%s%c%s", watch->path, DIRSEPC,
+                               event->name);
+
+   mask = HgfsNotifyInotifyToHgfs(event->mask);
+   matchMask = mask;
+   if (mask & HGFS_NOTIFY_NAME_EVENTS) {
+      matchMask |= HGFS_NOTIFY_NAME;
+   }
+
+   DblLnkLst_ForEach(link, &state->subscribers) {
+      HgfsNotifySubscriber *subscriber =
+         DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+      Bool interested;
+
+      if (isSelfEvent) {
+         /* Only the subscriber on the directory itself, others see the name. */
+         interested = strcmp(subscriber->path, watch->path) == 0 &&
+                      0 != (matchMask & (subscriber->eventFilter |
+                                         HGFS_NOTIFY_WATCH_DELETED));
+      } else {
+         interested = (strcmp(subscriber->path, watch->path) == 0 ||
+                       (subscriber->recursive &&
+                        HgfsNotifyIsPathUnder(watch->path, subscriber->path))) &&
+                      0 != (matchMask & subscriber->eventFilter);
+      }
+
+      if (interested) {
+         const char *name = fullPath + subscriber->share->pathLen;
+
+         while (*name == DIRSEPC) {
+            name++;
+         }
+         if (NULL != subscriber->journal) {
+            HgfsNotifyJournalAppend(subscriber->journal, name,
+                                    mask & HGFS_NOTIFY_JOURNAL_EVENTS);
+            if (mask & (HGFS_NOTIFY_DELETE_SELF | HGFS_NOTIFY_MOVE_SELF)) {
+               /* The tree is gone, the watches no longer follow it. */
+               subscriber->incomplete = TRUE;
+            }
+         } else {
+            HgfsNotifyQueueEvent(state, subscriber, name, mask);
+         }
+      }
+
+      /* Watch new directories below recursive subscribers. */
+      if (subscriber->recursive && !isSelfEvent &&
+          (event->mask & IN_ISDIR) &&
+          (event->mask & (IN_CREATE | IN_MOVED_TO)) &&
+          0 == (event->mask & IN_MOVED_FROM) &&
+          (strcmp(subscriber->path, watch->path) == 0 ||
+           HgfsNotifyIsPathUnder(watch->path, subscriber->path)) &&
+          !(NULL != state->movedFromPath &&
+            (event->mask & IN_MOVED_TO))) {
+         HgfsNotifyAddWatchTree(state, subscriber, fullPath, 1);
+      }
+   }
+
+   if ((event->mask & IN_ISDIR) && !isSelfEvent) {
+      if (event->mask & IN_MOVED_FROM) {
+         state->movedFromCookie = event->cookie;
+         state->movedFromPath = fullPath;
+         fullPath = NULL;
+      } else if ((event->mask & IN_MOVED_TO) && NULL != state->movedFromPath) {
+         HgfsNotifyRenameWatches(state, state->movedFromPath, fullPath);
+         free(state->movedFromPath);
+         state->movedFromPath = NULL;
+      }
+   }
+
+   free(fullPath);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyDeliver --
+ *
+ *    Delivers the queued events to the server. The lock is dropped around
+ *    the callback; HgfsNotify_RemoveSessionSubscribers waits for a delivery
+ *    to the session being removed to complete.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyDeliver(HgfsNotifyState *state)  // IN:
+{
+   MXUser_AcquireExclLock(state->lock);
+   HgfsNotifyDropMovedFrom(state);
+
+   while (DblLnkLst_IsLinked(&state->pending) && !state->exiting) {
+      HgfsNotifyEvent *event = DblLnkLst_Container(state->pending.next,
+                                                   HgfsNotifyEvent, links);
+
+      DblLnkLst_Unlink1(&event->links);
+      state->numPending--;
+
+      /* Skip events of subscribers removed since the event was queued. */
+      if (HashTable_Lookup(state->subscriberTable, AS_KEY(event->subscriber),
+                           NULL)) {
+         state->deliverySession = event->session;
+         MXUser_ReleaseExclLock(state->lock);
+
+         state->callbacks.eventReceive(event->share, event->subscriber,
+                                       event->name, event->mask,
+                                       event->session);
+
+         MXUser_AcquireExclLock(state->lock);
+         state->deliverySession = NULL;
+         MXUser_BroadcastCondVar(state->deliveryDone);
+      }
+
+      free(event->name);
+      free(event);
+   }
+
+   MXUser_ReleaseExclLock(state->lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyReactor --
+ *
+ *    Reactor thread: waits for inotify events, translates and queues them,
+ *    and delivers the queued events once the coalescing period expired.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HgfsNotifyReactor(void *data)  // IN: notification state
+{
+   HgfsNotifyState *state = data;
+   char *buffer = Util_SafeMalloc(HGFS_NOTIFY_READ_BUFFER_SIZE);
+
+   for (;;) {
+      struct pollfd fds[2];
+      int timeout = -1;
+      Bool exiting;
+
+      if (0 != state->numPending) {
+         VmTimeType now = Hostinfo_SystemTimerMS();
+
+         timeout = state->flushTime > now ? (int)(state->flushTime - now) : 0;
+      }
+
+      fds[0].fd = state->inotifyFd;
+      fds[0].events = POLLIN;
+      fds[0].revents = 0;
+      fds[1].fd = state->wakeFd;
+      fds[1].events = POLLIN;
+      fds[1].revents = 0;
+
+      if (poll(fds, ARRAYSIZE(fds), timeout) < 0 && errno != EINTR) {
+         Log("%s: poll failed: %d\n", __FUNCTION__, errno);
+         break;
+      }
+
+      if (fds[1].revents & POLLIN) {
+         uint64 value;
+
+         if (read(state->wakeFd, &value, sizeof value) < 0) {
+            LOG(4, "%s: wake read failed: %d\n", __FUNCTION__, errno);
+         }
+      }
+
+      MXUser_AcquireExclLock(state->lock);
+      exiting = state->exiting;
+      if (!exiting && state->reportDropped) {
+         state->reportDropped = FALSE;
+         HgfsNotifyQueueDropped(state);
+         HgfsNotifyJournalsOverflow(state);
+         state->flushTime = 0;
+      }
+      MXUser_ReleaseExclLock(state->lock);
+
+      if (exiting) {
+         break;
+      }
+
+      if (fds[0].revents & POLLIN) {
+         ssize_t len = read(state->inotifyFd, buffer,
+                            HGFS_NOTIFY_READ_BUFFER_SIZE);
+         ssize_t offset = 0;
+
+         MXUser_AcquireExclLock(state->lock);
+         if (0 != state->deactivateCount) {
+            state->eventsDiscarded = TRUE;
+            len = 0;
+         }
+         while (offset + (ssize_t)sizeof (struct inotify_event) <= len) {
+            const struct inotify_event *event =
+               (const struct inotify_event *)(buffer + offset);
+
+            HgfsNotifyProcessEvent(state, event);
+            offset += sizeof *event + event->len;
+         }
+         MXUser_ReleaseExclLock(state->lock);
+      }
+
+      if (0 != state->numPending &&
+          Hostinfo_SystemTimerMS() >= state->flushTime) {
+         HgfsNotifyDeliver(state);
+      }
+   }
+
+   free(buffer);
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyWake --
+ *
+ *    Wakes up the reactor thread.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyWake(HgfsNotifyState *state)  // IN:
+{
+   uint64 value = 1;
+
+   if (write(state->wakeFd, &value, sizeof value) < 0) {
+      LOG(4, "%s: wake write failed: %d\n", __FUNCTION__, errno);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Init --
+ *
+ *    Initialization for the notification component: creates the inotify
+ *    instance and starts the reactor thread.
+ *
+ * Results:
+ *    HGFS_ERROR_SUCCESS on success, an error otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsNotify_Init(const HgfsServerNotifyCallbacks *serverCbData) // IN: callbacks
+{
+   HgfsNotifyState *state;
+   HgfsInternalStatus status;
+   int error;
+
+   ASSERT(NULL == gHgfsNotify);
+   ASSERT(NULL != serverCbData && NULL != serverCbData->eventReceive);
+
+   state = Util_SafeCalloc(1, sizeof *state);
+   state->callbacks = *serverCbData;
+   state->wakeFd = -1;
+   state->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (state->inotifyFd < 0) {
+      status = errno;
+      Log("%s: inotify_init1 failed: %d\n", __FUNCTION__, status);
+      goto error;
+   }
+
+   state->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if (state->wakeFd < 0) {
+      status = errno;
+      Log("%s: eventfd failed: %d\n", __FUNCTION__, status);
+      goto error;
+   }
+
+   state->lock = MXUser_CreateExclLock("HgfsNotifyLock", RANK_hgfsNotifyLock);
+   state->deliveryDone = MXUser_CreateCondVarExclLock(state->lock);
+   DblLnkLst_Init(&state->shares);
+   DblLnkLst_Init(&state->subscribers);
+   DblLnkLst_Init(&state->pending);
+   DblLnkLst_Init(&state->journals);
+   state->subscriberTable = HashTable_Alloc(64, HASH_INT_KEY, NULL);
+   state->watches = HashTable_Alloc(1024, HASH_INT_KEY, NULL);
+   state->nextShareHandle = 1;
+   state->nextSubscriberHandle = 1;
+
+   error = pthread_create(&state->reactor, NULL, HgfsNotifyReactor, state);
+   if (0 != error) {
+      Log("%s: failed to create the reactor thread: %d\n", __FUNCTION__, error);
+      HashTable_Free(state->watches);
+      HashTable_Free(state->subscriberTable);
+      MXUser_DestroyCondVar(state->deliveryDone);
+      MXUser_DestroyExclLock(state->lock);
+      status = error;
+      goto error;
+   }
+
+   gHgfsNotify = state;
+   return HGFS_ERROR_SUCCESS;
+
+error:
+   if (state->wakeFd >= 0) {
+      close(state->wakeFd);
+   }
+   if (state->inotifyFd >= 0) {
+      close(state->inotifyFd);
+   }
+   free(state);
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Exit --
+ *
+ *    Exit for the notification component: stops the reactor thread and
+ *    releases all shared folders, subscribers and watches.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Exit(void)
+{
+   HgfsNotifyState *state = gHgfsNotify;
+   DblLnkLst_Links *link, *nextLink;
+
+   if (NULL == state) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(state->lock);
+   state->exiting = TRUE;
+   MXUser_ReleaseExclLock(state->lock);
+   HgfsNotifyWake(state);
+   pthread_join(state->reactor, NULL);
+
+   gHgfsNotify = NULL;
+
+   DblLnkLst_ForEachSafe(link, nextLink, &state->subscribers) {
+      HgfsNotifyRemoveSubscriberInternal(state,
+         DblLnkLst_Container(link, HgfsNotifySubscriber, links));
+   }
+   DblLnkLst_ForEachSafe(link, nextLink, &state->shares) {
+      HgfsNotifyShare *share = DblLnkLst_Container(link, HgfsNotifyShare, links);
+
+      DblLnkLst_Unlink1(&share->links);
+      free(share->path);
+      free(share);
+   }
+   HgfsNotifyFreePending(state);
+   free(state->movedFromPath);
+
+   ASSERT(HashTable_GetNumElements(state->watches) == 0);
+   HashTable_Free(state->watches);
+   HashTable_Free(state->subscriberTable);
+   MXUser_DestroyCondVar(state->deliveryDone);
+   MXUser_DestroyExclLock(state->lock);
+   close(state->wakeFd);
+   close(state->inotifyFd);
+   free(state);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Activate --
+ *
+ *    Activates generating file system change notifications. If events were
+ *    discarded while deactivated, the subscribers are told so.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Activate(HgfsNotifyActivateReason reason, // IN: reason
+                    struct HgfsSessionInfo *session) // IN: session
+{
+   HgfsNotifyState *state = gHgfsNotify;
+
+   if (NULL == state || HGFS_NOTIFY_REASON_SERVER_SYNC != reason) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(state->lock);
+   if (state->deactivateCount > 0 && --state->deactivateCount == 0 &&
+       state->eventsDiscarded) {
+      state->eventsDiscarded = FALSE;
+      state->reportDropped = TRUE;
+      HgfsNotifyWake(state);
+   }
+   MXUser_ReleaseExclLock(state->lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_Deactivate --
+ *
+ *    Deactivates generating file system change notifications. Events that
+ *    happen while deactivated are discarded.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_Deactivate(HgfsNotifyActivateReason reason, // IN: reason
+                      struct HgfsSessionInfo *session) // IN: session
+{
+   HgfsNotifyState *state = gHgfsNotify;
+
+   if (NULL == state || HGFS_NOTIFY_REASON_SERVER_SYNC != reason) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(state->lock);
+   state->deactivateCount++;
+   MXUser_ReleaseExclLock(state->lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_AddSharedFolder --
+ *
+ *    Allocates memory and initializes new shared folder structure.
+ *
+ * Results:
+ *    Opaque shared folder handle or HGFS_INVALID_FOLDER_HANDLE if adding
+ *    the shared folder fails.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsSharedFolderHandle
+HgfsNotify_AddSharedFolder(const char *path,       // IN: path in the host
+                           const char *shareName)  // IN: name of the shared folder
+{
+   HgfsNotifyState *state = gHgfsNotify;
+   HgfsNotifyShare *share;
+   size_t pathLen;
+
+   if (NULL == state || NULL == path) {
+      return HGFS_INVALID_FOLDER_HANDLE;
+   }
+
+   pathLen = strlen(path);
+   while (pathLen > 1 && path[pathLen - 1] == DIRSEPC) {
+      pathLen--;
+   }
+
+   share = Util_SafeMalloc(sizeof *share);
+   DblLnkLst_Init(&share->links);
+   share->path = Util_SafeStrndup(path, pathLen);
+   share->pathLen = pathLen;
+
+   MXUser_AcquireExclLock(state->lock);
+   share->handle = state->nextShareHandle++;
+   if (HGFS_INVALID_FOLDER_HANDLE == state->nextShareHandle) {
+      state->nextShareHandle = 1;
+   }
+   DblLnkLst_LinkLast(&state->shares, &share->links);
+   MXUser_ReleaseExclLock(state->lock);
+
+   LOG(8, "%s: share %s path %s handle %#x\n", __FUNCTION__,
+       shareName ? shareName : "NULL", share->path, share->handle);
+   return share->handle;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFindShare --
+ *
+ *    Looks up a shared folder by handle. The lock must be held.
+ *
+ * Results:
+ *    The shared folder, NULL if not found.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsNotifyShare *
+HgfsNotifyFindShare(HgfsNotifyState *state,               // IN:
+                    HgfsSharedFolderHandle sharedFolder)  // IN:
+{
+   DblLnkLst_Links *link;
+
+   DblLnkLst_ForEach(link, &state->shares) {
+      HgfsNotifyShare *share = DblLnkLst_Container(link, HgfsNotifyShare, links);
+
+      if (share->handle == sharedFolder) {
+         return share;
+      }
+   }
+
+   LOG(4, "%s: unknown shared folder handle %#x\n", __FUNCTION__, sharedFolder);
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyAllocSubscriber --
+ *
+ *    Allocates a subscriber on a directory of a shared folder. The relative
+ *    path of the directory may come with or without separators around it.
+ *
+ * Results:
+ *    The subscriber, which has no handle and no watches yet.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsNotifySubscriber *
+HgfsNotifyAllocSubscriber(HgfsNotifyShare *share,            // IN:
+                          const char *path,                  // IN: relative path
+                          uint32 eventFilter,                // IN: event filter
+                          Bool recursive,                    // IN: watch the tree
+                          struct HgfsSessionInfo *session)   // IN/OPT:
+{
+   HgfsNotifySubscriber *subscriber;
+   size_t pathLen;
+
+   while (*path == DIRSEPC) {
+      path++;
+   }
+   pathLen = strlen(path);
+   while (pathLen > 0 && path[pathLen - 1] == DIRSEPC) {
+      pathLen--;
+   }
+
+   subscriber = Util_SafeCalloc(1, sizeof *subscriber);
+   DblLnkLst_Init(&subscriber->links);
+   subscriber->handle = HGFS_INVALID_SUBSCRIBER_HANDLE;
+   subscriber->share = share;
+   subscriber->path = 0 == pathLen ?
+                      Util_SafeStrdup(share->path) :
+                      Str_SafeAsprintf(NULL, "%s%c%.*s", share->path, DIRSEPC,
+                                       (int)pathLen, path);
+   subscriber->eventFilter = eventFilter;
+   subscriber->recursive = recursive;
+   subscriber->inotifyMask = HgfsNotifyHgfsToInotify(eventFilter, recursive);
+   subscriber->session = session;
+   subscriber->wds = HashTable_Alloc(64, HASH_INT_KEY, NULL);
+
+   return subscriber;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFreeSubscriber --
+ *
+ *    Frees a subscriber which has no watches left.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyFreeSubscriber(HgfsNotifySubscriber *subscriber)  // IN:
+{
+   HashTable_Free(subscriber->wds);
+   free(subscriber->path);
+   free(subscriber);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_AddSubscriber --
+ *
+ *    Allocates memory and initializes new subscriber structure, and adds
+ *    the inotify watches on the directory (tree).
+ *
+ * Results:
+ *    Opaque subscriber handle for the new subscriber or
+ *    HGFS_INVALID_SUBSCRIBER_HANDLE if adding subscriber fails.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsSubscriberHandle
+HgfsNotify_AddSubscriber(HgfsSharedFolderHandle sharedFolder, // IN: shared folder handle
+                         const char *path,                    // IN: relative path
+                         uint32 eventFilter,                  // IN: event filter
+                         uint32 recursive,                    // IN: look in subfolders
+                         struct HgfsSessionInfo *session)     // IN: server context
+{
+   HgfsNotifyState *state = gHgfsNotify;
+   HgfsNotifySubscriber *subscriber;
+   HgfsSubscriberHandle handle = HGFS_INVALID_SUBSCRIBER_HANDLE;
+   HgfsNotifyShare *share;
+
+   if (NULL == state || NULL == path) {
+      return HGFS_INVALID_SUBSCRIBER_HANDLE;
+   }
+
+   MXUser_AcquireExclLock(state->lock);
+
+   share = HgfsNotifyFindShare(state, sharedFolder);
+   if (NULL == share) {
+      goto exit;
+   }
+
+   subscriber = HgfsNotifyAllocSubscriber(share, path, eventFilter,
+                                          0 != recursive, session);
+   if (!HgfsNotifyAddWatchTree(state, subscriber, subscriber->path, 0)) {
+      HgfsNotifyFreeSubscriber(subscriber);
+      goto exit;
+   }
+
+   subscriber->handle = state->nextSubscriberHandle++;
+   if (HGFS_INVALID_SUBSCRIBER_HANDLE == state->nextSubscriberHandle) {
+      state->nextSubscriberHandle = 1;
+   }
+   handle = subscriber->handle;
+   DblLnkLst_LinkLast(&state->subscribers, &subscriber->links);
+   HashTable_Insert(state->subscriberTable, AS_KEY(handle), subscriber);
+
+   LOG(8, "%s: subscriber %"FMT64"x on %s filter %#x recursive %d\n",
+       __FUNCTION__, handle, subscriber->path, eventFilter, recursive);
+
+exit:
+   MXUser_ReleaseExclLock(state->lock);
+   return handle;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyFreeJournal --
+ *
+ *    Frees a change journal. Its tokens are not accepted by a journal
+ *    started later. The lock must be held (or the reactor stopped).
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyFreeJournal(HgfsNotifyState *state,      // IN:
+                      HgfsNotifyJournal *journal)  // IN:
+{
+   uint64 seq;
+
+   for (seq = journal->firstSeq; seq < journal->nextSeq; seq++) {
+      free(HGFS_NOTIFY_JOURNAL_CHANGE(journal, seq)->name);
+   }
+
+   state->retiredSeq = MAX(state->retiredSeq, journal->nextSeq);
+   DblLnkLst_Unlink1(&journal->links);
+   state->numJournals--;
+   free(journal->changes);
+   free(journal);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyRemoveSubscriberInternal --
+ *
+ *    Removes a subscriber, or the subscriber feeding a change journal and
+ *    the journal, and drops its watch references.
+ *    The lock must be held (or the reactor stopped).
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNotifyRemoveSubscriberInternal(HgfsNotifyState *state,            // IN:
+                                   HgfsNotifySubscriber *subscriber)  // IN:
+{
+   const void **wds;
+   size_t numWds;
+   size_t i;
+
+   DblLnkLst_Unlink1(&subscriber->links);
+   HashTable_Delete(state->subscriberTable, AS_KEY(subscriber->handle));
+
+   HashTable_KeyArray(subscriber->wds, &wds, &numWds);
+   for (i = 0; i < numWds; i++) {
+      HgfsNotifyUnrefWatch(state, (int)(uintptr_t)wds[i]);
+   }
+   free(wds);
+
+   if (NULL != subscriber->journal) {
+      HgfsNotifyFreeJournal(state, subscriber->journal);
+   }
+   HgfsNotifyFreeSubscriber(subscriber);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSharedFolder --
+ *
+ *    Deallocates memory used by shared folder and performs necessary cleanup.
+ *    Also deletes all subscribers that are defined for the shared folder.
+ *
+ * Results:
+ *    TRUE if the shared folder was found, FALSE otherwise.
+ *
+ * Side effects:
+ *    Removes all subscribers that correspond to the shared folder and
+ *    invalidates their handles.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsNotify_RemoveSharedFolder(HgfsSharedFolderHandle sharedFolder) // IN
+{
+   HgfsNotifyState *state = gHgfsNotify;
+   DblLnkLst_Links *link, *nextLink;
+   Bool found = FALSE;
+
+   if (NULL == state) {
+      return FALSE;
+   }
+
+   MXUser_AcquireExclLock(state->lock);
+
+   DblLnkLst_ForEachSafe(link, nextLink, &state->subscribers) {
+      HgfsNotifySubscriber *subscriber =
+         DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+      if (subscriber->share->handle == sharedFolder) {
+         HgfsNotifyRemoveSubscriberInternal(state, subscriber);
+      }
+   }
+
+   DblLnkLst_ForEachSafe(link, nextLink, &state->shares) {
+      HgfsNotifyShare *share = DblLnkLst_Container(link, HgfsNotifyShare, links);
+
+      if (share->handle == sharedFolder) {
+         DblLnkLst_Unlink1(&share->links);
+         free(share->path);
+         free(share);
+         found = TRUE;
+         break;
+      }
+   }
+
+   MXUser_ReleaseExclLock(state->lock);
+   return found;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSubscriber --
+ *
+ *    Remove a subscriber and its watches.
+ *
+ * Results:
+ *    TRUE if the subscriber was found, FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsNotify_RemoveSubscriber(HgfsSubscriberHandle subscriber) // IN
+{
+   HgfsNotifyState *state = gHgfsNotify;
+   HgfsNotifySubscriber *entry;
+   Bool found;
+
+   if (NULL == state) {
+      return FALSE;
+   }
+
+   MXUser_AcquireExclLock(state->lock);
+   found = HashTable_Lookup(state->subscriberTable, AS_KEY(subscriber),
+                            (void **)&entry);
+   if (found) {
+      HgfsNotifyRemoveSubscriberInternal(state, entry);
+   }
+   MXUser_ReleaseExclLock(state->lock);
+
+   return found;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_RemoveSessionSubscribers --
+ *
+ *    Removes all subscribers of a session. On return no event is being or
+ *    will be delivered to the session.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_RemoveSessionSubscribers(struct HgfsSessionInfo *session) // IN
+{
+   HgfsNotifyState *state = gHgfsNotify;
+   DblLnkLst_Links *link, *nextLink;
+
+   if (NULL == state) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(state->lock);
+
+   DblLnkLst_ForEachSafe(link, nextLink, &state->subscribers) {
+      HgfsNotifySubscriber *subscriber =
+         DblLnkLst_Container(link, HgfsNotifySubscriber, links);
+
+      if (subscriber->session == session) {
+         HgfsNotifyRemoveSubscriberInternal(state, subscriber);
+      }
+   }
+
+   /* The delivery callback itself may end up releasing the session. */
+   if (!pthread_equal(pthread_self(), state->reactor)) {
+      while (state->deliverySession == session) {
+         MXUser_WaitCondVarExclLock(state->lock, state->deliveryDone);
+      }
+   }
+
+   MXUser_ReleaseExclLock(state->lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotifyStartJournal --
+ *
+ *    Starts a change journal on a directory tree of a shared folder. The
+ *    least recently queried journal is dropped if there are too many. The
+ *    sequence numbers start from the time of day in microseconds, above
+ *    those of the journals dropped, so that tokens of earlier journals of
+ *    the same tree are not accepted.
+ *
+ *    The lock must be held.
+ *
+ * Results:
+ *    The journal, which owns the subscriber. NULL if the directory could
+ *    not be watched, the subscriber is freed.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsNotifyJournal *
+HgfsNotifyStartJournal(HgfsNotifyState *state,         // IN:
+                       HgfsNotifySubscriber *watcher)  // IN: journal subscriber
+{
+   HgfsNotifyJournal *journal;
+   VmTimeType now;
+
+   if (!HgfsNotifyAddWatchTree(state, watcher, watcher->path, 0)) {
+      HgfsNotifyFreeSubscriber(watcher);
+      return NULL;
+   }
+
+   if (state->numJournals >= HGFS_NOTIFY_MAX_JOURNALS) {
+      HgfsNotifyJournal *oldest = NULL;
+      DblLnkLst_Links *link;
+
+      DblLnkLst_ForEach(link, &state->journals) {
+         journal = DblLnkLst_Container(link, HgfsNotifyJournal, links);
+         if (NULL == oldest || journal->lastQuery < oldest->lastQuery) {
+            oldest = journal;
+         }
+      }
+      LOG(4, "%s: dropping the journal of %s\n", __FUNCTION__,
+          oldest->watcher->path);
+      HgfsNotifyRemoveSubscriberInternal(state, oldest->watcher);
+   }
+
+   Hostinfo_GetTimeOfDay(&now);
+
+   journal = Util_SafeCalloc(1, sizeof *journal);
+   DblLnkLst_Init(&journal->links);
+   journal->watcher = watcher;
+   journal->changes = Util_SafeCalloc(HGFS_NOTIFY_JOURNAL_SIZE,
+                                      sizeof *journal->changes);
+   journal->firstSeq = MAX((uint64)now, state->retiredSeq + 1);
+   journal->nextSeq = journal->firstSeq;
+   journal->issuedSeq = journal->firstSeq;
+   watcher->journal = journal;
+
+   DblLnkLst_LinkLast(&state->subscribers, &watcher->links);
+   DblLnkLst_LinkLast(&state->journals, &journal->links);
+   state->numJournals++;
+
+   LOG(8, "%s: journal on %s from %"FMT64"u%s\n", __FUNCTION__,
+       watcher->path, journal->firstSeq,
+       watcher->incomplete ? ", incomplete" : "");
+   return journal;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_QueryJournal --
+ *
+ *    Returns the changes recorded in the change journal of a directory tree
+ *    of a shared folder since a token, at most maxChanges of them.
+ *
+ *    The first query of the tree starts its journal. A rescan of the tree
+ *    is required if the journal was just started or restarted, or if it
+ *    no longer has all the changes since the token, and the returned token
+ *    is then the one to query the changes after the rescan. A journal which
+ *    does not watch all of its tree is restarted.
+ *
+ * Results:
+ *    HGFS_ERROR_SUCCESS on success, an error otherwise. The caller frees
+ *    the changes with HgfsNotify_FreeChanges.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsNotify_QueryJournal(HgfsSharedFolderHandle sharedFolder, // IN: shared folder handle
+                        const char *path,                    // IN: relative path
+                        uint64 token,                        // IN: changes since
+                        uint32 maxChanges,                   // IN: changes to return
+                        HgfsNotifyChange **changes,          // OUT: changes
+                        uint32 *numChanges,                  // OUT: number of changes
+                        uint64 *nextToken,                   // OUT: next token
+                        Bool *resync,                        // OUT: rescan needed
+                        Bool *more)                          // OUT: more changes
+{
+   HgfsNotifyState *state = gHgfsNotify;
+   HgfsNotifySubscriber *watcher;
+   HgfsNotifyJournal *journal = NULL;
+   HgfsNotifyShare *share;
+   HgfsInternalStatus status;
+   DblLnkLst_Links *link;
+
+   *changes = NULL;
+   *numChanges = 0;
+   *resync = FALSE;
+   *more = FALSE;
+
+   if (NULL == state) {
+      return HGFS_ERROR_NOT_SUPPORTED;
+   }
+
+   MXUser_AcquireExclLock(state->lock);
+
+   share = HgfsNotifyFindShare(state, sharedFolder);
+   if (NULL == share) {
+      status = HGFS_ERROR_INVALID_PARAMETER;
+      goto exit;
+   }
+
+   watcher = HgfsNotifyAllocSubscriber(share, path, HGFS_NOTIFY_JOURNAL_EVENTS,
+                                       TRUE, NULL);
+
+   DblLnkLst_ForEach(link, &state->journals) {
+      HgfsNotifyJournal *current =
+         DblLnkLst_Container(link, HgfsNotifyJournal, links);
+
+      if (current->watcher->share == share &&
+          strcmp(current->watcher->path, watcher->path) == 0) {
+         journal = current;
+         break;
+      }
+   }
+
+   if (NULL != journal && journal->watcher->incomplete) {
+      LOG(4, "%s: restarting the journal of %s\n", __FUNCTION__,
+          watcher->path);
+      HgfsNotifyRemoveSubscriberInternal(state, journal->watcher);
+      journal = NULL;
+   }
+
+   if (NULL == journal) {
+      journal = HgfsNotifyStartJournal(state, watcher);
+      if (NULL == journal) {
+         status = HGFS_ERROR_FILE_NOT_FOUND;
+         goto exit;
+      }
+      *resync = TRUE;
+      *nextToken = journal->nextSeq;
+   } else {
+      HgfsNotifyFreeSubscriber(watcher);
+
+      if (token < journal->firstSeq || token > journal->nextSeq) {
+         *resync = TRUE;
+         *nextToken = journal->nextSeq;
+      } else {
+         uint64 seq;
+
+         *numChanges = (uint32)MIN(maxChanges, journal->nextSeq - token);
+         if (0 != *numChanges) {
+            *changes = Util_SafeCalloc(*numChanges, sizeof **changes);
+         }
+         for (seq = token; seq < token + *numChanges; seq++) {
+            HgfsNotifyChange *change = HGFS_NOTIFY_JOURNAL_CHANGE(journal, seq);
+            HgfsNotifyChange *copy = &(*changes)[seq - token];
+
+            copy->seq = change->seq;
+            copy->mask = change->mask;
+            copy->name = Util_SafeStrdup(change->name);
+         }
+         *nextToken = token + *numChanges;
+         *more = *nextToken < journal->nextSeq;
+      }
+   }
+
+   journal->issuedSeq = MAX(journal->issuedSeq, *nextToken);
+   journal->lastQuery = ++state->numJournalQueries;
+   status = HGFS_ERROR_SUCCESS;
+
+exit:
+   MXUser_ReleaseExclLock(state->lock);
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_FreeChanges --
+ *
+ *    Frees the changes returned by HgfsNotify_QueryJournal.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_FreeChanges(HgfsNotifyChange *changes, // IN: changes
+                       uint32 numChanges)         // IN: number of changes
+{
+   uint32 i;
+
+   for (i = 0; i < numChanges; i++) {
+      free(changes[i].name);
+   }
+   free(changes);
+}
@@ -245,3 +245,57 @@ void
 HgfsNotify_RemoveSessionSubscribers(struct HgfsSessionInfo *session) // IN
 {
 }
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_QueryJournal --
+ *
+ *    Returns the changes recorded in a change journal.
+ *
+ * Results:
+ *    Not supported error.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsNotify_QueryJournal(HgfsSharedFolderHandle sharedFolder, // IN: shared folder handle
+                        const char *path,                    // IN: relative path
+                        uint64 token,                        // IN: changes since
+                        uint32 maxChanges,                   // IN: changes to return
+                        HgfsNotifyChange **changes,          // OUT: changes
+                        uint32 *numChanges,                  // OUT: number of changes
+                        uint64 *nextToken,                   // OUT: next token
+                        Bool *resync,                        // OUT: rescan needed
+                        Bool *more)                          // OUT: more changes
+{
+   return HGFS_ERROR_NOT_SUPPORTED;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNotify_FreeChanges --
+ *
+ *    Frees the changes returned by HgfsNotify_QueryJournal.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsNotify_FreeChanges(HgfsNotifyChange *changes, // IN: changes
+                       uint32 numChanges)         // IN: number of changes
+{
+}
@@ -0,0 +1,111 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsNameFormC.c --
+ *
+ *    Names returned to HGFS clients are in unicode normal form C. Hosts
+ *    validate every directory entry name as UTF-8, and Mac hosts convert
+ *    it from normal form D, which allocates. Nearly all names on a share
+ *    are plain ASCII, or Latin script below U+0300, and need neither: no
+ *    code point below U+0300 is a combining mark, so such a name is its
+ *    own normal form C. HgfsNameFormC_IsTrivial recognizes those names
+ *    with a word-at-a-time scan for the ASCII runs, so the full
+ *    validation and normalization are only done for the other names.
+ */
+
+#include <string.h>
+
+#include "vmware.h"
+#include "hgfsNameFormC.h"
+
+
+/*
+ * Local data
+ */
+
+#define HGFS_NAME_ONES   0x0101010101010101ULL
+#define HGFS_NAME_HIGHS  0x8080808080808080ULL
+
+/*
+ * A 64-bit word holds only ASCII characters other than nul if no byte has
+ * the high bit set, and no byte is zero, which sets the high bit of that
+ * byte in word - ONES. Borrows can only cause false negatives, which are
+ * left to the byte by byte scan.
+ */
+#define HGFS_NAME_WORD_IS_ASCII(_w) \
+   (((((_w) - HGFS_NAME_ONES) | (_w)) & HGFS_NAME_HIGHS) == 0)
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNameFormC_IsTrivial --
+ *
+ *    Checks whether a nul terminated name is valid UTF-8 made only of code
+ *    points below U+0300, the combining diacritical marks. Such a name
+ *    needs no validation or normalization to normal form C.
+ *
+ * Results:
+ *    TRUE if the name is terminated within bufferSize bytes and only
+ *    holds code points below U+0300, FALSE otherwise. FALSE does not mean
+ *    that the name is invalid, only that it needs the full check.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsNameFormC_IsTrivial(const char *name,   // IN: name
+                        size_t bufferSize)  // IN: size of the name buffer
+{
+   const uint8 *p = (const uint8 *)name;
+   const uint8 *end = p + bufferSize;
+
+   while (p < end) {
+      uint64 word;
+
+      while ((size_t)(end - p) >= sizeof word) {
+         memcpy(&word, p, sizeof word);
+         if (!HGFS_NAME_WORD_IS_ASCII(word)) {
+            break;
+         }
+         p += sizeof word;
+      }
+      if (p == end) {
+         break;
+      }
+
+      if (*p == '\0') {
+         return TRUE;
+      } else if (*p < 0x80) {
+         p++;
+      } else if (*p >= 0xC2 && *p <= 0xCB &&
+                 end - p >= 2 && (p[1] & 0xC0) == 0x80) {
+         /* Two byte sequence for U+0080 to U+02FF. */
+         p += 2;
+      } else {
+         return FALSE;
+      }
+   }
+
+   /* Not terminated within the buffer. */
+   return FALSE;
+}
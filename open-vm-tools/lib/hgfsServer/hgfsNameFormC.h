@@ -0,0 +1,33 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsNameFormC.h --
+ *
+ *    Quick check for directory entry names that need no unicode
+ *    normalization before they are returned to HGFS clients.
+ */
+
+#ifndef _HGFS_NAME_FORM_C_H_
+#define _HGFS_NAME_FORM_C_H_
+
+#include "vm_basic_types.h"
+
+Bool HgfsNameFormC_IsTrivial(const char *name, size_t bufferSize);
+
+#endif // ifndef _HGFS_NAME_FORM_C_H_
@@ -35,6 +35,7 @@
 #include "cpName.h"
 #include "cpNameLite.h"
 #include "hashTable.h"
+#include "hostinfo.h"
 #include "hgfsServerInt.h"
 #include "hgfsServerPolicy.h"
 #include "hgfsUtil.h"
@@ -48,8 +49,11 @@
 #include "hgfsServerParameters.h"
 #include "hgfsServerOplock.h"
 #include "hgfsServerOplockMonitor.h"
+#include "hgfsServerStats.h"
+#include "hgfsServerThrottle.h"
 #include "hgfsDirNotify.h"
 #include "hgfsThreadpool.h"
+#include "hgfsAsyncIo.h"
 #include "userlock.h"
 #include "poll.h"
 #include "mutexRankLib.h"
@@ -125,9 +129,76 @@
 #define NUM_FILE_NODES 100
 #define NUM_SEARCHES 100
 
+/*
+ * File node and search handles are generation-tagged slot references.
+ * The low bits hold the index of the node or search in the session array,
+ * the next bit distinguishes searches from file nodes and the high bits
+ * hold a generation which is bumped every time the slot is reused, so a
+ * handle is resolved in constant time and stale handles are still rejected.
+ * Freed slots are reused in FIFO order, so a slot only comes back to the
+ * same handle after every free slot has been reused 2^15 times.
+ */
+#define HGFS_HANDLE_INDEX_BITS        16
+#define HGFS_HANDLE_MAX_SLOTS         (1U << HGFS_HANDLE_INDEX_BITS)
+#define HGFS_HANDLE_INDEX_MASK        (HGFS_HANDLE_MAX_SLOTS - 1)
+#define HGFS_HANDLE_SEARCH_FLAG       (1U << HGFS_HANDLE_INDEX_BITS)
+#define HGFS_HANDLE_GENERATION_SHIFT  (HGFS_HANDLE_INDEX_BITS + 1)
+#define HGFS_HANDLE_INDEX(_handle)    ((_handle) & HGFS_HANDLE_INDEX_MASK)
+
 /* Default maximun number of open nodes that have server locks. */
 #define MAX_LOCKED_FILENODES 10
 
+/*
+ * Lifetime of symlink check and attribute cache entries which are not backed
+ * by an oplock monitor, e.g. on Linux where the server is not notified of
+ * changes made to the files by other processes.
+ */
+#define HGFS_CACHE_UNMONITORED_LIFETIME_MS 1000
+
+/* Read-ahead window limits per file node and per session. */
+#define HGFS_READ_AHEAD_MIN_WINDOW   (128 * 1024)
+#define HGFS_READ_AHEAD_MAX_WINDOW   (8 * 1024 * 1024)
+#define HGFS_READ_AHEAD_SESSION_MAX  (64 * 1024 * 1024)
+
+/*
+ * Write-behind buffer size per file handle, when not configured, total
+ * per session, and how long data stays buffered.
+ */
+#define HGFS_WRITE_BEHIND_DEFAULT_SIZE  (256 * 1024)
+#define HGFS_WRITE_BEHIND_SESSION_MAX   (16 * 1024 * 1024)
+#define HGFS_WRITE_BEHIND_DELAY_MS      500
+
+/*
+ * Asynchronous requests transferring more data than this are bulk requests,
+ * which the threadpool runs after the other requests.
+ */
+#define HGFS_BULK_REQUEST_SIZE          (64 * 1024)
+
+#define AS_KEY(_x)  ((const void *)(uintptr_t)(_x))
+
+/*
+ * Data written through a file handle, not yet written to the file.
+ * Protected by the session's writeBehindLock.
+ */
+typedef struct HgfsWriteBehind {
+   HgfsHandle handle;            /* File handle the data was written to. */
+   fileDesc fd;                  /* Descriptor the data is written with. */
+   char *utf8Name;               /* File name. */
+   uint64 offset;                /* File offset of the buffered data. */
+   uint32 size;                  /* Size of the buffered data. */
+   uint32 capacity;              /* Size of buf. */
+   uint64 dirtyTimeNS;           /* When the buffered data was first written. */
+   HgfsInternalStatus error;     /* Error of a deferred write, not reported. */
+   Bool writing;                 /* buf is being written asynchronously. */
+   char *buf;
+} HgfsWriteBehind;
+
+/* Asynchronous write of a write-behind buffer. */
+typedef struct HgfsWriteBehindContext {
+   HgfsWriteBehind *wb;
+   HgfsSessionInfo *session;
+} HgfsWriteBehindContext;
+
 
 struct HgfsTransportSessionInfo {
    /* Default session id. */
@@ -175,8 +246,27 @@ typedef struct HgfsInputParam {
    HgfsOp op;                    /* Hgfs operation command code */
    uint32 id;                    /* Request ID to be matched with the reply */
    Bool sessionEnabled;          /* Requests have session enabled headers */
+   HgfsCompoundSubReply *compoundReply; /* Reply of a compound sub-request */
+   uint64 startNS;               /* Time the request was received */
+   HgfsStatsShare *statsShare;   /* Share the request is attributed to */
 } HgfsInputParam;
 
+/* A read request waiting for its asynchronous file read to complete. */
+typedef struct HgfsServerReadContext {
+   HgfsInputParam *input;
+   HgfsHandle file;              /* Read file handle, its node is pinned */
+   HgfsReplyReadV3 *reply;
+   Bool useDataBuffer;           /* Data is read into the data packet */
+} HgfsServerReadContext;
+
+/*
+ * State of a fsync request while its asynchronous flush is in flight.
+ */
+typedef struct HgfsServerFsyncContext {
+   HgfsInputParam *input;
+   HgfsHandle file;              /* Synced file handle, its node is pinned */
+} HgfsServerFsyncContext;
+
 /*
  * The HGFS server configurable settings.
  * (Note: the guest sets these to all defaults only modifiable from the VMX.)
@@ -268,6 +358,47 @@ static MXUserExclLock *gHgfsSharedFoldersLock = NULL;
 /* List of shared folders nodes. */
 static DblLnkLst_Links gHgfsSharedFoldersList;
 
+/*
+ * Index of the shares keyed by share name, so that resolving the share of a
+ * request is a single hash table probe rather than walks of the policy and
+ * notification share lists. The index is built from the policy on first use
+ * and dropped as a whole when the share list changes, to be rebuilt by the
+ * next lookup. Names that only match a share case insensitively miss the
+ * index and are resolved by the policy.
+ *
+ * The current index holds a reference to itself and each lookup holds one
+ * while it uses an entry, so a dropped index is freed, closing its share
+ * roots, once the last lookup using it is done. The entries own copies of
+ * the root directory names, as the policy frees its names when the share
+ * list changes. The share info of a request resolved through the index
+ * points at the copy, which lives at least as long as the policy's name.
+ *
+ * A share root is reopened in place when its path no longer refers to the
+ * directory it was opened on. Lookups may still use the old root, which is
+ * closed with the index.
+ */
+typedef struct HgfsShareIndexEntry {
+   char *name;
+   char *rootDir;
+   size_t rootDirLen;
+   Bool readPermissions;
+   Bool writePermissions;
+   HgfsShareOptions options;       // Case sensitivity, symlink following
+   HgfsSharedFolderHandle handle;  // Change notification handle
+   fileDesc rootFd;                // Share root opened by the platform, or -1
+} HgfsShareIndexEntry;
+
+typedef struct HgfsShareIndex {
+   HashTable *shares;              // Share name -> HgfsShareIndexEntry
+   Atomic_uint32 refCount;         // Lookups, plus one while current
+   fileDesc *staleRootFds;         // Share roots replaced by a reopen
+   uint32 numStaleRootFds;
+} HgfsShareIndex;
+
+static MXUserRWLock *gHgfsShareIndexLock = NULL;
+static HgfsShareIndex *gHgfsShareIndex = NULL;         // NULL until built
+static uint32 gHgfsShareIndexGeneration = 0;           // Bumped when dropped
+
 /*
  * Number of active sessions that support change directory notification. HGFS server
  * needs to maintain up-to-date shared folders list when there is
@@ -282,6 +413,20 @@ static Bool gHgfsDirNotifyActive = FALSE;
  */
 static Bool gHgfsThreadpoolActive = FALSE;
 
+/*
+ * Indicates if asynchronous file I/O is active. If so then reads of
+ * asynchronous requests are submitted without waiting for them, and the
+ * requests are completed by the async I/O completion reactor. Write-behind
+ * buffers are written the same way.
+ */
+static Bool gHgfsAsyncIoActive = FALSE;
+
+/*
+ * Indicates if the data requests of the shares are throttled. Asynchronous
+ * data requests over the limits of their share are delayed by the threadpool.
+ */
+static Bool gHgfsThrottleActive = FALSE;
+
 typedef struct HgfsSharedFolderProperties {
    DblLnkLst_Links links;
    char *name;                                /* Name of the share. */
@@ -290,10 +435,8 @@ typedef struct HgfsSharedFolderProperties {
 
 
 /* Allocate/Add sessions helper functions. */
-#ifndef VMX86_TOOLS
 static void
 HgfsServerAsyncInfoIncCount(HgfsAsyncRequestInfo *info);
-#endif
 
 static Bool
 HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession,
@@ -365,6 +508,23 @@ static Bool HgfsHandle2NotifyInfo(HgfsHandle handle,
                                   size_t *fileNameSize,
                                   HgfsSharedFolderHandle *folderHandle);
 static void HgfsFreeSearchDirents(HgfsSearch *search);
+static void HgfsServerShareIndexDrop(void);
+static HgfsInternalStatus HgfsWriteBehindFlushInternal(HgfsWriteBehind *wb,
+                                                       HgfsSessionInfo *session);
+static void HgfsWriteBehindFreeInternal(HgfsWriteBehind *wb,
+                                        HgfsSessionInfo *session);
+static HgfsInternalStatus HgfsServerWriteBehindFlush(HgfsHandle file,
+                                                     Bool reportError,
+                                                     HgfsSessionInfo *session);
+static void HgfsServerWriteBehindFlushName(const char *utf8Name,
+                                           uint64 offset,
+                                           uint64 length,
+                                           HgfsSessionInfo *session);
+static HgfsInternalStatus
+HgfsServerWriteBehindFlushRange(HgfsHandle file,
+                                uint64 offset,
+                                uint64 length,
+                                HgfsSessionInfo *session);
 
 static HgfsInternalStatus
 HgfsServerTransportGetDefaultSession(HgfsTransportSessionInfo *transportSession,
@@ -375,6 +535,15 @@ static Bool HgfsPacketSend(HgfsPacket *packet,
                            HgfsSendFlags flags);
 
 static void HgfsCacheRemoveLRUCb(void *data);
+static Bool HgfsCacheKeyIsNotShared(const char *key, void *clientData);
+static void HgfsServerCacheMonitor(HgfsSessionInfo *session, char *localName,
+                                   HOM_HANDLE *handle, VmTimeType *expiry);
+static Bool HgfsServerCacheEntryIsValid(VmTimeType expiry);
+static void HgfsServerCacheRemove(HgfsSessionInfo *session,
+                                  const char *localName, Bool nameChanged);
+static void HgfsServerCacheRemoveHandle(HgfsHandle file,
+                                        HgfsSessionInfo *session,
+                                        Bool nameChanged);
 
 /*
  * Opcode handlers
@@ -401,6 +570,12 @@ static void HgfsServerClose(HgfsInputParam *input);
 static void HgfsServerSearchClose(HgfsInputParam *input);
 static void HgfsServerSetDirNotifyWatch(HgfsInputParam *input);
 static void HgfsServerRemoveDirNotifyWatch(HgfsInputParam *input);
+static void HgfsServerOplockAcquire(HgfsInputParam *input);
+static void HgfsServerOplockBreakAck(HgfsInputParam *input);
+static void HgfsServerCopyRange(HgfsInputParam *input);
+static void HgfsServerFsync(HgfsInputParam *input);
+static void HgfsServerAccessCheck(HgfsInputParam *input);
+static void HgfsServerQueryChanges(HgfsInputParam *input);
 
 
 /*
@@ -456,6 +631,43 @@ HgfsServerSessionPut(HgfsSessionInfo *session)   // IN: session context
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsServerOplockSessionGet --
+ *
+ *      Increment session reference count unless the session is already
+ *      being closed. Used to send oplock breaks from the break thread, which
+ *      does not own a reference.
+ *
+ * Results:
+ *      TRUE if a reference was taken, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsServerOplockSessionGet(HgfsSessionInfo *session)   // IN: session context
+{
+   uint32 refCount;
+
+   ASSERT(session);
+
+   do {
+      refCount = Atomic_Read(&session->refCount);
+      if (0 == refCount) {
+         return FALSE;
+      }
+   } while (Atomic_ReadIfEqualWrite(&session->refCount, refCount,
+                                    refCount + 1) != refCount);
+
+   return TRUE;
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -579,6 +791,72 @@ HgfsServerGetNextHandleCounter(void)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerInitSlotHandle --
+ *
+ *    Compute the initial handle of a newly allocated node or search slot.
+ *    The generation is seeded from the checkpointed handle counter so that
+ *    handles do not collide with those handed out before a restore.
+ *
+ * Results:
+ *    The slot handle. It is only handed out once the slot is in use.
+ *
+ * Side effects:
+ *    Advances the handle counter.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsHandle
+HgfsServerInitSlotHandle(uint32 index,     // IN: slot index in the array
+                         uint32 typeFlag)  // IN: 0 or HGFS_HANDLE_SEARCH_FLAG
+{
+   HgfsHandle handle;
+
+   ASSERT(index < HGFS_HANDLE_MAX_SLOTS);
+
+   handle = (HgfsServerGetNextHandleCounter() << HGFS_HANDLE_GENERATION_SHIFT) |
+            typeFlag | index;
+   if (handle == HGFS_INVALID_HANDLE) {
+      handle &= ~(1U << HGFS_HANDLE_GENERATION_SHIFT);
+   }
+
+   return handle;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerNextSlotHandle --
+ *
+ *    Compute the handle for the next use of a node or search slot by bumping
+ *    the generation of the handle the slot previously had.
+ *
+ * Results:
+ *    The new handle for the slot.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsHandle
+HgfsServerNextSlotHandle(HgfsHandle prevHandle)  // IN: previous slot handle
+{
+   HgfsHandle handle = prevHandle + (1U << HGFS_HANDLE_GENERATION_SHIFT);
+
+   if (handle == HGFS_INVALID_HANDLE) {
+      handle += 1U << HGFS_HANDLE_GENERATION_SHIFT;
+   }
+
+   return handle;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -604,21 +882,22 @@ static HgfsFileNode *
 HgfsHandle2FileNode(HgfsHandle handle,        // IN: Hgfs file handle
                     HgfsSessionInfo *session) // IN: Session info
 {
-   unsigned int i;
-   HgfsFileNode *fileNode = NULL;
+   uint32 index = HGFS_HANDLE_INDEX(handle);
+   HgfsFileNode *fileNode;
 
    ASSERT(session);
    ASSERT(session->nodeArray);
 
-   /* XXX: This O(n) lookup can and should be optimized. */
-   for (i = 0; i < session->numNodes; i++) {
-      if (session->nodeArray[i].state != FILENODE_STATE_UNUSED &&
-          session->nodeArray[i].handle == handle) {
-         fileNode = &session->nodeArray[i];
-         break;
-      }
+   if (index >= session->numNodes) {
+      return NULL;
+   }
+
+   fileNode = &session->nodeArray[index];
+   if (fileNode->state == FILENODE_STATE_UNUSED || fileNode->handle != handle) {
+      return NULL;
    }
 
+   HgfsServerStats_SetShare(fileNode->shareName, fileNode->shareNameLen);
    return fileNode;
 }
 
@@ -718,7 +997,7 @@ HgfsHandle2FileDesc(HgfsHandle handle,        // IN: Hgfs file handle
    Bool found = FALSE;
    HgfsFileNode *fileNode = NULL;
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForRead(session->nodeArrayLock);
    fileNode = HgfsHandle2FileNode(handle, session);
    if (fileNode == NULL) {
       goto exit;
@@ -731,7 +1010,7 @@ HgfsHandle2FileDesc(HgfsHandle handle,        // IN: Hgfs file handle
    found = TRUE;
 
 exit:
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    return found;
 }
@@ -763,7 +1042,7 @@ HgfsHandle2AppendFlag(HgfsHandle handle,        // IN: Hgfs file handle
    Bool found = FALSE;
    HgfsFileNode *fileNode = NULL;
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForRead(session->nodeArrayLock);
    fileNode = HgfsHandle2FileNode(handle, session);
    if (fileNode == NULL) {
       goto exit;
@@ -773,7 +1052,7 @@ HgfsHandle2AppendFlag(HgfsHandle handle,        // IN: Hgfs file handle
    found = TRUE;
 
 exit:
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    return found;
 }
@@ -807,7 +1086,7 @@ HgfsHandle2LocalId(HgfsHandle handle,        // IN: Hgfs file handle
 
    ASSERT(localId);
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForRead(session->nodeArrayLock);
    fileNode = HgfsHandle2FileNode(handle, session);
    if (fileNode == NULL) {
       goto exit;
@@ -819,7 +1098,7 @@ HgfsHandle2LocalId(HgfsHandle handle,        // IN: Hgfs file handle
    found = TRUE;
 
 exit:
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    return found;
 }
@@ -854,7 +1133,7 @@ HgfsFileDesc2Handle(fileDesc fd,              // IN: OS handle (file descriptor)
    ASSERT(session);
    ASSERT(session->nodeArray);
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForRead(session->nodeArrayLock);
 
    for (i = 0; i < session->numNodes; i++) {
       existingFileNode = &session->nodeArray[i];
@@ -866,7 +1145,7 @@ HgfsFileDesc2Handle(fileDesc fd,              // IN: OS handle (file descriptor)
       }
    }
 
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    return found;
 }
@@ -902,7 +1181,7 @@ HgfsHandle2ShareMode(HgfsHandle handle,         // IN: Hgfs file handle
       return found;
    }
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForRead(session->nodeArrayLock);
 
    existingFileNode = HgfsHandle2FileNode(handle, session);
    if (existingFileNode == NULL) {
@@ -915,7 +1194,7 @@ HgfsHandle2ShareMode(HgfsHandle handle,         // IN: Hgfs file handle
    found = (nameStatus == HGFS_NAME_STATUS_COMPLETE);
 
 exit_unlock:
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    return found;
 }
@@ -985,7 +1264,7 @@ HgfsHandle2FileNameMode(HgfsHandle handle,       // IN: Hgfs file handle
       return found;
    }
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForRead(session->nodeArrayLock);
 
    existingFileNode = HgfsHandle2FileNode(handle, session);
    if (existingFileNode == NULL) {
@@ -1004,7 +1283,7 @@ HgfsHandle2FileNameMode(HgfsHandle handle,       // IN: Hgfs file handle
    found = TRUE;
 
 exit_unlock:
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    *fileName = name;
    *fileNameSize = nameSize;
@@ -1045,21 +1324,23 @@ HgfsHandle2NotifyInfo(HgfsHandle handle,                    // IN: Hgfs file han
    size_t nameSize;
 
    ASSERT(fileName != NULL && fileNameSize != NULL);
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForRead(session->nodeArrayLock);
 
    existingFileNode = HgfsHandle2FileNode(handle, session);
    if (NULL != existingFileNode) {
       nameSize = existingFileNode->utf8NameLen - existingFileNode->shareInfo.rootDirLen;
       name = Util_SafeMalloc(nameSize + 1);
       *folderHandle = existingFileNode->shareInfo.handle;
-      memcpy(name, existingFileNode->utf8Name, nameSize);
+      memcpy(name,
+             existingFileNode->utf8Name + existingFileNode->shareInfo.rootDirLen,
+             nameSize);
       name[nameSize] = '\0';
       *fileName = name;
       *fileNameSize = nameSize;
       found = TRUE;
    }
 
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    return found;
 }
@@ -1095,7 +1376,7 @@ HgfsGetNodeCopy(HgfsHandle handle,        // IN: Hgfs file handle
 
    ASSERT(copy);
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForRead(session->nodeArrayLock);
 
    original = HgfsHandle2FileNode(handle, session);
    if (original == NULL) {
@@ -1126,7 +1407,7 @@ HgfsGetNodeCopy(HgfsHandle handle,        // IN: Hgfs file handle
    found = TRUE;
 
 exit:
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    return found;
 }
@@ -1159,7 +1440,7 @@ HgfsHandleIsSequentialOpen(HgfsHandle handle,        // IN:  Hgfs file handle
 
    ASSERT(sequentialOpen);
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForRead(session->nodeArrayLock);
 
    node = HgfsHandle2FileNode(handle, session);
    if (node == NULL) {
@@ -1170,7 +1451,7 @@ HgfsHandleIsSequentialOpen(HgfsHandle handle,        // IN:  Hgfs file handle
    success = TRUE;
 
 exit:
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    return success;
 }
@@ -1203,7 +1484,7 @@ HgfsHandleIsSharedFolderOpen(HgfsHandle handle,        // IN:  Hgfs file handle
 
    ASSERT(sharedFolderOpen);
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForRead(session->nodeArrayLock);
 
    node = HgfsHandle2FileNode(handle, session);
    if (node == NULL) {
@@ -1214,7 +1495,7 @@ HgfsHandleIsSharedFolderOpen(HgfsHandle handle,        // IN:  Hgfs file handle
    success = TRUE;
 
 exit:
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    return success;
 }
@@ -1247,7 +1528,7 @@ HgfsUpdateNodeFileDesc(HgfsHandle handle,        // IN: Hgfs file handle
    HgfsFileNode *node;
    Bool updated = FALSE;
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForWrite(session->nodeArrayLock);
 
    node = HgfsHandle2FileNode(handle, session);
    if (node == NULL) {
@@ -1259,7 +1540,7 @@ HgfsUpdateNodeFileDesc(HgfsHandle handle,        // IN: Hgfs file handle
    updated = TRUE;
 
 exit:
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    return updated;
 }
@@ -1295,7 +1576,7 @@ HgfsUpdateNodeServerLock(fileDesc fd,                // IN: OS handle
    ASSERT(session);
    ASSERT(session->nodeArray);
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForWrite(session->nodeArrayLock);
 
    for (i = 0; i < session->numNodes; i++) {
       existingFileNode = &session->nodeArray[i];
@@ -1308,7 +1589,7 @@ HgfsUpdateNodeServerLock(fileDesc fd,                // IN: OS handle
       }
    }
 
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    return updated;
 }
@@ -1339,7 +1620,7 @@ HgfsUpdateNodeAppendFlag(HgfsHandle handle,        // IN: Hgfs file handle
    HgfsFileNode *node;
    Bool updated = FALSE;
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForWrite(session->nodeArrayLock);
 
    node = HgfsHandle2FileNode(handle, session);
    if (node == NULL) {
@@ -1352,7 +1633,7 @@ HgfsUpdateNodeAppendFlag(HgfsHandle handle,        // IN: Hgfs file handle
    updated = TRUE;
 
 exit:
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    return updated;
 }
@@ -1480,8 +1761,8 @@ HgfsDumpAllSearches(HgfsSessionInfo *session)   // IN: session info
  *    initializes it appropriately, adds the new entries to the
  *    free list, and then returns one off the free list.
  *
- *    The session's nodeArrayLock should be acquired prior to calling this
- *    function.
+ *    The session's nodeArrayLock should be acquired for write prior to
+ *    calling this function.
  *
  * Results:
  *    An unused file node on success
@@ -1518,8 +1799,14 @@ HgfsGetNewNode(HgfsSessionInfo *session)  // IN: session info
          HgfsDumpAllNodes(session);
       }
 
+      if (session->numNodes >= HGFS_HANDLE_MAX_SLOTS) {
+         LOG(4, "%s: reached the maximum number of nodes\n", __FUNCTION__);
+
+         return NULL;
+      }
+
       /* Try to get twice as much memory as we had */
-      newNumNodes = 2 * session->numNodes;
+      newNumNodes = MIN(2 * session->numNodes, HGFS_HANDLE_MAX_SLOTS);
       newMem = (HgfsFileNode *)realloc(session->nodeArray,
                                        newNumNodes * sizeof *(session->nodeArray));
       if (!newMem) {
@@ -1576,9 +1863,13 @@ HgfsGetNewNode(HgfsSessionInfo *session)  // IN: session info
          DblLnkLst_Init(&newMem[i].links);
 
          newMem[i].state = FILENODE_STATE_UNUSED;
+         newMem[i].handle = HgfsServerInitSlotHandle(i, 0);
          newMem[i].utf8Name = NULL;
          newMem[i].utf8NameLen = 0;
          newMem[i].fileCtx = NULL;
+         newMem[i].readAheadWindow = 0;
+         Atomic_WriteBool(&newMem[i].cacheReferenced, FALSE);
+         Atomic_Write(&newMem[i].fdUsers, 0);
 
          /* Append at the end of the list */
          DblLnkLst_LinkLast(&session->nodeFreeList, &newMem[i].links);
@@ -1607,8 +1898,8 @@ HgfsGetNewNode(HgfsSessionInfo *session)  // IN: session info
  *
  *    Free its localname, clear its fields, return it to the free list.
  *
- *    The session's nodeArrayLock should be acquired prior to calling this
- *    function.
+ *    The session's nodeArrayLock should be acquired for write prior to
+ *    calling this function.
  *
  * Results:
  *    None
@@ -1642,14 +1933,19 @@ HgfsRemoveFileNode(HgfsFileNode *node,        // IN: file node
    node->state = FILENODE_STATE_UNUSED;
    ASSERT(node->fileCtx == NULL);
    node->fileCtx = NULL;
+   Atomic_Write(&node->fdUsers, 0);
+
+   ASSERT(session->readAheadBytes >= node->readAheadWindow);
+   session->readAheadBytes -= node->readAheadWindow;
+   node->readAheadWindow = 0;
 
    if (node->shareInfo.rootDir) {
       free((void*)node->shareInfo.rootDir);
       node->shareInfo.rootDir = NULL;
    }
 
-   /* Prepend at the beginning of the list */
-   DblLnkLst_LinkFirst(&session->nodeFreeList, &node->links);
+   /* Append at the end of the list so that slots are reused in turn. */
+   DblLnkLst_LinkLast(&session->nodeFreeList, &node->links);
 }
 
 
@@ -1660,8 +1956,8 @@ HgfsRemoveFileNode(HgfsFileNode *node,        // IN: file node
  *
  *    Free its localname, clear its fields, return it to the free list.
  *
- *    The session's nodeArrayLock should be acquired prior to calling this
- *    function.
+ *    The session's nodeArrayLock should be acquired for write prior to
+ *    calling this function.
  *
  * Results:
  *    None
@@ -1704,9 +2000,9 @@ static void
 HgfsFreeFileNode(HgfsHandle handle,         // IN: Handle to free
                  HgfsSessionInfo *session)  // IN: Session info
 {
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForWrite(session->nodeArrayLock);
    HgfsFreeFileNodeInternal(handle, session);
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 }
 
 
@@ -1718,8 +2014,8 @@ HgfsFreeFileNode(HgfsHandle handle,         // IN: Handle to free
  *    Gets a free node off the free list, sets its name, localId info,
  *    file descriptor and permissions.
  *
- *    The session's nodeArrayLock should be acquired prior to calling this
- *    function.
+ *    The session's nodeArrayLock should be acquired for write prior to
+ *    calling this function.
  *
  * Results:
  *    A pointer to the newly added node on success
@@ -1800,7 +2096,7 @@ HgfsAddNewFileNode(HgfsFileOpenInfo *openInfo,  // IN: open info struct
    rootDir[newNode->shareInfo.rootDirLen] = '\0';
    newNode->shareInfo.rootDir = rootDir;
 
-   newNode->handle = HgfsServerGetNextHandleCounter();
+   newNode->handle = HgfsServerNextSlotHandle(newNode->handle);
    newNode->localId = *localId;
    newNode->fileDesc = fileDesc;
    newNode->shareAccess = (openInfo->mask & HGFS_OPEN_VALID_SHARE_ACCESS) ?
@@ -1817,6 +2113,10 @@ HgfsAddNewFileNode(HgfsFileOpenInfo *openInfo,  // IN: open info struct
       newNode->flags |= HGFS_FILE_NODE_SEQUENTIAL_FL;
    }
 
+   newNode->readAheadNextOffset = 0;
+   newNode->readAheadEnd = 0;
+   ASSERT(newNode->readAheadWindow == 0);
+
    newNode->serverLock = openInfo->acquiredLock;
    newNode->state = FILENODE_STATE_IN_USE_NOT_CACHED;
    newNode->shareInfo.readPermissions = openInfo->shareInfo.readPermissions;
@@ -1829,6 +2129,44 @@ HgfsAddNewFileNode(HgfsFileOpenInfo *openInfo,  // IN: open info struct
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCacheHasUsedNode --
+ *
+ *    Check if the file descriptor of a cached node is in use by a request,
+ *    see HgfsGetCachedNode.
+ *
+ *    The session's nodeArrayLock should be acquired for write prior to
+ *    calling this function.
+ *
+ * Results:
+ *    TRUE if a cached node is in use.
+ *    FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsCacheHasUsedNode(HgfsSessionInfo *session)  // IN: session info
+{
+   DblLnkLst_Links *link;
+
+   DblLnkLst_ForEach(link, &session->nodeCachedList) {
+      HgfsFileNode *node = DblLnkLst_Container(link, HgfsFileNode, links);
+
+      if (Atomic_Read(&node->fdUsers) != 0) {
+         return TRUE;
+      }
+   }
+
+   return FALSE;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1838,8 +2176,8 @@ HgfsAddNewFileNode(HgfsFileOpenInfo *openInfo,  // IN: open info struct
  *    the maximum number of entries then the first node is removed. The
  *    first node should be the least recently used.
  *
- *    The session's nodeArrayLock should be acquired prior to calling this
- *    function.
+ *    The session's nodeArrayLock should be acquired for write prior to
+ *    calling this function.
  *
  * Results:
  *    TRUE on success
@@ -1864,21 +2202,23 @@ HgfsAddToCacheInternal(HgfsHandle handle,         // IN: HGFS file handle
       return TRUE;
    }
 
-   /* Remove the LRU node if the list is full. */
-   if (session->numCachedOpenNodes == gHgfsCfgSettings.maxCachedOpenNodes) {
-      if (!HgfsRemoveLruNode(session)) {
-         LOG(4, "%s: Unable to remove LRU node from cache.\n", __FUNCTION__);
+   /*
+    * Remove the LRU node if the list is full. If every cached node is in use
+    * by a request, the cache grows past the limit until they are done.
+    */
+   if (session->numCachedOpenNodes >= gHgfsCfgSettings.maxCachedOpenNodes &&
+       !HgfsRemoveLruNode(session) &&
+       !HgfsCacheHasUsedNode(session)) {
+      LOG(4, "%s: Unable to remove LRU node from cache.\n", __FUNCTION__);
 
-         return FALSE;
-      }
+      return FALSE;
    }
 
-   ASSERT(session->numCachedOpenNodes < gHgfsCfgSettings.maxCachedOpenNodes);
-
    node = HgfsHandle2FileNode(handle, session);
    ASSERT(node);
    /* Append at the end of the list. */
    DblLnkLst_LinkLast(&session->nodeCachedList, &node->links);
+   Atomic_WriteBool(&node->cacheReferenced, FALSE);
 
    node->state = FILENODE_STATE_IN_USE_CACHED;
    session->numCachedOpenNodes++;
@@ -1909,8 +2249,8 @@ HgfsAddToCacheInternal(HgfsHandle handle,         // IN: HGFS file handle
  *    file descriptor. If the node was not already in the cache then nothing
  *    is done.
  *
- *    The session's nodeArrayLock should be acquired prior to calling this
- *    function.
+ *    The session's nodeArrayLock should be acquired for write prior to
+ *    calling this function.
  *
  * Results:
  *    TRUE on success
@@ -1957,6 +2297,12 @@ HgfsRemoveFromCacheInternal(HgfsHandle handle,        // IN: Hgfs handle to the
        * Instead, we'll just await the lobotomization of the node cache to
        * really fix this.
        */
+      HgfsServerWriteBehindFlush(handle, FALSE, session);
+      if (node->serverLock != HGFS_LOCK_NONE) {
+         HgfsPlatformDowngradeOplock(node->fileDesc, HGFS_LOCK_NONE);
+         node->serverLock = HGFS_LOCK_NONE;
+         session->numCachedLockedNodes--;
+      }
       if (HgfsPlatformCloseFile(node->fileDesc, node->fileCtx)) {
          LOG(4, "%s: Could not close fd %u\n", __FUNCTION__, node->fileDesc);
 
@@ -1964,14 +2310,6 @@ HgfsRemoveFromCacheInternal(HgfsHandle handle,        // IN: Hgfs handle to the
       }
       node->fileCtx = NULL;
 
-     /*
-      * If we have just removed the node then the number of used nodes better
-      * be less than the max. If we didn't remove a node, it means the
-      * node we tried to remove was not in the cache to begin with, and
-      * we have a problem (see bug 36244).
-      */
-
-      ASSERT(session->numCachedOpenNodes < gHgfsCfgSettings.maxCachedOpenNodes);
    }
 
    return TRUE;
@@ -1984,11 +2322,11 @@ HgfsRemoveFromCacheInternal(HgfsHandle handle,        // IN: Hgfs handle to the
  * HgfsIsCachedInternal --
  *
  *    Check if the node exists in the cache. If the node is found in
- *    the cache then move it to the end of the list. Most recently
- *    used nodes move towards the end of the list.
+ *    the cache then mark it referenced, so that HgfsRemoveLruNode moves
+ *    it to the end of the list instead of evicting it.
  *
- *    The session nodeArrayLock should be acquired prior to calling this
- *    function.
+ *    The session nodeArrayLock should be acquired for read or write prior
+ *    to calling this function.
  *
  * Results:
  *    TRUE if the node is found in the cache.
@@ -2017,10 +2355,12 @@ HgfsIsCachedInternal(HgfsHandle handle,         // IN: Structure representing fi
 
    if (node->state == FILENODE_STATE_IN_USE_CACHED) {
       /*
-       * Move this node to the end of the list.
+       * Moving the node would need the lock for write, the LRU scan moves
+       * it to the end of the list later.
        */
-      DblLnkLst_Unlink1(&node->links);
-      DblLnkLst_LinkLast(&session->nodeCachedList, &node->links);
+      if (!Atomic_ReadBool(&node->cacheReferenced)) {
+         Atomic_WriteBool(&node->cacheReferenced, TRUE);
+      }
 
       return TRUE;
    }
@@ -2055,9 +2395,9 @@ HgfsIsServerLockAllowed(HgfsSessionInfo *session)  // IN: session info
 {
    Bool allowed;
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForRead(session->nodeArrayLock);
    allowed = session->numCachedLockedNodes < MAX_LOCKED_FILENODES;
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    return allowed;
 }
@@ -2113,8 +2453,14 @@ HgfsGetNewSearch(HgfsSessionInfo *session)  // IN: session info
          HgfsDumpAllSearches(session);
       }
 
+      if (session->numSearches >= HGFS_HANDLE_MAX_SLOTS) {
+         LOG(4, "%s: reached the maximum number of searches\n", __FUNCTION__);
+
+         return NULL;
+      }
+
       /* Try to get twice as much memory as we had */
-      newNumSearches = 2 * session->numSearches;
+      newNumSearches = MIN(2 * session->numSearches, HGFS_HANDLE_MAX_SLOTS);
       newMem = (HgfsSearch *)realloc(session->searchArray,
                                      newNumSearches * sizeof *(session->searchArray));
       if (!newMem) {
@@ -2166,14 +2512,15 @@ HgfsGetNewSearch(HgfsSessionInfo *session)  // IN: session info
 
       for (i = session->numSearches; i < newNumSearches; i++) {
          DblLnkLst_Init(&newMem[i].links);
+         newMem[i].handle = HgfsServerInitSlotHandle(i, HGFS_HANDLE_SEARCH_FLAG);
          newMem[i].utf8Dir = NULL;
          newMem[i].utf8DirLen = 0;
          newMem[i].utf8ShareName = NULL;
          newMem[i].utf8ShareNameLen = 0;
          newMem[i].shareInfo.rootDir = NULL;
          newMem[i].shareInfo.rootDirLen = 0;
-         newMem[i].dents = NULL;
-         newMem[i].numDents = 0;
+         HgfsDentArena_Init(&newMem[i].dents);
+         newMem[i].stream = NULL;
 
          /* Append at the end of the list */
          DblLnkLst_LinkLast(&session->searchFreeList, &newMem[i].links);
@@ -2303,8 +2650,8 @@ HgfsGetSearchCopy(HgfsHandle handle,        // IN: Hgfs search handle
    copy->utf8ShareName[copy->utf8ShareNameLen] = '\0';
 
    /* No dents for the copy, they consume too much memory and aren't needed. */
-   copy->dents = NULL;
-   copy->numDents = 0;
+   HgfsDentArena_Init(&copy->dents);
+   copy->stream = NULL;
 
    copy->handle = original->handle;
    copy->type = original->type;
@@ -2356,11 +2703,11 @@ HgfsAddNewSearch(char const *utf8Dir,       // IN: UTF8 name of dir to search in
       return NULL;
    }
 
-   newSearch->dents = NULL;
-   newSearch->numDents = 0;
+   HgfsDentArena_Init(&newSearch->dents);
+   newSearch->stream = NULL;
    newSearch->flags = 0;
    newSearch->type = type;
-   newSearch->handle = HgfsServerGetNextHandleCounter();
+   newSearch->handle = HgfsServerNextSlotHandle(newSearch->handle);
 
    newSearch->utf8DirLen = strlen(utf8Dir);
    newSearch->utf8Dir = Util_SafeStrdup(utf8Dir);
@@ -2382,7 +2729,8 @@ HgfsAddNewSearch(char const *utf8Dir,       // IN: UTF8 name of dir to search in
  *
  * HgfsFreeSearchDirents --
  *
- *    Frees all dirents and dirents pointer array.
+ *    Frees all dirents of the search and closes its directory if it is a
+ *    streaming search.
  *
  *    Caller should hold the session's searchArrayLock.
  *
@@ -2398,15 +2746,11 @@ HgfsAddNewSearch(char const *utf8Dir,       // IN: UTF8 name of dir to search in
 static void
 HgfsFreeSearchDirents(HgfsSearch *search)       // IN/OUT: search
 {
-   unsigned int i;
+   HgfsDentArena_Free(&search->dents);
 
-   if (NULL != search->dents) {
-      for (i = 0; i < search->numDents; i++) {
-         free(search->dents[i]);
-         search->dents[i] = NULL;
-      }
-      free(search->dents);
-      search->dents = NULL;
+   if (NULL != search->stream) {
+      HgfsPlatformSearchStreamClose(search->stream);
+      search->stream = NULL;
    }
 }
 
@@ -2450,8 +2794,8 @@ HgfsRemoveSearchInternal(HgfsSearch *search,       // IN: search
    search->shareInfo.rootDirLen = 0;
    search->shareInfo.rootDir = NULL;
 
-   /* Prepend at the beginning of the list */
-   DblLnkLst_LinkFirst(&session->searchFreeList, &search->links);
+   /* Append at the end of the list so that slots are reused in turn. */
+   DblLnkLst_LinkLast(&session->searchFreeList, &search->links);
 }
 
 
@@ -2612,14 +2956,14 @@ HgfsServerGetDirEntry(HgfsHandle handle,                // IN: Handle to search
       goto out;
    }
 
-   /* No more entries or none. */
-   if (search->dents == NULL) {
+   /* No more entries or none. Streaming searches read entries on demand. */
+   if (0 == search->dents.numDents && NULL == search->stream) {
       goto out;
    }
 
    if (HGFS_SEARCH_LAST_ENTRY_INDEX == index) {
       /* Set the index to the final entry. */
-      index = search->numDents - 1;
+      index = search->dents.numDents - 1;
    }
 
    status = HgfsPlatformGetDirEntry(search,
@@ -2659,21 +3003,22 @@ HgfsSearch *
 HgfsSearchHandle2Search(HgfsHandle handle,         // IN: handle
                         HgfsSessionInfo *session)  // IN: session info
 {
-   unsigned int i;
-   HgfsSearch *search = NULL;
+   uint32 index = HGFS_HANDLE_INDEX(handle);
+   HgfsSearch *search;
 
    ASSERT(session);
    ASSERT(session->searchArray);
 
-   /* XXX: This O(n) lookup can and should be optimized. */
-   for (i = 0; i < session->numSearches; i++) {
-      if (!DblLnkLst_IsLinked(&session->searchArray[i].links) &&
-          session->searchArray[i].handle == handle) {
-         search = &session->searchArray[i];
-         break;
-      }
+   if (index >= session->numSearches) {
+      return NULL;
+   }
+
+   search = &session->searchArray[index];
+   if (DblLnkLst_IsLinked(&search->links) || search->handle != handle) {
+      return NULL;
    }
 
+   HgfsServerStats_SetShare(search->utf8ShareName, search->utf8ShareNameLen);
    return search;
 }
 
@@ -2713,7 +3058,7 @@ HgfsUpdateNodeNames(const char *oldLocalName,  // IN: Name of file to look for
 
    newBufferLen = strlen(newLocalName);
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForWrite(session->nodeArrayLock);
 
    for (i = 0; i < session->numNodes; i++) {
       fileNode = &session->nodeArray[i];
@@ -2739,7 +3084,7 @@ HgfsUpdateNodeNames(const char *oldLocalName,  // IN: Name of file to look for
       }
    }
 
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 }
 
 
@@ -2773,12 +3118,16 @@ HgfsServerClose(HgfsInputParam *input)  // IN: Input params
                               input->op, &file)) {
       LOG(4, "%s: close fh %u\n", __FUNCTION__, file);
 
+      /* Report the data that could not be written once the file is closed. */
+      status = HgfsServerWriteBehindFlush(file, TRUE, input->session);
+
       if (!HgfsRemoveFromCache(file, input->session)) {
          LOG(4, "%s: Could not remove the node from cache.\n", __FUNCTION__);
          status = HGFS_ERROR_INVALID_HANDLE;
       } else {
          HgfsFreeFileNode(file, input->session);
-         if (!HgfsPackCloseReply(input->packet, input->request, input->op,
+         if (status == HGFS_ERROR_SUCCESS &&
+             !HgfsPackCloseReply(input->packet, input->request, input->op,
                                  &replyPayloadSize, input->session)) {
             status = HGFS_ERROR_INTERNAL;
          }
@@ -2842,6 +3191,8 @@ HgfsServerSearchClose(HgfsInputParam *input)  // IN: Input params
 }
 
 
+static void HgfsServerCompound(HgfsInputParam *input);
+
 #define HGFS_SIZEOF_OP(type) (sizeof (type) + sizeof (HgfsRequest))
 
 /* Opcode handlers, indexed by opcode */
@@ -2910,6 +3261,25 @@ static struct {
    { HgfsServerRemoveDirNotifyWatch, sizeof (HgfsRequestRemoveWatchV4),            REQ_SYNC},
    { NULL,                       0,                                                REQ_SYNC}, // No Op notify
    { HgfsServerSearchRead,       sizeof (HgfsRequestSearchReadV4),                 REQ_SYNC},
+   { NULL,                       0,                                                REQ_SYNC}, // No Op open
+   { NULL,                       0,                                                REQ_SYNC}, // No Op enumerate streams
+   { NULL,                       0,                                                REQ_SYNC}, // No Op getattr
+   { NULL,                       0,                                                REQ_SYNC}, // No Op setattr
+   { NULL,                       0,                                                REQ_SYNC}, // No Op delete
+   { NULL,                       0,                                                REQ_SYNC}, // No Op linkmove
+   { NULL,                       0,                                                REQ_SYNC}, // No Op fsctl
+   { HgfsServerAccessCheck,      sizeof (HgfsRequestAccessCheckV4),                REQ_SYNC},
+   { HgfsServerFsync,            sizeof (HgfsRequestFsyncV4),                      REQ_ASYNC},
+   { NULL,                       0,                                                REQ_SYNC}, // No Op query volume
+   { HgfsServerOplockAcquire,    sizeof (HgfsRequestServerLockChangeV2),           REQ_SYNC},
+   { HgfsServerOplockBreakAck,   sizeof (HgfsReplyOplockBreakV4),                  REQ_SYNC},
+   { NULL,                       0,                                                REQ_SYNC}, // No Op lock byte range
+   { NULL,                       0,                                                REQ_SYNC}, // No Op unlock byte range
+   { NULL,                       0,                                                REQ_SYNC}, // No Op query EAs
+   { NULL,                       0,                                                REQ_SYNC}, // No Op set EAs
+   { HgfsServerCompound,         sizeof (HgfsRequestCompoundV4),                   REQ_SYNC},
+   { HgfsServerCopyRange,        sizeof (HgfsRequestCopyRangeV4),                  REQ_ASYNC},
+   { HgfsServerQueryChanges,     sizeof (HgfsRequestQueryChangesV4),               REQ_SYNC},
 
 };
 
@@ -2957,6 +3327,7 @@ HgfsServerInputAllocInit(HgfsPacket *packet,                        // IN: packe
    localParams->op = requestOp;
    localParams->payload = requestOpArgs;
    localParams->payloadSize = requestOpArgsSize;
+   localParams->startNS = Hostinfo_SystemTimerNS();
 
    if (NULL != localParams->payload) {
       localParams->payloadOffset = (char *)localParams->payload -
@@ -2989,6 +3360,7 @@ HgfsServerInputExit(HgfsInputParam *params)                        // IN: packet
       HgfsServerSessionPut(params->session);
    }
    HgfsServerTransportSessionPut(params->transportSession);
+   HgfsServerStats_EndRequest(&params->statsShare);
    free(params);
 }
 
@@ -3186,6 +3558,47 @@ HgfsServerGetReplyHeaderSize(Bool sessionEnabled,     // IN: session based reque
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerRecordStats --
+ *
+ *    Records a completed request in the server statistics.
+ *
+ *    Data carried in the data packet is counted as received for writes and
+ *    as sent for all other operations.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerRecordStats(HgfsInternalStatus status,   // IN: Status of the request
+                      size_t replySize,            // IN: size of the reply
+                      HgfsInputParam *input)       // IN: request context
+{
+   uint64 bytesIn = input->requestSize;
+   uint64 bytesOut = replySize;
+
+   if (NULL != input->packet) {
+      if (HGFS_OP_WRITE_FAST_V4 == input->op) {
+         bytesIn += input->packet->dataPacketDataSize;
+      } else {
+         bytesOut += input->packet->dataPacketDataSize;
+      }
+   }
+
+   HgfsServerStats_RequestDone(input->op, input->statsShare,
+                               HGFS_ERROR_SUCCESS != status, input->startNS,
+                               bytesIn, bytesOut);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -3227,6 +3640,21 @@ HgfsServerCompleteRequest(HgfsInternalStatus status,   // IN: Status of the requ
    replyHeaderSize = HgfsServerGetReplyHeaderSize(input->sessionEnabled,
                                                   input->op);
 
+   HgfsServerRecordStats(status, replyHeaderSize + replyPayloadSize, input);
+
+   if (NULL != input->compoundReply) {
+      /* A compound sub-request: the reply is sent with the compound reply. */
+      input->compoundReply->status = status;
+      if (HGFS_ERROR_SUCCESS == status && 0 != replyPayloadSize) {
+         input->compoundReply->reply = Util_SafeMalloc(replyPayloadSize);
+         memcpy(input->compoundReply->reply,
+                (char *)input->packet->replyPacket + replyHeaderSize,
+                replyPayloadSize);
+         input->compoundReply->replySize = replyPayloadSize;
+      }
+      goto exit;
+   }
+
    if (replyHeaderSize != 0) {
       replySize = replyHeaderSize + replyPayloadSize;
    } else {
@@ -3294,6 +3722,7 @@ HgfsServerProcessRequest(void *context)
    }
 
    input->payload = (char *)input->request + input->payloadOffset;
+   HgfsServerStats_BeginRequest(&input->statsShare);
    (*handlers[input->op].handler)(input);
 }
 
@@ -3301,27 +3730,15 @@ HgfsServerProcessRequest(void *context)
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerSessionReceive --
- *
- *    Dispatch an incoming packet (in packetIn) to a handler function.
- *
- *    This function cannot fail; if something goes wrong, it returns
- *    a packet containing only a reply header with error code.
- *
- *    The handler function can send the reply packet either using
- *    HgfsPacketSend helper functions. This function would return error
- *    as a reply if the op handler do not return HGFS_ERROR_SUCCESS.
+ * HgfsServerCompoundOpIsAllowed --
  *
- *    NOTE: If any op handler needs to keep packetIn around for sending replies
- *    at a later point (possibly in a different thread context), it should
- *    make a copy of it. The validity of packetIn for the HGFS server is only
- *    within the scope of this function.
+ *    Checks if an operation can be a sub-request of a compound request.
  *
- *    Definitions of Meta Packet, Data packet can be looked up in
- *    hgfsChannelVmci.c
+ *    Sub-requests cannot use the shared memory data packet, which belongs
+ *    to the compound request, nor change the session.
  *
  * Results:
- *    None
+ *    TRUE if the operation is allowed, FALSE otherwise.
  *
  * Side effects:
  *    None
@@ -3329,17 +3746,491 @@ HgfsServerProcessRequest(void *context)
  *-----------------------------------------------------------------------------
  */
 
-static void
-HgfsServerSessionReceive(HgfsPacket *packet,      // IN: Hgfs Packet
-                         void *clientData)        // IN: session info
+static Bool
+HgfsServerCompoundOpIsAllowed(HgfsOp op)  // IN: sub-request operation
 {
-   HgfsTransportSessionInfo *transportSession = clientData;
-   HgfsInternalStatus status;
-   HgfsInputParam *input = NULL;
+   switch (op) {
+   case HGFS_OP_OPEN_V3:
+   case HGFS_OP_READ_V3:
+   case HGFS_OP_WRITE_V3:
+   case HGFS_OP_CLOSE_V3:
+   case HGFS_OP_SEARCH_OPEN_V3:
+   case HGFS_OP_SEARCH_READ_V3:
+   case HGFS_OP_SEARCH_CLOSE_V3:
+   case HGFS_OP_GETATTR_V3:
+   case HGFS_OP_SETATTR_V3:
+   case HGFS_OP_CREATE_DIR_V3:
+   case HGFS_OP_DELETE_FILE_V3:
+   case HGFS_OP_DELETE_DIR_V3:
+   case HGFS_OP_RENAME_V3:
+   case HGFS_OP_QUERY_VOLUME_INFO_V3:
+   case HGFS_OP_CREATE_SYMLINK_V3:
+      return TRUE;
+   default:
+      return FALSE;
+   }
+}
 
-   ASSERT(transportSession);
 
-   if (transportSession->state == HGFS_SESSION_STATE_CLOSED) {
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCompoundSubRequest --
+ *
+ *    Executes a sub-request of a compound request.
+ *
+ *    The sub-request is processed by its op handler like any request, with
+ *    a private packet holding a copy of its arguments behind a session
+ *    header. HgfsServerCompleteRequest keeps its reply in subReply instead
+ *    of sending it.
+ *
+ * Results:
+ *    None, the status and reply are returned in subReply.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerCompoundSubRequest(HgfsInputParam *input,              // IN: compound request
+                             const HgfsCompoundSubRequest *sub,  // IN: sub-request
+                             const HgfsHandle *relatedHandle,    // IN: handle or NULL
+                             void *replyBuf,                     // IN: reply buffer
+                             size_t replyBufSize,                // IN: its size
+                             HgfsCompoundSubReply *subReply)     // OUT: sub-reply
+{
+   HgfsPacket subPacket;
+   HgfsInputParam *subInput;
+   HgfsHeader *header;
+   size_t subRequestSize = sizeof *header + sub->argsSize;
+
+   subReply->op = sub->op;
+   subReply->status = HGFS_ERROR_SUCCESS;
+   subReply->reply = NULL;
+   subReply->replySize = 0;
+
+   if (!HgfsServerCompoundOpIsAllowed(sub->op) ||
+       subRequestSize < handlers[sub->op].minReqSize) {
+      LOG(4, "%s: Invalid sub-request op %d size %"FMTSZ"u\n", __FUNCTION__,
+          sub->op, sub->argsSize);
+      subReply->status = HGFS_ERROR_PROTOCOL;
+      return;
+   }
+
+   if (0 != (sub->flags & HGFS_COMPOUND_FLAG_RELATED_HANDLE)) {
+      if (NULL == relatedHandle) {
+         LOG(4, "%s: No handle for related op %d\n", __FUNCTION__, sub->op);
+         subReply->status = HGFS_ERROR_INVALID_HANDLE;
+         return;
+      }
+      if (sub->argsSize < sizeof *relatedHandle ||
+          sub->handleOffset > sub->argsSize - sizeof *relatedHandle) {
+         LOG(4, "%s: Invalid handle offset %u\n", __FUNCTION__,
+             sub->handleOffset);
+         subReply->status = HGFS_ERROR_PROTOCOL;
+         return;
+      }
+   }
+
+   header = Util_SafeMalloc(subRequestSize);
+   memset(header, 0, sizeof *header);
+   header->version = HGFS_HEADER_VERSION;
+   header->dummy = HGFS_OP_NEW_HEADER;
+   header->packetSize = (uint32)subRequestSize;
+   header->headerSize = sizeof *header;
+   header->requestId = input->id;
+   header->op = sub->op;
+   header->flags = HGFS_PACKET_FLAG_REQUEST;
+   header->sessionId = input->session->sessionId;
+   memcpy(header + 1, sub->args, sub->argsSize);
+   if (0 != (sub->flags & HGFS_COMPOUND_FLAG_RELATED_HANDLE)) {
+      memcpy((char *)(header + 1) + sub->handleOffset, relatedHandle,
+             sizeof *relatedHandle);
+   }
+
+   /* No data packet, sub-requests carry their data inline. */
+   memset(&subPacket, 0, sizeof subPacket);
+   subPacket.id = input->packet->id;
+   subPacket.metaPacketSize = subRequestSize;
+   subPacket.metaPacketDataSize = subRequestSize;
+   subPacket.replyPacket = replyBuf;
+   subPacket.replyPacketSize = replyBufSize;
+
+   /* The references are dropped when the sub-request completes. */
+   HgfsServerTransportSessionGet(input->transportSession);
+   HgfsServerSessionGet(input->session);
+   HgfsServerInputAllocInit(&subPacket,
+                            input->transportSession,
+                            input->session,
+                            header,
+                            subRequestSize,
+                            TRUE,
+                            input->id,
+                            sub->op,
+                            sub->argsSize,
+                            header + 1,
+                            &subInput);
+   subInput->compoundReply = subReply;
+
+   ASSERT(REQ_SYNC == handlers[sub->op].reqType);
+   HgfsServerStats_BeginRequest(&subInput->statsShare);
+   (*handlers[sub->op].handler)(subInput);
+
+   free(header);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCompoundCloseHandle --
+ *
+ *    Closes the handle returned by a successful open or search open
+ *    sub-request whose reply is discarded, since the client never learns
+ *    about it.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerCompoundCloseHandle(const HgfsCompoundSubReply *subReply,  // IN: sub-reply
+                              HgfsSessionInfo *session)              // IN: session
+{
+   HgfsHandle handle;
+
+   if (HGFS_ERROR_SUCCESS != subReply->status ||
+       !HgfsUnpackCompoundReplyHandle(subReply->op, subReply->reply,
+                                      subReply->replySize, &handle)) {
+      return;
+   }
+
+   LOG(4, "%s: closing handle %u of op %d\n", __FUNCTION__, handle,
+       subReply->op);
+   if (HGFS_OP_SEARCH_OPEN_V3 == subReply->op) {
+      HgfsRemoveSearch(handle, session);
+   } else if (HgfsRemoveFromCache(handle, session)) {
+      HgfsFreeFileNode(handle, session);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCompound --
+ *
+ *    Handle a Compound request: execute its sub-requests in order until one
+ *    fails, and send all their replies in one reply.
+ *
+ *    A sub-request may use the handle returned by the most recent open or
+ *    search open of the chain.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerCompound(HgfsInputParam *input)  // IN: Input params
+{
+   HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
+   HgfsCompoundSubRequest *subRequests = NULL;
+   HgfsCompoundSubReply *subReplies = NULL;
+   uint32 numSubRequests = 0;
+   uint32 numSubReplies = 0;
+   size_t replyPayloadSize = 0;
+   size_t replyMaxSize;
+   HgfsHandle relatedHandle;
+   Bool relatedHandleValid = FALSE;
+   void *replyBuf = NULL;
+   uint32 i;
+
+   HGFS_ASSERT_INPUT(input);
+
+   if (!input->sessionEnabled ||
+       !HgfsUnpackCompoundRequest(input->payload, input->payloadSize, input->op,
+                                  &subRequests, &numSubRequests)) {
+      LOG(4, "%s: Error: Op %d unpack compound request\n", __FUNCTION__,
+          input->op);
+      status = HGFS_ERROR_PROTOCOL;
+      goto exit;
+   }
+
+   /* Any reply of a sub-request fits in a packet, so it fits here too. */
+   replyMaxSize = input->session->maxPacketSize;
+   replyBuf = Util_SafeMalloc(replyMaxSize);
+   subReplies = Util_SafeCalloc(numSubRequests, sizeof *subReplies);
+
+   for (i = 0; i < numSubRequests; i++) {
+      HgfsCompoundSubReply *subReply = &subReplies[numSubReplies++];
+
+      HgfsServerCompoundSubRequest(input, &subRequests[i],
+                                   relatedHandleValid ? &relatedHandle : NULL,
+                                   replyBuf, replyMaxSize, subReply);
+
+      /* All the replies must fit in the compound reply. */
+      if (sizeof (HgfsHeader) +
+          HgfsPackCalculateCompoundReplySize(subReplies, numSubReplies) >
+          replyMaxSize) {
+         LOG(4, "%s: Reply %u of op %d does not fit\n", __FUNCTION__, i,
+             subReply->op);
+         HgfsServerCompoundCloseHandle(subReply, input->session);
+         free(subReply->reply);
+         subReply->reply = NULL;
+         subReply->replySize = 0;
+         subReply->status = HGFS_ERROR_NOT_ENOUGH_MEMORY;
+         if (sizeof (HgfsHeader) +
+             HgfsPackCalculateCompoundReplySize(subReplies, numSubReplies) >
+             replyMaxSize) {
+            numSubReplies--;
+         }
+      }
+
+      if (HGFS_ERROR_SUCCESS != subReply->status) {
+         break;
+      }
+
+      if (HgfsUnpackCompoundReplyHandle(subReply->op, subReply->reply,
+                                        subReply->replySize, &relatedHandle)) {
+         relatedHandleValid = TRUE;
+      }
+   }
+
+   if (!HgfsPackCompoundReply(input->packet, input->request, input->op,
+                              subReplies, numSubReplies, &replyPayloadSize,
+                              input->session)) {
+      status = HGFS_ERROR_INTERNAL;
+   }
+
+exit:
+   if (NULL != subReplies) {
+      for (i = 0; i < numSubRequests; i++) {
+         free(subReplies[i].reply);
+      }
+      free(subReplies);
+   }
+   free(subRequests);
+   free(replyBuf);
+
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerGetRequestFile --
+ *
+ *    Get the file handle an asynchronous request is for and the amount of
+ *    data it transfers.
+ *
+ * Results:
+ *    The file handle, HGFS_INVALID_HANDLE if the request is not for a file
+ *    handle or cannot be unpacked.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsHandle
+HgfsServerGetRequestFile(HgfsInputParam *input,  // IN: request params
+                         uint64 *bytes)          // OUT: bytes transferred
+{
+   HgfsHandle file = HGFS_INVALID_HANDLE;
+   HgfsHandle srcFile;
+   uint64 offset;
+   uint64 srcOffset;
+   uint64 copyLength;
+   uint32 length;
+   HgfsWriteFlags flags;
+   const void *data;
+   Bool dataOnly;
+   Bool unpacked;
+
+   switch (input->op) {
+   case HGFS_OP_READ_FAST_V4:
+      unpacked = HgfsUnpackReadRequest(input->payload, input->payloadSize,
+                                       input->op, &file, &offset, &length);
+      break;
+   case HGFS_OP_WRITE_FAST_V4:
+      unpacked = HgfsUnpackWriteRequest(input->payload, input->payloadSize,
+                                        input->op, &file, &offset, &length,
+                                        &flags, &data);
+      break;
+   case HGFS_OP_COPY_RANGE_V4:
+      /* Copies are ordered with the writes to the destination. */
+      unpacked = HgfsUnpackCopyRangeRequest(input->payload, input->payloadSize,
+                                            input->op, &srcFile, &srcOffset,
+                                            &file, &offset, &copyLength);
+      break;
+   case HGFS_OP_FSYNC_V4:
+      /* The writes received before the fsync must be done before it. */
+      unpacked = HgfsUnpackFsyncRequest(input->payload, input->payloadSize,
+                                        input->op, &file, &dataOnly);
+      break;
+   default:
+      unpacked = FALSE;
+      break;
+   }
+
+   if (!unpacked) {
+      *bytes = 0;
+      return HGFS_INVALID_HANDLE;
+   }
+
+   switch (input->op) {
+   case HGFS_OP_READ_FAST_V4:
+   case HGFS_OP_WRITE_FAST_V4:
+      *bytes = length;
+      break;
+   case HGFS_OP_COPY_RANGE_V4:
+      *bytes = copyLength;
+      break;
+   default:
+      *bytes = 0;
+      break;
+   }
+
+   return file;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerGetRequestOrderKey --
+ *
+ *    Get the key used to order an asynchronous request with respect to the
+ *    other requests of the session: requests for the same file handle share
+ *    the key and must be processed in the order they were received.
+ *
+ * Results:
+ *    The order key, HGFS_THREADPOOL_NO_ORDER_KEY if the request does not
+ *    need to be ordered.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+HgfsServerGetRequestOrderKey(HgfsInputParam *input,  // IN: request params
+                             HgfsHandle file)        // IN: handle of request
+{
+   if (file == HGFS_INVALID_HANDLE) {
+      return HGFS_THREADPOOL_NO_ORDER_KEY;
+   }
+
+   /* Handles are per session, so tie the key to the session too. */
+   return ((uint64)(uintptr_t)input->session << 32) ^ ((uint64)file + 1);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerThrottleRequest --
+ *
+ *    Charge an asynchronous request to the share of its file handle.
+ *
+ * Results:
+ *    The delay in milliseconds before the request may be processed.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsServerThrottleRequest(HgfsInputParam *input,  // IN: request params
+                          HgfsHandle file,        // IN: handle of request
+                          uint64 bytes,           // IN: bytes transferred
+                          Bool bulk)              // IN: bulk transfer
+{
+   HgfsSessionInfo *session = input->session;
+   HgfsFileNode *fileNode;
+   uint32 delayMs = 0;
+
+   if (!gHgfsThrottleActive || file == HGFS_INVALID_HANDLE) {
+      return 0;
+   }
+
+   MXUser_AcquireForRead(session->nodeArrayLock);
+   fileNode = HgfsHandle2FileNode(file, session);
+   if (NULL != fileNode) {
+      delayMs = HgfsServerThrottle_Charge(fileNode->shareName,
+                                          fileNode->shareNameLen, bytes,
+                                          bulk);
+   }
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
+
+   return delayMs;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerSessionReceive --
+ *
+ *    Dispatch an incoming packet (in packetIn) to a handler function.
+ *
+ *    This function cannot fail; if something goes wrong, it returns
+ *    a packet containing only a reply header with error code.
+ *
+ *    The handler function can send the reply packet either using
+ *    HgfsPacketSend helper functions. This function would return error
+ *    as a reply if the op handler do not return HGFS_ERROR_SUCCESS.
+ *
+ *    NOTE: If any op handler needs to keep packetIn around for sending replies
+ *    at a later point (possibly in a different thread context), it should
+ *    make a copy of it. The validity of packetIn for the HGFS server is only
+ *    within the scope of this function.
+ *
+ *    Definitions of Meta Packet, Data packet can be looked up in
+ *    hgfsChannelVmci.c
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerSessionReceive(HgfsPacket *packet,      // IN: Hgfs Packet
+                         void *clientData)        // IN: session info
+{
+   HgfsTransportSessionInfo *transportSession = clientData;
+   HgfsInternalStatus status;
+   HgfsInputParam *input = NULL;
+   HgfsHandle file;
+   uint64 orderKey;
+   uint64 bytes;
+   uint32 delayMs;
+   Bool bulk;
+
+   ASSERT(transportSession);
+
+   if (transportSession->state == HGFS_SESSION_STATE_CLOSED) {
       LOG(4, "%s: %d: Received packet after disconnected.\n", __FUNCTION__,
           __LINE__);
       return;
@@ -3377,7 +4268,18 @@ HgfsServerSessionReceive(HgfsPacket *packet,      // IN: Hgfs Packet
          }
          if (0 != (packet->state & HGFS_STATE_ASYNC_REQUEST)) {
             LOG(4, "%s: %d: @@Async\n", __FUNCTION__, __LINE__);
-#ifndef VMX86_TOOLS
+            /*
+             * Requests for the same file are queued in order so that they
+             * are not reordered, requests for other files run in parallel.
+             * The key has to be extracted before the mappings are released.
+             * Requests over the limits of their share are delayed, and bulk
+             * transfers run after the other requests.
+             */
+            file = HgfsServerGetRequestFile(input, &bytes);
+            orderKey = HgfsServerGetRequestOrderKey(input, file);
+            bulk = bytes > HGFS_BULK_REQUEST_SIZE;
+            delayMs = HgfsServerThrottleRequest(input, file, bytes, bulk);
+
             /*
              * Asynchronous processing is supported by the transport.
              * We can release mappings here and reacquire when needed.
@@ -3387,11 +4289,16 @@ HgfsServerSessionReceive(HgfsPacket *packet,      // IN: Hgfs Packet
             HgfsServerAsyncInfoIncCount(&input->session->asyncRequestsInfo);
 
             if (gHgfsThreadpoolActive) {
-               if (!HgfsThreadpool_QueueWorkItem(HgfsServerProcessRequest, input)) {
+               if (!HgfsThreadpool_QueueThrottledWorkItem(HgfsServerProcessRequest,
+                                                          orderKey,
+                                                          delayMs,
+                                                          bulk,
+                                                          input)) {
                   LOG(4, "%s: %d: failed to queue item.\n", __FUNCTION__, __LINE__);
                   HgfsServerProcessRequest(input);
                }
             } else {
+#ifndef VMX86_TOOLS
                 /* Remove pending requests during poweroff. */
                 Poll_Callback(POLL_CS_MAIN,
                               POLL_FLAG_REMOVE_AT_POWEROFF,
@@ -3400,11 +4307,11 @@ HgfsServerSessionReceive(HgfsPacket *packet,      // IN: Hgfs Packet
                               POLL_REALTIME,
                               1000,
                               NULL);
-            }
 #else
-            /* Tools code should never process request async. */
-            ASSERT(0);
+                /* Tools code only processes requests async on the threadpool. */
+                HgfsServerProcessRequest(input);
 #endif
+            }
          } else {
             LOG(4, "%s: %d: ##Sync\n", __FUNCTION__, __LINE__);
             HgfsServerProcessRequest(input);
@@ -3734,6 +4641,9 @@ HgfsServerShareAddInternal(const char *shareName,   // IN: shared folder name
          shareProps->name = Util_SafeStrdup(shareName);
          DblLnkLst_Init(&shareProps->links);
          DblLnkLst_LinkLast(&gHgfsSharedFoldersList, &shareProps->links);
+
+         /* Index entries cache the notification handle. */
+         HgfsServerShareIndexDrop();
       }
 
       LOG(8, "%s: %s, %s, add hnd %#x\n",__FUNCTION__,
@@ -3936,30 +4846,386 @@ HgfsServerGetShareName(HgfsSharedFolderHandle sharedFolder, // IN: Notify handle
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServer_InitState --
+ * HgfsServerShareIndexEntryFree --
  *
- *    Initialize the global server state
+ *    Hash table free callback for share index entries.
  *
  * Results:
- *    TRUE if succeeded, FALSE if failed.
+ *    None.
  *
  * Side effects:
- *    Memory allocation.
+ *    Closes the share root.
  *
  *-----------------------------------------------------------------------------
  */
 
-Bool
-HgfsServer_InitState(const HgfsServerCallbacks **callbackTable,   // IN/OUT: our callbacks
-                     HgfsServerConfig *serverCfgData,             // IN: configurable settings
-                     HgfsServerMgrCallbacks *serverMgrData)       // IN: mgr callback
+static void
+HgfsServerShareIndexEntryFree(void *data)  // IN: share index entry
 {
-   Bool result = TRUE;
+   HgfsShareIndexEntry *entry = data;
 
-   ASSERT(callbackTable);
+   if (entry->rootFd >= 0) {
+      HgfsPlatformCloseFile(entry->rootFd, NULL);
+   }
+   free(entry->name);
+   free(entry->rootDir);
+   free(entry);
+}
 
-   /* Save any server manager data for logging state updates.*/
-   gHgfsMgrData = serverMgrData;
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerShareIndexBuild --
+ *
+ *    Builds an index of the shares currently exported by the policy.
+ *
+ *    Must be called without the share index lock held.
+ *
+ * Results:
+ *    The new index, NULL if the shares could not be enumerated.
+ *
+ * Side effects:
+ *    Opens the share roots.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsShareIndex *
+HgfsServerShareIndexBuild(void)
+{
+   HgfsShareIndex *index;
+   void *state;
+   Bool done = FALSE;
+
+   state = HgfsServerResEnumInit();
+   if (NULL == state) {
+      LOG(4, "%s: failed to enumerate shares\n", __FUNCTION__);
+      return NULL;
+   }
+
+   index = Util_SafeCalloc(1, sizeof *index);
+   index->shares = HashTable_Alloc(32, HASH_STRING_KEY,
+                                   HgfsServerShareIndexEntryFree);
+   Atomic_Write(&index->refCount, 1);
+
+   while (!done) {
+      char const *shareName;
+      size_t shareNameLen;
+      char const *rootDir;
+      HgfsShareIndexEntry *entry;
+
+      if (!HgfsServerResEnumGet(state, &shareName, &shareNameLen, &done)) {
+         LOG(4, "%s: failed to enumerate shares\n", __FUNCTION__);
+         HashTable_Free(index->shares);
+         free(index);
+         index = NULL;
+         break;
+      }
+      if (done) {
+         break;
+      }
+
+      entry = Util_SafeCalloc(1, sizeof *entry);
+      entry->rootFd = -1;
+      if (HgfsServerPolicy_ProcessCPName(shareName, shareNameLen,
+                                         &entry->readPermissions,
+                                         &entry->writePermissions,
+                                         &entry->handle,
+                                         &rootDir) !=
+             HGFS_NAME_STATUS_COMPLETE ||
+          HgfsServerPolicy_GetShareOptions(shareName, shareNameLen,
+                                           &entry->options) !=
+             HGFS_NAME_STATUS_COMPLETE) {
+         /* Left to the policy, which reports the error to the client. */
+         free(entry);
+         continue;
+      }
+
+      entry->name = Util_SafeStrndup(shareName, shareNameLen);
+      entry->rootDir = Util_SafeStrdup(rootDir);
+      entry->rootDirLen = strlen(entry->rootDir);
+      entry->handle = HgfsServerGetShareHandle(entry->name);
+      entry->rootFd = HgfsPlatformShareRootOpen(entry->rootDir);
+
+      if (!HashTable_Insert(index->shares, entry->name, entry)) {
+         LOG(4, "%s: duplicate share %s\n", __FUNCTION__, entry->name);
+         HgfsServerShareIndexEntryFree(entry);
+      }
+   }
+
+   HgfsServerResEnumExit(state);
+   return index;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerShareIndexPut --
+ *
+ *    Drops a reference to a share index, freeing it with the last one.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Closes the share roots with the last reference.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerShareIndexPut(HgfsShareIndex *index)  // IN: share index
+{
+   if (Atomic_ReadDec32(&index->refCount) == 1) {
+      uint32 i;
+
+      for (i = 0; i < index->numStaleRootFds; i++) {
+         HgfsPlatformCloseFile(index->staleRootFds[i], NULL);
+      }
+      free(index->staleRootFds);
+      HashTable_Free(index->shares);
+      free(index);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerShareIndexReopenRoot --
+ *
+ *    Reopens the root of a share of the index after its path was found to
+ *    refer to another directory than the root the caller got from a lookup.
+ *
+ *    Must be called without the share index lock held.
+ *
+ * Results:
+ *    The current share root, which remains open until the index is put, or
+ *    -1 if the share path can't be opened as a share root anymore.
+ *
+ * Side effects:
+ *    The stale root is closed with the index.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static fileDesc
+HgfsServerShareIndexReopenRoot(HgfsShareIndex *index,  // IN: referenced index
+                               const char *shareName,  // IN: share name
+                               const char *rootDir,    // IN: share root path
+                               fileDesc staleRootFd)   // IN: root from lookup
+{
+   HgfsShareIndexEntry *entry;
+   fileDesc rootFd = HgfsPlatformShareRootOpen(rootDir);
+   fileDesc currentFd = -1;
+
+   LOG(4, "%s: share root %s was replaced\n", __FUNCTION__, rootDir);
+
+   MXUser_AcquireForWrite(gHgfsShareIndexLock);
+   if (HashTable_Lookup(index->shares, shareName, (void **)&entry)) {
+      if (entry->rootFd == staleRootFd) {
+         index->staleRootFds =
+            Util_SafeRealloc(index->staleRootFds,
+                             (index->numStaleRootFds + 1) *
+                             sizeof *index->staleRootFds);
+         index->staleRootFds[index->numStaleRootFds++] = staleRootFd;
+         entry->rootFd = rootFd;
+         currentFd = rootFd;
+         rootFd = -1;
+      } else {
+         /* Another lookup reopened it meanwhile. */
+         currentFd = entry->rootFd;
+      }
+   }
+   MXUser_ReleaseRWLock(gHgfsShareIndexLock);
+
+   if (rootFd >= 0) {
+      HgfsPlatformCloseFile(rootFd, NULL);
+   }
+   return currentFd;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerShareIndexDrop --
+ *
+ *    Drops the share index after the share list changed. The next lookup
+ *    rebuilds it.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Frees the index unless lookups still use it.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerShareIndexDrop(void)
+{
+   HgfsShareIndex *index;
+
+   if (NULL == gHgfsShareIndexLock) {
+      return;
+   }
+
+   MXUser_AcquireForWrite(gHgfsShareIndexLock);
+   index = gHgfsShareIndex;
+   gHgfsShareIndex = NULL;
+   gHgfsShareIndexGeneration++;
+   MXUser_ReleaseRWLock(gHgfsShareIndexLock);
+
+   if (NULL != index) {
+      HgfsServerShareIndexPut(index);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerShareIndexLookup --
+ *
+ *    Looks up a share by its exact name in the share index, building the
+ *    index if there is none.
+ *
+ *    Must be called without the share index lock held.
+ *
+ * Results:
+ *    The index, referenced, and a copy of the share's entry if found, NULL
+ *    otherwise. The share root of the entry remains open until the index is
+ *    put with HgfsServerShareIndexPut.
+ *
+ * Side effects:
+ *    May build the share index.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsShareIndex *
+HgfsServerShareIndexLookup(const char *shareName,        // IN: share name
+                           size_t shareNameLen,          // IN: share name length
+                           HgfsShareIndexEntry *entryOut) // OUT: share entry
+{
+   char key[HGFS_PATH_MAX];
+   HgfsShareIndexEntry *entry;
+   HgfsShareIndex *found = NULL;
+
+   if (NULL == gHgfsShareIndexLock || shareNameLen >= sizeof key) {
+      return NULL;
+   }
+   memcpy(key, shareName, shareNameLen);
+   key[shareNameLen] = '\0';
+
+   MXUser_AcquireForRead(gHgfsShareIndexLock);
+   if (NULL == gHgfsShareIndex) {
+      uint32 generation = gHgfsShareIndexGeneration;
+      HgfsShareIndex *index;
+
+      MXUser_ReleaseRWLock(gHgfsShareIndexLock);
+
+      index = HgfsServerShareIndexBuild();
+      if (NULL == index) {
+         return NULL;
+      }
+
+      /*
+       * Install the index unless another thread did meanwhile or the share
+       * list changed while it was built.
+       */
+      MXUser_AcquireForWrite(gHgfsShareIndexLock);
+      if (NULL == gHgfsShareIndex &&
+          generation == gHgfsShareIndexGeneration) {
+         gHgfsShareIndex = index;
+         index = NULL;
+      }
+      MXUser_ReleaseRWLock(gHgfsShareIndexLock);
+
+      if (NULL != index) {
+         HgfsServerShareIndexPut(index);
+      }
+
+      MXUser_AcquireForRead(gHgfsShareIndexLock);
+   }
+
+   if (NULL != gHgfsShareIndex &&
+       HashTable_Lookup(gHgfsShareIndex->shares, key, (void **)&entry)) {
+      *entryOut = *entry;
+      found = gHgfsShareIndex;
+      Atomic_Inc(&found->refCount);
+   }
+   MXUser_ReleaseRWLock(gHgfsShareIndexLock);
+
+   return found;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerGetShareOptions --
+ *
+ *    Gets the config options of a share, from the share index if possible.
+ *
+ * Results:
+ *    HGFS_NAME_STATUS_COMPLETE on success, the policy's error otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsNameStatus
+HgfsServerGetShareOptions(const char *shareName,        // IN: share name
+                          size_t shareNameLen,          // IN: share name length
+                          HgfsShareOptions *options)    // OUT: config options
+{
+   HgfsShareIndexEntry entry;
+   HgfsShareIndex *index;
+
+   index = HgfsServerShareIndexLookup(shareName, shareNameLen, &entry);
+   if (NULL != index) {
+      *options = entry.options;
+      HgfsServerShareIndexPut(index);
+      return HGFS_NAME_STATUS_COMPLETE;
+   }
+   return HgfsServerPolicy_GetShareOptions(shareName, shareNameLen, options);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServer_InitState --
+ *
+ *    Initialize the global server state
+ *
+ * Results:
+ *    TRUE if succeeded, FALSE if failed.
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsServer_InitState(const HgfsServerCallbacks **callbackTable,   // IN/OUT: our callbacks
+                     HgfsServerConfig *serverCfgData,             // IN: configurable settings
+                     HgfsServerMgrCallbacks *serverMgrData)       // IN: mgr callback
+{
+   Bool result = TRUE;
+
+   ASSERT(callbackTable);
+
+   /* Save any server manager data for logging state updates.*/
+   gHgfsMgrData = serverMgrData;
 
    if (NULL != serverCfgData) {
       gHgfsCfgSettings = *serverCfgData;
@@ -3972,6 +5238,8 @@ HgfsServer_InitState(const HgfsServerCallbacks **callbackTable,   // IN/OUT: our
    DblLnkLst_Init(&gHgfsSharedFoldersList);
    gHgfsSharedFoldersLock = MXUser_CreateExclLock("sharedFoldersLock",
                                                   RANK_hgfsSharedFolders);
+   gHgfsShareIndexLock = MXUser_CreateRWLock("shareIndexLock",
+                                             RANK_hgfsShareIndexLock);
 
    if (!HgfsPlatformInit()) {
       LOG(4, "Could not initialize server platform specific \n");
@@ -3981,12 +5249,15 @@ HgfsServer_InitState(const HgfsServerCallbacks **callbackTable,   // IN/OUT: our
    if (result) {
       *callbackTable = &gHgfsServerCBTable;
 
+      HgfsServerStats_Init();
+
       if (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_NOTIFY_ENABLED)) {
          gHgfsDirNotifyActive = HgfsNotify_Init(&gHgfsServerNotifyCBTable) == HGFS_STATUS_SUCCESS;
          Log("%s: initialized notification %s.\n", __FUNCTION__,
              (gHgfsDirNotifyActive ? "active" : "inactive"));
       }
-      if (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_OPLOCK_MONITOR_ENABLED)) {
+      if (0 != (gHgfsCfgSettings.flags & (HGFS_CONFIG_OPLOCK_ENABLED |
+                                          HGFS_CONFIG_OPLOCK_MONITOR_ENABLED))) {
          if (!HgfsServerOplockInit()) {
             Log("%s: failed to init oplock module.\n", __FUNCTION__);
             HgfsServerOplockDestroy();
@@ -4000,6 +5271,21 @@ HgfsServer_InitState(const HgfsServerCallbacks **callbackTable,   // IN/OUT: our
          Log("%s: initialized threadpool %s.\n", __FUNCTION__,
              (gHgfsThreadpoolActive ? "active" : "inactive"));
       }
+      if (   gHgfsThreadpoolActive
+          && (   0 != gHgfsCfgSettings.shareBytesPerSec
+              || 0 != gHgfsCfgSettings.shareRequestsPerSec)) {
+         /* Requests are delayed by the threadpool, they need it. */
+         gHgfsThrottleActive =
+            HgfsServerThrottle_Init(gHgfsCfgSettings.shareBytesPerSec,
+                                    gHgfsCfgSettings.shareRequestsPerSec);
+         Log("%s: initialized share throttling %s.\n", __FUNCTION__,
+             (gHgfsThrottleActive ? "active" : "inactive"));
+      }
+      if (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_ASYNC_FILE_IO_ENABLED)) {
+         gHgfsAsyncIoActive = HgfsAsyncIo_Init();
+         Log("%s: initialized async file I/O %s.\n", __FUNCTION__,
+             (gHgfsAsyncIoActive ? "active" : "inactive"));
+      }
       if (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_OPLOCK_MONITOR_ENABLED)) {
          if (!HgfsOplockMonitorInit()) {
             Log("%s: failed to init oplock monitor module.\n", __FUNCTION__);
@@ -4060,13 +5346,32 @@ HgfsServer_ExitState(void)
       gHgfsSharedFoldersLock = NULL;
    }
 
+   if (NULL != gHgfsShareIndexLock) {
+      HgfsServerShareIndexDrop();
+      MXUser_DestroyRWLock(gHgfsShareIndexLock);
+      gHgfsShareIndexLock = NULL;
+   }
+
    if (gHgfsThreadpoolActive) {
       HgfsThreadpool_Exit();
       gHgfsThreadpoolActive = FALSE;
       Log("%s: exit threadpool - inactive.\n", __FUNCTION__);
    }
 
+   if (gHgfsThrottleActive) {
+      HgfsServerThrottle_Exit();
+      gHgfsThrottleActive = FALSE;
+      Log("%s: exit share throttling - inactive.\n", __FUNCTION__);
+   }
+
+   if (gHgfsAsyncIoActive) {
+      HgfsAsyncIo_Exit();
+      gHgfsAsyncIoActive = FALSE;
+      Log("%s: exit async file I/O - inactive.\n", __FUNCTION__);
+   }
+
    HgfsPlatformDestroy();
+   HgfsServerStats_Exit();
 
    /*
     * Reset the server manager callbacks.
@@ -4617,7 +5922,6 @@ HgfsServerAsyncInfoDecCount(HgfsAsyncRequestInfo *info) // IN/OUT: info
 }
 
 
-#ifndef VMX86_TOOLS
 /*
  *-----------------------------------------------------------------------------
  *
@@ -4640,7 +5944,42 @@ HgfsServerAsyncInfoIncCount(HgfsAsyncRequestInfo *info) // IN/OUT: info
 {
    Atomic_Inc(&info->requestCount);
 }
-#endif // VMX86_TOOLS
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerMaxPacketSize --
+ *
+ *    Get the largest packet size the server can offer on a transport session.
+ *    Channels which pass data buffers as guest page mappings can move up to
+ *    HGFS_HUGE_IO_MAX bytes per read or write without a contiguous copy, all
+ *    others keep the large packet size, or the legacy one if large packets
+ *    are switched off.
+ *
+ * Results:
+ *    The maximum packet size.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsServerMaxPacketSize(HgfsTransportSessionInfo *transportSession) // IN:
+{
+   HgfsServerChannelData *channelCapabilities =
+      &transportSession->channelCapabilities;
+   size_t maxPacketSize = HgfsLargePacketMax(FALSE);
+
+   if ((channelCapabilities->flags & HGFS_CHANNEL_SHARED_MEM) != 0 &&
+       maxPacketSize == HGFS_LARGE_PACKET_MAX) {
+      maxPacketSize = HGFS_HUGE_PACKET_MAX;
+   }
+
+   return MIN(channelCapabilities->maxPacketSize, maxPacketSize);
+}
 
 
 /*
@@ -4684,8 +6023,11 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
    session->fileIOLock = MXUser_CreateExclLock("HgfsFileIOLock",
                                                RANK_hgfsFileIOLock);
 
-   session->nodeArrayLock = MXUser_CreateExclLock("HgfsNodeArrayLock",
-                                                  RANK_hgfsNodeArrayLock);
+   session->nodeArrayLock = MXUser_CreateRWLock("HgfsNodeArrayLock",
+                                                RANK_hgfsNodeArrayLock);
+
+   session->readAheadLock = MXUser_CreateExclLock("HgfsReadAheadLock",
+                                                  RANK_hgfsReadAheadLock);
 
    session->searchArrayLock = MXUser_CreateExclLock("HgfsSearchArrayLock",
                                                     RANK_hgfsSearchArrayLock);
@@ -4697,12 +6039,8 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
    session->transportSession = transportSession;
    session->numInvalidationAttempts = 0;
 
-   if (  createSessionInfo.maxPacketSize
-       < transportSession->channelCapabilities.maxPacketSize) {
-      session->maxPacketSize = createSessionInfo.maxPacketSize;
-   } else {
-      session->maxPacketSize = transportSession->channelCapabilities.maxPacketSize;
-   }
+   session->maxPacketSize = MIN(createSessionInfo.maxPacketSize,
+                                HgfsServerMaxPacketSize(transportSession));
    session->flags |= HGFS_SESSION_MAXPACKETSIZE_VALID;
 
    /*
@@ -4728,9 +6066,11 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
                                         sizeof (HgfsFileNode));
    session->numCachedOpenNodes = 0;
    session->numCachedLockedNodes = 0;
+   session->readAheadBytes = 0;
 
    for (i = 0; i < session->numNodes; i++) {
       DblLnkLst_Init(&session->nodeArray[i].links);
+      session->nodeArray[i].handle = HgfsServerInitSlotHandle(i, 0);
       /* Append at the end of the list. */
       DblLnkLst_LinkLast(&session->nodeFreeList, &session->nodeArray[i].links);
    }
@@ -4752,6 +6092,8 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
 
    for (i = 0; i < session->numSearches; i++) {
       DblLnkLst_Init(&session->searchArray[i].links);
+      session->searchArray[i].handle =
+         HgfsServerInitSlotHandle(i, HGFS_HANDLE_SEARCH_FLAG);
       /* Append at the end of the list. */
       DblLnkLst_LinkLast(&session->searchFreeList,
                          &session->searchArray[i].links);
@@ -4791,12 +6133,16 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
                                            HGFS_OP_CAPFLAG_IS_SUPPORTED, session);
             HgfsServerSetSessionCapability(HGFS_OP_REMOVE_WATCH_V4,
                                            HGFS_OP_CAPFLAG_IS_SUPPORTED, session);
+            HgfsServerSetSessionCapability(HGFS_OP_QUERY_CHANGES_V4,
+                                           HGFS_OP_CAPFLAG_IS_SUPPORTED, session);
             session->flags |= HGFS_SESSION_CHANGENOTIFY_ENABLED;
          } else {
             HgfsServerSetSessionCapability(HGFS_OP_SET_WATCH_V4,
                                            HGFS_OP_CAPFLAG_NOT_SUPPORTED, session);
             HgfsServerSetSessionCapability(HGFS_OP_REMOVE_WATCH_V4,
                                            HGFS_OP_CAPFLAG_NOT_SUPPORTED, session);
+            HgfsServerSetSessionCapability(HGFS_OP_QUERY_CHANGES_V4,
+                                           HGFS_OP_CAPFLAG_NOT_SUPPORTED, session);
          }
          LOG(8, "%s: session notify capability is %s\n", __FUNCTION__,
              (session->flags & HGFS_SESSION_CHANGENOTIFY_ENABLED ? "enabled" :
@@ -4805,9 +6151,21 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
 
       HgfsServerSetSessionCapability(HGFS_OP_SEARCH_READ_V4,
                                      HGFS_OP_CAPFLAG_IS_SUPPORTED, session);
+
+#ifdef HGFS_OPLOCK_LEASES
+      /* Oplock breaks are sent by the server, like change notifications. */
+      if (   0 != (session->flags & HGFS_SESSION_OPLOCK_ENABLED)
+          && HgfsServerOplockIsInited()) {
+         HgfsServerSetSessionCapability(HGFS_OP_OPLOCK_ACQUIRE_V4,
+                                        HGFS_OP_CAPFLAG_IS_SUPPORTED, session);
+         HgfsServerSetSessionCapability(HGFS_OP_OPLOCK_BREAK_V4,
+                                        HGFS_OP_CAPFLAG_IS_SUPPORTED, session);
+      }
+#endif
    }
 
-   if (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_OPLOCK_MONITOR_ENABLED)) {
+   if (0 != (gHgfsCfgSettings.flags & (HGFS_CONFIG_OPLOCK_MONITOR_ENABLED |
+                                       HGFS_CONFIG_CACHE_ENABLED))) {
       /* Allocate symlink check status cache. */
       session->symlinkCache = HgfsCache_Alloc(HgfsCacheRemoveLRUCb);
 
@@ -4815,6 +6173,24 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
       session->fileAttrCache = HgfsCache_Alloc(HgfsCacheRemoveLRUCb);
    }
 
+#if defined(__linux__) || defined(__APPLE__)
+   /*
+    * Buffered data is written after a delay by the threadpool. Other
+    * platforms seek and write under the fileIOLock, which ranks below
+    * the locks held while the data is written.
+    */
+   if (   0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_WRITE_BEHIND_ENABLED)
+       && gHgfsThreadpoolActive) {
+      session->writeBehindLock = MXUser_CreateExclLock("HgfsWriteBehindLock",
+                                                       RANK_hgfsWriteBehindLock);
+      session->writeBehindTable = HashTable_Alloc(64, HASH_INT_KEY, NULL);
+      session->writeBehindBytes = 0;
+      session->writeBehindTimerQueued = FALSE;
+      session->writeBehindWritten =
+         MXUser_CreateCondVarExclLock(session->writeBehindLock);
+   }
+#endif
+
    *sessionData = session;
 
    Log("%s: init session %p id %"FMT64"x\n", __FUNCTION__, session, session->sessionId);
@@ -4980,7 +6356,7 @@ HgfsServerExitSessionInternal(HgfsSessionInfo *session)    // IN: session contex
       HgfsNotify_RemoveSessionSubscribers(session);
    }
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForWrite(session->nodeArrayLock);
 
    Log("%s: teardown session %p id 0x%"FMT64"x\n", __FUNCTION__, session, session->sessionId);
 
@@ -4999,7 +6375,7 @@ HgfsServerExitSessionInternal(HgfsSessionInfo *session)    // IN: session contex
    free(session->nodeArray);
    session->nodeArray = NULL;
 
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    /*
     * Recycle all searches that are still in use, then destroy the
@@ -5019,12 +6395,39 @@ HgfsServerExitSessionInternal(HgfsSessionInfo *session)    // IN: session contex
 
    MXUser_ReleaseExclLock(session->searchArrayLock);
 
+   /*
+    * The buffered data was written when the nodes were closed, drop the
+    * errors that were never reported.
+    */
+   if (NULL != session->writeBehindTable) {
+      HgfsWriteBehind **wbs;
+      size_t numWbs;
+      size_t j;
+
+      ASSERT(!session->writeBehindTimerQueued);
+
+      MXUser_AcquireExclLock(session->writeBehindLock);
+      HashTable_ToArray(session->writeBehindTable, (void ***)&wbs, &numWbs);
+      for (j = 0; j < numWbs; j++) {
+         HgfsWriteBehindFlushInternal(wbs[j], session);
+         HgfsWriteBehindFreeInternal(wbs[j], session);
+      }
+      free(wbs);
+      ASSERT(0 == session->writeBehindBytes);
+      MXUser_ReleaseExclLock(session->writeBehindLock);
+
+      HashTable_Free(session->writeBehindTable);
+      MXUser_DestroyCondVar(session->writeBehindWritten);
+      MXUser_DestroyExclLock(session->writeBehindLock);
+   }
+
    if (gHgfsThreadpoolActive) {
       HgfsThreadpool_Deactivate();
    }
 
    /* Teardown the locks for the sessions and destroy itself. */
-   MXUser_DestroyExclLock(session->nodeArrayLock);
+   MXUser_DestroyRWLock(session->nodeArrayLock);
+   MXUser_DestroyExclLock(session->readAheadLock);
    MXUser_DestroyExclLock(session->searchArrayLock);
    MXUser_DestroyExclLock(session->fileIOLock);
 
@@ -5062,13 +6465,16 @@ HgfsServer_GetHandleCounter(void)
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServer_SetHandleCounter --
+ * HgfsServer_GetStats --
  *
- *    Set the file handle counter. This is used by the checkpointing code to
- *    restore this value so we avoid the risk of handle collision.
+ *    Return the request statistics of the server, one line per operation
+ *    and per share that has seen requests and one with the data packet
+ *    bytes copied through bounce buffers and transferred directly,
+ *    followed by the throttle counters of the shares if they are throttled.
  *
  * Results:
- *    None
+ *    The statistics, to be freed by the caller, or NULL if the server is not
+ *    initialized.
  *
  * Side effects:
  *    None
@@ -5076,15 +6482,52 @@ HgfsServer_GetHandleCounter(void)
  *-----------------------------------------------------------------------------
  */
 
-void
-HgfsServer_SetHandleCounter(uint32 newHandleCounter)
+char *
+HgfsServer_GetStats(void)
 {
-   HgfsServerInitHandleCounter(newHandleCounter);
+   char *stats = HgfsServerStats_GetReport();
+   char *throttle = HgfsServerThrottle_GetReport();
+   char *report;
+
+   if (NULL == stats || NULL == throttle) {
+      free(throttle);
+      return stats;
+   }
+
+   report = Str_SafeAsprintf(NULL, "%s%s", stats, throttle);
+   free(stats);
+   free(throttle);
+
+   return report;
 }
 
 
 /*
- *----------------------------------------------------------------------------
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServer_SetHandleCounter --
+ *
+ *    Set the file handle counter. This is used by the checkpointing code to
+ *    restore this value so we avoid the risk of handle collision.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServer_SetHandleCounter(uint32 newHandleCounter)
+{
+   HgfsServerInitHandleCounter(newHandleCounter);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
  *
  * HgfsServerSessionSendComplete --
  *
@@ -5282,7 +6725,7 @@ HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
    ASSERT(session->searchArray);
    LOG(4, "%s: Beginning\n", __FUNCTION__);
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForWrite(session->nodeArrayLock);
 
    /*
     * Iterate over each node, skipping those that are unused. For each node,
@@ -5324,7 +6767,7 @@ HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
       }
    }
 
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    MXUser_AcquireExclLock(session->searchArrayLock);
 
@@ -5368,37 +6811,14 @@ HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
 
    MXUser_ReleaseExclLock(session->searchArrayLock);
 
-   HgfsCache* caches[] = {session->symlinkCache, session->fileAttrCache };
-   for (i = 0; i < sizeof(caches) / sizeof(caches[0]); i++) {
-      const void **keys = NULL;
-      size_t nkeys;
-      int keyIdx;
-
-      if (!caches[i]) {
-         continue;
-      }
-      MXUser_AcquireExclLock(caches[i]->lock);
-      HashTable_KeyArray(caches[i]->hashTable, &keys, &nkeys);
-      MXUser_ReleaseExclLock(caches[i]->lock);
-      for (keyIdx = 0; keyIdx < nkeys; keyIdx++) {
-         DblLnkLst_Links *l;
-         const char *name = (const char *)keys[keyIdx];
-         for (l = shares->next; l != shares; l = l->next) {
-            HgfsSharedFolder *share;
-
-            share = DblLnkLst_Container(l, HgfsSharedFolder, links);
-            if (strncmp(name, share->path, strlen(name)) == 0) {
-               break;
-            }
-         }
-
-         if (l == shares) {
-            LOG(4, "%s: Remove %s from cache\n", __FUNCTION__, name);
-            HgfsCache_Invalidate(caches[i], name);
-
-         }
-      }
-      free((void *)keys);
+   /* Drop the cached results for paths which are no longer within a share. */
+   if (NULL != session->symlinkCache) {
+      HgfsCache_RemoveMatching(session->symlinkCache, HgfsCacheKeyIsNotShared,
+                               shares);
+   }
+   if (NULL != session->fileAttrCache) {
+      HgfsCache_RemoveMatching(session->fileAttrCache, HgfsCacheKeyIsNotShared,
+                               shares);
    }
 
    LOG(4, "%s: Ending\n", __FUNCTION__);
@@ -5448,6 +6868,7 @@ HgfsServerSessionInvalidateObjects(void *clientData,         // IN:
 
    /* Now invalidate any stale shares and add any new ones. */
    HgfsServerSharesReset(shares);
+   HgfsServerShareIndexDrop();
    LOG(4, "%s: Ending\n", __FUNCTION__);
 }
 
@@ -5647,7 +7068,196 @@ HgfsOplockFileChangeCb(HgfsSessionInfo *session, // IN: Session info
 static void
 HgfsCacheRemoveLRUCb(void *data) // IN
 {
-   HgfsOplockUnmonitorFileChange(((HOM_HANDLE *)data)[0]);
+   HOM_HANDLE handle = ((HOM_HANDLE *)data)[0];
+
+   if (handle != HGFS_OPLOCK_INVALID_MONITOR_HANDLE) {
+      HgfsOplockUnmonitorFileChange(handle);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCacheKeyIsNotShared --
+ *
+ *    Cache match callback used when the list of shares changes.
+ *
+ * Results:
+ *    TRUE if the path is not within any of the shares, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsCacheKeyIsNotShared(const char *key,   // IN: Cached path
+                        void *clientData)  // IN: List of shares
+{
+   DblLnkLst_Links *shares = clientData;
+   DblLnkLst_Links *l;
+
+   for (l = shares->next; l != shares; l = l->next) {
+      HgfsSharedFolder *share = DblLnkLst_Container(l, HgfsSharedFolder, links);
+
+      if (strncmp(key, share->path, share->pathLen) == 0 &&
+          (key[share->pathLen] == '\0' || key[share->pathLen] == DIRSEPC)) {
+         return FALSE;
+      }
+   }
+
+   LOG(4, "%s: Remove %s from cache\n", __FUNCTION__, key);
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCacheMonitor --
+ *
+ *    Set up the validity of a new symlink check or attribute cache entry.
+ *    If the oplock monitor is enabled and can watch the file, the entry
+ *    remains valid until the file is changed. Otherwise, the entry expires
+ *    after HGFS_CACHE_UNMONITORED_LIFETIME_MS, unless it is removed earlier
+ *    by a mutating request from the client. Symlink check results are only
+ *    cached when monitored.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    An oplock monitor may be registered for the file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerCacheMonitor(HgfsSessionInfo *session, // IN: Session info
+                       char *localName,          // IN: Path of the entry
+                       HOM_HANDLE *handle,       // OUT: Monitor handle
+                       VmTimeType *expiry)       // OUT: Expiry time
+{
+   *handle = HGFS_OPLOCK_INVALID_MONITOR_HANDLE;
+   if (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_OPLOCK_MONITOR_ENABLED)) {
+      *handle = HgfsOplockMonitorFileChange(localName, session,
+                                            HgfsOplockFileChangeCb,
+                                            Util_SafeStrdup(localName));
+   }
+
+   if (*handle != HGFS_OPLOCK_INVALID_MONITOR_HANDLE) {
+      *expiry = 0;
+   } else {
+      *expiry = Hostinfo_SystemTimerMS() + HGFS_CACHE_UNMONITORED_LIFETIME_MS;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCacheEntryIsValid --
+ *
+ *    Check whether a symlink check or attribute cache entry has expired.
+ *
+ * Results:
+ *    TRUE if the entry can be used, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsServerCacheEntryIsValid(VmTimeType expiry) // IN: Expiry time, 0 if none
+{
+   return expiry == 0 || Hostinfo_SystemTimerMS() < expiry;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCacheRemove --
+ *
+ *    Remove the cached results for a path which is being modified by a
+ *    request from the client.
+ *
+ *    If the name itself changed (create, delete, rename), the cached
+ *    results for all paths below it and the attributes of its parent
+ *    directory are removed as well.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerCacheRemove(HgfsSessionInfo *session,  // IN: Session info
+                      const char *localName,     // IN: Modified path
+                      Bool nameChanged)          // IN: Path created/removed
+{
+   if (NULL != session->symlinkCache) {
+      HgfsCache_Remove(session->symlinkCache, localName, nameChanged);
+   }
+
+   if (NULL != session->fileAttrCache) {
+      HgfsCache_Remove(session->fileAttrCache, localName, nameChanged);
+
+      if (nameChanged) {
+         const char *sep = strrchr(localName, DIRSEPC);
+
+         if (NULL != sep && sep != localName) {
+            char *parent = Util_SafeStrndup(localName, sep - localName);
+
+            HgfsCache_Remove(session->fileAttrCache, parent, FALSE);
+            free(parent);
+         }
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCacheRemoveHandle --
+ *
+ *    Remove the cached results for the file referenced by a handle.
+ *    See HgfsServerCacheRemove.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerCacheRemoveHandle(HgfsHandle file,           // IN: Hgfs file handle
+                            HgfsSessionInfo *session,  // IN: Session info
+                            Bool nameChanged)          // IN: Path removed
+{
+   char *fileName;
+   size_t fileNameSize;
+
+   if (NULL == session->symlinkCache && NULL == session->fileAttrCache) {
+      return;
+   }
+
+   if (HgfsHandle2FileName(file, session, &fileName, &fileNameSize)) {
+      HgfsServerCacheRemove(session, fileName, nameChanged);
+      free(fileName);
+   }
 }
 
 /*
@@ -5696,7 +7306,10 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
    char *tempPtr;
    uint32 startIndex = 0;
    HgfsShareOptions shareOptions;
-   HgfsSymlinkCacheEntry *entry;
+   HgfsShareIndexEntry share;
+   HgfsShareIndex *shareIndex;
+   fileDesc shareRootFd;
+   HgfsSymlinkCacheEntry entry;
 
    ASSERT(cpName);
    ASSERT(bufOut);
@@ -5723,34 +7336,47 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
       return HGFS_NAME_STATUS_INCOMPLETE_BASE;
    }
 
-   /* Check permission on the share and get the share path */
-   nameStatus = HgfsServerPolicy_ProcessCPName(cpName,
-                                               len,
-                                               &shareInfo->readPermissions,
-                                               &shareInfo->writePermissions,
-                                               &shareInfo->handle, // XXX: to be deleted.
-                                               &shareInfo->rootDir);
-   if (nameStatus != HGFS_NAME_STATUS_COMPLETE) {
-      LOG(4, "%s: No such share (%s)\n", __FUNCTION__, cpName);
-      return nameStatus;
-   }
-   shareInfo->rootDirLen = strlen(shareInfo->rootDir);
-   /*
-    * XXX: The handle is now NOT propagated back and held in the policy but only in the
-    * table of share properties.
-    *
-    * Get shareInfo handle returns a valid handle only if we have change
-    * notification active.
-    * Note: cpName begins with the share name.
-    */
-   shareInfo->handle = HgfsServerGetShareHandle(cpName);
+   shareIndex = HgfsServerShareIndexLookup(cpName, len, &share);
+   if (NULL != shareIndex) {
+      shareInfo->readPermissions = share.readPermissions;
+      shareInfo->writePermissions = share.writePermissions;
+      shareInfo->handle = share.handle;
+      shareInfo->rootDir = share.rootDir;
+      shareInfo->rootDirLen = share.rootDirLen;
+      shareOptions = share.options;
+      shareRootFd = share.rootFd;
+   } else {
+      /* Check permission on the share and get the share path */
+      nameStatus = HgfsServerPolicy_ProcessCPName(cpName,
+                                                  len,
+                                                  &shareInfo->readPermissions,
+                                                  &shareInfo->writePermissions,
+                                                  &shareInfo->handle, // XXX: to be deleted.
+                                                  &shareInfo->rootDir);
+      if (nameStatus != HGFS_NAME_STATUS_COMPLETE) {
+         LOG(4, "%s: No such share (%s)\n", __FUNCTION__, cpName);
+         return nameStatus;
+      }
+      shareInfo->rootDirLen = strlen(shareInfo->rootDir);
+      /*
+       * XXX: The handle is now NOT propagated back and held in the policy but only in the
+       * table of share properties.
+       *
+       * Get shareInfo handle returns a valid handle only if we have change
+       * notification active.
+       * Note: cpName begins with the share name.
+       */
+      shareInfo->handle = HgfsServerGetShareHandle(cpName);
 
-   /* Get the config options. */
-   nameStatus = HgfsServerPolicy_GetShareOptions(cpName, len, &shareOptions);
-   if (nameStatus != HGFS_NAME_STATUS_COMPLETE) {
-      LOG(4, "%s: no matching share: %s.\n", __FUNCTION__, cpName);
-      return nameStatus;
+      /* Get the config options. */
+      nameStatus = HgfsServerPolicy_GetShareOptions(cpName, len, &shareOptions);
+      if (nameStatus != HGFS_NAME_STATUS_COMPLETE) {
+         LOG(4, "%s: no matching share: %s.\n", __FUNCTION__, cpName);
+         return nameStatus;
+      }
+      shareRootFd = -1;
    }
+   HgfsServerStats_SetShare(cpName, len);
 
    /* Point to the next component, if any */
    cpNameSize -= next - cpName;
@@ -5764,8 +7390,8 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
    myBufOut = (char *) malloc(outSize * sizeof *myBufOut);
    if (!myBufOut) {
       LOG(4, "%s: out of memory allocating string\n", __FUNCTION__);
-
-      return HGFS_NAME_STATUS_OUT_OF_MEMORY;
+      nameStatus = HGFS_NAME_STATUS_OUT_OF_MEMORY;
+      goto error;
    }
 
    out = myBufOut;
@@ -5920,8 +7546,10 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
    if (!HgfsServerPolicy_IsShareOptionSet(shareOptions,
                                           HGFS_SHARE_FOLLOW_SYMLINKS)) {
       if (NULL != session->symlinkCache &&
-          HgfsCache_Get(session->symlinkCache, myBufOut, (void **)&entry)) {
-         nameStatus = entry->nameStatus;
+          HgfsCache_GetCopy(session->symlinkCache, myBufOut, &entry,
+                            sizeof entry) &&
+          HgfsServerCacheEntryIsValid(entry.expiry)) {
+         nameStatus = entry.nameStatus;
       } else {
          /*
           * Verify that either the path is same as share path or the path until
@@ -5933,20 +7561,33 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
           * We should use the resolved file path for further file system
           * operations, instead of using the one passed from the client.
           */
+         if (shareRootFd >= 0 &&
+             !HgfsPlatformShareRootIsCurrent(shareRootFd, share.rootDir)) {
+            shareRootFd = HgfsServerShareIndexReopenRoot(shareIndex, share.name,
+                                                         share.rootDir,
+                                                         shareRootFd);
+         }
          nameStatus = HgfsPlatformPathHasSymlink(myBufOut, myBufOutLen,
                                                  shareInfo->rootDir,
-                                                 shareInfo->rootDirLen);
+                                                 shareInfo->rootDirLen,
+                                                 shareRootFd);
          if (NULL != session->symlinkCache) {
-            HOM_HANDLE handle =
-               HgfsOplockMonitorFileChange(myBufOut, session,
-                                           HgfsOplockFileChangeCb,
-                                           Util_SafeStrdup(myBufOut));
-            if (handle != HGFS_OPLOCK_INVALID_MONITOR_HANDLE) {
-               entry = Util_SafeCalloc(1, sizeof *entry);
-               entry->handle = handle;
-               entry->nameStatus = nameStatus;
-               HgfsCache_Put(session->symlinkCache, myBufOut,
-                             entry);
+            HgfsSymlinkCacheEntry *newEntry =
+               Util_SafeCalloc(1, sizeof *newEntry);
+
+            HgfsServerCacheMonitor(session, myBufOut, &newEntry->handle,
+                                   &newEntry->expiry);
+
+            /*
+             * Without a monitor nothing tells us that a directory of the
+             * path was replaced by a symlink from outside the guest, so do
+             * not trust the result for even HGFS_CACHE_UNMONITORED_LIFETIME_MS.
+             */
+            if (newEntry->handle != HGFS_OPLOCK_INVALID_MONITOR_HANDLE) {
+               newEntry->nameStatus = nameStatus;
+               HgfsCache_Put(session->symlinkCache, myBufOut, newEntry);
+            } else {
+               free(newEntry);
             }
          }
       }
@@ -5982,20 +7623,26 @@ HgfsServerGetLocalNameInfo(const char *cpName,      // IN:  Cross-platform filen
 
    /*
     * Contrary to Coverity analysis, storage pointed to by the variable
-    * "entry" is not leaked; HgfsCache_Put stores a pointer to it in the
-    * symlink cache.  However, no Coverity annotation for leaked_storage
+    * "newEntry" is not leaked; HgfsCache_Put stores a pointer to it in the
+    * cache.  However, no Coverity annotation for leaked_storage
     * is added here because such an annotation cannot be made specific to
-    * entry; as a result, if any actual memory leaks were to be introduced
+    * newEntry; as a result, if any actual memory leaks were to be introduced
     * by a future change, the leaked_storage annotation would cause such
     * new leaks to be flagged as false positives.
     *
     * XXX - can something be done with Coverity function models so that
     * Coverity stops reporting this?
     */
+   if (NULL != shareIndex) {
+      HgfsServerShareIndexPut(shareIndex);
+   }
    return HGFS_NAME_STATUS_COMPLETE;
 
 error:
    free(myBufOut);
+   if (NULL != shareIndex) {
+      HgfsServerShareIndexPut(shareIndex);
+   }
 
    return nameStatus;
 }
@@ -6129,8 +7776,8 @@ HgfsServerSearchRealDir(char const *baseDir,      // IN: Directory to search
    }
 
    /* Get the config options. */
-   nameStatus = HgfsServerPolicy_GetShareOptions(shareName, strlen(shareName),
-                                                 &configOptions);
+   nameStatus = HgfsServerGetShareOptions(shareName, strlen(shareName),
+                                          &configOptions);
    if (nameStatus != HGFS_NAME_STATUS_COMPLETE) {
       LOG(4, "%s: no matching share: %s.\n", __FUNCTION__, shareName);
       status = HGFS_ERROR_INTERNAL;
@@ -6141,8 +7788,21 @@ HgfsServerSearchRealDir(char const *baseDir,      // IN: Directory to search
    followSymlinks = HgfsServerPolicy_IsShareOptionSet(configOptions,
                                                       HGFS_SHARE_FOLLOW_SYMLINKS);
 
-   status = HgfsPlatformScandir(baseDir, baseDirLen, followSymlinks,
-                                &search->dents, &search->numDents);
+   /*
+    * Streaming searches read the directory as the entries are consumed, so
+    * the first entries can be returned without scanning the whole directory.
+    * Snapshot searches, which read all the entries upfront, remain for
+    * platforms without streaming support.
+    */
+   status = HGFS_ERROR_NOT_SUPPORTED;
+   if (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_SEARCH_STREAMING_ENABLED)) {
+      status = HgfsPlatformSearchStreamOpen(baseDir, baseDirLen, followSymlinks,
+                                            &search->stream);
+   }
+   if (HGFS_ERROR_NOT_SUPPORTED == status) {
+      status = HgfsPlatformScandir(baseDir, baseDirLen, followSymlinks,
+                                   &search->dents);
+   }
    if (HGFS_ERROR_SUCCESS != status) {
       LOG(4, "%s: couldn't scandir\n", __FUNCTION__);
       HgfsRemoveSearchInternal(search, session);
@@ -6207,8 +7867,7 @@ HgfsServerSearchVirtualDir(HgfsServerResEnumGetFunc getName,      // IN: Name en
                                  initName,
                                  cleanupName,
                                  type,
-                                 &search->dents,
-                                 &search->numDents);
+                                 &search->dents);
    if (HGFS_ERROR_SUCCESS != status) {
       LOG(4, "%s: couldn't get dents\n", __FUNCTION__);
       HgfsRemoveSearchInternal(search, session);
@@ -6275,8 +7934,7 @@ HgfsServerRestartSearchVirtualDir(HgfsServerResEnumGetFunc getName,      // IN:
                                  initName,
                                  cleanupName,
                                  vdirSearch->type,
-                                 &vdirSearch->dents,
-                                 &vdirSearch->numDents);
+                                 &vdirSearch->dents);
    if (HGFS_ERROR_SUCCESS != status) {
       LOG(4, "%s: couldn't get root dents %u\n", __FUNCTION__, status);
       goto exit;
@@ -6318,9 +7976,9 @@ HgfsRemoveFromCache(HgfsHandle handle,        // IN: Hgfs handle to the node
 {
    Bool removed = FALSE;
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForWrite(session->nodeArrayLock);
    removed = HgfsRemoveFromCacheInternal(handle, session);
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    return removed;
 }
@@ -6329,9 +7987,13 @@ HgfsRemoveFromCache(HgfsHandle handle,        // IN: Hgfs handle to the node
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsIsCached --
+ * HgfsGetCachedNode --
  *
- *    Grab a lock and call HgfsIsCachedInternal.
+ *    Grab a lock and call HgfsIsCachedInternal. If the node is cached, take
+ *    a use of its file descriptor: the node is not removed from the cache
+ *    to make room for other nodes until HgfsPutCachedNode is called, so the
+ *    descriptor is not closed and reused for another file while a request
+ *    is doing I/O on it.
  *
  * Results:
  *    TRUE if the node is found in the cache.
@@ -6344,27 +8006,64 @@ HgfsRemoveFromCache(HgfsHandle handle,        // IN: Hgfs handle to the node
  */
 
 Bool
-HgfsIsCached(HgfsHandle handle,         // IN: Structure representing file node
-             HgfsSessionInfo *session)  // IN: Session info
+HgfsGetCachedNode(HgfsHandle handle,         // IN: Structure representing file node
+                  HgfsSessionInfo *session)  // IN: Session info
 {
    Bool cached = FALSE;
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForRead(session->nodeArrayLock);
    cached = HgfsIsCachedInternal(handle, session);
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   if (cached) {
+      Atomic_Inc(&HgfsHandle2FileNode(handle, session)->fdUsers);
+   }
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    return cached;
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPutCachedNode --
+ *
+ *    Drop a use of the file descriptor of a cached node taken by
+ *    HgfsGetCachedNode or HgfsAddToCacheFd.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    The node may be removed from the cache again.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsPutCachedNode(HgfsHandle handle,         // IN: Structure representing file node
+                  HgfsSessionInfo *session)  // IN: Session info
+{
+   HgfsFileNode *node;
+
+   MXUser_AcquireForRead(session->nodeArrayLock);
+   node = HgfsHandle2FileNode(handle, session);
+
+   /* The uses were dropped if the handle was closed in the meantime. */
+   if (NULL != node && Atomic_Read(&node->fdUsers) != 0) {
+      Atomic_Dec(&node->fdUsers);
+   }
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
  * HgfsRemoveLruNode--
  *
- *    Removes the least recently used node in the cache. The first node is
- *    removed since most recently used nodes are moved to the end of the
- *    list.
+ *    Removes the least recently used node in the cache. The first node
+ *    that was not used since the last scan is removed, nodes that were used
+ *    are moved to the end of the list (second chance).
  *
  *    XXX: Right now we do not remove nodes that have server locks on them
  *         This is not correct and should be fixed before the release.
@@ -6373,8 +8072,8 @@ HgfsIsCached(HgfsHandle handle,         // IN: Structure representing file node
  *
  *    Assumes that there is at least one node in the cache.
  *
- *    The session's nodeArrayLock should be acquired prior to calling this
- *    function.
+ *    The session's nodeArrayLock should be acquired for write prior to
+ *    calling this function.
  *
  * Results:
  *    TRUE on success
@@ -6392,14 +8091,16 @@ HgfsRemoveLruNode(HgfsSessionInfo *session)   // IN: session info
    HgfsFileNode *lruNode = NULL;
    HgfsHandle handle;
    Bool found = FALSE;
-   uint32 numOpenNodes = session->numCachedOpenNodes;
+   /* Referenced nodes are passed over once before they can be removed. */
+   uint32 numOpenNodes = 2 * session->numCachedOpenNodes;
 
    ASSERT(session);
    ASSERT(session->numCachedOpenNodes > 0);
 
    /*
-    * Remove the first item from the list that does not have a server lock,
-    * file context or is open in sequential mode.
+    * Remove the first item from the list that was not used since the last
+    * scan and does not have a server lock, file context or is open in
+    * sequential mode.
     */
    while (!found && (numOpenNodes-- > 0)) {
       lruNode = DblLnkLst_Container(session->nodeCachedList.next,
@@ -6407,7 +8108,8 @@ HgfsRemoveLruNode(HgfsSessionInfo *session)   // IN: session info
 
       ASSERT(lruNode->state == FILENODE_STATE_IN_USE_CACHED);
       if (lruNode->serverLock != HGFS_LOCK_NONE || lruNode->fileCtx != NULL
-          || (lruNode->flags & HGFS_FILE_NODE_SEQUENTIAL_FL) != 0) {
+          || (lruNode->flags & HGFS_FILE_NODE_SEQUENTIAL_FL) != 0
+          || Atomic_Read(&lruNode->fdUsers) != 0) {
          /*
 	  * Move this node with the server lock to the beginning of the list.
 	  * Also, prevent files opened in HGFS_FILE_NODE_SEQUENTIAL_FL mode
@@ -6415,9 +8117,14 @@ HgfsRemoveLruNode(HgfsSessionInfo *session)   // IN: session info
 	  * allow files to be closed/re-opened (eg: When restoring a file
 	  * into a Windows guest you cannot use BackupWrite, then close and
 	  * re-open the file and continue to use BackupWrite.
+	  * Nodes whose file descriptor is in use by a request are kept too.
 	  */
          DblLnkLst_Unlink1(&lruNode->links);
          DblLnkLst_LinkLast(&session->nodeCachedList, &lruNode->links);
+      } else if (Atomic_ReadBool(&lruNode->cacheReferenced)) {
+         Atomic_WriteBool(&lruNode->cacheReferenced, FALSE);
+         DblLnkLst_Unlink1(&lruNode->links);
+         DblLnkLst_LinkLast(&session->nodeCachedList, &lruNode->links);
       } else {
          found = TRUE;
       }
@@ -6440,9 +8147,14 @@ HgfsRemoveLruNode(HgfsSessionInfo *session)   // IN: session info
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsAddToCache --
+ * HgfsAddToCacheFd --
+ *
+ *    Grabs the cache lock, sets the file descriptor of the node, calls
+ *    HgfsAddToCacheInternal and takes a use of the descriptor, see
+ *    HgfsGetCachedNode.
  *
- *    Grabs the cache lock and calls HgfsAddToCacheInternal.
+ *    If another request cached the node with its own descriptor in the
+ *    meantime, the given descriptor is closed and the cached one is used.
  *
  * Results:
  *    TRUE on success
@@ -6455,14 +8167,35 @@ HgfsRemoveLruNode(HgfsSessionInfo *session)   // IN: session info
  */
 
 Bool
-HgfsAddToCache(HgfsHandle handle,        // IN: HGFS file handle
-               HgfsSessionInfo *session) // IN: Session info
+HgfsAddToCacheFd(HgfsHandle handle,        // IN: HGFS file handle
+                 HgfsSessionInfo *session, // IN: Session info
+                 fileDesc *fd)             // IN/OUT: OS handle (file desc)
 {
+   HgfsFileNode *node;
    Bool added = FALSE;
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForWrite(session->nodeArrayLock);
+
+   node = HgfsHandle2FileNode(handle, session);
+   if (NULL == node) {
+      goto exit;
+   }
+
+   if (node->state == FILENODE_STATE_IN_USE_CACHED) {
+      HgfsPlatformCloseFile(*fd, NULL);
+      *fd = node->fileDesc;
+   } else {
+      node->fileDesc = *fd;
+      node->fileCtx = NULL;
+   }
+
    added = HgfsAddToCacheInternal(handle, session);
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   if (added) {
+      Atomic_Inc(&node->fdUsers);
+   }
+
+exit:
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    return added;
 }
@@ -6526,14 +8259,14 @@ HgfsCreateAndCacheFileNode(HgfsFileOpenInfo *openInfo, // IN: Open info struct
       sharedFolderOpen = TRUE;
    }
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForWrite(session->nodeArrayLock);
 
    node = HgfsAddNewFileNode(openInfo, localId, fileDesc, append, len,
                              openInfo->cpName, sharedFolderOpen, session);
 
    if (node == NULL) {
       LOG(4, "%s: Failed to add new node.\n", __FUNCTION__);
-      MXUser_ReleaseExclLock(session->nodeArrayLock);
+      MXUser_ReleaseRWLock(session->nodeArrayLock);
 
       HgfsPlatformCloseFile(fileDesc, NULL);
       return FALSE;
@@ -6545,12 +8278,12 @@ HgfsCreateAndCacheFileNode(HgfsFileOpenInfo *openInfo, // IN: Open info struct
       HgfsPlatformCloseFile(fileDesc, NULL);
 
       LOG(4, "%s: Failed to add node to the cache.\n", __FUNCTION__);
-      MXUser_ReleaseExclLock(session->nodeArrayLock);
+      MXUser_ReleaseRWLock(session->nodeArrayLock);
 
       return FALSE;
    }
 
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    /* Only after everything is successful, save the handle in the open info. */
    openInfo->file = handle;
@@ -6632,7 +8365,7 @@ HgfsAllocInitReply(HgfsPacket *packet,           // IN/OUT: Hgfs Packet
  *    HGFS error code on failure.
  *
  * Side effects:
- *    None
+ *    On success the file descriptor is in use until HgfsPutCachedNode.
  *
  *-----------------------------------------------------------------------------
  */
@@ -6717,36 +8450,332 @@ exit:
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerRead --
+ * HgfsServerReadAhead --
  *
- *    Handle a Read request.
+ *    Detects sequential reads of a file node and asks the platform to read
+ *    ahead of them. The read-ahead window starts at
+ *    HGFS_READ_AHEAD_MIN_WINDOW and doubles each time the reader has used
+ *    half of it, up to HGFS_READ_AHEAD_MAX_WINDOW. The windows of all nodes
+ *    of a session are limited to HGFS_READ_AHEAD_SESSION_MAX. A read which
+ *    is not within the current window turns read-ahead off for the node.
+ *
+ *    Reads may be processed out of order by the thread pool, so reads within
+ *    the window behind the last read still count as sequential.
  *
  * Results:
- *    HGFS_ERROR_SUCCESS on success.
- *    HGFS error code on failure.
+ *    None.
  *
  * Side effects:
- *    None
+ *    None.
  *
  *-----------------------------------------------------------------------------
  */
 
 static void
-HgfsServerRead(HgfsInputParam *input)  // IN: Input params
+HgfsServerReadAhead(HgfsHandle file,           // IN: file handle
+                    fileDesc readFd,           // IN: file descriptor
+                    uint64 offset,             // IN: offset of the read
+                    uint32 size,               // IN: size of the read
+                    HgfsSessionInfo *session)  // IN: session info
 {
-   HgfsInternalStatus status;
-   HgfsHandle file;
-   fileDesc readFd;
-   uint64 offset;
-   uint32 requiredSize;
-   size_t replyPayloadSize = 0;
-   size_t replyReadSize = 0;
-   size_t replyReadDataSize = 0;
-   void *replyRead;
+   HgfsFileNode *node;
+   uint64 readEnd = offset + size;
+   uint64 aheadStart = 0;
+   uint64 aheadEnd = 0;
 
-   HGFS_ASSERT_INPUT(input);
+   if (0 == (gHgfsCfgSettings.flags & HGFS_CONFIG_READ_AHEAD_ENABLED) ||
+       0 == size) {
+      return;
+   }
 
-   if (!HgfsUnpackReadRequest(input->payload, input->payloadSize, input->op, &file,
+   MXUser_AcquireForRead(session->nodeArrayLock);
+
+   node = HgfsHandle2FileNode(file, session);
+   if (NULL == node || 0 != (node->flags & HGFS_FILE_NODE_SEQUENTIAL_FL)) {
+      /* Sequential opens read at the file position, not at offset. */
+      MXUser_ReleaseRWLock(session->nodeArrayLock);
+      return;
+   }
+
+   MXUser_AcquireExclLock(session->readAheadLock);
+
+   if (offset != node->readAheadNextOffset &&
+       (0 == node->readAheadWindow ||
+        offset >= node->readAheadEnd ||
+        offset + node->readAheadWindow < node->readAheadNextOffset)) {
+      /* Random access. */
+      session->readAheadBytes -= node->readAheadWindow;
+      node->readAheadWindow = 0;
+      node->readAheadEnd = 0;
+      node->readAheadNextOffset = readEnd;
+      goto exit;
+   }
+
+   node->readAheadNextOffset = MAX(node->readAheadNextOffset, readEnd);
+   if (node->readAheadNextOffset + node->readAheadWindow / 2 >=
+       node->readAheadEnd) {
+      uint32 window = node->readAheadWindow == 0 ?
+                      HGFS_READ_AHEAD_MIN_WINDOW :
+                      MIN(2 * node->readAheadWindow, HGFS_READ_AHEAD_MAX_WINDOW);
+
+      if (session->readAheadBytes - node->readAheadWindow + window <=
+          HGFS_READ_AHEAD_SESSION_MAX) {
+         session->readAheadBytes += window - node->readAheadWindow;
+         node->readAheadWindow = window;
+      }
+
+      if (0 != node->readAheadWindow) {
+         aheadStart = MAX(node->readAheadNextOffset, node->readAheadEnd);
+         aheadEnd = node->readAheadNextOffset + node->readAheadWindow;
+         node->readAheadEnd = MAX(node->readAheadEnd, aheadEnd);
+      }
+   }
+
+exit:
+   MXUser_ReleaseExclLock(session->readAheadLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
+
+   if (aheadEnd > aheadStart) {
+      LOG(10, "%s: handle %u, read ahead %"FMT64"u bytes at %"FMT64"u\n",
+          __FUNCTION__, file, aheadEnd - aheadStart, aheadStart);
+      HgfsPlatformReadAhead(readFd, aheadStart, aheadEnd - aheadStart);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerReadDataPacket --
+ *
+ *    Reads file data into the data packet of a request. The data is read
+ *    straight into the guest mappings if the platform supports it, otherwise
+ *    into the data packet buffer, which may be a bounce buffer.
+ *
+ * Results:
+ *    HGFS_ERROR_SUCCESS on success.
+ *    HGFS error code on failure.
+ *
+ * Side effects:
+ *    The data packet size is set to the size read.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsServerReadDataPacket(HgfsInputParam *input,  // IN: Input params
+                         fileDesc readFd,        // IN: file descriptor
+                         uint64 offset,          // IN: file offset to read from
+                         uint32 requiredSize,    // IN: length of data to read
+                         uint32 *actualSize)     // OUT: actual length read
+{
+   HgfsServerChannelCallbacks *chanCb = input->transportSession->channelCbTable;
+   HgfsInternalStatus status;
+   HgfsVmxIov *iov;
+   uint32 iovCount;
+   void *payload;
+
+   iov = HSPU_GetDataPacketIov(input->packet, BUF_WRITEABLE, requiredSize,
+                               chanCb, &iovCount);
+   if (NULL != iov) {
+      status = HgfsPlatformReadFileIov(readFd, input->session, offset,
+                                       requiredSize, iov, iovCount, actualSize);
+      if (HGFS_ERROR_NOT_SUPPORTED != status) {
+         if (HGFS_ERROR_SUCCESS == status) {
+            HSPU_SetDataPacketSize(input->packet, *actualSize);
+         }
+         return status;
+      }
+
+      /* Release the mappings, nothing was read into them. */
+      HSPU_SetDataPacketSize(input->packet, 0);
+      HSPU_PutDataPacketBuf(input->packet, chanCb);
+   }
+
+   payload = HSPU_GetDataPacketBuf(input->packet, BUF_WRITEABLE, chanCb);
+   if (NULL == payload) {
+      LOG(4, "%s: V3/V4 Failed to get payload -> PROTOCOL_ERROR.\n",
+          __FUNCTION__);
+      return HGFS_ERROR_PROTOCOL;
+   }
+
+   status = HgfsPlatformReadFile(readFd, input->session, offset,
+                                 requiredSize, payload, actualSize);
+   if (HGFS_ERROR_SUCCESS == status) {
+      HSPU_SetDataPacketSize(input->packet, *actualSize);
+   }
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerReadAsyncDone --
+ *
+ *    Completes a read request once its asynchronous file read is done.
+ *    Called on the async I/O completion reactor thread.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    The reply is sent and the read context is freed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerReadAsyncDone(HgfsInternalStatus status,  // IN: read status
+                        uint32 actualSize,          // IN: length read
+                        void *data)                 // IN: read context
+{
+   HgfsServerReadContext *context = data;
+   HgfsInputParam *input = context->input;
+   size_t replyPayloadSize = 0;
+
+   if (HGFS_ERROR_SUCCESS == status) {
+      if (context->useDataBuffer) {
+         HSPU_SetDataPacketSize(input->packet, actualSize);
+      }
+      context->reply->reserved = 0;
+      context->reply->actualSize = actualSize;
+      replyPayloadSize = sizeof *context->reply;
+      if (!context->useDataBuffer) {
+         replyPayloadSize += actualSize;
+      }
+   } else {
+      LOG(4, "%s: async read failed %d.\n", __FUNCTION__, status);
+   }
+
+   HgfsPutCachedNode(context->file, input->session);
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+   free(context);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerReadAsync --
+ *
+ *    Submits the file read of an asynchronous V3/V4 read request without
+ *    waiting for it, when async file I/O is active. The data is read into
+ *    the guest mappings of the data packet or into the reply.
+ *
+ * Results:
+ *    TRUE if the read was submitted, HgfsServerReadAsyncDone completes the
+ *    request and the caller must not touch it anymore.
+ *    FALSE if the caller should read synchronously.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsServerReadAsync(HgfsInputParam *input,    // IN: Input params
+                    HgfsHandle file,          // IN: read file handle
+                    fileDesc readFd,          // IN: file descriptor
+                    uint64 offset,            // IN: file offset to read from
+                    uint32 requiredSize,      // IN: length of data to read
+                    HgfsReplyReadV3 *reply,   // IN: read reply
+                    Bool useDataBuffer)       // IN: read into the data packet
+{
+   HgfsServerChannelCallbacks *chanCb = input->transportSession->channelCbTable;
+   HgfsServerReadContext *context;
+   HgfsInternalStatus status;
+   HgfsVmxIov payloadIov;
+   HgfsVmxIov *iov;
+   uint32 iovCount;
+
+   /*
+    * Compound sub-requests are completed with their compound request.
+    *
+    * The next request for the handle is dispatched as soon as the read is
+    * submitted, so a later write may land before the read completes. The
+    * guest issued both without waiting, so either order is valid, as for
+    * reads and writes from different handles.
+    */
+   if (!gHgfsAsyncIoActive ||
+       0 == (input->packet->state & HGFS_STATE_ASYNC_REQUEST) ||
+       NULL != input->compoundReply ||
+       0 == requiredSize) {
+      return FALSE;
+   }
+
+   if (useDataBuffer) {
+      iov = HSPU_GetDataPacketIov(input->packet, BUF_WRITEABLE, requiredSize,
+                                  chanCb, &iovCount);
+      if (NULL == iov) {
+         return FALSE;
+      }
+   } else {
+      memset(&payloadIov, 0, sizeof payloadIov);
+      payloadIov.va = reply->payload;
+      payloadIov.len = requiredSize;
+      iov = &payloadIov;
+      iovCount = 1;
+   }
+
+   context = Util_SafeMalloc(sizeof *context);
+   context->input = input;
+   context->file = file;
+   context->reply = reply;
+   context->useDataBuffer = useDataBuffer;
+
+   status = HgfsPlatformReadFileIovAsync(readFd, input->session, offset,
+                                         requiredSize, iov, iovCount,
+                                         HgfsServerReadAsyncDone, context);
+   if (HGFS_ERROR_SUCCESS == status) {
+      return TRUE;
+   }
+
+   free(context);
+   if (useDataBuffer) {
+      /* Release the mappings, nothing was read into them. */
+      HSPU_SetDataPacketSize(input->packet, 0);
+      HSPU_PutDataPacketBuf(input->packet, chanCb);
+   }
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerRead --
+ *
+ *    Handle a Read request.
+ *
+ * Results:
+ *    HGFS_ERROR_SUCCESS on success.
+ *    HGFS error code on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerRead(HgfsInputParam *input)  // IN: Input params
+{
+   HgfsInternalStatus status;
+   HgfsHandle file;
+   fileDesc readFd;
+   uint64 offset;
+   uint32 requiredSize;
+   size_t replyPayloadSize = 0;
+   size_t replyReadSize = 0;
+   size_t replyReadDataSize = 0;
+   void *replyRead;
+   Bool readFdUsed = FALSE;
+
+   HGFS_ASSERT_INPUT(input);
+
+   if (!HgfsUnpackReadRequest(input->payload, input->payloadSize, input->op, &file,
                               &offset, &requiredSize)) {
       LOG(4, "%s: Failed to unpack a valid packet -> PROTOCOL_ERROR.\n",
           __FUNCTION__);
@@ -6770,6 +8799,15 @@ HgfsServerRead(HgfsInputParam *input)  // IN: Input params
       LOG(4, "%s: Error: validate args %u.\n", __FUNCTION__, status);
       goto exit;
    }
+   readFdUsed = TRUE;
+
+   status = HgfsServerWriteBehindFlushRange(file, offset, requiredSize,
+                                            input->session);
+   if (status != HGFS_ERROR_SUCCESS) {
+      goto exit;
+   }
+
+   HgfsServerReadAhead(file, readFd, offset, requiredSize, input->session);
 
    replyRead = HgfsAllocInitReply(input->packet,
                                   input->request,
@@ -6780,8 +8818,14 @@ HgfsServerRead(HgfsInputParam *input)  // IN: Input params
    case HGFS_OP_READ_FAST_V4:
    case HGFS_OP_READ_V3: {
          HgfsReplyReadV3 *reply = replyRead;
-         void *payload;
          Bool readUseDataBuffer = replyReadDataSize != 0;
+         uint32 actualSize = 0;
+
+         if (HgfsServerReadAsync(input, file, readFd, offset, requiredSize,
+                                 reply, readUseDataBuffer)) {
+            /* HgfsServerReadAsyncDone releases the node and completes. */
+            return;
+         }
 
          /*
           * The read data size holds the size of the data to read which will be read
@@ -6789,55 +8833,657 @@ HgfsServerRead(HgfsInputParam *input)  // IN: Input params
           * same buffer as the reply arguments.
           */
          if (readUseDataBuffer) {
-            payload = HSPU_GetDataPacketBuf(input->packet, BUF_WRITEABLE,
-                                            input->transportSession->channelCbTable);
+            status = HgfsServerReadDataPacket(input, readFd, offset,
+                                              requiredSize, &actualSize);
          } else {
-            payload = &reply->payload[0];
-         }
-         if (payload) {
-            uint32 actualSize = 0;
             status = HgfsPlatformReadFile(readFd, input->session, offset,
-                                          requiredSize, payload,
+                                          requiredSize, &reply->payload[0],
                                           &actualSize);
-            if (HGFS_ERROR_SUCCESS == status) {
-               reply->reserved = 0;
-               reply->actualSize = actualSize;
-               replyPayloadSize = sizeof *reply;
+         }
+         if (HGFS_ERROR_SUCCESS == status) {
+            reply->reserved = 0;
+            reply->actualSize = actualSize;
+            replyPayloadSize = sizeof *reply;
 
-               if (readUseDataBuffer) {
-                  HSPU_SetDataPacketSize(input->packet, reply->actualSize);
-               } else {
-                  replyPayloadSize += reply->actualSize;
-               }
+            if (!readUseDataBuffer) {
+               replyPayloadSize += reply->actualSize;
             }
+         }
+         break;
+      }
+   case HGFS_OP_READ: {
+         uint32 actualSize = 0;
+         HgfsReplyRead *reply = replyRead;
+
+         status = HgfsPlatformReadFile(readFd, input->session, offset, requiredSize,
+                                       reply->payload, &actualSize);
+         if (HGFS_ERROR_SUCCESS == status) {
+            reply->actualSize = actualSize;
+            replyPayloadSize = sizeof *reply + reply->actualSize;
          } else {
-            status = HGFS_ERROR_PROTOCOL;
-            LOG(4, "%s: V3/V4 Failed to get payload -> PROTOCOL_ERROR.\n",
-                __FUNCTION__);
+            LOG(4, "%s: V1 Failed to read-> %d.\n", __FUNCTION__, status);
+         }
+         break;
+      }
+   default:
+      NOT_REACHED();
+      break;
+   }
+
+exit:
+   if (readFdUsed) {
+      HgfsPutCachedNode(file, input->session);
+   }
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehindFlushInternal --
+ *
+ *    Writes the data buffered in a write-behind buffer to the file, or
+ *    waits for its asynchronous write to complete.
+ *
+ *    The session's writeBehindLock should be acquired prior to calling this
+ *    function, and no lock the completion reactor may take, such as the
+ *    nodeArrayLock, should be held.
+ *
+ * Results:
+ *    HGFS_ERROR_SUCCESS on success.
+ *    HGFS error code on failure, which is also kept in the buffer until it
+ *    is reported.
+ *
+ * Side effects:
+ *    The buffer is empty.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsWriteBehindFlushInternal(HgfsWriteBehind *wb,        // IN: buffer
+                             HgfsSessionInfo *session)   // IN: session info
+{
+   HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
+   uint32 flushedSize = 0;
+
+   if (wb->writing) {
+      while (wb->writing) {
+         MXUser_WaitCondVarExclLock(session->writeBehindLock,
+                                    session->writeBehindWritten);
+      }
+      return wb->error;
+   }
+
+   while (flushedSize < wb->size) {
+      uint32 writtenSize = 0;
+
+      status = HgfsPlatformWriteFile(wb->fd, session, wb->offset + flushedSize,
+                                     wb->size - flushedSize, 0, FALSE, FALSE,
+                                     wb->buf + flushedSize, &writtenSize);
+      if (HGFS_ERROR_SUCCESS == status && 0 == writtenSize) {
+         status = HGFS_ERROR_IO;
+      }
+      if (HGFS_ERROR_SUCCESS != status) {
+         LOG(4, "%s: handle %u, %u bytes at %"FMT64"u lost: %u\n", __FUNCTION__,
+             wb->handle, wb->size - flushedSize, wb->offset + flushedSize,
+             status);
+         if (HGFS_ERROR_SUCCESS == wb->error) {
+            wb->error = status;
          }
          break;
       }
-   case HGFS_OP_READ: {
-         uint32 actualSize = 0;
-         HgfsReplyRead *reply = replyRead;
+      flushedSize += writtenSize;
+   }
+
+   wb->size = 0;
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehindWritten --
+ *
+ *    Completion of the asynchronous write of a write-behind buffer, called
+ *    on the completion reactor thread.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    The buffer is empty.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsWriteBehindWritten(HgfsInternalStatus status,  // IN: write status
+                       uint32 writtenSize,         // IN: bytes written
+                       void *data)                 // IN: write-behind context
+{
+   HgfsWriteBehindContext *context = data;
+   HgfsWriteBehind *wb = context->wb;
+   HgfsSessionInfo *session = context->session;
+
+   MXUser_AcquireExclLock(session->writeBehindLock);
+   ASSERT(wb->writing);
+   if (HGFS_ERROR_SUCCESS != status) {
+      LOG(4, "%s: handle %u, %u bytes at %"FMT64"u lost: %u\n", __FUNCTION__,
+          wb->handle, wb->size - writtenSize, wb->offset + writtenSize,
+          status);
+      if (HGFS_ERROR_SUCCESS == wb->error) {
+         wb->error = status;
+      }
+   }
+   wb->size = 0;
+   wb->writing = FALSE;
+   MXUser_BroadcastCondVar(session->writeBehindWritten);
+   MXUser_ReleaseExclLock(session->writeBehindLock);
+
+   HgfsServerSessionPut(session);
+   free(context);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehindWriteInternal --
+ *
+ *    Starts writing the data buffered in a write-behind buffer to the file
+ *    without waiting for it, when async file I/O is active. Until the write
+ *    completes the buffer is left alone and flushing it waits.
+ *
+ *    The session's writeBehindLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    TRUE if the write was submitted, FALSE if the data should be flushed.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsWriteBehindWriteInternal(HgfsWriteBehind *wb,        // IN: buffer
+                             HgfsSessionInfo *session)   // IN: session info
+{
+   HgfsWriteBehindContext *context;
+   HgfsVmxIov iov;
+
+   ASSERT(!wb->writing && 0 != wb->size);
+
+   if (!gHgfsAsyncIoActive) {
+      return FALSE;
+   }
+
+   context = Util_SafeMalloc(sizeof *context);
+   context->wb = wb;
+   context->session = session;
+   memset(&iov, 0, sizeof iov);
+   iov.va = wb->buf;
+   iov.len = wb->size;
+
+   /* The completion may run first, it waits for the writeBehindLock. */
+   wb->writing = TRUE;
+   HgfsServerSessionGet(session);
+   if (HGFS_ERROR_SUCCESS !=
+       HgfsPlatformWriteFileIovAsync(wb->fd, wb->offset, wb->size, &iov, 1,
+                                     HgfsWriteBehindWritten, context)) {
+      wb->writing = FALSE;
+      HgfsServerSessionPut(session);
+      free(context);
+      return FALSE;
+   }
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsWriteBehindFreeInternal --
+ *
+ *    Removes a write-behind buffer from its session and frees it.
+ *
+ *    The session's writeBehindLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsWriteBehindFreeInternal(HgfsWriteBehind *wb,        // IN: buffer
+                            HgfsSessionInfo *session)   // IN: session info
+{
+   ASSERT(0 == wb->size && !wb->writing);
+   ASSERT(session->writeBehindBytes >= wb->capacity);
+
+   HashTable_Delete(session->writeBehindTable, AS_KEY(wb->handle));
+   session->writeBehindBytes -= wb->capacity;
+   free(wb->utf8Name);
+   free(wb->buf);
+   free(wb);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerWriteBehindFlush --
+ *
+ *    Writes the data buffered for a file handle to the file and frees the
+ *    write-behind buffer.
+ *
+ *    If reportError is TRUE, the error of an earlier deferred write is
+ *    returned and forgotten. Otherwise it is kept, with the buffer, until
+ *    the next operation on the handle reports it, and an asynchronous write
+ *    in flight is not waited for: it writes through its own descriptor, so
+ *    the nodeArrayLock may be held to close the file.
+ *
+ * Results:
+ *    HGFS_ERROR_SUCCESS on success.
+ *    HGFS error code of a failed deferred write.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsServerWriteBehindFlush(HgfsHandle file,            // IN: file handle
+                           Bool reportError,           // IN: report errors
+                           HgfsSessionInfo *session)   // IN: session info
+{
+   HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
+   HgfsWriteBehind *wb;
+
+   if (NULL == session->writeBehindTable) {
+      return HGFS_ERROR_SUCCESS;
+   }
+
+   MXUser_AcquireExclLock(session->writeBehindLock);
+   if (HashTable_Lookup(session->writeBehindTable, AS_KEY(file),
+                        (void **)&wb) &&
+       (reportError || !wb->writing)) {
+      HgfsWriteBehindFlushInternal(wb, session);
+      if (reportError || HGFS_ERROR_SUCCESS == wb->error) {
+         status = wb->error;
+         HgfsWriteBehindFreeInternal(wb, session);
+      }
+   }
+   MXUser_ReleaseExclLock(session->writeBehindLock);
+
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerWriteBehindFlushName --
+ *
+ *    Writes the data buffered for a file, through any of its handles, which
+ *    overlaps a range of the file. Errors are kept until the next operation
+ *    on the handle which buffered the data.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerWriteBehindFlushName(const char *utf8Name,       // IN: file name
+                               uint64 offset,              // IN: range start
+                               uint64 length,              // IN: range length
+                               HgfsSessionInfo *session)   // IN: session info
+{
+   HgfsWriteBehind **wbs;
+   size_t numWbs;
+   size_t i;
+
+   if (NULL == session->writeBehindTable) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(session->writeBehindLock);
+   HashTable_ToArray(session->writeBehindTable, (void ***)&wbs, &numWbs);
+   for (i = 0; i < numWbs; i++) {
+      HgfsWriteBehind *wb = wbs[i];
+
+      if (0 != wb->size &&
+          wb->offset < offset + length && offset < wb->offset + wb->size &&
+          strcmp(wb->utf8Name, utf8Name) == 0) {
+         HgfsWriteBehindFlushInternal(wb, session);
+      }
+   }
+   MXUser_ReleaseExclLock(session->writeBehindLock);
+
+   free(wbs);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerWriteBehindFlushRange --
+ *
+ *    Prepares a read or an unbuffered write through a file handle: writes
+ *    the buffered data of the file which overlaps the range, and reports
+ *    the error of an earlier deferred write through the handle.
+ *
+ * Results:
+ *    HGFS_ERROR_SUCCESS on success.
+ *    HGFS error code of a failed deferred write.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsServerWriteBehindFlushRange(HgfsHandle file,            // IN: file handle
+                                uint64 offset,              // IN: range start
+                                uint64 length,              // IN: range length
+                                HgfsSessionInfo *session)   // IN: session info
+{
+   HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
+   HgfsWriteBehind *wb;
+   uint32 numOthers;
+   char *utf8Name;
+   size_t utf8NameLen;
+
+   if (NULL == session->writeBehindTable) {
+      return HGFS_ERROR_SUCCESS;
+   }
+
+   MXUser_AcquireExclLock(session->writeBehindLock);
+   numOthers = HashTable_GetNumElements(session->writeBehindTable);
+   if (HashTable_Lookup(session->writeBehindTable, AS_KEY(file),
+                        (void **)&wb)) {
+      numOthers--;
+      if (0 != wb->size &&
+          wb->offset < offset + length && offset < wb->offset + wb->size) {
+         HgfsWriteBehindFlushInternal(wb, session);
+      }
+      status = wb->error;
+      wb->error = HGFS_ERROR_SUCCESS;
+   }
+   MXUser_ReleaseExclLock(session->writeBehindLock);
+
+   /* Data written through other handles of the same file. */
+   if (0 != numOthers &&
+       HgfsHandle2FileName(file, session, &utf8Name, &utf8NameLen)) {
+      HgfsServerWriteBehindFlushName(utf8Name, offset, length, session);
+      free(utf8Name);
+   }
+
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerWriteBehindTimer --
+ *
+ *    Work item which writes the data that has been buffered for longer
+ *    than HGFS_WRITE_BEHIND_DELAY_MS, asynchronously when async file I/O
+ *    is active, and frees the idle buffers.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Requeues itself while data is buffered.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerWriteBehindTimer(void *data)  // IN: session info
+{
+   HgfsSessionInfo *session = data;
+   uint64 expiredNS = Hostinfo_SystemTimerNS() -
+                      (uint64)HGFS_WRITE_BEHIND_DELAY_MS * 1000000;
+   HgfsWriteBehind **wbs;
+   size_t numWbs;
+   size_t i;
+   Bool requeue = FALSE;
+
+   MXUser_AcquireExclLock(session->writeBehindLock);
+   HashTable_ToArray(session->writeBehindTable, (void ***)&wbs, &numWbs);
+   for (i = 0; i < numWbs; i++) {
+      HgfsWriteBehind *wb = wbs[i];
+
+      if (0 != wb->size && !wb->writing && wb->dirtyTimeNS <= expiredNS &&
+          !HgfsWriteBehindWriteInternal(wb, session)) {
+         HgfsWriteBehindFlushInternal(wb, session);
+      }
+      if (0 != wb->size) {
+         requeue = TRUE;
+      } else if (HGFS_ERROR_SUCCESS == wb->error &&
+                 wb->dirtyTimeNS <= expiredNS) {
+         HgfsWriteBehindFreeInternal(wb, session);
+      }
+   }
+   free(wbs);
+
+   if (requeue) {
+      requeue = HgfsThreadpool_QueueDelayedWorkItem(HgfsServerWriteBehindTimer,
+                                                    HGFS_WRITE_BEHIND_DELAY_MS,
+                                                    session);
+      if (!requeue) {
+         /* Exiting, write everything now. */
+         HashTable_ToArray(session->writeBehindTable, (void ***)&wbs, &numWbs);
+         for (i = 0; i < numWbs; i++) {
+            HgfsWriteBehindFlushInternal(wbs[i], session);
+         }
+         free(wbs);
+      }
+   }
+   session->writeBehindTimerQueued = requeue;
+   MXUser_ReleaseExclLock(session->writeBehindLock);
+
+   if (!requeue) {
+      HgfsServerSessionPut(session);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerWriteBehind --
+ *
+ *    Buffers the data of a write request, so that small contiguous writes
+ *    through a file handle are merged into fewer, larger writes.
+ *
+ *    The buffered data is written when a write is not contiguous with it or
+ *    does not fit in the buffer, when the buffer is full, when the handle is
+ *    closed, when the file is read, resized or its attributes are queried,
+ *    and HGFS_WRITE_BEHIND_DELAY_MS after the data was buffered.
+ *
+ *    The error of a deferred write is returned by the next read, write or
+ *    close of the handle.
+ *
+ * Results:
+ *    HGFS_ERROR_SUCCESS, buffered is TRUE if the data was buffered and FALSE
+ *    if it should be written now.
+ *    HGFS error code of a failed deferred write.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsServerWriteBehind(HgfsInputParam *input,  // IN: Input params
+                      HgfsHandle file,        // IN: file handle
+                      fileDesc writeFd,       // IN: file descriptor
+                      uint64 writeOffset,     // IN: file offset to write to
+                      uint32 writeSize,       // IN: length of data to write
+                      Bool writeAtOffset,     // IN: data is written at offset
+                      const void *writeData,  // IN: inline data or NULL
+                      Bool *buffered)         // OUT: data was buffered
+{
+   HgfsSessionInfo *session = input->session;
+   HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
+   HgfsWriteBehind *wb = NULL;
+   uint32 capacity = gHgfsCfgSettings.writeBehindSize;
+   char *utf8Name = NULL;
+   size_t utf8NameLen;
+
+   *buffered = FALSE;
+
+   if (NULL == session->writeBehindTable) {
+      return HGFS_ERROR_SUCCESS;
+   }
+
+   if (0 == capacity) {
+      capacity = HGFS_WRITE_BEHIND_DEFAULT_SIZE;
+   }
+   capacity = MIN(capacity, HGFS_WRITE_BEHIND_SESSION_MAX);
+
+   status = HgfsServerWriteBehindFlushRange(file, writeOffset, writeSize,
+                                            session);
+   if (HGFS_ERROR_SUCCESS != status) {
+      return status;
+   }
+
+   if (!writeAtOffset || writeSize > capacity) {
+      return HgfsServerWriteBehindFlush(file, TRUE, session);
+   }
+
+   MXUser_AcquireExclLock(session->writeBehindLock);
+
+   if (!HashTable_Lookup(session->writeBehindTable, AS_KEY(file),
+                         (void **)&wb)) {
+      if (session->writeBehindBytes + capacity > HGFS_WRITE_BEHIND_SESSION_MAX) {
+         /* Too much is buffered already, write this directly. */
+         goto exit;
+      }
+
+      MXUser_ReleaseExclLock(session->writeBehindLock);
+      if (!HgfsHandle2FileName(file, session, &utf8Name, &utf8NameLen)) {
+         return HGFS_ERROR_INVALID_HANDLE;
+      }
+      MXUser_AcquireExclLock(session->writeBehindLock);
+
+      /* Requests for a handle are serialized, nobody added it meanwhile. */
+      ASSERT(!HashTable_Lookup(session->writeBehindTable, AS_KEY(file),
+                               NULL));
+      if (session->writeBehindBytes + capacity > HGFS_WRITE_BEHIND_SESSION_MAX) {
+         goto exit;
+      }
+
+      wb = Util_SafeCalloc(1, sizeof *wb);
+      wb->handle = file;
+      wb->utf8Name = utf8Name;
+      wb->buf = Util_SafeMalloc(capacity);
+      wb->capacity = capacity;
+      utf8Name = NULL;
+      HashTable_Insert(session->writeBehindTable, AS_KEY(file), wb);
+      session->writeBehindBytes += capacity;
+   }
+
+   if (wb->writing) {
+      /* The buffer is being written, the write completes in this call. */
+      status = HgfsWriteBehindFlushInternal(wb, session);
+      wb->error = HGFS_ERROR_SUCCESS;
+      if (HGFS_ERROR_SUCCESS != status) {
+         goto exit;
+      }
+   }
+
+   if (0 != wb->size &&
+       (writeOffset != wb->offset + wb->size ||
+        writeSize > wb->capacity - wb->size ||
+        writeFd != wb->fd)) {
+      status = HgfsWriteBehindFlushInternal(wb, session);
+      if (HGFS_ERROR_SUCCESS != status) {
+         wb->error = HGFS_ERROR_SUCCESS;
+         goto exit;
+      }
+   }
+
+   if (0 == wb->size) {
+      wb->fd = writeFd;
+      wb->offset = writeOffset;
+      wb->dirtyTimeNS = Hostinfo_SystemTimerNS();
+   }
+
+   if (NULL != writeData) {
+      memcpy(wb->buf + wb->size, writeData, writeSize);
+   } else {
+      HgfsServerChannelCallbacks *chanCb =
+         input->transportSession->channelCbTable;
+      HgfsVmxIov *iov;
+      uint32 iovCount;
+      uint32 copiedSize = 0;
+      uint32 i;
+
+      iov = HSPU_GetDataPacketIov(input->packet, BUF_READABLE, writeSize,
+                                  chanCb, &iovCount);
+      if (NULL == iov) {
+         LOG(4, "%s: Error: Op %d mapping write data buffer\n",
+             __FUNCTION__, input->op);
+         status = HGFS_ERROR_PROTOCOL;
+         goto exit;
+      }
+      for (i = 0; i < iovCount && copiedSize < writeSize; i++) {
+         uint32 copySize = MIN(iov[i].len, writeSize - copiedSize);
 
-         status = HgfsPlatformReadFile(readFd, input->session, offset, requiredSize,
-                                       reply->payload, &actualSize);
-         if (HGFS_ERROR_SUCCESS == status) {
-            reply->actualSize = actualSize;
-            replyPayloadSize = sizeof *reply + reply->actualSize;
-         } else {
-            LOG(4, "%s: V1 Failed to read-> %d.\n", __FUNCTION__, status);
-         }
-         break;
+         memcpy(wb->buf + wb->size + copiedSize, iov[i].va, copySize);
+         copiedSize += copySize;
+      }
+      ASSERT(copiedSize == writeSize);
+   }
+   wb->size += writeSize;
+   *buffered = TRUE;
+
+   if (wb->size == wb->capacity) {
+      /* An asynchronous write reports its error later, like the timer's. */
+      if (!HgfsWriteBehindWriteInternal(wb, session)) {
+         status = HgfsWriteBehindFlushInternal(wb, session);
+         wb->error = HGFS_ERROR_SUCCESS;
+      }
+   } else if (!session->writeBehindTimerQueued) {
+      HgfsServerSessionGet(session);
+      session->writeBehindTimerQueued =
+         HgfsThreadpool_QueueDelayedWorkItem(HgfsServerWriteBehindTimer,
+                                             HGFS_WRITE_BEHIND_DELAY_MS,
+                                             session);
+      if (!session->writeBehindTimerQueued) {
+         HgfsServerSessionPut(session);
+         status = HgfsWriteBehindFlushInternal(wb, session);
+         wb->error = HGFS_ERROR_SUCCESS;
       }
-   default:
-      NOT_REACHED();
-      break;
    }
 
 exit:
-   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+   MXUser_ReleaseExclLock(session->writeBehindLock);
+   free(utf8Name);
+
+   return status;
 }
 
 
@@ -6877,7 +9523,7 @@ exit:
  *    HGFS error code on failure.
  *
  * Side effects:
- *    None
+ *    On success the file descriptor is in use until HgfsPutCachedNode.
  *
  *-----------------------------------------------------------------------------
  */
@@ -6978,6 +9624,7 @@ HgfsServerValidateWrite(HgfsInputParam *input,     // IN: Input params
    if (!HgfsHandleIsSequentialOpen(writeHandle, input->session, &sequentialHandle)) {
       status = HGFS_ERROR_INVALID_HANDLE;
       LOG(4, "%s: Could not get sequential open status\n", __FUNCTION__);
+      HgfsPutCachedNode(writeHandle, input->session);
       goto exit;
    }
 
@@ -6985,6 +9632,7 @@ HgfsServerValidateWrite(HgfsInputParam *input,     // IN: Input params
    if (!HgfsHandle2AppendFlag(writeHandle, input->session, &appendHandle)) {
       status = HGFS_ERROR_INVALID_HANDLE;
       LOG(4, "%s: Could not get append mode\n", __FUNCTION__);
+      HgfsPutCachedNode(writeHandle, input->session);
       goto exit;
    }
 #endif
@@ -7029,6 +9677,9 @@ HgfsServerWrite(HgfsInputParam *input)  // IN: Input params
    fileDesc writeFd;
    Bool writeSequential;
    Bool writeAppend;
+   Bool writeFdUsed = FALSE;
+
+   Bool buffered = FALSE;
 
    HGFS_ASSERT_INPUT(input);
 
@@ -7041,6 +9692,17 @@ HgfsServerWrite(HgfsInputParam *input)  // IN: Input params
       goto exit;
    }
 
+   if (0 != (writeFlags & HGFS_WRITE_APPEND)) {
+      /*
+       * The file descriptor is reopened for appending, buffered data must
+       * be written with the current one.
+       */
+      status = HgfsServerWriteBehindFlush(writeFile, TRUE, input->session);
+      if (HGFS_ERROR_SUCCESS != status) {
+         goto exit;
+      }
+   }
+
    /*
     * Validate the write arguments with the data and request buffers to ensure
     * there isn't a malformed request or we try to write more data than is in the buffer.
@@ -7057,42 +9719,430 @@ HgfsServerWrite(HgfsInputParam *input)  // IN: Input params
       LOG(4, "%s: Error: validate args %u.\n", __FUNCTION__, status);
       goto exit;
    }
+   writeFdUsed = TRUE;
+
+   if (writeSize > 0) {
+      if (NULL == writeData) {
+         HSPU_SetDataPacketSize(input->packet, writeSize);
+      }
+
+      status = HgfsServerWriteBehind(input, writeFile, writeFd, writeOffset,
+                                     writeSize,
+                                     !writeSequential && !writeAppend,
+                                     writeData, &buffered);
+      if (HGFS_ERROR_SUCCESS != status) {
+         goto exit;
+      }
+      status = HGFS_ERROR_NOT_SUPPORTED;
+
+      if (buffered) {
+         writtenSize = writeSize;
+         status = HGFS_ERROR_SUCCESS;
+      } else if (NULL == writeData) {
+         HgfsServerChannelCallbacks *chanCb =
+            input->transportSession->channelCbTable;
+         HgfsVmxIov *iov;
+         uint32 iovCount;
+
+         /*
+          * No inline data to write, get it from the transport shared memory.
+          * Write straight from the guest mappings if the platform supports
+          * it, otherwise through the data packet buffer.
+          */
+         iov = HSPU_GetDataPacketIov(input->packet, BUF_READABLE, writeSize,
+                                     chanCb, &iovCount);
+         if (NULL != iov) {
+            status = HgfsPlatformWriteFileIov(writeFd,
+                                              input->session,
+                                              writeOffset,
+                                              writeSize,
+                                              writeFlags,
+                                              writeSequential,
+                                              writeAppend,
+                                              iov,
+                                              iovCount,
+                                              &writtenSize);
+            if (HGFS_ERROR_NOT_SUPPORTED == status) {
+               /* Release the mappings, nothing was written from them. */
+               HSPU_SetDataPacketSize(input->packet, 0);
+               HSPU_PutDataPacketBuf(input->packet, chanCb);
+               HSPU_SetDataPacketSize(input->packet, writeSize);
+            }
+         }
+
+         if (HGFS_ERROR_NOT_SUPPORTED == status) {
+            writeData = HSPU_GetDataPacketBuf(input->packet, BUF_READABLE,
+                                              chanCb);
+            if (NULL == writeData) {
+               LOG(4, "%s: Error: Op %d mapping write data buffer\n",
+                   __FUNCTION__, input->op);
+               status = HGFS_ERROR_PROTOCOL;
+               goto exit;
+            }
+         }
+      }
+
+      if (HGFS_ERROR_NOT_SUPPORTED == status) {
+         status = HgfsPlatformWriteFile(writeFd,
+                                        input->session,
+                                        writeOffset,
+                                        writeSize,
+                                        writeFlags,
+                                        writeSequential,
+                                        writeAppend,
+                                        writeData,
+                                        &writtenSize);
+      }
+      if (HGFS_ERROR_SUCCESS != status) {
+         goto exit;
+      }
+      HgfsServerCacheRemoveHandle(writeFile, input->session, FALSE);
+   }
+
+   if (!HgfsPackWriteReply(input->packet, input->request, input->op,
+                           writtenSize, &writeReplySize, input->session)) {
+      status = HGFS_ERROR_INTERNAL;
+   }
+
+exit:
+   if (writeFdUsed) {
+      HgfsPutCachedNode(writeFile, input->session);
+   }
+   HgfsServerCompleteRequest(status, writeReplySize, input);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerCopyRange --
+ *
+ *    Handle a copy range request. Data is copied between two open files on
+ *    the host, without going through the client. At most
+ *    HGFS_COPY_RANGE_MAX bytes are copied, the client asks for the rest.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerCopyRange(HgfsInputParam *input)  // IN: Input params
+{
+   HgfsHandle srcFile;
+   HgfsHandle dstFile;
+   uint64 srcOffset;
+   uint64 dstOffset;
+   uint64 length;
+   fileDesc srcFd;
+   fileDesc dstFd;
+   Bool srcSequential;
+   Bool dstSequential;
+   Bool srcFdUsed = FALSE;
+   Bool dstFdUsed = FALSE;
+   Bool cloned = FALSE;
+   uint32 copiedSize = 0;
+   size_t replyPayloadSize = 0;
+   HgfsInternalStatus status;
+
+   HGFS_ASSERT_INPUT(input);
+
+   if (!HgfsUnpackCopyRangeRequest(input->payload, input->payloadSize,
+                                   input->op, &srcFile, &srcOffset,
+                                   &dstFile, &dstOffset, &length)) {
+      status = HGFS_ERROR_PROTOCOL;
+      goto exit;
+   }
+   length = MIN(length, HGFS_COPY_RANGE_MAX);
+
+   status = HgfsPlatformGetFd(srcFile, input->session, FALSE, &srcFd);
+   if (HGFS_ERROR_SUCCESS != status) {
+      goto exit;
+   }
+   srcFdUsed = TRUE;
+
+   status = HgfsPlatformGetFd(dstFile, input->session, FALSE, &dstFd);
+   if (HGFS_ERROR_SUCCESS != status) {
+      goto exit;
+   }
+   dstFdUsed = TRUE;
+
+   if (!HgfsHandleIsSequentialOpen(srcFile, input->session, &srcSequential) ||
+       !HgfsHandleIsSequentialOpen(dstFile, input->session, &dstSequential)) {
+      status = HGFS_ERROR_INVALID_HANDLE;
+      goto exit;
+   }
+   if (srcSequential || dstSequential) {
+      /* Sequential files are read and written at their file position. */
+      status = HGFS_ERROR_NOT_SUPPORTED;
+      goto exit;
+   }
+
+   /* Buffered data must be in the files before the host copies them. */
+   status = HgfsServerWriteBehindFlushRange(srcFile, srcOffset, length,
+                                            input->session);
+   if (HGFS_ERROR_SUCCESS == status) {
+      status = HgfsServerWriteBehindFlushRange(dstFile, dstOffset, length,
+                                               input->session);
+   }
+   if (HGFS_ERROR_SUCCESS != status) {
+      goto exit;
+   }
+
+   status = HgfsPlatformCopyRange(srcFd, srcOffset, dstFd, dstOffset,
+                                  (uint32)length, &copiedSize, &cloned);
+   if (HGFS_ERROR_SUCCESS != status) {
+      LOG(4, "%s: copy from %u to %u failed %d\n", __FUNCTION__, srcFile,
+          dstFile, status);
+      goto exit;
+   }
+   HgfsServerCacheRemoveHandle(dstFile, input->session, FALSE);
+
+   if (!HgfsPackCopyRangeReply(input->packet, input->request, input->op,
+                               copiedSize, cloned, &replyPayloadSize,
+                               input->session)) {
+      status = HGFS_ERROR_INTERNAL;
+   }
+
+exit:
+   if (dstFdUsed) {
+      HgfsPutCachedNode(dstFile, input->session);
+   }
+   if (srcFdUsed) {
+      HgfsPutCachedNode(srcFile, input->session);
+   }
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerFsyncDone --
+ *
+ *    Completes a fsync request once its asynchronous flush is done.
+ *    Called on the async I/O completion reactor thread.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    The reply is sent and the fsync context is freed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerFsyncDone(HgfsInternalStatus status,  // IN: flush status
+                    uint32 actualSize,          // IN: unused
+                    void *data)                 // IN: fsync context
+{
+   HgfsServerFsyncContext *context = data;
+   HgfsInputParam *input = context->input;
+   size_t replyPayloadSize = 0;
+
+   if (HGFS_ERROR_SUCCESS != status) {
+      LOG(4, "%s: async fsync of %u failed %d\n", __FUNCTION__,
+          context->file, status);
+   } else if (!HgfsPackFsyncReply(input->packet, input->request, input->op,
+                                  &replyPayloadSize, input->session)) {
+      status = HGFS_ERROR_INTERNAL;
+   }
+
+   HgfsPutCachedNode(context->file, input->session);
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+   free(context);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerFsync --
+ *
+ *    Handle a fsync request: flush an open file, or a directory open for a
+ *    search, to storage without closing it. Data buffered for the file by
+ *    the server is written first and the errors of deferred writes are
+ *    reported, as fsync(2) does.
+ *
+ *    The flush is submitted without waiting for it when async file I/O is
+ *    active, otherwise it blocks the thread processing the request.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerFsync(HgfsInputParam *input)  // IN: Input params
+{
+   HgfsHandle file;
+   Bool dataOnly;
+   fileDesc fd;
+   Bool fdUsed = FALSE;
+   HgfsSearch search;
+   size_t replyPayloadSize = 0;
+   HgfsInternalStatus status;
+
+   HGFS_ASSERT_INPUT(input);
+
+   if (!HgfsUnpackFsyncRequest(input->payload, input->payloadSize, input->op,
+                               &file, &dataOnly)) {
+      status = HGFS_ERROR_PROTOCOL;
+      goto exit;
+   }
+
+   LOG(4, "%s: fsync fh %u%s\n", __FUNCTION__, file,
+       dataOnly ? " data only" : "");
+
+   if (HgfsGetSearchCopy(file, input->session, &search)) {
+      /* Virtual directories, i.e. the share list, have nothing to flush. */
+      if (DIRECTORY_SEARCH_TYPE_DIR == search.type) {
+         status = HgfsPlatformFsyncDirectory(search.utf8Dir);
+      } else {
+         status = HGFS_ERROR_SUCCESS;
+      }
+      free(search.utf8Dir);
+      free(search.utf8ShareName);
+   } else {
+      status = HgfsServerWriteBehindFlush(file, TRUE, input->session);
+      if (HGFS_ERROR_SUCCESS != status) {
+         goto exit;
+      }
+
+      status = HgfsPlatformGetFd(file, input->session, FALSE, &fd);
+      if (HGFS_ERROR_SUCCESS != status) {
+         goto exit;
+      }
+      fdUsed = TRUE;
+
+      /* Compound sub-requests are completed with their compound request. */
+      if (gHgfsAsyncIoActive &&
+          0 != (input->packet->state & HGFS_STATE_ASYNC_REQUEST) &&
+          NULL == input->compoundReply) {
+         HgfsServerFsyncContext *context = Util_SafeMalloc(sizeof *context);
+
+         context->input = input;
+         context->file = file;
+         if (HGFS_ERROR_SUCCESS ==
+             HgfsPlatformFsyncAsync(fd, dataOnly, HgfsServerFsyncDone,
+                                    context)) {
+            /* HgfsServerFsyncDone releases the node and completes. */
+            return;
+         }
+         free(context);
+      }
+
+      status = HgfsPlatformFsync(fd, dataOnly);
+   }
+
+   if (HGFS_ERROR_SUCCESS == status &&
+       !HgfsPackFsyncReply(input->packet, input->request, input->op,
+                           &replyPayloadSize, input->session)) {
+      status = HGFS_ERROR_INTERNAL;
+   }
+
+exit:
+   if (fdUsed) {
+      HgfsPutCachedNode(file, input->session);
+   }
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerAccessCheck --
+ *
+ *    Handle an access check request: whether the client may access a file
+ *    with the given permissions, as access(2) does, without opening it or
+ *    getting its attributes. The reply has no data, the status is the
+ *    answer.
+ *
+ *    Access must be allowed by both the share and the file. Write access is
+ *    denied on read only shares, with a file not found error if the file
+ *    does not exist.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerAccessCheck(HgfsInputParam *input)  // IN: Input params
+{
+   const char *cpName;
+   size_t cpNameSize;
+   uint32 caseFlags;
+   HgfsPermissions perms;
+   HgfsShareInfo shareInfo;
+   HgfsShareOptions configOptions;
+   Bool followSymlinks;
+   HgfsNameStatus nameStatus;
+   char *utf8Name = NULL;
+   size_t utf8NameLen;
+   size_t replyPayloadSize = 0;
+   HgfsInternalStatus status;
+
+   HGFS_ASSERT_INPUT(input);
+
+   if (!HgfsUnpackAccessCheckRequest(input->payload, input->payloadSize,
+                                     input->op, &cpName, &cpNameSize,
+                                     &caseFlags, &perms)) {
+      status = HGFS_ERROR_PROTOCOL;
+      goto exit;
+   }
+
+   nameStatus = HgfsServerGetLocalNameInfo(cpName, cpNameSize, caseFlags,
+                                           input->session, &shareInfo,
+                                           &utf8Name, &utf8NameLen);
+   if (HGFS_NAME_STATUS_COMPLETE != nameStatus) {
+      LOG(4, "%s: access check of a name not in a share\n", __FUNCTION__);
+      status = HgfsPlatformConvertFromNameStatus(nameStatus);
+      goto exit;
+   }
 
-   if (writeSize > 0) {
-      if (NULL == writeData) {
-         /* No inline data to write, get it from the transport shared memory. */
-         HSPU_SetDataPacketSize(input->packet, writeSize);
-         writeData = HSPU_GetDataPacketBuf(input->packet, BUF_READABLE,
-                                           input->transportSession->channelCbTable);
-         if (NULL == writeData) {
-            LOG(4, "%s: Error: Op %d mapping write data buffer\n",
-                __FUNCTION__, input->op);
-            status = HGFS_ERROR_PROTOCOL;
-            goto exit;
-         }
-      }
-
-      status = HgfsPlatformWriteFile(writeFd,
-                                     input->session,
-                                     writeOffset,
-                                     writeSize,
-                                     writeFlags,
-                                     writeSequential,
-                                     writeAppend,
-                                     writeData,
-                                     &writtenSize);
-      if (HGFS_ERROR_SUCCESS != status) {
-         goto exit;
-      }
+   nameStatus = HgfsServerGetShareOptions(cpName, cpNameSize, &configOptions);
+   if (HGFS_NAME_STATUS_COMPLETE != nameStatus) {
+      LOG(4, "%s: no matching share: %s.\n", __FUNCTION__, cpName);
+      status = HgfsPlatformConvertFromNameStatus(nameStatus);
+      goto exit;
    }
 
-   if (!HgfsPackWriteReply(input->packet, input->request, input->op,
-                           writtenSize, &writeReplySize, input->session)) {
+   followSymlinks = HgfsServerPolicy_IsShareOptionSet(configOptions,
+                                                      HGFS_SHARE_FOLLOW_SYMLINKS);
+   status = HgfsPlatformAccessCheck(utf8Name, perms, followSymlinks);
+   if (HGFS_ERROR_SUCCESS == status &&
+       ((0 != (perms & HGFS_PERM_WRITE) && !shareInfo.writePermissions) ||
+        (0 != (perms & (HGFS_PERM_READ | HGFS_PERM_EXEC)) &&
+         !shareInfo.readPermissions))) {
+      status = HGFS_ERROR_ACCESS_DENIED;
+   }
+   LOG(4, "%s: access %#x to \"%s\": %d\n", __FUNCTION__, perms, utf8Name,
+       status);
+
+   if (HGFS_ERROR_SUCCESS == status &&
+       !HgfsPackAccessCheckReply(input->packet, input->request, input->op,
+                                 &replyPayloadSize, input->session)) {
       status = HGFS_ERROR_INTERNAL;
    }
 
 exit:
-   HgfsServerCompleteRequest(status, writeReplySize, input);
+   free(utf8Name);
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
 }
 
 
@@ -7312,8 +10362,8 @@ HgfsSymlinkCreate(HgfsSessionInfo *session, // IN: session info,
    if (nameStatus == HGFS_NAME_STATUS_COMPLETE) {
       if (shareInfo.writePermissions ) {
          /* Get the config options. */
-         nameStatus = HgfsServerPolicy_GetShareOptions(srcFileName, srcFileNameLength,
-                                                       &configOptions);
+         nameStatus = HgfsServerGetShareOptions(srcFileName, srcFileNameLength,
+                                                &configOptions);
          if (nameStatus == HGFS_NAME_STATUS_COMPLETE) {
             /* Prohibit symlink ceation if symlink following is enabled. */
             if (HgfsServerPolicy_IsShareOptionSet(configOptions, HGFS_SHARE_FOLLOW_SYMLINKS)) {
@@ -7345,6 +10395,9 @@ HgfsSymlinkCreate(HgfsSessionInfo *session, // IN: session info,
       localTargetName[trgFileNameLength] = '\0';
 
       status = HgfsPlatformSymlinkCreate(localSymlinkName, localTargetName);
+      if (HGFS_ERROR_SUCCESS == status) {
+         HgfsServerCacheRemove(session, localSymlinkName, TRUE);
+      }
    }
 
    free(localSymlinkName);
@@ -7525,10 +10578,12 @@ HgfsValidateRenameFile(Bool useHandle,            // IN:
           */
         LOG(4, "%s: could not get file name for fd %d\n", __FUNCTION__, *descr);
         status = HGFS_ERROR_INVALID_HANDLE;
+        HgfsPutCachedNode(fileHandle, session);
       } else if (HgfsHandleIsSharedFolderOpen(fileHandle, session, &sharedFolderOpen) &&
                                               sharedFolderOpen) {
          LOG(4, "%s: Cannot rename shared folder\n", __FUNCTION__);
          status = HGFS_ERROR_ACCESS_DENIED;
+         HgfsPutCachedNode(fileHandle, session);
       }
    } else {
       nameStatus = HgfsServerGetLocalNameInfo(cpName,
@@ -7619,6 +10674,8 @@ HgfsServerRename(HgfsInputParam *input)  // IN: Input params
    uint32 newCaseFlags;
    HgfsShareInfo shareInfo;
    size_t replyPayloadSize = 0;
+   Bool srcFileUsed = FALSE;
+   Bool targetFileUsed = FALSE;
 
    HGFS_ASSERT_INPUT(input);
 
@@ -7637,6 +10694,8 @@ HgfsServerRename(HgfsInputParam *input)  // IN: Input params
                                       &utf8OldName,
                                       &utf8OldNameLen);
       if (HGFS_ERROR_SUCCESS == status) {
+         srcFileUsed = (hints & HGFS_RENAME_HINT_USE_SRCFILE_DESC) != 0;
+
          /*
           * Renaming a file requires both read and write permssions for the
           * original file.
@@ -7662,6 +10721,8 @@ HgfsServerRename(HgfsInputParam *input)  // IN: Input params
                                       &utf8NewName,
                                       &utf8NewNameLen);
             if (HGFS_ERROR_SUCCESS == status) {
+               targetFileUsed = (hints & HGFS_RENAME_HINT_USE_TARGETFILE_DESC) != 0;
+
                /*
                 * Renaming a file requires both read and write permssions for
                 * the target directory.
@@ -7692,6 +10753,8 @@ HgfsServerRename(HgfsInputParam *input)  // IN: Input params
       if (HGFS_ERROR_SUCCESS == status) {
          /* Update all file nodes that refer to this file to contain the new name. */
          HgfsUpdateNodeNames(utf8OldName, utf8NewName, input->session);
+         HgfsServerCacheRemove(input->session, utf8OldName, TRUE);
+         HgfsServerCacheRemove(input->session, utf8NewName, TRUE);
          if (!HgfsPackRenameReply(input->packet, input->request, input->op,
                                   &replyPayloadSize, input->session)) {
             status = HGFS_ERROR_INTERNAL;
@@ -7699,6 +10762,12 @@ HgfsServerRename(HgfsInputParam *input)  // IN: Input params
       }
    }
 
+   if (srcFileUsed) {
+      HgfsPutCachedNode(srcFile, input->session);
+   }
+   if (targetFileUsed) {
+      HgfsPutCachedNode(targetFile, input->session);
+   }
    free(utf8OldName);
    free(utf8NewName);
 
@@ -7773,6 +10842,7 @@ HgfsServerCreateDir(HgfsInputParam *input)  // IN: Input params
       if (shareInfo.writePermissions) {
          status = HgfsPlatformCreateDir(&info, utf8Name);
          if (HGFS_ERROR_SUCCESS == status) {
+            HgfsServerCacheRemove(input->session, utf8Name, TRUE);
             if (!HgfsPackCreateDirReply(input->packet, input->request, info.requestType,
                                         &replyPayloadSize, input->session)) {
                status = HGFS_ERROR_PROTOCOL;
@@ -7860,6 +10930,9 @@ HgfsServerDeleteFile(HgfsInputParam *input)  // IN: Input params
                                &cpNameSize, &hints, &file, &caseFlags)) {
       if (hints & HGFS_DELETE_HINT_USE_FILE_DESC) {
          status = HgfsPlatformDeleteFileByHandle(file, input->session);
+         if (HGFS_ERROR_SUCCESS == status) {
+            HgfsServerCacheRemoveHandle(file, input->session, TRUE);
+         }
       } else {
          char *utf8Name = NULL;
          size_t utf8NameLen;
@@ -7891,6 +10964,9 @@ HgfsServerDeleteFile(HgfsInputParam *input)  // IN: Input params
             } else {
                LOG(4, "%s: deleting \"%s\"\n", __FUNCTION__, utf8Name);
                status = HgfsPlatformDeleteFileByName(utf8Name);
+               if (HGFS_ERROR_SUCCESS == status) {
+                  HgfsServerCacheRemove(input->session, utf8Name, TRUE);
+               }
             }
             free(utf8Name);
          } else {
@@ -7965,8 +11041,11 @@ HgfsServerDeleteDir(HgfsInputParam *input)  // IN: Input params
                if (HGFS_ERROR_SUCCESS != status) {
                   LOG(4, "%s: error deleting directory %d: %d\n", __FUNCTION__,
                      file, status);
+               } else {
+                  HgfsServerCacheRemoveHandle(file, input->session, TRUE);
                }
             }
+            HgfsPutCachedNode(file, input->session);
          } else {
             LOG(4, "%s: could not map cached handle %u, error %u\n",
                __FUNCTION__, file, status);
@@ -7996,37 +11075,279 @@ HgfsServerDeleteDir(HgfsInputParam *input)  // IN: Input params
                }
                LOG(4, "HgfsServerDeleteDir: failed access check, error %d\n", status);
             } else {
-               LOG(4, "%s: removing \"%s\"\n", __FUNCTION__, utf8Name);
-               status = HgfsPlatformDeleteDirByName(utf8Name);
+               LOG(4, "%s: removing \"%s\"\n", __FUNCTION__, utf8Name);
+               status = HgfsPlatformDeleteDirByName(utf8Name);
+               if (HGFS_ERROR_SUCCESS == status) {
+                  HgfsServerCacheRemove(input->session, utf8Name, TRUE);
+               }
+            }
+            free(utf8Name);
+         } else {
+            LOG(4, "%s: access check failed\n", __FUNCTION__);
+            status = HgfsPlatformConvertFromNameStatus(nameStatus);
+         }
+      }
+      if (HGFS_ERROR_SUCCESS == status) {
+         if (!HgfsPackDeleteReply(input->packet, input->request, input->op,
+                                  &replyPayloadSize, input->session)) {
+            status = HGFS_ERROR_INTERNAL;
+         }
+      }
+   } else {
+      status = HGFS_ERROR_PROTOCOL;
+   }
+
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerServerLockChange --
+ *
+ *    Called by the client when it wants to either acquire an oplock on a file
+ *    that was previously opened, or when it wants to release/downgrade an
+ *    oplock on a file that was previously oplocked.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerServerLockChange(HgfsInputParam *input)  // IN: Input params
+{
+
+   HGFS_ASSERT_INPUT(input);
+
+   HgfsServerCompleteRequest(HGFS_ERROR_NOT_SUPPORTED, 0, input);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerWriteWin32Stream --
+ *
+ *    Handle a write request in the WIN32_STREAM_ID format.
+ *
+ * Results:
+ *    ERROR_SUCCESS or an appropriate Win32 error code.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsServerWriteWin32Stream(HgfsInputParam *input)  // IN: Input params
+{
+   uint32  actualSize;
+   HgfsInternalStatus status;
+   HgfsHandle file;
+   const char *dataToWrite;
+   Bool doSecurity;
+   size_t replyPayloadSize = 0;
+   size_t requiredSize;
+
+   HGFS_ASSERT_INPUT(input);
+
+   if (HgfsUnpackWriteWin32StreamRequest(input->payload, input->payloadSize, input->op, &file,
+                                         &dataToWrite, &requiredSize, &doSecurity)) {
+      status = HgfsPlatformWriteWin32Stream(file, (char *)dataToWrite, (uint32)requiredSize,
+                                            doSecurity, &actualSize, input->session);
+      if (HGFS_ERROR_SUCCESS == status) {
+         if (!HgfsPackWriteWin32StreamReply(input->packet, input->request, input->op,
+                                            actualSize, &replyPayloadSize,
+                                            input->session)) {
+            status = HGFS_ERROR_INTERNAL;
+         }
+      }
+   } else {
+      status = HGFS_ERROR_PROTOCOL;
+   }
+
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerSetDirWatchByHandle --
+ *
+ *    Sets directory notification watch request using directory handle.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsServerSetDirWatchByHandle(HgfsInputParam *input,         // IN: Input params
+                              HgfsHandle dir,                // IN: directory handle
+                              uint32 events,                 // IN: event types to report
+                              Bool watchTree,                // IN: recursive watch
+                              HgfsSubscriberHandle *watchId) // OUT: watch id
+{
+   HgfsInternalStatus status;
+   char *fileName = NULL;
+   size_t fileNameSize;
+   HgfsSharedFolderHandle sharedFolder = HGFS_INVALID_FOLDER_HANDLE;
+
+   LOG(8, "%s: entered\n", __FUNCTION__);
+
+   ASSERT(watchId != NULL);
+
+   if (HgfsHandle2NotifyInfo(dir, input->session, &fileName, &fileNameSize,
+                             &sharedFolder)) {
+      LOG(4, "%s: adding a subscriber on shared folder handle %#x\n",
+          __FUNCTION__, sharedFolder);
+      *watchId = HgfsNotify_AddSubscriber(sharedFolder, fileName, events, watchTree,
+                                          input->session);
+      status = (HGFS_INVALID_SUBSCRIBER_HANDLE == *watchId) ? HGFS_ERROR_INTERNAL :
+                                                              HGFS_ERROR_SUCCESS;
+      LOG(4, "%s: result of add subscriber id %"FMT64"x status %u\n",
+          __FUNCTION__, *watchId, status);
+   } else {
+      status = HGFS_ERROR_INTERNAL;
+   }
+   free(fileName);
+   LOG(8, "%s: exit %u\n", __FUNCTION__, status);
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerSetDirWatchByName --
+ *
+ *    Sets directory notification watch request using directory name.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsServerSetDirWatchByName(HgfsInputParam *input,         // IN: Input params
+                            const char *cpName,            // IN: directory name
+                            uint32 cpNameSize,             // IN: directory name length
+                            uint32 caseFlags,              // IN: case flags
+                            uint32 events,                 // IN: event types to report
+                            Bool watchTree,                // IN: recursive watch
+                            HgfsSubscriberHandle *watchId) // OUT: watch id
+{
+   HgfsInternalStatus status;
+   HgfsNameStatus nameStatus;
+   char *utf8Name = NULL;
+   size_t utf8NameLen;
+   HgfsShareInfo shareInfo;
+   HgfsSharedFolderHandle sharedFolder = HGFS_INVALID_FOLDER_HANDLE;
+
+   ASSERT(cpName != NULL);
+   ASSERT(watchId != NULL);
+
+   LOG(8, "%s: entered\n",__FUNCTION__);
+
+   nameStatus = HgfsServerGetLocalNameInfo(cpName, cpNameSize, caseFlags,
+                                           input->session, &shareInfo,
+                                           &utf8Name, &utf8NameLen);
+   if (HGFS_NAME_STATUS_COMPLETE == nameStatus) {
+      char const *inEnd = cpName + cpNameSize;
+      char const *next;
+      int len;
+
+      ASSERT(utf8Name);
+      /*
+       * Get first component.
+       */
+      len = CPName_GetComponent(cpName, inEnd, (char const **) &next);
+      if (len < 0) {
+         LOG(4, "%s: get first component failed\n", __FUNCTION__);
+         nameStatus = HGFS_NAME_STATUS_FAILURE;
+      } else if (0 == len) {
+         /* See if we are dealing with the base of the namespace */
+         nameStatus = HGFS_NAME_STATUS_INCOMPLETE_BASE;
+      } else {
+         sharedFolder = shareInfo.handle;
+      }
+
+      if (HGFS_NAME_STATUS_COMPLETE == nameStatus &&
+          HGFS_INVALID_FOLDER_HANDLE != sharedFolder) {
+         if (cpNameSize > len + 1) {
+            size_t nameSize = cpNameSize - len - 1;
+            char tempBuf[HGFS_PATH_MAX];
+            char *tempPtr = tempBuf;
+            size_t tempSize = sizeof tempBuf;
+
+            nameStatus = CPName_ConvertFrom((char const **) &next, &nameSize,
+                                            &tempSize, &tempPtr);
+            if (HGFS_NAME_STATUS_COMPLETE == nameStatus) {
+               LOG(8, "%s: session %p id %"FMT64"x on share hnd %#x\n",
+                   __FUNCTION__, input->session, input->session->sessionId,
+                   sharedFolder);
+               *watchId = HgfsNotify_AddSubscriber(sharedFolder, tempBuf, events,
+                                                   watchTree,
+                                                   input->session);
+               status = (HGFS_INVALID_SUBSCRIBER_HANDLE == *watchId) ?
+                        HGFS_ERROR_INTERNAL : HGFS_ERROR_SUCCESS;
+               LOG(8, "%s: watchId %"FMT64"x result %u\n", __FUNCTION__,
+                   *watchId, status);
+            } else {
+               LOG(4, "%s: Conversion to platform specific name failed\n",
+                   __FUNCTION__);
+               status = HgfsPlatformConvertFromNameStatus(nameStatus);
             }
-            free(utf8Name);
          } else {
-            LOG(4, "%s: access check failed\n", __FUNCTION__);
-            status = HgfsPlatformConvertFromNameStatus(nameStatus);
-         }
-      }
-      if (HGFS_ERROR_SUCCESS == status) {
-         if (!HgfsPackDeleteReply(input->packet, input->request, input->op,
-                                  &replyPayloadSize, input->session)) {
-            status = HGFS_ERROR_INTERNAL;
+            LOG(8, "%s: adding subscriber on share hnd %#x\n", __FUNCTION__,
+                sharedFolder);
+            *watchId = HgfsNotify_AddSubscriber(sharedFolder, "", events, watchTree,
+                                                input->session);
+            status = (HGFS_INVALID_SUBSCRIBER_HANDLE == *watchId) ? HGFS_ERROR_INTERNAL :
+                                                                    HGFS_ERROR_SUCCESS;
+            LOG(8, "%s: adding subscriber on share hnd %#x watchId %"FMT64"x result %u\n",
+                __FUNCTION__, sharedFolder, *watchId, status);
          }
+      } else if (HGFS_NAME_STATUS_INCOMPLETE_BASE == nameStatus) {
+         LOG(4, "%s: Notification for root share is not supported yet\n",
+             __FUNCTION__);
+         status = HGFS_ERROR_INVALID_PARAMETER;
+      } else {
+         LOG(4, "%s: file not found.\n", __FUNCTION__);
+         status = HgfsPlatformConvertFromNameStatus(nameStatus);
       }
    } else {
-      status = HGFS_ERROR_PROTOCOL;
+      LOG(4, "%s: file not found.\n", __FUNCTION__);
+      status = HgfsPlatformConvertFromNameStatus(nameStatus);
    }
-
-   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+   free(utf8Name);
+   LOG(8, "%s: exit %u\n",__FUNCTION__, status);
+   return status;
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerServerLockChange --
+ * HgfsServerSetDirNotifyWatch --
  *
- *    Called by the client when it wants to either acquire an oplock on a file
- *    that was previously opened, or when it wants to release/downgrade an
- *    oplock on a file that was previously oplocked.
+ *    Handle a set directory notification watch request.
  *
  * Results:
  *    None.
@@ -8038,24 +11359,68 @@ HgfsServerDeleteDir(HgfsInputParam *input)  // IN: Input params
  */
 
 static void
-HgfsServerServerLockChange(HgfsInputParam *input)  // IN: Input params
+HgfsServerSetDirNotifyWatch(HgfsInputParam *input)  // IN: Input params
 {
+   const char *cpName;
+   size_t cpNameSize;
+   HgfsInternalStatus status;
+   HgfsHandle dir;
+   uint32 caseFlags;
+   size_t replyPayloadSize = 0;
+   uint32 flags;
+   uint32 events;
+   HgfsSubscriberHandle watchId = HGFS_INVALID_SUBSCRIBER_HANDLE;
+   Bool useHandle;
 
    HGFS_ASSERT_INPUT(input);
 
-   HgfsServerCompleteRequest(HGFS_ERROR_NOT_SUPPORTED, 0, input);
+   LOG(8, "%s: entered\n", __FUNCTION__);
+
+   /*
+    * If the active session does not support directory change notification - bail out
+    * with an error immediately.
+    * Clients are expected to check the session capabilities and flags but a malicious
+    * or broken client could still issue this to us.
+    */
+   if (0 == (input->session->flags & HGFS_SESSION_CHANGENOTIFY_ENABLED)) {
+      HgfsServerCompleteRequest(HGFS_ERROR_PROTOCOL, 0, input);
+      return;
+   }
+
+   if (HgfsUnpackSetWatchRequest(input->payload, input->payloadSize, input->op,
+                                 &useHandle, &cpName, &cpNameSize, &flags, &events,
+                                 &dir, &caseFlags)) {
+      Bool watchTree = 0 != (flags & HGFS_NOTIFY_FLAG_WATCH_TREE);
+      if (useHandle) {
+         status = HgfsServerSetDirWatchByHandle(input, dir, events, watchTree, &watchId);
+      } else {
+         status = HgfsServerSetDirWatchByName(input, cpName, cpNameSize, caseFlags,
+                                              events, watchTree, &watchId);
+      }
+      if (HGFS_ERROR_SUCCESS == status) {
+         if (!HgfsPackSetWatchReply(input->packet, input->request, input->op,
+                                    watchId, &replyPayloadSize, input->session)) {
+            status = HGFS_ERROR_INTERNAL;
+         }
+      }
+   } else {
+      status = HGFS_ERROR_PROTOCOL;
+   }
+
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
+   LOG(8, "%s: exit %u\n", __FUNCTION__, status);
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerWriteWin32Stream --
+ * HgfsServerRemoveDirNotifyWatch --
  *
- *    Handle a write request in the WIN32_STREAM_ID format.
+ *    Handle a remove directory notification watch request.
  *
  * Results:
- *    ERROR_SUCCESS or an appropriate Win32 error code.
+ *    None.
  *
  * Side effects:
  *    None
@@ -8064,97 +11429,169 @@ HgfsServerServerLockChange(HgfsInputParam *input)  // IN: Input params
  */
 
 static void
-HgfsServerWriteWin32Stream(HgfsInputParam *input)  // IN: Input params
+HgfsServerRemoveDirNotifyWatch(HgfsInputParam *input)  // IN: Input params
 {
-   uint32  actualSize;
+   HgfsSubscriberHandle watchId;
    HgfsInternalStatus status;
-   HgfsHandle file;
-   const char *dataToWrite;
-   Bool doSecurity;
    size_t replyPayloadSize = 0;
-   size_t requiredSize;
 
+   LOG(8, "%s: entered\n", __FUNCTION__);
    HGFS_ASSERT_INPUT(input);
 
-   if (HgfsUnpackWriteWin32StreamRequest(input->payload, input->payloadSize, input->op, &file,
-                                         &dataToWrite, &requiredSize, &doSecurity)) {
-      status = HgfsPlatformWriteWin32Stream(file, (char *)dataToWrite, (uint32)requiredSize,
-                                            doSecurity, &actualSize, input->session);
-      if (HGFS_ERROR_SUCCESS == status) {
-         if (!HgfsPackWriteWin32StreamReply(input->packet, input->request, input->op,
-                                            actualSize, &replyPayloadSize,
-                                            input->session)) {
-            status = HGFS_ERROR_INTERNAL;
-         }
+   /*
+    * If the active session does not support directory change notification - bail out
+    * with an error immediately.
+    * Clients are expected to check the session capabilities and flags but a malicious
+    * or broken client could still issue this to us.
+    */
+   if (0 == (input->session->flags & HGFS_SESSION_CHANGENOTIFY_ENABLED)) {
+      HgfsServerCompleteRequest(HGFS_ERROR_PROTOCOL, 0, input);
+      return;
+   }
+
+   if (HgfsUnpackRemoveWatchRequest(input->payload, input->payloadSize, input->op,
+                                    &watchId)) {
+      LOG(8, "%s: remove subscriber on subscr id %"FMT64"x\n", __FUNCTION__,
+          watchId);
+      if (HgfsNotify_RemoveSubscriber(watchId)) {
+         status = HGFS_ERROR_SUCCESS;
+      } else {
+         status = HGFS_ERROR_INTERNAL;
       }
+      LOG(8, "%s: remove subscriber on subscr id %"FMT64"x result %u\n",
+          __FUNCTION__, watchId, status);
    } else {
       status = HGFS_ERROR_PROTOCOL;
    }
+   if (HGFS_ERROR_SUCCESS == status) {
+      if (!HgfsPackRemoveWatchReply(input->packet, input->request, input->op,
+         &replyPayloadSize, input->session)) {
+            status = HGFS_ERROR_INTERNAL;
+      }
+   }
 
    HgfsServerCompleteRequest(status, replyPayloadSize, input);
+   LOG(8, "%s: exit result %u\n", __FUNCTION__, status);
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerSetDirWatchByHandle --
+ * HgfsServerQueryChanges --
  *
- *    Sets directory notification watch request using directory handle.
+ *    Handle a query changes request: returns the changes recorded in the
+ *    change journal of a directory tree of a share since a token, so that
+ *    a client revalidates its caches without rescanning the tree.
  *
  * Results:
  *    None.
  *
  * Side effects:
- *    None
+ *    The first query of a directory tree starts its journal.
  *
  *-----------------------------------------------------------------------------
  */
 
-static HgfsInternalStatus
-HgfsServerSetDirWatchByHandle(HgfsInputParam *input,         // IN: Input params
-                              HgfsHandle dir,                // IN: directory handle
-                              uint32 events,                 // IN: event types to report
-                              Bool watchTree,                // IN: recursive watch
-                              HgfsSubscriberHandle *watchId) // OUT: watch id
+static void
+HgfsServerQueryChanges(HgfsInputParam *input)  // IN: Input params
 {
+   const char *cpName;
+   size_t cpNameSize;
+   uint32 caseFlags;
+   uint64 token;
+   uint32 maxReplySize;
+   size_t maxRecordsSize;
+   HgfsShareInfo shareInfo;
+   HgfsNameStatus nameStatus;
+   char *utf8Name = NULL;
+   size_t utf8NameLen;
+   const char *path;
+   char *shareName = NULL;
+   size_t shareNameLen;
+   HgfsNotifyChange *changes = NULL;
+   uint32 numChanges = 0;
+   uint64 nextToken;
+   Bool resync;
+   Bool more;
+   size_t replyPayloadSize = 0;
    HgfsInternalStatus status;
-   char *fileName = NULL;
-   size_t fileNameSize;
-   HgfsSharedFolderHandle sharedFolder = HGFS_INVALID_FOLDER_HANDLE;
 
-   LOG(8, "%s: entered\n", __FUNCTION__);
+   HGFS_ASSERT_INPUT(input);
 
-   ASSERT(watchId != NULL);
+   /* The journals are fed by the change notification component. */
+   if (0 == (input->session->flags & HGFS_SESSION_CHANGENOTIFY_ENABLED)) {
+      status = HGFS_ERROR_PROTOCOL;
+      goto exit;
+   }
 
-   if (HgfsHandle2NotifyInfo(dir, input->session, &fileName, &fileNameSize,
-                             &sharedFolder)) {
-      LOG(4, "%s: adding a subscriber on shared folder handle %#x\n",
-          __FUNCTION__, sharedFolder);
-      *watchId = HgfsNotify_AddSubscriber(sharedFolder, fileName, events, watchTree,
-                                          input->session);
-      status = (HGFS_INVALID_SUBSCRIBER_HANDLE == *watchId) ? HGFS_ERROR_INTERNAL :
-                                                              HGFS_ERROR_SUCCESS;
-      LOG(4, "%s: result of add subscriber id %"FMT64"x status %u\n",
-          __FUNCTION__, *watchId, status);
-   } else {
+   if (!HgfsUnpackQueryChangesRequest(input->payload, input->payloadSize,
+                                      input->op, &cpName, &cpNameSize,
+                                      &caseFlags, &token, &maxReplySize)) {
+      status = HGFS_ERROR_PROTOCOL;
+      goto exit;
+   }
+
+   nameStatus = HgfsServerGetLocalNameInfo(cpName, cpNameSize, caseFlags,
+                                           input->session, &shareInfo,
+                                           &utf8Name, &utf8NameLen);
+   if (HGFS_NAME_STATUS_COMPLETE != nameStatus) {
+      LOG(4, "%s: query changes of a name not in a share\n", __FUNCTION__);
+      status = HgfsPlatformConvertFromNameStatus(nameStatus);
+      goto exit;
+   }
+
+   if (!shareInfo.readPermissions) {
+      status = HGFS_ERROR_ACCESS_DENIED;
+      goto exit;
+   }
+
+   if (!HgfsServerGetShareName(shareInfo.handle, &shareNameLen, &shareName)) {
+      LOG(4, "%s: no notification share for %s\n", __FUNCTION__, utf8Name);
+      status = HGFS_ERROR_NOT_SUPPORTED;
+      goto exit;
+   }
+
+   /* The local name is the share root followed by the relative path. */
+   ASSERT(utf8NameLen >= shareInfo.rootDirLen);
+   path = utf8Name + shareInfo.rootDirLen;
+
+   maxRecordsSize = MIN(maxReplySize,
+                        input->session->maxPacketSize - sizeof (HgfsHeader) -
+                        sizeof (HgfsReplyQueryChangesV4));
+   status = HgfsNotify_QueryJournal(shareInfo.handle, path, token,
+                                    maxRecordsSize / sizeof (HgfsChangeRecordV4),
+                                    &changes, &numChanges, &nextToken,
+                                    &resync, &more);
+   LOG(4, "%s: %u changes of \"%s\" since %"FMT64"u: %d\n", __FUNCTION__,
+       numChanges, utf8Name, token, status);
+
+   if (HGFS_ERROR_SUCCESS == status &&
+       !HgfsPackQueryChangesReply(input->packet, input->request, input->op,
+                                  shareName, changes, numChanges, nextToken,
+                                  resync, more, maxRecordsSize,
+                                  &replyPayloadSize, input->session)) {
       status = HGFS_ERROR_INTERNAL;
    }
-   free(fileName);
-   LOG(8, "%s: exit %u\n", __FUNCTION__, status);
-   return status;
+
+exit:
+   HgfsNotify_FreeChanges(changes, numChanges);
+   free(shareName);
+   free(utf8Name);
+   HgfsServerCompleteRequest(status, replyPayloadSize, input);
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerSetDirWatchByName --
+ * HgfsServerOplockAcquireNode --
  *
- *    Sets directory notification watch request using directory name.
+ *    Acquire an oplock on the open file of a node. The nodes with oplocks
+ *    stay in the node cache, so only a limited number of them may have one.
  *
  * Results:
- *    None.
+ *    The oplock held by the node.
  *
  * Side effects:
  *    None
@@ -8162,110 +11599,99 @@ HgfsServerSetDirWatchByHandle(HgfsInputParam *input,         // IN: Input params
  *-----------------------------------------------------------------------------
  */
 
-static HgfsInternalStatus
-HgfsServerSetDirWatchByName(HgfsInputParam *input,         // IN: Input params
-                            const char *cpName,            // IN: directory name
-                            uint32 cpNameSize,             // IN: directory name length
-                            uint32 caseFlags,              // IN: case flags
-                            uint32 events,                 // IN: event types to report
-                            Bool watchTree,                // IN: recursive watch
-                            HgfsSubscriberHandle *watchId) // OUT: watch id
+static HgfsLockType
+HgfsServerOplockAcquireNode(HgfsHandle handle,         // IN: Hgfs file handle
+                            fileDesc fd,               // IN: OS handle
+                            HgfsLockType serverLock,   // IN: Oplock asked for
+                            HgfsSessionInfo *session)  // IN: Session info
 {
-   HgfsInternalStatus status;
-   HgfsNameStatus nameStatus;
-   char *utf8Name = NULL;
-   size_t utf8NameLen;
-   HgfsShareInfo shareInfo;
-   HgfsSharedFolderHandle sharedFolder = HGFS_INVALID_FOLDER_HANDLE;
+   HgfsFileNode *node;
+   HgfsLockType newLock = HGFS_LOCK_NONE;
 
-   ASSERT(cpName != NULL);
-   ASSERT(watchId != NULL);
+   MXUser_AcquireForWrite(session->nodeArrayLock);
+
+   node = HgfsHandle2FileNode(handle, session);
+   if (NULL == node ||
+       node->state != FILENODE_STATE_IN_USE_CACHED ||
+       node->fileDesc != fd) {
+      goto exit;
+   }
+
+   if (node->serverLock == HGFS_LOCK_NONE &&
+       session->numCachedLockedNodes >= MAX_LOCKED_FILENODES) {
+      LOG(4, "%s: Too many files with oplocks.\n", __FUNCTION__);
+      goto exit;
+   }
+
+   newLock = serverLock;
+   HgfsPlatformAcquireOplock(fd, handle, session, &newLock);
+
+   if (node->serverLock == HGFS_LOCK_NONE && newLock != HGFS_LOCK_NONE) {
+      session->numCachedLockedNodes++;
+   }
+   node->serverLock = newLock;
+
+exit:
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
-   LOG(8, "%s: entered\n",__FUNCTION__);
+   return newLock;
+}
 
-   nameStatus = HgfsServerGetLocalNameInfo(cpName, cpNameSize, caseFlags,
-                                           input->session, &shareInfo,
-                                           &utf8Name, &utf8NameLen);
-   if (HGFS_NAME_STATUS_COMPLETE == nameStatus) {
-      char const *inEnd = cpName + cpNameSize;
-      char const *next;
-      int len;
 
-      ASSERT(utf8Name);
-      /*
-       * Get first component.
-       */
-      len = CPName_GetComponent(cpName, inEnd, (char const **) &next);
-      if (len < 0) {
-         LOG(4, "%s: get first component failed\n", __FUNCTION__);
-         nameStatus = HGFS_NAME_STATUS_FAILURE;
-      } else if (0 == len) {
-         /* See if we are dealing with the base of the namespace */
-         nameStatus = HGFS_NAME_STATUS_INCOMPLETE_BASE;
-      } else {
-         sharedFolder = shareInfo.handle;
-      }
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerOplockChange --
+ *
+ *    Downgrade or release the oplock on the open file of a node, when the
+ *    client acknowledges a break or gives up the oplock, or when the client
+ *    did not acknowledge a break in time.
+ *
+ * Results:
+ *    The oplock held by the node.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
 
-      if (HGFS_NAME_STATUS_COMPLETE == nameStatus &&
-          HGFS_INVALID_FOLDER_HANDLE != sharedFolder) {
-         if (cpNameSize > len + 1) {
-            size_t nameSize = cpNameSize - len - 1;
-            char tempBuf[HGFS_PATH_MAX];
-            char *tempPtr = tempBuf;
-            size_t tempSize = sizeof tempBuf;
+static HgfsLockType
+HgfsServerOplockChange(HgfsHandle handle,         // IN: Hgfs file handle
+                       HgfsLockType serverLock,   // IN: Oplock kept
+                       HgfsSessionInfo *session)  // IN: Session info
+{
+   HgfsFileNode *node;
+   HgfsLockType newLock = HGFS_LOCK_NONE;
 
-            nameStatus = CPName_ConvertFrom((char const **) &next, &nameSize,
-                                            &tempSize, &tempPtr);
-            if (HGFS_NAME_STATUS_COMPLETE == nameStatus) {
-               LOG(8, "%s: session %p id %"FMT64"x on share hnd %#x\n",
-                   __FUNCTION__, input->session, input->session->sessionId,
-                   sharedFolder);
-               *watchId = HgfsNotify_AddSubscriber(sharedFolder, tempBuf, events,
-                                                   watchTree,
-                                                   input->session);
-               status = (HGFS_INVALID_SUBSCRIBER_HANDLE == *watchId) ?
-                        HGFS_ERROR_INTERNAL : HGFS_ERROR_SUCCESS;
-               LOG(8, "%s: watchId %"FMT64"x result %u\n", __FUNCTION__,
-                   *watchId, status);
-            } else {
-               LOG(4, "%s: Conversion to platform specific name failed\n",
-                   __FUNCTION__);
-               status = HgfsPlatformConvertFromNameStatus(nameStatus);
-            }
-         } else {
-            LOG(8, "%s: adding subscriber on share hnd %#x\n", __FUNCTION__,
-                sharedFolder);
-            *watchId = HgfsNotify_AddSubscriber(sharedFolder, "", events, watchTree,
-                                                input->session);
-            status = (HGFS_INVALID_SUBSCRIBER_HANDLE == *watchId) ? HGFS_ERROR_INTERNAL :
-                                                                    HGFS_ERROR_SUCCESS;
-            LOG(8, "%s: adding subscriber on share hnd %#x watchId %"FMT64"x result %u\n",
-                __FUNCTION__, sharedFolder, *watchId, status);
-         }
-      } else if (HGFS_NAME_STATUS_INCOMPLETE_BASE == nameStatus) {
-         LOG(4, "%s: Notification for root share is not supported yet\n",
-             __FUNCTION__);
-         status = HGFS_ERROR_INVALID_PARAMETER;
-      } else {
-         LOG(4, "%s: file not found.\n", __FUNCTION__);
-         status = HgfsPlatformConvertFromNameStatus(nameStatus);
+   MXUser_AcquireForWrite(session->nodeArrayLock);
+
+   node = HgfsHandle2FileNode(handle, session);
+   if (NULL != node &&
+       node->state == FILENODE_STATE_IN_USE_CACHED &&
+       node->serverLock != HGFS_LOCK_NONE) {
+      newLock = HgfsPlatformDowngradeOplock(node->fileDesc, serverLock);
+      if (newLock == HGFS_LOCK_NONE) {
+         session->numCachedLockedNodes--;
       }
-   } else {
-      LOG(4, "%s: file not found.\n", __FUNCTION__);
-      status = HgfsPlatformConvertFromNameStatus(nameStatus);
+      node->serverLock = newLock;
    }
-   free(utf8Name);
-   LOG(8, "%s: exit %u\n",__FUNCTION__, status);
-   return status;
+
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
+
+   return newLock;
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerSetDirNotifyWatch --
+ * HgfsServerOplockAcquire --
  *
- *    Handle a set directory notification watch request.
+ *    Handle an oplock acquire request. The client asks for an oplock on an
+ *    open file so that it can cache the file data, or gives the oplock up
+ *    by asking for HGFS_LOCK_NONE. The oplock is opportunistic: the reply
+ *    has the oplock granted, which may be none.
  *
  * Results:
  *    None.
@@ -8277,65 +11703,63 @@ HgfsServerSetDirWatchByName(HgfsInputParam *input,         // IN: Input params
  */
 
 static void
-HgfsServerSetDirNotifyWatch(HgfsInputParam *input)  // IN: Input params
+HgfsServerOplockAcquire(HgfsInputParam *input)  // IN: Input params
 {
-   const char *cpName;
-   size_t cpNameSize;
+   HgfsHandle file;
+   HgfsLockType serverLock;
    HgfsInternalStatus status;
-   HgfsHandle dir;
-   uint32 caseFlags;
    size_t replyPayloadSize = 0;
-   uint32 flags;
-   uint32 events;
-   HgfsSubscriberHandle watchId = HGFS_INVALID_SUBSCRIBER_HANDLE;
-   Bool useHandle;
 
    HGFS_ASSERT_INPUT(input);
 
-   LOG(8, "%s: entered\n", __FUNCTION__);
-
    /*
-    * If the active session does not support directory change notification - bail out
-    * with an error immediately.
-    * Clients are expected to check the session capabilities and flags but a malicious
-    * or broken client could still issue this to us.
+    * Clients are expected to check the session capabilities and flags but a
+    * malicious or broken client could still issue this to us.
     */
-   if (0 == (input->session->flags & HGFS_SESSION_CHANGENOTIFY_ENABLED)) {
+   if (   0 == (input->session->flags & HGFS_SESSION_OPLOCK_ENABLED)
+       || !HgfsServerOplockIsInited()) {
       HgfsServerCompleteRequest(HGFS_ERROR_PROTOCOL, 0, input);
       return;
    }
 
-   if (HgfsUnpackSetWatchRequest(input->payload, input->payloadSize, input->op,
-                                 &useHandle, &cpName, &cpNameSize, &flags, &events,
-                                 &dir, &caseFlags)) {
-      Bool watchTree = 0 != (flags & HGFS_NOTIFY_FLAG_WATCH_TREE);
-      if (useHandle) {
-         status = HgfsServerSetDirWatchByHandle(input, dir, events, watchTree, &watchId);
-      } else {
-         status = HgfsServerSetDirWatchByName(input, cpName, cpNameSize, caseFlags,
-                                              events, watchTree, &watchId);
-      }
+   if (!HgfsUnpackOplockAcquireRequest(input->payload, input->payloadSize,
+                                       input->op, &file, &serverLock)) {
+      status = HGFS_ERROR_PROTOCOL;
+   } else if (HGFS_LOCK_NONE == serverLock) {
+      serverLock = HgfsServerOplockChange(file, HGFS_LOCK_NONE, input->session);
+      status = HGFS_ERROR_SUCCESS;
+   } else {
+      fileDesc fd;
+
+      status = HgfsPlatformGetFd(file, input->session, FALSE, &fd);
       if (HGFS_ERROR_SUCCESS == status) {
-         if (!HgfsPackSetWatchReply(input->packet, input->request, input->op,
-                                    watchId, &replyPayloadSize, input->session)) {
-            status = HGFS_ERROR_INTERNAL;
-         }
+         serverLock = HgfsServerOplockAcquireNode(file, fd, serverLock,
+                                                  input->session);
+         HgfsPutCachedNode(file, input->session);
+      }
+   }
+
+   if (HGFS_ERROR_SUCCESS == status) {
+      LOG(4, "%s: oplock %d on file %u\n", __FUNCTION__, serverLock, file);
+      if (!HgfsPackOplockAcquireReply(input->packet, input->request, input->op,
+                                      serverLock, &replyPayloadSize,
+                                      input->session)) {
+         status = HGFS_ERROR_INTERNAL;
       }
-   } else {
-      status = HGFS_ERROR_PROTOCOL;
    }
 
    HgfsServerCompleteRequest(status, replyPayloadSize, input);
-   LOG(8, "%s: exit %u\n", __FUNCTION__, status);
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsServerRemoveDirNotifyWatch --
+ * HgfsServerOplockBreakAck --
  *
- *    Handle a remove directory notification watch request.
+ *    Handle the acknowledgement of an oplock break sent to the client. It
+ *    contains the oplock the client keeps, which is downgraded to what the
+ *    break allows.
  *
  * Results:
  *    None.
@@ -8347,49 +11771,36 @@ HgfsServerSetDirNotifyWatch(HgfsInputParam *input)  // IN: Input params
  */
 
 static void
-HgfsServerRemoveDirNotifyWatch(HgfsInputParam *input)  // IN: Input params
+HgfsServerOplockBreakAck(HgfsInputParam *input)  // IN: Input params
 {
-   HgfsSubscriberHandle watchId;
+   HgfsHandle file;
+   HgfsLockType serverLock;
    HgfsInternalStatus status;
    size_t replyPayloadSize = 0;
 
-   LOG(8, "%s: entered\n", __FUNCTION__);
    HGFS_ASSERT_INPUT(input);
 
-   /*
-    * If the active session does not support directory change notification - bail out
-    * with an error immediately.
-    * Clients are expected to check the session capabilities and flags but a malicious
-    * or broken client could still issue this to us.
-    */
-   if (0 == (input->session->flags & HGFS_SESSION_CHANGENOTIFY_ENABLED)) {
+   if (   0 == (input->session->flags & HGFS_SESSION_OPLOCK_ENABLED)
+       || !HgfsServerOplockIsInited()) {
       HgfsServerCompleteRequest(HGFS_ERROR_PROTOCOL, 0, input);
       return;
    }
 
-   if (HgfsUnpackRemoveWatchRequest(input->payload, input->payloadSize, input->op,
-                                    &watchId)) {
-      LOG(8, "%s: remove subscriber on subscr id %"FMT64"x\n", __FUNCTION__,
-          watchId);
-      if (HgfsNotify_RemoveSubscriber(watchId)) {
-         status = HGFS_ERROR_SUCCESS;
-      } else {
+   if (HgfsUnpackOplockBreakAckReply(input->payload, input->payloadSize,
+                                     input->op, &file, &serverLock)) {
+      serverLock = HgfsServerOplockChange(file, serverLock, input->session);
+      LOG(4, "%s: oplock %d on file %u\n", __FUNCTION__, serverLock, file);
+      status = HGFS_ERROR_SUCCESS;
+      if (!HgfsPackOplockBreakAckReply(input->packet, input->request, input->op,
+                                       file, serverLock, &replyPayloadSize,
+                                       input->session)) {
          status = HGFS_ERROR_INTERNAL;
       }
-      LOG(8, "%s: remove subscriber on subscr id %"FMT64"x result %u\n",
-          __FUNCTION__, watchId, status);
    } else {
       status = HGFS_ERROR_PROTOCOL;
    }
-   if (HGFS_ERROR_SUCCESS == status) {
-      if (!HgfsPackRemoveWatchReply(input->packet, input->request, input->op,
-         &replyPayloadSize, input->session)) {
-            status = HGFS_ERROR_INTERNAL;
-      }
-   }
 
    HgfsServerCompleteRequest(status, replyPayloadSize, input);
-   LOG(8, "%s: exit result %u\n", __FUNCTION__, status);
 }
 
 
@@ -8428,7 +11839,7 @@ HgfsServerGetattr(HgfsInputParam *input)  // IN: Input params
    HgfsShareInfo shareInfo;
    size_t replyPayloadSize = 0;
    HgfsSessionInfo *session;
-   HgfsFileAttrCacheEntry *entry;
+   HgfsFileAttrCacheEntry entry;
 
    HGFS_ASSERT_INPUT(input);
 
@@ -8444,31 +11855,28 @@ HgfsServerGetattr(HgfsInputParam *input)  // IN: Input params
 
          memset(&node, 0, sizeof node);
          found = HgfsGetNodeCopy(file, session, TRUE, &node);
+         if (found) {
+            HgfsServerWriteBehindFlushName(node.utf8Name, 0, MAX_UINT64,
+                                           session);
+         }
 
+         /*
+          * The attributes obtained from the descriptor are those of the
+          * symlink target if the node was opened through a symlink, so they
+          * are only looked up in the cache and never added to it.
+          */
          if (found && NULL != session->fileAttrCache &&
-             HgfsCache_Get(session->fileAttrCache, node.utf8Name,
-                           (void **)&entry)) {
-            attr = entry->attr;
+             HgfsCache_GetCopy(session->fileAttrCache, node.utf8Name,
+                               &entry, sizeof entry) &&
+             HgfsServerCacheEntryIsValid(entry.expiry)) {
+            attr = entry.attr;
             status = HGFS_ERROR_SUCCESS;
          } else {
             targetNameLen = 0;
             status = HgfsPlatformGetFd(file, session, FALSE, &fd);
             if (HGFS_ERROR_SUCCESS == status) {
                status = HgfsPlatformGetattrFromFd(fd, session, &attr);
-               if (found && HGFS_ERROR_SUCCESS == status &&
-                   NULL != session->fileAttrCache) {
-                  HOM_HANDLE handle =
-                     HgfsOplockMonitorFileChange(node.utf8Name, session,
-                                                 HgfsOplockFileChangeCb,
-                                                 Util_SafeStrdup(node.utf8Name));
-                  if (handle != HGFS_OPLOCK_INVALID_MONITOR_HANDLE) {
-                     entry = Util_SafeCalloc(1, sizeof *entry);
-                     entry->handle = handle;
-                     entry->attr = attr;
-                     HgfsCache_Put(session->fileAttrCache, node.utf8Name,
-                                   entry);
-                  }
-               }
+               HgfsPutCachedNode(file, session);
             } else {
                LOG(4, "%s: Could not get file descriptor\n", __FUNCTION__);
             }
@@ -8500,56 +11908,59 @@ HgfsServerGetattr(HgfsInputParam *input)  // IN: Input params
             /* This is a regular lookup; proceed as usual */
             ASSERT(localName);
 
+            HgfsServerWriteBehindFlushName(localName, 0, MAX_UINT64, session);
+
             if (NULL != session->fileAttrCache &&
-                HgfsCache_Get(session->fileAttrCache, localName,
-                              (void **)&entry)) {
-               attr = entry->attr;
+                HgfsCache_GetCopy(session->fileAttrCache, localName,
+                                  &entry, sizeof entry) &&
+                HgfsServerCacheEntryIsValid(entry.expiry)) {
+               attr = entry.attr;
                status = HGFS_ERROR_SUCCESS;
             } else {
                /* Get the config options. */
-               nameStatus = HgfsServerPolicy_GetShareOptions(cpName, cpNameSize,
-                                                             &configOptions);
+               nameStatus = HgfsServerGetShareOptions(cpName, cpNameSize,
+                                                      &configOptions);
                if (HGFS_NAME_STATUS_COMPLETE == nameStatus) {
                   status = HgfsPlatformGetattrFromName(localName, configOptions,
                                                        (char *)cpName, &attr,
                                                        &targetName);
-                  if (HGFS_ERROR_SUCCESS == status &&
+                  /* Symlinks are not cached as the reply needs the target. */
+                  if (HGFS_ERROR_SUCCESS == status && NULL == targetName &&
                       NULL != session->fileAttrCache) {
-                     HOM_HANDLE handle =
-                        HgfsOplockMonitorFileChange(localName, session,
-                                                    HgfsOplockFileChangeCb,
-                                                    Util_SafeStrdup(localName));
-                     if (handle != HGFS_OPLOCK_INVALID_MONITOR_HANDLE) {
-                        entry = Util_SafeCalloc(1, sizeof *entry);
-                        entry->handle = handle;
-                        entry->attr = attr;
-                        HgfsCache_Put(session->fileAttrCache, localName,
-                                      entry);
-                     }
+                     HgfsFileAttrCacheEntry *newEntry =
+                        Util_SafeCalloc(1, sizeof *newEntry);
+
+                     HgfsServerCacheMonitor(session, localName,
+                                            &newEntry->handle,
+                                            &newEntry->expiry);
+                     newEntry->attr = attr;
+                     HgfsCache_Put(session->fileAttrCache, localName,
+                                   newEntry);
                   }
                } else {
                   LOG(4, "%s: no matching share: %s.\n", __FUNCTION__, cpName);
                   status = HGFS_ERROR_FILE_NOT_FOUND;
                }
+            }
 
-               if (HGFS_ERROR_SUCCESS == status &&
-                   !HgfsServer_ShareAccessCheck(HGFS_OPEN_MODE_READ_ONLY,
+            if (HGFS_ERROR_SUCCESS == status) {
+               if (!HgfsServer_ShareAccessCheck(HGFS_OPEN_MODE_READ_ONLY,
                                                 shareInfo.writePermissions,
                                                 shareInfo.readPermissions)) {
-                      status = HGFS_ERROR_ACCESS_DENIED;
-               } else if (status != HGFS_ERROR_SUCCESS) {
-                  /*
-                   * If it is a dangling share server should not return
-                   * HGFS_ERROR_FILE_NOT_FOUND
-                   * to the client because it causes confusion: a name that is returned
-                   * by directory enumeration should not produce "name not found"
-                   * error.
-                   * Replace it with a more appropriate error code: no such device.
-                   */
-                  if (status == HGFS_ERROR_FILE_NOT_FOUND &&
-                      HgfsServerIsSharedFolderOnly(cpName, cpNameSize)) {
-                     status = HGFS_ERROR_IO;
-                  }
+                  status = HGFS_ERROR_ACCESS_DENIED;
+               }
+            } else {
+               /*
+                * If it is a dangling share server should not return
+                * HGFS_ERROR_FILE_NOT_FOUND
+                * to the client because it causes confusion: a name that is returned
+                * by directory enumeration should not produce "name not found"
+                * error.
+                * Replace it with a more appropriate error code: no such device.
+                */
+               if (status == HGFS_ERROR_FILE_NOT_FOUND &&
+                   HgfsServerIsSharedFolderOnly(cpName, cpNameSize)) {
+                  status = HGFS_ERROR_IO;
                }
             }
             break;
@@ -8577,10 +11988,10 @@ HgfsServerGetattr(HgfsInputParam *input)  // IN: Input params
 
    /*
     * Contrary to Coverity analysis, storage pointed to by the variable
-    * "entry" is not leaked; HgfsCache_Put stores a pointer to it in the
-    * symlink cache.  However, no Coverity annotation for leaked_storage
+    * "newEntry" is not leaked; HgfsCache_Put stores a pointer to it in the
+    * cache.  However, no Coverity annotation for leaked_storage
     * is added here because such an annotation cannot be made specific to
-    * entry; as a result, if any actual memory leaks were to be introduced
+    * newEntry; as a result, if any actual memory leaks were to be introduced
     * by a future change, the leaked_storage annotation would cause such
     * new leaks to be flagged as false positives.
     *
@@ -8631,11 +12042,19 @@ HgfsServerSetattr(HgfsInputParam *input)  // IN: Input params
       if (hints & HGFS_ATTR_HINT_USE_FILE_DESC) {
          if (HgfsHandle2ShareMode(file, input->session, &shareMode)) {
             if (HGFS_OPEN_MODE_READ_ONLY != shareMode) {
-               status = HgfsPlatformSetattrFromFd(file,
-                                                  input->session,
-                                                  &attr,
-                                                  hints,
-                                                  useHostTime);
+               if (0 != (attr.mask & HGFS_ATTR_VALID_SIZE)) {
+                  status = HgfsServerWriteBehindFlushRange(file, 0, MAX_UINT64,
+                                                           input->session);
+               }
+               if (HGFS_ERROR_SUCCESS == status) {
+                  status = HgfsPlatformSetattrFromFd(file,
+                                                     input->session,
+                                                     &attr,
+                                                     hints,
+                                                     useHostTime);
+               }
+               /* Even a failed setattr may have changed some attributes. */
+               HgfsServerCacheRemoveHandle(file, input->session, FALSE);
             } else {
                status = HGFS_ERROR_ACCESS_DENIED;
             }
@@ -8669,7 +12088,7 @@ HgfsServerSetattr(HgfsInputParam *input)  // IN: Input params
                                              shareInfo.readPermissions)) {
                status = HGFS_ERROR_ACCESS_DENIED;
             } else if (HGFS_NAME_STATUS_COMPLETE !=
-                       HgfsServerPolicy_GetShareOptions(cpName, cpNameSize,
+                       HgfsServerGetShareOptions(cpName, cpNameSize,
                        &configOptions)) {
                LOG(4, "%s: no matching share: %s.\n", __FUNCTION__, cpName);
                status = HGFS_ERROR_FILE_NOT_FOUND;
@@ -8679,11 +12098,16 @@ HgfsServerSetattr(HgfsInputParam *input)  // IN: Input params
                   __FUNCTION__);
                status = HGFS_ERROR_PATH_BUSY;
             } else {
+               if (0 != (attr.mask & HGFS_ATTR_VALID_SIZE)) {
+                  HgfsServerWriteBehindFlushName(utf8Name, 0, MAX_UINT64,
+                                                 input->session);
+               }
                status = HgfsPlatformSetattrFromName(utf8Name,
                                                     &attr,
                                                     configOptions,
                                                     hints,
                                                     useHostTime);
+               HgfsServerCacheRemove(input->session, utf8Name, FALSE);
             }
             free(utf8Name);
          } else {
@@ -8753,9 +12177,9 @@ HgfsServerValidateOpenParameters(HgfsFileOpenInfo *openInfo, // IN/OUT: openfile
                HgfsShareOptions configOptions;
 
                /* Get the config options. */
-               nameStatus = HgfsServerPolicy_GetShareOptions(openInfo->cpName,
-                                                             openInfo->cpNameSize,
-                                                             &configOptions);
+               nameStatus = HgfsServerGetShareOptions(openInfo->cpName,
+                                                      openInfo->cpNameSize,
+                                                      &configOptions);
                if (nameStatus == HGFS_NAME_STATUS_COMPLETE) {
                   *followSymlinks =
                      HgfsServerPolicy_IsShareOptionSet(configOptions,
@@ -8884,6 +12308,12 @@ HgfsServerOpen(HgfsInputParam *input)  // IN: Input params
             if (status == HGFS_ERROR_SUCCESS) {
                ASSERT(newHandle >= 0);
 
+               /* Creating or truncating the file changes its attributes. */
+               if ((openInfo.mask & HGFS_OPEN_VALID_FLAGS) &&
+                   openInfo.flags != HGFS_OPEN) {
+                  HgfsServerCacheRemove(input->session, openInfo.utf8Name, TRUE);
+               }
+
                /*
                 * Open succeeded, so make new node and return its handle. If we fail,
                 * it's almost certainly an internal server error.
@@ -9272,9 +12702,9 @@ HgfsServerSearchRead(HgfsInputParam *input)  // IN: Input params
          if (HgfsGetSearchCopy(hgfsSearchHandle, input->session, &search)) {
             /* Get the config options. */
             if (search.utf8ShareNameLen != 0) {
-               nameStatus = HgfsServerPolicy_GetShareOptions(search.utf8ShareName,
-                                                             search.utf8ShareNameLen,
-                                                             &configOptions);
+               nameStatus = HgfsServerGetShareOptions(search.utf8ShareName,
+                                                      search.utf8ShareNameLen,
+                                                      &configOptions);
                if (nameStatus != HGFS_NAME_STATUS_COMPLETE) {
                   LOG(4, "%s: no matching share: %s.\n", __FUNCTION__,
                       search.utf8ShareName);
@@ -9442,12 +12872,11 @@ HgfsServerDestroySession(HgfsInputParam *input)  // IN: Input params
       transportSession->defaultSessionId = HGFS_INVALID_SESSION_ID;
    }
 
-   if (0 != (gHgfsCfgSettings.flags & HGFS_CONFIG_OPLOCK_MONITOR_ENABLED)) {
-      HgfsCache_Destroy(session->symlinkCache);
-      session->symlinkCache = NULL;
-      HgfsCache_Destroy(session->fileAttrCache);
-      session->fileAttrCache = NULL;
-   }
+   /* The caches are allocated if either the oplock monitor or the cache is on. */
+   HgfsCache_Destroy(session->symlinkCache);
+   session->symlinkCache = NULL;
+   HgfsCache_Destroy(session->fileAttrCache);
+   session->fileAttrCache = NULL;
 
    /*
     * Remove the session from the list. By doing that, the refcount of
@@ -9670,6 +13099,101 @@ exit:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerOplockBreakNotify --
+ *
+ *    Called by the oplock break thread when an oplock of the client must be
+ *    broken: sends the oplock break request with the oplock the client may
+ *    keep. The client acknowledges it with an oplock break request of its
+ *    own, see HgfsServerOplockBreakAck.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Drops the session reference taken by HgfsServerOplockSessionGet.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerOplockBreakNotify(HgfsSessionInfo *session,  // IN: session info
+                            HgfsHandle handle,         // IN: Hgfs file handle
+                            HgfsLockType serverLock)   // IN: oplock to keep
+{
+   HgfsPacket *packet = NULL;
+   HgfsHeader *packetHeader;
+   size_t sizeNeeded;
+
+   LOG(4, "%s: break file %u to oplock %d\n", __FUNCTION__, handle, serverLock);
+
+   if (session->state == HGFS_SESSION_STATE_CLOSED) {
+      LOG(4, "%s: session has been closed drop the break %"FMT64"x\n",
+          __FUNCTION__, session->sessionId);
+      goto exit;
+   }
+
+   sizeNeeded = HgfsPackGetOplockBreakSize();
+
+   /* Released by the send complete callback, as for change notifications. */
+   packet = Util_SafeCalloc(1, sizeof *packet + sizeNeeded);
+   packetHeader = (HgfsHeader *)((char *)packet + sizeof *packet);
+   packet->metaPacketSize = sizeNeeded;
+   packet->metaPacketDataSize = packet->metaPacketSize;
+   packet->metaPacket = packetHeader;
+
+   if (!HgfsPackOplockBreakRequest(packetHeader, handle, serverLock,
+                                   session->sessionId, &sizeNeeded)) {
+      LOG(4, "%s: failed to pack oplock break request\n", __FUNCTION__);
+      goto exit;
+   }
+
+   if (!HgfsPacketSend(packet,
+                       session->transportSession,
+                       session,
+                       0)) {
+      LOG(4, "%s: failed to send oplock break to the client\n", __FUNCTION__);
+      goto exit;
+   }
+
+   packet = NULL;
+
+exit:
+   free(packet);
+   HgfsServerSessionPut(session);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerOplockBreakTimeout --
+ *
+ *    Called by the oplock break thread when the client did not acknowledge
+ *    an oplock break in time and the oplock was downgraded without it.
+ *    Updates the node and tells the client about the oplock it has now.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Drops the session reference taken by HgfsServerOplockSessionGet.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerOplockBreakTimeout(HgfsSessionInfo *session,  // IN: session info
+                             HgfsHandle handle,         // IN: Hgfs file handle
+                             HgfsLockType serverLock)   // IN: oplock kept
+{
+   serverLock = HgfsServerOplockChange(handle, serverLock, session);
+   HgfsServerOplockBreakNotify(session, handle, serverLock);
+}
+
+
 /*
  * more testing
  */
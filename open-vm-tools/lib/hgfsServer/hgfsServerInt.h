@@ -32,8 +32,10 @@ struct DirectoryEntry;
 #endif
 
 #include "dbllnklst.h"
+#include "hashTable.h"
 #include "cpName.h"     // for HgfsNameStatus
 #include "hgfsCache.h"
+#include "hgfsDentArena.h"
 #include "hgfsProto.h"
 #include "hgfsServer.h" // for the server public types
 #include "hgfsServerPolicy.h"
@@ -236,6 +238,26 @@ typedef struct HgfsFileNode {
 
    /* Parameters associated with the share. */
    HgfsShareInfo shareInfo;
+
+   /*
+    * Set when the cached node is used, cleared when the LRU scan gives it a
+    * second chance. Set with the nodeArrayLock held for read.
+    */
+   Atomic_Bool cacheReferenced;
+
+   /*
+    * Number of requests using the cached fileDesc, see HgfsGetCachedNode.
+    * The node is not removed from the cache to make room while it is set.
+    */
+   Atomic_uint32 fdUsers;
+
+   /*
+    * Sequential read detection, see HgfsServerReadAhead. Protected by the
+    * session's readAheadLock while the nodeArrayLock is held for read.
+    */
+   uint64 readAheadNextOffset;   /* Offset following the last read */
+   uint64 readAheadEnd;          /* End of the range already read ahead */
+   uint32 readAheadWindow;       /* Read-ahead size, 0 for random access */
 } HgfsFileNode;
 
 
@@ -278,10 +300,13 @@ typedef struct HgfsSearch {
    size_t utf8ShareNameLen;
 
    /* Directory entries for this search */
-   struct DirectoryEntry **dents;
+   HgfsDentArena dents;
 
-   /* Number of dents */
-   uint32 numDents;
+   /*
+    * Open directory of a streaming search, which only holds a window of the
+    * directory entries in dents. NULL if dents has all the entries.
+    */
+   struct HgfsSearchStream *stream;
 
    /*
     * What type of search is this (what objects does it track)? This is
@@ -349,10 +374,12 @@ typedef struct HgfsSessionInfo {
    /*
     ** START NODE ARRAY **************************************************
     *
-    * Lock for the following 6 fields: the node array,
-    * counters and lists for this session.
+    * Lock for the following fields: the node array,
+    * counters and lists for this session. Handle lookups and reads of node
+    * fields take it for read, allocating, changing and removing nodes and
+    * the cache list take it for write.
     */
-   MXUserExclLock *nodeArrayLock;
+   MXUserRWLock *nodeArrayLock;
 
    /* Open file nodes of this session. */
    HgfsFileNode *nodeArray;
@@ -371,6 +398,13 @@ typedef struct HgfsSessionInfo {
 
    /* Number of open nodes having server locks. */
    unsigned int numCachedLockedNodes;
+
+   /*
+    * Sum of the read-ahead windows of the nodes. The read-ahead state is
+    * changed under the readAheadLock with the nodeArrayLock held for read.
+    */
+   MXUserExclLock *readAheadLock;
+   uint32 readAheadBytes;
    /** END NODE ARRAY ****************************************************/
 
    /*
@@ -391,6 +425,31 @@ typedef struct HgfsSessionInfo {
    DblLnkLst_Links searchFreeList;
    /** END SEARCH ARRAY ****************************************************/
 
+   /*
+    ** START WRITE BEHIND ************************************************
+    *
+    * Lock for the following three fields: the write-behind buffers of the
+    * file handles and their total size, for this session. NULL if the
+    * buffering is disabled.
+    */
+   MXUserExclLock *writeBehindLock;
+
+   /* Write-behind buffers keyed by file handle. */
+   HashTable *writeBehindTable;
+
+   /* Sum of the write-behind buffer capacities. */
+   uint32 writeBehindBytes;
+
+   /* The work item writing the buffered data is queued. */
+   Bool writeBehindTimerQueued;
+
+   /*
+    * Broadcast, with the writeBehindLock held, when an asynchronous write
+    * of buffered data completes.
+    */
+   MXUserCondVar *writeBehindWritten;
+   /** END WRITE BEHIND ****************************************************/
+
    /* Array of session specific capabiities. */
    HgfsOpCapability hgfsSessionCapabilities[HGFS_OP_MAX];
 
@@ -522,13 +581,36 @@ typedef struct HgfsCreateSessionInfo {
    HgfsSessionFlags flags;       /* Session capability flags. */
 } HgfsCreateSessionInfo;
 
+typedef struct HgfsCompoundSubRequest {
+   HgfsOp op;                    /* Sub-request operation */
+   uint32 flags;                 /* HGFS_COMPOUND_FLAG_xxx */
+   uint32 handleOffset;          /* Offset of the related handle in args */
+   const void *args;             /* Operation arguments, without header */
+   size_t argsSize;              /* Byte length of args */
+} HgfsCompoundSubRequest;
+
+typedef struct HgfsCompoundSubReply {
+   HgfsOp op;                    /* Sub-request operation */
+   HgfsInternalStatus status;    /* Sub-request status */
+   void *reply;                  /* Operation reply, without header */
+   size_t replySize;             /* Byte length of reply */
+} HgfsCompoundSubReply;
+
+/*
+ * Cache entries start with the oplock monitor handle, which is
+ * HGFS_OPLOCK_INVALID_MONITOR_HANDLE for entries that are not monitored and
+ * are only valid until their expiry time. Symlink check entries are always
+ * monitored.
+ */
 typedef struct HgfsSymlinkCacheEntry {
    HOM_HANDLE handle;            /* File handle. */
+   VmTimeType expiry;            /* Expiry time (ms), 0 if monitored. */
    HgfsNameStatus nameStatus;    /* Symlink check status. */
 } HgfsSymlinkCacheEntry;
 
 typedef struct HgfsFileAttrCacheEntry {
    HOM_HANDLE handle;            /* File handle. */
+   VmTimeType expiry;            /* Expiry time (ms), 0 if monitored. */
    HgfsFileAttrInfo attr;        /* Attributes of entry. */
 } HgfsFileAttrCacheEntry;
 
@@ -648,12 +730,17 @@ HgfsRemoveFromCache(HgfsHandle handle,         // IN: Hgfs handle of the node
                     HgfsSessionInfo *session); // IN: Session info
 
 Bool
-HgfsAddToCache(HgfsHandle handle,         // IN: Hgfs handle of the node
-               HgfsSessionInfo *session); // IN: Session info
+HgfsAddToCacheFd(HgfsHandle handle,         // IN: Hgfs handle of the node
+                 HgfsSessionInfo *session,  // IN: Session info
+                 fileDesc *fd);             // IN/OUT: OS handle (file desc)
 
 Bool
-HgfsIsCached(HgfsHandle handle,         // IN: Hgfs handle of the node
-             HgfsSessionInfo *session); // IN: Session info
+HgfsGetCachedNode(HgfsHandle handle,         // IN: Hgfs handle of the node
+                  HgfsSessionInfo *session); // IN: Session info
+
+void
+HgfsPutCachedNode(HgfsHandle handle,         // IN: Hgfs handle of the node
+                  HgfsSessionInfo *session); // IN: Session info
 
 Bool
 HgfsIsServerLockAllowed(HgfsSessionInfo *session);  // IN: session info
@@ -771,7 +858,13 @@ HgfsNameStatus
 HgfsPlatformPathHasSymlink(const char *fileName,      // IN: fileName to be checked
                            size_t fileNameLength,     // IN
                            const char *sharePath,     // IN: share path in question
-                           size_t sharePathLen);      // IN
+                           size_t sharePathLen,       // IN
+                           fileDesc shareRootFd);     // IN: share root or -1
+fileDesc
+HgfsPlatformShareRootOpen(const char *sharePath);     // IN: share path
+Bool
+HgfsPlatformShareRootIsCurrent(fileDesc shareRootFd,  // IN: share root
+                               const char *sharePath); // IN: share path
 HgfsInternalStatus
 HgfsPlatformSymlinkCreate(char *localSymlinkName,   // IN: symbolic link file name
                           char *localTargetName);   // IN: symlink target name
@@ -800,15 +893,20 @@ HgfsInternalStatus
 HgfsPlatformScandir(char const *baseDir,             // IN: Directory to search in
                     size_t baseDirLen,               // IN: Length of directory
                     Bool followSymlinks,             // IN: followSymlinks config option
-                    struct DirectoryEntry ***dents,  // OUT: Array of DirectoryEntrys
-                    int *numDents);                  // OUT: Number of DirectoryEntrys
+                    HgfsDentArena *dents);           // OUT: Directory entries
+HgfsInternalStatus
+HgfsPlatformSearchStreamOpen(char const *baseDir,               // IN: Directory to search in
+                             size_t baseDirLen,                 // IN: Length of directory
+                             Bool followSymlinks,               // IN: followSymlinks config option
+                             struct HgfsSearchStream **stream); // OUT: Open directory
+void
+HgfsPlatformSearchStreamClose(struct HgfsSearchStream *stream); // IN: Open directory
 HgfsInternalStatus
 HgfsPlatformScanvdir(HgfsServerResEnumGetFunc enumNamesGet,   // IN: Function to get name
                      HgfsServerResEnumInitFunc enumNamesInit, // IN: Setup function
                      HgfsServerResEnumExitFunc enumNamesExit, // IN: Cleanup function
                      DirectorySearchType type,                // IN: Kind of search
-                     struct DirectoryEntry ***dents,          // OUT: Array of DirectoryEntrys
-                     uint32 *numDents);                       // OUT: total number of directory entrys
+                     HgfsDentArena *dents);                   // OUT: Directory entries
 HgfsInternalStatus
 HgfsPlatformSearchDir(HgfsNameStatus nameStatus,       // IN: name status
                       const char *dirName,             // IN: relative directory name
@@ -845,6 +943,77 @@ HgfsPlatformWriteFile(fileDesc writeFile,          // IN: file descriptor
                       Bool writeAppend,            // IN: write is appended
                       const void *writeData,       // IN: data to be written
                       uint32 *writtenSize);        // OUT: byte length written
+void
+HgfsPlatformReadAhead(fileDesc readFile,           // IN: file descriptor
+                      uint64 offset,               // IN: start of the range
+                      uint64 length);              // IN: length of the range
+HgfsInternalStatus
+HgfsPlatformReadFileIov(fileDesc readFile,           // IN: file descriptor
+                        HgfsSessionInfo *session,    // IN: session info
+                        uint64 offset,               // IN: file offset to read from
+                        uint32 requiredSize,         // IN: length of data to read
+                        HgfsVmxIov *vmxIov,          // OUT: mapped buffers for the data
+                        uint32 vmxIovCount,          // IN: count of vmxIov
+                        uint32 *actualSize);         // OUT: actual length read
+
+/*
+ * Completion of an asynchronous platform file I/O, called on the thread of
+ * the completion reactor.
+ */
+typedef void (*HgfsPlatformIoCallback)(HgfsInternalStatus status,  // IN: I/O status
+                                       uint32 actualSize,          // IN: bytes transferred
+                                       void *data);                // IN: caller data
+
+HgfsInternalStatus
+HgfsPlatformReadFileIovAsync(fileDesc readFile,               // IN: file descriptor
+                             HgfsSessionInfo *session,        // IN: session info
+                             uint64 offset,                   // IN: file offset to read from
+                             uint32 requiredSize,             // IN: length of data to read
+                             HgfsVmxIov *vmxIov,              // OUT: mapped buffers for the data
+                             uint32 vmxIovCount,              // IN: count of vmxIov
+                             HgfsPlatformIoCallback callback, // IN: completion callback
+                             void *data);                     // IN: callback data
+HgfsInternalStatus
+HgfsPlatformWriteFileIov(fileDesc writeFile,          // IN: file descriptor
+                         HgfsSessionInfo *session,    // IN: session info
+                         uint64 writeOffset,          // IN: file offset to write to
+                         uint32 writeDataSize,        // IN: length of data to write
+                         HgfsWriteFlags writeFlags,   // IN: write flags
+                         Bool writeSequential,        // IN: write is sequential
+                         Bool writeAppend,            // IN: write is appended
+                         const HgfsVmxIov *vmxIov,    // IN: mapped data to be written
+                         uint32 vmxIovCount,          // IN: count of vmxIov
+                         uint32 *writtenSize);        // OUT: byte length written
+HgfsInternalStatus
+HgfsPlatformWriteFileIovAsync(fileDesc writeFile,               // IN: file descriptor
+                              uint64 writeOffset,               // IN: file offset to write to
+                              uint32 writeDataSize,             // IN: length of data to write
+                              const HgfsVmxIov *vmxIov,         // IN: mapped data to be written
+                              uint32 vmxIovCount,               // IN: count of vmxIov
+                              HgfsPlatformIoCallback callback,  // IN: completion callback
+                              void *data);                      // IN: callback data
+HgfsInternalStatus
+HgfsPlatformCopyRange(fileDesc srcFile,           // IN: file to copy from
+                      uint64 srcOffset,           // IN: offset to copy from
+                      fileDesc dstFile,           // IN: file to copy to
+                      uint64 dstOffset,           // IN: offset to copy to
+                      uint32 length,              // IN: bytes to copy
+                      uint32 *copiedSize,         // OUT: bytes copied
+                      Bool *cloned);              // OUT: blocks are shared
+HgfsInternalStatus
+HgfsPlatformFsync(fileDesc file,                      // IN: file descriptor
+                  Bool dataOnly);                     // IN: like fdatasync(2)
+HgfsInternalStatus
+HgfsPlatformFsyncAsync(fileDesc file,                   // IN: file descriptor
+                       Bool dataOnly,                   // IN: like fdatasync(2)
+                       HgfsPlatformIoCallback callback, // IN: completion callback
+                       void *data);                     // IN: callback data
+HgfsInternalStatus
+HgfsPlatformFsyncDirectory(const char *dirName);      // IN: directory name
+HgfsInternalStatus
+HgfsPlatformAccessCheck(const char *fileName,         // IN: file name
+                        HgfsPermissions perms,        // IN: permissions to check
+                        Bool followSymlinks);         // IN: check the link target
 HgfsInternalStatus
 HgfsPlatformWriteWin32Stream(HgfsHandle file,           // IN: packet header
                              char *dataToWrite,         // IN: data to write
@@ -935,6 +1104,17 @@ HSPU_GetDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
                       MappingType mappingType,              // IN: Readable/ Writeable ?
                       HgfsServerChannelCallbacks *chanCb);  // IN: Channel callbacks
 
+HgfsVmxIov *
+HSPU_GetDataPacketIov(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
+                      MappingType mappingType,              // IN: Readable/ Writeable ?
+                      size_t dataSize,                      // IN: size to map
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      uint32 *iovCount);                    // OUT: mapped iov count
+
+void
+HSPU_GetDataPacketStats(uint64 *bounceBytes,   // OUT: bytes copied
+                        uint64 *directBytes);  // OUT: bytes not copied
+
 void
 HSPU_SetDataPacketSize(HgfsPacket *packet,            // IN/OUT: Hgfs Packet
                        size_t dataSize);              // IN: data size
@@ -46,6 +46,8 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <sys/resource.h> // for getrlimit
+#include <sys/uio.h>      // for preadv/pwritev
+#include <limits.h>       // for IOV_MAX
 
 #if defined(__FreeBSD__)
 #   include <sys/param.h>
@@ -58,7 +60,9 @@
 #include "hgfsServerPolicy.h" // for security policy
 #include "hgfsServerInt.h"
 #include "hgfsServerOplock.h"
+#include "hgfsAsyncIo.h"
 #include "hgfsEscape.h"
+#include "hgfsNameFormC.h"
 #include "err.h"
 #include "str.h"
 #include "cpNameLite.h"
@@ -69,7 +73,20 @@
 #include "su.h"
 #include "codeset.h"
 #include "unicodeOperations.h"
+#include "unicodeTransforms.h"
 #include "userlock.h"
+#include "hashTable.h"
+#include "mutexRankLib.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/openat2.h>)
+#include <linux/openat2.h>
+#endif
+#if __has_include(<linux/fs.h>)
+#include <sys/ioctl.h>
+#include <linux/fs.h>      // for FICLONERANGE
+#endif
+#endif
 
 #if defined(__linux__) && !defined(SYS_getdents64)
 /* For DT_UNKNOWN */
@@ -566,6 +583,51 @@ HgfsServerGetOpenFlags(HgfsOpenFlags flagsIn, // IN
 }
 
 
+#if defined(__linux__)
+/*
+ * Paths are checked to be within their share by resolving them beneath an
+ * O_PATH fd on the share root with openat2(2), rather than resolving every
+ * component with realpath(3). The share root fds are owned by the share
+ * index of the server, see HgfsPlatformShareRootOpen.
+ */
+
+/* Set once openat2(2) is found to be missing, e.g. on kernels before 5.6. */
+static Bool gHgfsNoOpenat2;
+#endif
+
+/*
+ * Case-folded indexes of directory entries for case insensitive lookups,
+ * keyed by directory path. An index is valid while the directory keeps its
+ * identity and status change time: creating, removing or renaming an entry
+ * updates the directory's ctime, as do permission changes. Directories
+ * changed less than HGFS_CASE_INDEX_SETTLE_SECS before they are scanned are
+ * not cached, so a change landing in the same timestamp tick as the scan is
+ * not missed. Indexes are dropped least recently used first to stay within
+ * the directory and name limits.
+ */
+
+#define HGFS_CASE_INDEX_MAX_DIRS      256
+#define HGFS_CASE_INDEX_MAX_NAMES     (128 * 1024)
+#define HGFS_CASE_INDEX_SETTLE_SECS   2
+
+typedef struct HgfsCaseIndex {
+   DblLnkLst_Links links;  // LRU list, most recently used last
+   char *dirPath;
+   dev_t dev;
+   ino_t ino;
+   time_t ctime;
+   uint32 numNames;
+   HashTable *names;       // Case-folded name -> name on disk
+} HgfsCaseIndex;
+
+static MXUserExclLock *gHgfsCaseIndexLock;
+static HashTable *gHgfsCaseIndexes;
+static DblLnkLst_Links gHgfsCaseIndexList;
+static uint32 gHgfsCaseIndexNames;   // Names in all cached indexes
+
+static void HgfsCaseIndexFree(HgfsCaseIndex *index);
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -585,6 +647,12 @@ HgfsServerGetOpenFlags(HgfsOpenFlags flagsIn, // IN
 Bool
 HgfsPlatformInit(void)
 {
+   gHgfsCaseIndexLock = MXUser_CreateExclLock("hgfsCaseIndexLock",
+                                              RANK_hgfsCaseIndexLock);
+   gHgfsCaseIndexes = HashTable_Alloc(HGFS_CASE_INDEX_MAX_DIRS,
+                                      HASH_STRING_KEY, NULL);
+   DblLnkLst_Init(&gHgfsCaseIndexList);
+   gHgfsCaseIndexNames = 0;
    return TRUE;
 }
 
@@ -608,6 +676,22 @@ HgfsPlatformInit(void)
 void
 HgfsPlatformDestroy(void)
 {
+   if (NULL != gHgfsCaseIndexes) {
+      DblLnkLst_Links *link;
+      DblLnkLst_Links *nextLink;
+
+      DblLnkLst_ForEachSafe(link, nextLink, &gHgfsCaseIndexList) {
+         DblLnkLst_Unlink1(link);
+         HgfsCaseIndexFree(DblLnkLst_Container(link, HgfsCaseIndex, links));
+      }
+      HashTable_Free(gHgfsCaseIndexes);
+      gHgfsCaseIndexes = NULL;
+      gHgfsCaseIndexNames = 0;
+   }
+   if (NULL != gHgfsCaseIndexLock) {
+      MXUser_DestroyExclLock(gHgfsCaseIndexLock);
+      gHgfsCaseIndexLock = NULL;
+   }
 }
 
 
@@ -765,12 +849,15 @@ HgfsCheckFileNode(char const *localName,      // IN
  *    correct write flags). Otherwise, it opens a new file, caches the node
  *    and returns the file desriptor.
  *
+ *    On success the caller must call HgfsPutCachedNode when it is done with
+ *    the file descriptor.
+ *
  * Results:
  *    Zero on success. fd contains the opened file descriptor.
  *    Non-zero on error.
  *
  * Side effects:
- *    None
+ *    The node is kept in the cache until HgfsPutCachedNode is called.
  *
  *-----------------------------------------------------------------------------
  */
@@ -807,17 +894,18 @@ HgfsPlatformGetFd(HgfsHandle hgfsHandle,    // IN:  HGFS file handle
    }
 
    /* If the node is found in the cache */
-   if (HgfsIsCached(hgfsHandle, session)) {
+   if (HgfsGetCachedNode(hgfsHandle, session)) {
       /*
        * If the append flag is set check to see if the file was opened
        * in append mode. If not, close the file and reopen it in append
        * mode.
        */
       if (append && !(node.flags & HGFS_FILE_NODE_APPEND_FL)) {
-         status = HgfsPlatformCloseFile(node.fileDesc, node.fileCtx);
-         if (status != 0) {
+         HgfsPutCachedNode(hgfsHandle, session);
+         if (!HgfsRemoveFromCache(hgfsHandle, session)) {
             LOG(4, "%s: Couldn't close file \"%s\" for reopening\n",
                 __FUNCTION__, node.utf8Name);
+            status = EBADF;
             goto exit;
          }
 
@@ -872,19 +960,12 @@ HgfsPlatformGetFd(HgfsHandle hgfsHandle,    // IN:  HGFS file handle
    }
 
    /*
-    * Update the original node with the new value of the file desc.
-    * This call might fail if the node is not used anymore.
+    * Update the original node with the new value of the file desc and add
+    * it to the cache. This call might fail if the node is not used anymore.
     */
-   if (!HgfsUpdateNodeFileDesc(hgfsHandle, session, newFd, NULL)) {
-      LOG(4, "%s: Could not update the node -- node is not used.\n",
-          __FUNCTION__);
-      status = EBADF;
-      goto exit;
-   }
-
-   /* Add the node to the cache. */
-   if (!HgfsAddToCache(hgfsHandle, session)) {
+   if (!HgfsAddToCacheFd(hgfsHandle, session, &newFd)) {
       LOG(4, "%s: Could not add node to the cache\n", __FUNCTION__);
+      HgfsPlatformCloseFile(newFd, NULL);
       status = EBADF;
       goto exit;
    }
@@ -1431,6 +1512,248 @@ HgfsGetHiddenAttr(char const *fileName,         // IN:  Input filename
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseIndexFree --
+ *
+ *    Free a directory case index.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsCaseIndexFree(HgfsCaseIndex *index)  // IN: index
+{
+   HashTable_Free(index->names);
+   free(index->dirPath);
+   free(index);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseIndexBuild --
+ *
+ *    Read a directory and index its entries by their case-folded names.
+ *    Entries whose names are not valid in the default encoding are skipped.
+ *    When several entries fold to the same name the first one read is kept,
+ *    which is the one a scan of the directory would have matched.
+ *
+ * Results:
+ *    Returns 0 and the new index in the index argument on success, errno
+ *    otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsCaseIndexBuild(const char *dirPath,        // IN: directory
+                   const struct stat *dirStat, // IN: directory stat, before read
+                   HgfsCaseIndex **index)      // OUT: new index
+{
+   struct dirent *dirent;
+   DIR *dir;
+   char **foldedNames = NULL;
+   char **names = NULL;
+   uint32 numNames = 0;
+   uint32 maxNames = 0;
+   uint32 numBuckets;
+   uint32 i;
+   HgfsCaseIndex *newIndex;
+
+   dir = Posix_OpenDir(dirPath);
+   if (NULL == dir) {
+      return errno;
+   }
+
+   while ((dirent = readdir(dir))) {
+      char *nameU;
+
+      if (!Unicode_IsBufferValid(dirent->d_name, strlen(dirent->d_name),
+                                 STRING_ENCODING_DEFAULT)) {
+         continue;
+      }
+
+      if (numNames == maxNames) {
+         maxNames = maxNames == 0 ? 64 : maxNames * 2;
+         foldedNames = Util_SafeRealloc(foldedNames,
+                                        maxNames * sizeof *foldedNames);
+         names = Util_SafeRealloc(names, maxNames * sizeof *names);
+      }
+
+      nameU = Unicode_Alloc(dirent->d_name, STRING_ENCODING_DEFAULT);
+      foldedNames[numNames] = Unicode_FoldCase(nameU);
+      free(nameU);
+      names[numNames] = Util_SafeStrdup(dirent->d_name);
+      numNames++;
+   }
+   closedir(dir);
+
+   for (numBuckets = 16; numBuckets < numNames && numBuckets < (1 << 20);
+        numBuckets <<= 1) {
+   }
+
+   newIndex = Util_SafeCalloc(1, sizeof *newIndex);
+   DblLnkLst_Init(&newIndex->links);
+   newIndex->dirPath = Util_SafeStrdup(dirPath);
+   newIndex->dev = dirStat->st_dev;
+   newIndex->ino = dirStat->st_ino;
+   newIndex->ctime = dirStat->st_ctime;
+   newIndex->names = HashTable_Alloc(numBuckets,
+                                     HASH_STRING_KEY | HASH_FLAG_COPYKEY,
+                                     free);
+   for (i = 0; i < numNames; i++) {
+      if (HashTable_Insert(newIndex->names, foldedNames[i], names[i])) {
+         newIndex->numNames++;
+      } else {
+         free(names[i]);
+      }
+      free(foldedNames[i]);
+   }
+   free(foldedNames);
+   free(names);
+
+   *index = newIndex;
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseIndexLookup --
+ *
+ *    Look up a case-folded name in the cached index of a directory.
+ *
+ * Results:
+ *    TRUE if a valid index for the directory is cached. The matching name,
+ *    or NULL if the directory has no such entry, is returned in the name
+ *    argument and needs to be freed.
+ *    FALSE if there is no valid index for the directory.
+ *
+ * Side effects:
+ *    Drops the directory's index if it is stale.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsCaseIndexLookup(const char *dirPath,         // IN: directory
+                    const struct stat *dirStat,  // IN: directory stat
+                    const char *foldedName,      // IN: case-folded name
+                    char **name)                 // OUT: name on disk
+{
+   HgfsCaseIndex *index;
+   HgfsCaseIndex *staleIndex = NULL;
+   char *found;
+   Bool valid = FALSE;
+
+   *name = NULL;
+
+   MXUser_AcquireExclLock(gHgfsCaseIndexLock);
+   if (HashTable_Lookup(gHgfsCaseIndexes, dirPath, (void **)&index)) {
+      if (index->dev == dirStat->st_dev && index->ino == dirStat->st_ino &&
+          index->ctime == dirStat->st_ctime) {
+         if (HashTable_Lookup(index->names, foldedName, (void **)&found)) {
+            *name = Util_SafeStrdup(found);
+         }
+         DblLnkLst_Unlink1(&index->links);
+         DblLnkLst_LinkLast(&gHgfsCaseIndexList, &index->links);
+         valid = TRUE;
+      } else {
+         HashTable_Delete(gHgfsCaseIndexes, dirPath);
+         DblLnkLst_Unlink1(&index->links);
+         gHgfsCaseIndexNames -= index->numNames;
+         staleIndex = index;
+      }
+   }
+   MXUser_ReleaseExclLock(gHgfsCaseIndexLock);
+
+   if (NULL != staleIndex) {
+      HgfsCaseIndexFree(staleIndex);
+   }
+   return valid;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseIndexInsert --
+ *
+ *    Cache a directory case index, replacing any index cached for the same
+ *    directory. Indexes of recently changed directories and of directories
+ *    too large for the cache are freed instead.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    The least recently used indexes may be dropped.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsCaseIndexInsert(HgfsCaseIndex *index)  // IN: index, consumed
+{
+   DblLnkLst_Links dropped;
+   DblLnkLst_Links *link;
+   DblLnkLst_Links *nextLink;
+   HgfsCaseIndex *oldIndex;
+
+   if (index->ctime + HGFS_CASE_INDEX_SETTLE_SECS > time(NULL) ||
+       index->numNames > HGFS_CASE_INDEX_MAX_NAMES) {
+      HgfsCaseIndexFree(index);
+      return;
+   }
+
+   DblLnkLst_Init(&dropped);
+
+   MXUser_AcquireExclLock(gHgfsCaseIndexLock);
+   if (HashTable_Lookup(gHgfsCaseIndexes, index->dirPath,
+                        (void **)&oldIndex)) {
+      /* Another thread indexed the same directory meanwhile. */
+      HashTable_Delete(gHgfsCaseIndexes, index->dirPath);
+      DblLnkLst_Unlink1(&oldIndex->links);
+      gHgfsCaseIndexNames -= oldIndex->numNames;
+      DblLnkLst_LinkLast(&dropped, &oldIndex->links);
+   }
+
+   while (HashTable_GetNumElements(gHgfsCaseIndexes) >=
+             HGFS_CASE_INDEX_MAX_DIRS ||
+          gHgfsCaseIndexNames + index->numNames > HGFS_CASE_INDEX_MAX_NAMES) {
+      oldIndex = DblLnkLst_Container(gHgfsCaseIndexList.next, HgfsCaseIndex,
+                                     links);
+      HashTable_Delete(gHgfsCaseIndexes, oldIndex->dirPath);
+      DblLnkLst_Unlink1(&oldIndex->links);
+      gHgfsCaseIndexNames -= oldIndex->numNames;
+      DblLnkLst_LinkLast(&dropped, &oldIndex->links);
+   }
+
+   HashTable_Insert(gHgfsCaseIndexes, index->dirPath, index);
+   DblLnkLst_LinkLast(&gHgfsCaseIndexList, &index->links);
+   gHgfsCaseIndexNames += index->numNames;
+   MXUser_ReleaseExclLock(gHgfsCaseIndexLock);
+
+   DblLnkLst_ForEachSafe(link, nextLink, &dropped) {
+      DblLnkLst_Unlink1(link);
+      HgfsCaseIndexFree(DblLnkLst_Container(link, HgfsCaseIndex, links));
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1439,6 +1762,9 @@ HgfsGetHiddenAttr(char const *fileName,         // IN:  Input filename
  *    Do a case insensitive search of a directory for the specified entry. If
  *    a matching entry is found, return it in the convertedComponent argument.
  *
+ *    The search uses the cached case index of the directory, reading the
+ *    directory only when there is no valid index for it.
+ *
  * Results:
  *    On Success:
  *    Returns 0 and the converted component name in the argument convertedComponent.
@@ -1461,28 +1787,28 @@ HgfsConvertComponentCase(char *currentComponent,           // IN
                          const char **convertedComponent,  // OUT
                          size_t *convertedComponentSize)   // OUT
 {
-   struct dirent *dirent;
-   DIR *dir = NULL;
-   char *dentryName;
-   size_t dentryNameLen;
+   struct stat dirStat;
+   char *foldedComponent;
    char *myConvertedComponent = NULL;
-   size_t myConvertedComponentSize;
-   int ret;
+   HgfsCaseIndex *index;
+   int ret = 0;
 
    ASSERT(currentComponent);
    ASSERT(dirPath);
    ASSERT(convertedComponent);
    ASSERT(convertedComponentSize);
 
-   /* Open the specified directory. */
-   dir = Posix_OpenDir(dirPath);
-   if (!dir) {
+   if (Posix_Stat(dirPath, &dirStat) < 0) {
       ret = errno;
       goto exit;
    }
+   if (!S_ISDIR(dirStat.st_mode)) {
+      ret = ENOTDIR;
+      goto exit;
+   }
 
    /*
-    * Unicode_CompareIgnoreCase crashes with invalid unicode strings,
+    * Unicode_FoldCase crashes with invalid unicode strings,
     * validate it before passing it to Unicode_* functions.
     */
    if (!Unicode_IsBufferValid(currentComponent, -1, STRING_ENCODING_UTF8)) {
@@ -1491,67 +1817,34 @@ HgfsConvertComponentCase(char *currentComponent,           // IN
       goto exit;
    }
 
-   /*
-    * Read all of the directory entries. For each one, convert the name
-    * to lower case and then compare it to the lower case component.
-    */
-   while ((dirent = readdir(dir))) {
-      char *dentryNameU;
-      int cmpResult;
-
-      dentryName = dirent->d_name;
-      dentryNameLen = strlen(dentryName);
-
-      /*
-       * Unicode_CompareIgnoreCase crashes with invalid unicode strings,
-       * validate and convert it appropriately before passing it to Unicode_*
-       * functions.
-       */
-
-      if (!Unicode_IsBufferValid(dentryName, dentryNameLen,
-                                 STRING_ENCODING_DEFAULT)) {
-         /* Invalid unicode string, skip the entry. */
-         continue;
-      }
-
-      dentryNameU = Unicode_Alloc(dentryName, STRING_ENCODING_DEFAULT);
+   foldedComponent = Unicode_FoldCase(currentComponent);
+   if (!HgfsCaseIndexLookup(dirPath, &dirStat, foldedComponent,
+                            &myConvertedComponent)) {
+      ret = HgfsCaseIndexBuild(dirPath, &dirStat, &index);
+      if (ret == 0) {
+         char *found;
 
-      cmpResult = Unicode_CompareIgnoreCase(currentComponent, dentryNameU);
-      free(dentryNameU);
-
-      if (cmpResult == 0) {
-         /*
-          * The current directory entry is a case insensitive match to
-          * the specified component. Malloc and copy the current directory entry.
-          */
-         myConvertedComponentSize = dentryNameLen + 1;
-         myConvertedComponent = malloc(myConvertedComponentSize);
-         if (myConvertedComponent == NULL) {
-            ret = errno;
-            LOG(4, "%s: failed to malloc myConvertedComponent.\n",
-                __FUNCTION__);
-            goto exit;
+         if (HashTable_Lookup(index->names, foldedComponent,
+                              (void **)&found)) {
+            myConvertedComponent = Util_SafeStrdup(found);
          }
-         Str_Strcpy(myConvertedComponent, dentryName, myConvertedComponentSize);
-
-         /* Success. Cleanup and exit. */
-         ret = 0;
-         *convertedComponentSize = myConvertedComponentSize;
-         *convertedComponent = myConvertedComponent;
-         goto exit;
+         HgfsCaseIndexInsert(index);
       }
    }
+   free(foldedComponent);
 
-   /* We didn't find a match. Failure. */
-   ret = ENOENT;
+   if (ret == 0 && NULL == myConvertedComponent) {
+      /* We didn't find a match. Failure. */
+      ret = ENOENT;
+   }
 
 exit:
-   if (dir) {
-      closedir(dir);
-   }
    if (ret) {
       *convertedComponent = NULL;
       *convertedComponentSize = 0;
+   } else {
+      *convertedComponent = myConvertedComponent;
+      *convertedComponentSize = strlen(myConvertedComponent) + 1;
    }
    return ret;
 }
@@ -1582,13 +1875,14 @@ HgfsConstructConvertedPath(char **path,                 // IN/OUT
 {
    char *p;
    size_t convertedPathLen = convertedPathSize - 1;
+   size_t separatorLen = sizeof (DIRSEPS) - 1;  // Not sizeof (DIRSEPC), an int
 
    ASSERT(path);
    ASSERT(*path);
    ASSERT(convertedPath);
    ASSERT(pathSize);
 
-   p = realloc(*path, *pathSize + convertedPathLen + sizeof (DIRSEPC));
+   p = realloc(*path, *pathSize + convertedPathLen + separatorLen);
    if (!p) {
       int error = errno;
       LOG(4, "%s: failed to realloc.\n", __FUNCTION__);
@@ -1596,7 +1890,7 @@ HgfsConstructConvertedPath(char **path,                 // IN/OUT
    }
 
    *path = p;
-   *pathSize += convertedPathLen + sizeof (DIRSEPC);
+   *pathSize += convertedPathLen + separatorLen;
 
    /* Copy out the converted component to curDir, and free it. */
    Str_Strncat(p, *pathSize, DIRSEPS, sizeof (DIRSEPS));
@@ -2897,7 +3191,7 @@ HgfsPlatformSetattrFromFd(HgfsHandle file,          // IN: file descriptor
    status = HgfsPlatformGetFd(file, session, FALSE, &fd);
    if (status != 0) {
       LOG(4, "%s: Could not get file descriptor\n", __FUNCTION__);
-      goto exit;
+      return status;
    }
 
    /* We need the old stats so that we can preserve times. */
@@ -3047,6 +3341,7 @@ HgfsPlatformSetattrFromFd(HgfsHandle file,          // IN: file descriptor
    }
 
 exit:
+   HgfsPutCachedNode(file, session);
    return status;
 }
 
@@ -3407,10 +3702,13 @@ HgfsPlatformDirDumpDents(HgfsSearch *search)         // IN: search
 
    ASSERT(search != NULL);
 
-   Log("%s: %u dents in \"%s\"\n", __FUNCTION__, search->numDents, search->utf8Dir);
+   Log("%s: %u dents in \"%s\"\n", __FUNCTION__, search->dents.numDents,
+       search->utf8Dir);
+
+   for (i = 0; i < search->dents.numDents; i++) {
+      DirectoryEntry *dent = HgfsDentArena_Get(&search->dents, i);
 
-   for (i = 0; i < search->numDents; i++) {
-      Log("\"%s\"\n", search->dents[i]->d_name);
+      Log("\"%s\"\n", dent->d_name);
    }
 }
 #endif
@@ -3426,6 +3724,8 @@ HgfsPlatformDirDumpDents(HgfsSearch *search)         // IN: search
  *    encoding.
  *    On Mac OS the default encoding is Utf8 form D thus a convertion to
  *    Utf8 for C is required.
+ *    Names made only of code points below U+0300, which is nearly all of
+ *    them, are neither validated nor converted.
  *
  * Results:
  *    TRUE on success. Buffer has name in Utf8 form C encoding.
@@ -3441,6 +3741,11 @@ Bool
 HgfsConvertToUtf8FormC(char *buffer,         // IN/OUT: name to normalize
                        size_t bufferSize)    // IN: size of the name buffer
 {
+   if (HgfsNameFormC_IsTrivial(buffer, bufferSize)) {
+      /* Valid and already in normal form C, the common case. */
+      return TRUE;
+   }
+
 #if defined(__APPLE__)
    size_t entryNameLen;
    char *entryName = NULL;
@@ -3483,99 +3788,125 @@ HgfsConvertToUtf8FormC(char *buffer,         // IN/OUT: name to normalize
 }
 
 
+#if defined(__linux__)
+/*
+ * Streaming searches hold at most a window of HGFS_SEARCH_STREAM_WINDOW
+ * entries and read up to HGFS_SEARCH_STREAM_READ_AHEAD entries past the one
+ * requested. The directory position at the start of each window is kept, so
+ * that a client going back to an earlier entry only rereads one window.
+ */
+#define HGFS_SEARCH_STREAM_WINDOW      4096
+#define HGFS_SEARCH_STREAM_READ_AHEAD  256
+
+typedef struct HgfsSearchResumePoint {
+   uint32 index;     // Index of the first entry read from the position
+   uint64 position;  // Directory position (getdents d_off cookie)
+} HgfsSearchResumePoint;
+
+typedef struct HgfsSearchStream {
+   int fd;                               // Open directory
+   uint32 base;                          // Index of the first entry in dents
+   uint64 position;                      // Directory position after dents
+   Bool eof;                             // All entries were read
+   HgfsSearchResumePoint *resumePoints;  // Sorted by index
+   uint32 numResumePoints;
+} HgfsSearchStream;
+
+
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsPlatformGetDirEntry --
+ * HgfsSearchStreamAddResumePoint --
  *
- *    Returns the directory entry (or a copy) at the given index. If remove is set
- *    to TRUE, the existing result is also pruned and the remaining results
- *    are shifted up in the result array.
+ *    Records the directory position of an entry index, unless an equal or
+ *    later index has already been recorded.
  *
  * Results:
- *    HGFS_ERROR_SUCCESS or an appropriate error code.
+ *    None.
  *
  * Side effects:
- *    None.
+ *    Memory allocation.
  *
  *-----------------------------------------------------------------------------
  */
 
-HgfsInternalStatus
-HgfsPlatformGetDirEntry(HgfsSearch *search,               // IN: search
-                        HgfsSessionInfo *session,         // IN: Session info
-                        uint32 index,                     // IN: Offset to retrieve at
-                        Bool remove,                      // IN: If true, removes the result
-                        struct DirectoryEntry **dirEntry) // OUT: dirent
+static void
+HgfsSearchStreamAddResumePoint(HgfsSearchStream *stream,  // IN/OUT: open directory
+                               uint32 index,              // IN: entry index
+                               uint64 position)           // IN: directory position
 {
-   DirectoryEntry *dent = NULL;
-   HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
+   HgfsSearchResumePoint *point;
 
-   if (index >= search->numDents) {
-      goto out;
+   if (0 != stream->numResumePoints &&
+       stream->resumePoints[stream->numResumePoints - 1].index >= index) {
+      return;
    }
 
-   /* If we're not removing the result, we need to make a copy of it. */
-   if (remove) {
-      /*
-       * We're going to shift the dents array, overwriting the dent pointer at
-       * offset, so first we need to save said pointer so that we can return it
-       * later to the caller.
-       */
-      dent = search->dents[index];
-
-      if (index < search->numDents - 1) {
-         /* Shift up the remaining results */
-         memmove(&search->dents[index], &search->dents[index + 1],
-                 (search->numDents - (index + 1)) * sizeof search->dents[0]);
-      }
+   stream->resumePoints = Util_SafeRealloc(stream->resumePoints,
+                                           (stream->numResumePoints + 1) *
+                                           sizeof *stream->resumePoints);
+   point = &stream->resumePoints[stream->numResumePoints++];
+   point->index = index;
+   point->position = position;
+}
 
-      /* Decrement the number of results */
-      search->numDents--;
-   } else {
-      DirectoryEntry *originalDent;
-      size_t nameLen;
 
-      originalDent = search->dents[index];
-      ASSERT(originalDent);
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSearchStreamRewind --
+ *
+ *    Repositions a streaming search at the last resume point before an
+ *    entry, dropping the current window.
+ *
+ * Results:
+ *    HGFS_ERROR_SUCCESS or an appropriate error code.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
 
-      nameLen = strlen(originalDent->d_name);
-      /*
-       * Make sure the name will not overrun the d_name buffer, the end of
-       * which is also the end of the DirectoryEntry.
-       */
-      ASSERT(offsetof(DirectoryEntry, d_name) + nameLen < originalDent->d_reclen);
+static HgfsInternalStatus
+HgfsSearchStreamRewind(HgfsSearch *search,  // IN/OUT: search
+                       uint32 index)        // IN: entry index
+{
+   HgfsSearchStream *stream = search->stream;
+   HgfsSearchResumePoint *point;
+   uint32 i;
 
-      dent = malloc(originalDent->d_reclen);
-      if (dent == NULL) {
-         status = HGFS_ERROR_NOT_ENOUGH_MEMORY;
-         goto out;
-      }
+   /* The first resume point is the start of the directory. */
+   ASSERT(stream->numResumePoints > 0 && stream->resumePoints[0].index == 0);
 
-      /*
-       * Yes, there are more members than this in a dirent. But if you look
-       * at the top of hgfsServerInt.h, you'll see that on Windows we only
-       * define d_reclen and d_name, as those are the only fields we need.
-       */
-      dent->d_reclen = originalDent->d_reclen;
-      memcpy(dent->d_name, originalDent->d_name, nameLen);
-      dent->d_name[nameLen] = 0;
+   for (i = stream->numResumePoints - 1; stream->resumePoints[i].index > index; i--) {
+      continue;
    }
+   point = &stream->resumePoints[i];
 
-out:
-   if (status == HGFS_ERROR_SUCCESS) {
-      *dirEntry = dent;
+   if (lseek(stream->fd, point->position, SEEK_SET) == (off_t)-1) {
+      HgfsInternalStatus status = errno;
+
+      LOG(4, "%s: error in lseek: %d (%s)\n", __FUNCTION__, status,
+          Err_Errno2String(status));
+      return status;
    }
-   return status;
+
+   HgfsDentArena_Free(&search->dents);
+   stream->base = point->index;
+   stream->position = point->position;
+   stream->eof = FALSE;
+
+   return HGFS_ERROR_SUCCESS;
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsPlatformSetDirEntry --
+ * HgfsSearchStreamRead --
  *
- *    Sets the directory entry into the search read information.
+ *    Reads the next batch of entries of a streaming search into its window.
  *
  * Results:
  *    HGFS_ERROR_SUCCESS or an appropriate error code.
@@ -3586,15 +3917,234 @@ out:
  *-----------------------------------------------------------------------------
  */
 
-HgfsInternalStatus
-HgfsPlatformSetDirEntry(HgfsSearch *search,              // IN: partially valid search
-                        HgfsShareOptions configOptions,  // IN: share configuration settings
-                        HgfsSessionInfo *session,        // IN: session info
-                        struct DirectoryEntry *dirEntry, // IN: the indexed dirent
-                        Bool getAttr,                    // IN: get the entry attributes
-                        HgfsFileAttrInfo *entryAttr,     // OUT: entry attributes, optional
-                        char **entryName,                // OUT: entry name
-                        uint32 *entryNameLength)         // OUT: entry name length
+static HgfsInternalStatus
+HgfsSearchStreamRead(HgfsSearch *search)  // IN/OUT: search
+{
+   HgfsSearchStream *stream = search->stream;
+   char buffer[8192];
+   size_t offset = 0;
+   int result;
+
+   result = getdents(stream->fd, (void *)buffer, sizeof buffer);
+   if (result < 0) {
+      HgfsInternalStatus status = errno;
+
+      LOG(4, "%s: error in getdents: %d (%s)\n", __FUNCTION__, status,
+          Err_Errno2String(status));
+      return status;
+   }
+
+   if (0 == result) {
+      stream->eof = TRUE;
+      return HGFS_ERROR_SUCCESS;
+   }
+
+   while (offset < result) {
+      DirectoryEntry *newDent = (DirectoryEntry *)(buffer + offset);
+
+      ASSERT(newDent->d_reclen <= result - offset);
+
+      /* Names that can't be converted to utf8 are discarded, see Scandir. */
+      if (HgfsConvertToUtf8FormC(newDent->d_name,
+                                 newDent->d_reclen - offsetof(DirectoryEntry, d_name))) {
+         DirectoryEntry *myDent = HgfsDentArena_Alloc(&search->dents,
+                                                      newDent->d_reclen);
+
+         if (NULL == myDent) {
+            return HGFS_ERROR_NOT_ENOUGH_MEMORY;
+         }
+         memcpy(myDent, newDent, newDent->d_reclen);
+      }
+      stream->position = newDent->d_off;
+      offset += newDent->d_reclen;
+   }
+
+   return HGFS_ERROR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSearchStreamFill --
+ *
+ *    Makes sure the window of a streaming search holds the entry at the
+ *    given index, unless the directory has fewer entries, plus some
+ *    read-ahead. The window is moved forward once it is full, or back to
+ *    the last resume point before the entry.
+ *
+ *    Caller should hold the session's searchArrayLock.
+ *
+ * Results:
+ *    HGFS_ERROR_SUCCESS or an appropriate error code.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsSearchStreamFill(HgfsSearch *search,  // IN/OUT: search
+                     uint32 index)        // IN: entry index
+{
+   HgfsSearchStream *stream = search->stream;
+   HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
+
+   if (index < stream->base) {
+      status = HgfsSearchStreamRewind(search, index);
+   }
+
+   while (HGFS_ERROR_SUCCESS == status && !stream->eof) {
+      uint32 end = stream->base + search->dents.numDents;
+
+      if (index < end) {
+         /* Enough read-ahead, or no room left in the window for more. */
+         if (end - index > HGFS_SEARCH_STREAM_READ_AHEAD ||
+             search->dents.numDents >= HGFS_SEARCH_STREAM_WINDOW) {
+            break;
+         }
+      } else if (search->dents.numDents >= HGFS_SEARCH_STREAM_WINDOW) {
+         /* The window is behind the entry, move it forward. */
+         HgfsSearchStreamAddResumePoint(stream, end, stream->position);
+         HgfsDentArena_Free(&search->dents);
+         stream->base = end;
+      }
+
+      status = HgfsSearchStreamRead(search);
+   }
+
+   return status;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformGetDirEntry --
+ *
+ *    Returns a copy of the directory entry at the given index. If remove is set
+ *    to TRUE, the existing result is also pruned and the remaining results
+ *    are shifted up in the result array.
+ *
+ * Results:
+ *    HGFS_ERROR_SUCCESS or an appropriate error code.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformGetDirEntry(HgfsSearch *search,               // IN: search
+                        HgfsSessionInfo *session,         // IN: Session info
+                        uint32 index,                     // IN: Offset to retrieve at
+                        Bool remove,                      // IN: If true, removes the result
+                        struct DirectoryEntry **dirEntry) // OUT: dirent
+{
+   DirectoryEntry *dent = NULL;
+   DirectoryEntry *originalDent;
+   HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
+
+#if defined(__linux__)
+   if (NULL != search->stream) {
+      /* Remove is only used for virtual directory searches. */
+      ASSERT(!remove);
+
+      status = HgfsSearchStreamFill(search, index);
+      if (HGFS_ERROR_SUCCESS != status) {
+         goto out;
+      }
+
+      /* Turn the directory index into the window index. */
+      if (index < search->stream->base) {
+         goto out;
+      }
+      index -= search->stream->base;
+   }
+#endif
+
+   if (index >= search->dents.numDents) {
+      goto out;
+   }
+
+   originalDent = HgfsDentArena_Get(&search->dents, index);
+   ASSERT(originalDent);
+
+   /*
+    * The dents live in the search's arena, the caller always gets a copy.
+    * If the result is removed, the remaining results are shifted up.
+    */
+   if (remove) {
+      dent = malloc(originalDent->d_reclen);
+      if (dent == NULL) {
+         status = HGFS_ERROR_NOT_ENOUGH_MEMORY;
+         goto out;
+      }
+      memcpy(dent, originalDent, originalDent->d_reclen);
+
+      HgfsDentArena_Remove(&search->dents, index);
+   } else {
+      size_t nameLen;
+
+      nameLen = strlen(originalDent->d_name);
+      /*
+       * Make sure the name will not overrun the d_name buffer, the end of
+       * which is also the end of the DirectoryEntry.
+       */
+      ASSERT(offsetof(DirectoryEntry, d_name) + nameLen < originalDent->d_reclen);
+
+      dent = malloc(originalDent->d_reclen);
+      if (dent == NULL) {
+         status = HGFS_ERROR_NOT_ENOUGH_MEMORY;
+         goto out;
+      }
+
+      /*
+       * Yes, there are more members than this in a dirent. But if you look
+       * at the top of hgfsServerInt.h, you'll see that on Windows we only
+       * define d_reclen and d_name, as those are the only fields we need.
+       */
+      dent->d_reclen = originalDent->d_reclen;
+      memcpy(dent->d_name, originalDent->d_name, nameLen);
+      dent->d_name[nameLen] = 0;
+   }
+
+out:
+   if (status == HGFS_ERROR_SUCCESS) {
+      *dirEntry = dent;
+   }
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformSetDirEntry --
+ *
+ *    Sets the directory entry into the search read information.
+ *
+ * Results:
+ *    HGFS_ERROR_SUCCESS or an appropriate error code.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformSetDirEntry(HgfsSearch *search,              // IN: partially valid search
+                        HgfsShareOptions configOptions,  // IN: share configuration settings
+                        HgfsSessionInfo *session,        // IN: session info
+                        struct DirectoryEntry *dirEntry, // IN: the indexed dirent
+                        Bool getAttr,                    // IN: get the entry attributes
+                        HgfsFileAttrInfo *entryAttr,     // OUT: entry attributes, optional
+                        char **entryName,                // OUT: entry name
+                        uint32 *entryNameLength)         // OUT: entry name length
 {
    HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
    unsigned int length;
@@ -3760,6 +4310,96 @@ HgfsPlatformSetDirEntry(HgfsSearch *search,              // IN: partially valid
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformSearchStreamOpen --
+ *
+ *    Opens a directory for a streaming search: entries are read on demand
+ *    by HgfsPlatformGetDirEntry. The directory is opened like in
+ *    HgfsPlatformScandir.
+ *
+ * Results:
+ *    HGFS_ERROR_SUCCESS on success.
+ *    HGFS_ERROR_NOT_SUPPORTED if the platform only supports snapshot searches.
+ *    Another error code otherwise.
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformSearchStreamOpen(char const *baseDir,               // IN: Directory to search in
+                             size_t baseDirLen,                 // IN: Ignored
+                             Bool followSymlinks,               // IN: followSymlinks config option
+                             struct HgfsSearchStream **stream)  // OUT: Open directory
+{
+#if defined(__linux__)
+   HgfsSearchStream *myStream;
+   int openFlags = O_NONBLOCK | O_RDONLY | O_DIRECTORY | O_NOFOLLOW;
+   int fd;
+
+   /* Follow symlinks if config option is set. */
+   if (followSymlinks) {
+      openFlags &= ~O_NOFOLLOW;
+   }
+
+   /* We want a directory. No FIFOs. Symlinks only if config option is set. */
+   fd = Posix_Open(baseDir, openFlags);
+   if (fd < 0) {
+      HgfsInternalStatus status = errno;
+
+      LOG(4, "%s: error in open: %d (%s)\n", __FUNCTION__, status,
+          Err_Errno2String(status));
+      return status;
+   }
+
+   myStream = Util_SafeCalloc(1, sizeof *myStream);
+   myStream->fd = fd;
+   HgfsSearchStreamAddResumePoint(myStream, 0, 0);
+
+   *stream = myStream;
+   return HGFS_ERROR_SUCCESS;
+#else
+   return HGFS_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformSearchStreamClose --
+ *
+ *    Closes the directory of a streaming search.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsPlatformSearchStreamClose(struct HgfsSearchStream *stream)  // IN: Open directory
+{
+#if defined(__linux__)
+   if (close(stream->fd) < 0) {
+      LOG(4, "%s: error in close: %d (%s)\n", __FUNCTION__, errno,
+          Err_Errno2String(errno));
+   }
+   free(stream->resumePoints);
+   free(stream);
+#else
+   NOT_REACHED();
+#endif
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -3789,8 +4429,7 @@ HgfsInternalStatus
 HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search in
                     size_t baseDirLen,              // IN: Ignored
                     Bool followSymlinks,            // IN: followSymlinks config option
-                    struct DirectoryEntry ***dents, // OUT: Array of DirectoryEntrys
-                    int *numDents)                  // OUT: Number of DirectoryEntrys
+                    HgfsDentArena *dents)           // OUT: Directory entries
 {
 #if defined(__APPLE__)
    DIR *fd = NULL;
@@ -3799,8 +4438,7 @@ HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search i
    int openFlags = O_NONBLOCK | O_RDONLY | O_DIRECTORY | O_NOFOLLOW;
 #endif
    int result;
-   DirectoryEntry **myDents = NULL;
-   int myNumDents = 0;
+   HgfsDentArena myDents;
    HgfsInternalStatus status = 0;
 
    /*
@@ -3809,6 +4447,8 @@ HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search i
     */
    char buffer[8192];
 
+   HgfsDentArena_Init(&myDents);
+
 #if defined(__APPLE__)
    /*
     * Since opendir does not support O_NOFOLLOW flag need to explicitly verify
@@ -3869,39 +4509,25 @@ HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search i
       size_t offset = 0;
       while (offset < 1) {
 #endif
-         DirectoryEntry *newDent, **newDents;
+         DirectoryEntry *newDent, *myDent;
 
          newDent = (DirectoryEntry *)(buffer + offset);
 
          /* This dent had better fit in the actual space we've got left. */
          ASSERT(newDent->d_reclen <= result - offset);
 
-         /* Add another dent pointer to the dents array. */
-         newDents = realloc(myDents, sizeof *myDents * (myNumDents + 1));
-         if (newDents == NULL) {
-            status = ENOMEM;
-            goto exit;
-         }
-         myDents = newDents;
-
-         /*
-          * Allocate the new dent and set it up. We do a straight memcpy of
-          * the entire record to avoid dealing with platform-specific fields.
-          */
-         myDents[myNumDents] = malloc(newDent->d_reclen);
-         if (myDents[myNumDents] == NULL) {
-            status = ENOMEM;
-            goto exit;
-         }
-
          if (HgfsConvertToUtf8FormC(newDent->d_name,
                                     newDent->d_reclen - offsetof(DirectoryEntry, d_name))) {
-            memcpy(myDents[myNumDents], newDent, newDent->d_reclen);
             /*
-             * Dent is done. Bump the offset to the batched buffer to process the
-             * next dent within it.
+             * Add the new dent to the arena. We do a straight memcpy of
+             * the entire record to avoid dealing with platform-specific fields.
              */
-            myNumDents++;
+            myDent = HgfsDentArena_Alloc(&myDents, newDent->d_reclen);
+            if (myDent == NULL) {
+               status = ENOMEM;
+               goto exit;
+            }
+            memcpy(myDent, newDent, newDent->d_reclen);
          } else {
             /*
              * XXX:
@@ -3911,8 +4537,11 @@ HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search i
              *    Need to change this to a more reasonable behavior, similar
              *    to name escaping which is used to deal with illegal file names.
              */
-            free(myDents[myNumDents]);
          }
+         /*
+          * Dent is done. Bump the offset to the batched buffer to process the
+          * next dent within it.
+          */
          offset += newDent->d_reclen;
       }
    }
@@ -3940,14 +4569,9 @@ HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search i
     * given to us by the client.
     */
    if (status != 0) {
-      size_t i;
-      for (i = 0; i < myNumDents; i++) {
-         free(myDents[i]);
-      }
-      free(myDents);
+      HgfsDentArena_Free(&myDents);
    } else {
       *dents = myDents;
-      *numDents = myNumDents;
    }
    return status;
 }
@@ -3961,7 +4585,7 @@ HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search i
  *    Perform a scandir on our virtual directory.
  *
  *    Get directory entry names from the given callback function, and
- *    build an array of DirectoryEntrys of all the names. Somewhat similar to
+ *    build an arena of DirectoryEntrys of all the names. Somewhat similar to
  *    scandir(3) on linux, but more general.
  *
  * Results:
@@ -3979,15 +4603,14 @@ HgfsPlatformScanvdir(HgfsServerResEnumGetFunc enumNamesGet,   // IN: Function to
                      HgfsServerResEnumInitFunc enumNamesInit, // IN: Setup function
                      HgfsServerResEnumExitFunc enumNamesExit, // IN: Cleanup function
                      DirectorySearchType type,                // IN: Kind of search - unused
-                     struct DirectoryEntry ***dents,          // OUT: Array of DirectoryEntrys
-                     uint32 *numDents)                        // OUT: total number of directory entrys
+                     HgfsDentArena *dents)                    // OUT: Directory entries
 {
    HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
-   uint32 totalDents = 0;   // Number of allocated dents
-   uint32 myNumDents = 0;     // Current actual number of dents
-   DirectoryEntry **myDents = NULL; // So realloc is happy w/ zero myNumDents
+   HgfsDentArena myDents;
    void *enumNamesHandle;
 
+   HgfsDentArena_Init(&myDents);
+
    ASSERT(NULL != enumNamesInit);
    ASSERT(NULL != enumNamesGet);
    ASSERT(NULL != enumNamesExit);
@@ -4008,10 +4631,10 @@ HgfsPlatformScanvdir(HgfsServerResEnumGetFunc enumNamesGet,   // IN: Function to
       Bool done = FALSE;
 
       /* Add '.' and ".." as the first dents. */
-      if (myNumDents == 0) {
+      if (myDents.numDents == 0) {
          currentEntryName = ".";
          currentEntryNameLen = 1;
-      } else if (myNumDents == 1) {
+      } else if (myDents.numDents == 1) {
          currentEntryName = "..";
          currentEntryNameLen = 2;
       } else {
@@ -4044,25 +4667,6 @@ HgfsPlatformScanvdir(HgfsServerResEnumGetFunc enumNamesGet,   // IN: Function to
          continue;
       }
 
-      /* See if we need to allocate more memory */
-      if (myNumDents == totalDents) {
-         void *p;
-
-         if (totalDents != 0) {
-            totalDents *= 2;
-         } else {
-            totalDents = 100;
-         }
-         p = realloc(myDents, totalDents * sizeof *myDents);
-         if (NULL == p) {
-            status = HGFS_ERROR_NOT_ENOUGH_MEMORY;
-            LOG(4, "%s:  Error: realloc growing array memory ret %u\n",
-                __FUNCTION__, status);
-            goto exit;
-         }
-         myDents = p;
-      }
-
       /* This file/directory can be added to the list. */
       LOG(4, "%s: Nextfilename = \"%s\"\n", __FUNCTION__, currentEntryName);
 
@@ -4073,7 +4677,7 @@ HgfsPlatformScanvdir(HgfsServerResEnumGetFunc enumNamesGet,   // IN: Function to
        */
 
       currentEntryLen = offsetof(DirectoryEntry, d_name) + currentEntryNameLen + 1;
-      currentEntry = malloc(currentEntryLen);
+      currentEntry = HgfsDentArena_Alloc(&myDents, currentEntryLen);
       if (NULL == currentEntry) {
          status = HGFS_ERROR_NOT_ENOUGH_MEMORY;
          LOG(4, "%s:  Error: allocate dentry memory ret %u\n", __FUNCTION__,
@@ -4083,25 +4687,9 @@ HgfsPlatformScanvdir(HgfsServerResEnumGetFunc enumNamesGet,   // IN: Function to
       currentEntry->d_reclen = (unsigned short)currentEntryLen;
       memcpy(currentEntry->d_name, currentEntryName, currentEntryNameLen);
       currentEntry->d_name[currentEntryNameLen] = 0;
-
-      myDents[myNumDents] = currentEntry;
-      myNumDents++;
-   }
-
-   /* Trim extra memory off of dents */
-   {
-      void *p;
-
-      p = realloc(myDents, myNumDents * sizeof *myDents);
-      if (NULL != p) {
-         myDents = p;
-      } else {
-         LOG(4, "%s: Error: realloc trimming array memory\n", __FUNCTION__);
-      }
    }
 
    *dents = myDents;
-   *numDents = myNumDents;
 
 exit:
    if (NULL != enumNamesHandle) {
@@ -4112,14 +4700,8 @@ exit:
    }
 
    if (HGFS_ERROR_SUCCESS != status) {
-      unsigned int i;
-
       /* Free whatever has been allocated so far */
-      for (i = 0; i < myNumDents; i++) {
-         free(myDents[i]);
-      }
-
-      free(myDents);
+      HgfsDentArena_Free(&myDents);
    }
 
    return status;
@@ -4375,6 +4957,842 @@ HgfsPlatformWriteFile(fileDesc writeFd,            // IN: file descriptor
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformReadAhead --
+ *
+ *    Starts reading a range of a file into the page cache, so that the
+ *    following reads of a sequential reader don't wait for the disk.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsPlatformReadAhead(fileDesc file,     // IN: file descriptor
+                      uint64 offset,     // IN: start of the range
+                      uint64 length)     // IN: length of the range
+{
+#if defined(__linux__)
+   int error = posix_fadvise(file, offset, length, POSIX_FADV_WILLNEED);
+
+   if (error != 0) {
+      LOG(4, "%s: fadvise failed: %s\n", __FUNCTION__,
+          Err_Errno2String(error));
+   }
+#elif defined(__APPLE__)
+   struct radvisory advice;
+
+   advice.ra_offset = offset;
+   advice.ra_count = (int)MIN(length, MAX_INT32);
+   if (fcntl(file, F_RDADVISE, &advice) < 0) {
+      LOG(4, "%s: F_RDADVISE failed: %s\n", __FUNCTION__,
+          Err_Errno2String(errno));
+   }
+#endif
+}
+
+
+#if defined(__linux__)
+/*
+ * Guest data buffers up to this many mappings (256KB with 4KB pages) are
+ * converted to a struct iovec array on the stack.
+ */
+#define HGFS_IOV_STACK_COUNT  64
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsIovFromVmxIov --
+ *
+ *    Fills an iovec array describing the first dataSize bytes of the mapped
+ *    guest buffers.
+ *
+ * Results:
+ *    The number of iovec entries used.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsIovFromVmxIov(const HgfsVmxIov *vmxIov,  // IN: mapped guest buffers
+                  uint32 vmxIovCount,        // IN: count of vmxIov
+                  uint32 dataSize,           // IN: size of the data
+                  struct iovec *iov)         // OUT: iovecs
+{
+   uint32 remainingSize = dataSize;
+   uint32 i;
+
+   for (i = 0; i < vmxIovCount && remainingSize > 0; i++) {
+      ASSERT(vmxIov[i].va != NULL);
+      iov[i].iov_base = vmxIov[i].va;
+      iov[i].iov_len = MIN(vmxIov[i].len, remainingSize);
+      remainingSize -= iov[i].iov_len;
+   }
+   ASSERT(remainingSize == 0);
+
+   return i;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsTransferIov --
+ *
+ *    Reads or writes an iovec array, at the file offset or at the current
+ *    position for sequential files. Arrays longer than IOV_MAX, as used by
+ *    the negotiated HGFS_HUGE_IO_MAX transfers, are split into several calls
+ *    which stop at the first short transfer.
+ *
+ * Results:
+ *    The number of bytes transferred, or -1 with errno set if nothing was
+ *    transferred.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static ssize_t
+HgfsTransferIov(int fd,                   // IN: file descriptor
+                const struct iovec *iov,  // IN: iovecs
+                int iovCount,             // IN: count of iov
+                Bool sequential,          // IN: use the current position
+                uint64 offset,            // IN: file offset
+                Bool isWrite)             // IN: write rather than read
+{
+   ssize_t total = 0;
+
+   while (iovCount > 0) {
+      int count = MIN(iovCount, IOV_MAX);
+      size_t chunkSize = 0;
+      ssize_t transferred;
+      int i;
+
+      for (i = 0; i < count; i++) {
+         chunkSize += iov[i].iov_len;
+      }
+
+      if (isWrite) {
+         transferred = sequential ? writev(fd, iov, count) :
+                                    pwritev(fd, iov, count, offset + total);
+      } else {
+         transferred = sequential ? readv(fd, iov, count) :
+                                    preadv(fd, iov, count, offset + total);
+      }
+
+      if (transferred < 0) {
+         return total > 0 ? total : -1;
+      }
+      total += transferred;
+      if ((size_t)transferred < chunkSize) {
+         break;
+      }
+      iov += count;
+      iovCount -= count;
+   }
+
+   return total;
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformReadFileIov --
+ *
+ *    Reads data from a file straight into the mapped guest buffers, avoiding
+ *    the copy through a contiguous buffer.
+ *
+ * Results:
+ *    Zero on success.
+ *    HGFS_ERROR_NOT_SUPPORTED if the buffers can't be used directly, the
+ *    caller should fall back to HgfsPlatformReadFile.
+ *    Other non-zero values on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformReadFileIov(fileDesc file,               // IN: file descriptor
+                        HgfsSessionInfo *session,    // IN: session info
+                        uint64 offset,               // IN: file offset to read from
+                        uint32 requiredSize,         // IN: length of data to read
+                        HgfsVmxIov *vmxIov,          // OUT: mapped buffers for the data
+                        uint32 vmxIovCount,          // IN: count of vmxIov
+                        uint32 *actualSize)          // OUT: actual length read
+{
+#if defined(__linux__)
+   struct iovec stackIov[HGFS_IOV_STACK_COUNT];
+   struct iovec *iov = stackIov;
+   HgfsInternalStatus status = 0;
+   HgfsHandle handle;
+   Bool sequentialOpen;
+   ssize_t error;
+   int iovCount;
+
+   ASSERT(session);
+
+   LOG(4, "%s: read fh %u, offset %"FMT64"u, count %u, iovs %u\n", __FUNCTION__,
+       file, offset, requiredSize, vmxIovCount);
+
+   if (!HgfsFileDesc2Handle(file, session, &handle)) {
+      LOG(4, "%s: Could not get file handle\n", __FUNCTION__);
+      return EBADF;
+   }
+
+   if (!HgfsHandleIsSequentialOpen(handle, session, &sequentialOpen)) {
+      LOG(4, "%s: Could not get sequenial open status\n", __FUNCTION__);
+      return EBADF;
+   }
+
+   if (vmxIovCount > ARRAYSIZE(stackIov)) {
+      iov = Util_SafeMalloc(vmxIovCount * sizeof *iov);
+   }
+   iovCount = HgfsIovFromVmxIov(vmxIov, vmxIovCount, requiredSize, iov);
+
+   error = HgfsTransferIov(file, iov, iovCount, sequentialOpen, offset, FALSE);
+
+   if (error < 0) {
+      status = errno;
+      LOG(4, "%s: error reading from file: %s\n", __FUNCTION__,
+          Err_Errno2String(status));
+   } else {
+      LOG(4, "%s: read %"FMTSZ"d bytes\n", __FUNCTION__, error);
+      *actualSize = error;
+   }
+
+   if (iov != stackIov) {
+      free(iov);
+   }
+   return status;
+#else
+   return HGFS_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformReadFileIovAsync --
+ *
+ *    Submits a read from a file straight into the mapped guest buffers
+ *    without waiting for it. The callback is called with the result once
+ *    the read completes, possibly before this function returns.
+ *
+ * Results:
+ *    Zero if the read was submitted.
+ *    HGFS_ERROR_NOT_SUPPORTED if the read can't be done asynchronously, the
+ *    caller should fall back to HgfsPlatformReadFileIov.
+ *    Other non-zero values on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformReadFileIovAsync(fileDesc file,                   // IN: file descriptor
+                             HgfsSessionInfo *session,        // IN: session info
+                             uint64 offset,                   // IN: file offset to read from
+                             uint32 requiredSize,             // IN: length of data to read
+                             HgfsVmxIov *vmxIov,              // OUT: mapped buffers for the data
+                             uint32 vmxIovCount,              // IN: count of vmxIov
+                             HgfsPlatformIoCallback callback, // IN: completion callback
+                             void *data)                      // IN: callback data
+{
+#if defined(__linux__)
+   HgfsHandle handle;
+   Bool sequentialOpen;
+
+   ASSERT(session);
+
+   if (!HgfsFileDesc2Handle(file, session, &handle)) {
+      LOG(4, "%s: Could not get file handle\n", __FUNCTION__);
+      return EBADF;
+   }
+
+   if (!HgfsHandleIsSequentialOpen(handle, session, &sequentialOpen)) {
+      LOG(4, "%s: Could not get sequenial open status\n", __FUNCTION__);
+      return EBADF;
+   }
+
+   /* Sequential reads depend on the file position left by the previous one. */
+   if (sequentialOpen) {
+      return HGFS_ERROR_NOT_SUPPORTED;
+   }
+
+   LOG(4, "%s: read fh %u, offset %"FMT64"u, count %u, iovs %u\n",
+       __FUNCTION__, file, offset, requiredSize, vmxIovCount);
+
+   if (!HgfsAsyncIo_Read(file, offset, vmxIov, vmxIovCount, requiredSize,
+                         callback, data)) {
+      return HGFS_ERROR_NOT_SUPPORTED;
+   }
+   return 0;
+#else
+   return HGFS_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformWriteFileIov --
+ *
+ *    Writes data to a file straight from the mapped guest buffers, avoiding
+ *    the copy through a contiguous buffer.
+ *
+ * Results:
+ *    Zero on success.
+ *    HGFS_ERROR_NOT_SUPPORTED if the buffers can't be used directly, the
+ *    caller should fall back to HgfsPlatformWriteFile.
+ *    Other non-zero values on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformWriteFileIov(fileDesc writeFd,            // IN: file descriptor
+                         HgfsSessionInfo *session,    // IN: session info
+                         uint64 writeOffset,          // IN: file offset to write to
+                         uint32 writeDataSize,        // IN: length of data to write
+                         HgfsWriteFlags writeFlags,   // IN: write flags
+                         Bool writeSequential,        // IN: write is sequential
+                         Bool writeAppend,            // IN: write is appended
+                         const HgfsVmxIov *vmxIov,    // IN: mapped data to be written
+                         uint32 vmxIovCount,          // IN: count of vmxIov
+                         uint32 *writtenSize)         // OUT: actual length written
+{
+#if defined(__linux__)
+   struct iovec stackIov[HGFS_IOV_STACK_COUNT];
+   struct iovec *iov = stackIov;
+   HgfsInternalStatus status = 0;
+   ssize_t error;
+   int iovCount;
+
+   LOG(4, "%s: write fh %u offset %"FMT64"u, count %u, iovs %u\n",
+       __FUNCTION__, writeFd, writeOffset, writeDataSize, vmxIovCount);
+
+   if (!writeSequential) {
+      status = HgfsWriteCheckIORange(writeOffset, writeDataSize);
+      if (status != 0) {
+         return status;
+      }
+   }
+
+   if (vmxIovCount > ARRAYSIZE(stackIov)) {
+      iov = Util_SafeMalloc(vmxIovCount * sizeof *iov);
+   }
+   iovCount = HgfsIovFromVmxIov(vmxIov, vmxIovCount, writeDataSize, iov);
+
+   error = HgfsTransferIov(writeFd, iov, iovCount, writeSequential,
+                           writeOffset, TRUE);
+
+   if (error < 0) {
+      status = errno;
+      LOG(4, "%s: error writing to file: %s\n", __FUNCTION__,
+         Err_Errno2String(status));
+   } else {
+      *writtenSize = error;
+      LOG(4, "%s: wrote %d bytes\n", __FUNCTION__, *writtenSize);
+   }
+
+   if (iov != stackIov) {
+      free(iov);
+   }
+   return status;
+#else
+   return HGFS_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformWriteFileIovAsync --
+ *
+ *    Submits a write of the mapped buffers to a file at an offset without
+ *    waiting for it. The callback is called with the result once the whole
+ *    data has been written or the write failed, possibly before this
+ *    function returns. The file descriptor may be closed meanwhile.
+ *
+ * Results:
+ *    Zero if the write was submitted.
+ *    HGFS_ERROR_NOT_SUPPORTED if the write can't be done asynchronously,
+ *    the caller should fall back to HgfsPlatformWriteFileIov.
+ *    Other non-zero values on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformWriteFileIovAsync(fileDesc writeFd,                // IN: file descriptor
+                              uint64 writeOffset,              // IN: file offset to write to
+                              uint32 writeDataSize,            // IN: length of data to write
+                              const HgfsVmxIov *vmxIov,        // IN: mapped data to be written
+                              uint32 vmxIovCount,              // IN: count of vmxIov
+                              HgfsPlatformIoCallback callback, // IN: completion callback
+                              void *data)                      // IN: callback data
+{
+#if defined(__linux__)
+   HgfsInternalStatus status;
+
+   LOG(4, "%s: write fh %u offset %"FMT64"u, count %u, iovs %u\n",
+       __FUNCTION__, writeFd, writeOffset, writeDataSize, vmxIovCount);
+
+   status = HgfsWriteCheckIORange(writeOffset, writeDataSize);
+   if (status != 0) {
+      return status;
+   }
+
+   if (!HgfsAsyncIo_Write(writeFd, writeOffset, vmxIov, vmxIovCount,
+                          writeDataSize, callback, data)) {
+      return HGFS_ERROR_NOT_SUPPORTED;
+   }
+   return 0;
+#else
+   return HGFS_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+
+/* Size of the bounce buffer of copies through the server. */
+#define HGFS_COPY_RANGE_BUFFER_SIZE  (1024 * 1024)
+
+#if defined(__linux__)
+/* Set once copy_file_range(2) is found to be missing, e.g. on kernels before 4.5. */
+static Bool gHgfsNoCopyFileRange;
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCopyRangeBuffered --
+ *
+ *    Copies a range of a file to another file through a buffer of the
+ *    server.
+ *
+ * Results:
+ *    Zero if any data was copied or the source range is past the end of the
+ *    file, with the number of bytes copied.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsCopyRangeBuffered(int srcFd,            // IN: file to copy from
+                      uint64 srcOffset,     // IN: offset to copy from
+                      int dstFd,            // IN: file to copy to
+                      uint64 dstOffset,     // IN: offset to copy to
+                      uint32 length,        // IN: bytes to copy
+                      uint32 *copiedSize)   // OUT: bytes copied
+{
+   size_t bufferSize = MIN(length, HGFS_COPY_RANGE_BUFFER_SIZE);
+   char *buffer = Util_SafeMalloc(bufferSize);
+   HgfsInternalStatus status = 0;
+   uint32 copied = 0;
+
+   while (copied < length) {
+      ssize_t readSize = pread(srcFd, buffer, MIN(bufferSize, length - copied),
+                               srcOffset + copied);
+      ssize_t written = 0;
+
+      if (readSize < 0) {
+         if (EINTR == errno) {
+            continue;
+         }
+         status = errno;
+         break;
+      }
+      if (readSize == 0) {
+         break;
+      }
+
+      while (written < readSize) {
+         ssize_t result = pwrite(dstFd, buffer + written, readSize - written,
+                                 dstOffset + copied + written);
+
+         if (result < 0) {
+            if (EINTR == errno) {
+               continue;
+            }
+            status = errno;
+            break;
+         }
+         written += result;
+      }
+      copied += written;
+      if (status != 0) {
+         break;
+      }
+   }
+
+   free(buffer);
+
+   if (status != 0) {
+      LOG(4, "%s: error copying: %s\n", __FUNCTION__,
+          Err_Errno2String(status));
+   }
+
+   /* The error of a partial copy is reported by the next request. */
+   *copiedSize = copied;
+   return copied != 0 ? 0 : status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformCopyRange --
+ *
+ *    Copies a range of a file to another file on the host. The range is
+ *    cloned if the filesystem shares blocks between files, otherwise the
+ *    kernel copies it with copy_file_range(2), and the server copies it
+ *    through a buffer if the kernel can't.
+ *
+ *    The copy stops at the end of the source file.
+ *
+ * Results:
+ *    Zero on success, with the number of bytes copied.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformCopyRange(fileDesc srcFile,    // IN: file to copy from
+                      uint64 srcOffset,    // IN: offset to copy from
+                      fileDesc dstFile,    // IN: file to copy to
+                      uint64 dstOffset,    // IN: offset to copy to
+                      uint32 length,       // IN: bytes to copy
+                      uint32 *copiedSize,  // OUT: bytes copied
+                      Bool *cloned)        // OUT: blocks are shared
+{
+   struct stat srcStat;
+   struct stat dstStat;
+   int flags;
+
+   *copiedSize = 0;
+   *cloned = FALSE;
+
+   if (fstat(srcFile, &srcStat) < 0 || fstat(dstFile, &dstStat) < 0) {
+      return errno;
+   }
+
+   /* Positional writes to a file opened for appending append. */
+   flags = fcntl(dstFile, F_GETFL);
+   if (flags < 0) {
+      return errno;
+   }
+   if (0 != (flags & O_APPEND)) {
+      return EBADF;
+   }
+
+   if (srcOffset >= (uint64)srcStat.st_size || length == 0) {
+      return 0;
+   }
+   length = MIN(length, (uint64)srcStat.st_size - srcOffset);
+
+   if (srcStat.st_dev == dstStat.st_dev && srcStat.st_ino == dstStat.st_ino &&
+       srcOffset < dstOffset + length && dstOffset < srcOffset + length) {
+      LOG(4, "%s: overlapping ranges in one file\n", __FUNCTION__);
+      return EINVAL;
+   }
+
+#if !defined(sun)
+   {
+      HgfsInternalStatus status = HgfsWriteCheckIORange(dstOffset, length);
+
+      if (status != 0) {
+         return status;
+      }
+   }
+#endif
+
+   LOG(4, "%s: copy fh %u offset %"FMT64"u to fh %u offset %"FMT64"u, "
+       "count %u\n", __FUNCTION__, srcFile, srcOffset, dstFile, dstOffset,
+       length);
+
+#if defined(__linux__)
+#if defined(FICLONERANGE)
+   {
+      struct file_clone_range range;
+
+      range.src_fd = srcFile;
+      range.src_offset = srcOffset;
+      range.src_length = length;
+      range.dest_offset = dstOffset;
+      if (ioctl(dstFile, FICLONERANGE, &range) == 0) {
+         *copiedSize = length;
+         *cloned = TRUE;
+         return 0;
+      }
+
+      /* No reflinks, different filesystems or a range not on blocks. */
+      LOG(4, "%s: cannot clone: %s\n", __FUNCTION__,
+          Err_Errno2String(errno));
+   }
+#endif
+
+#if defined(SYS_copy_file_range)
+   if (!gHgfsNoCopyFileRange) {
+      loff_t srcPos = srcOffset;
+      loff_t dstPos = dstOffset;
+      uint32 copied = 0;
+      int error = 0;
+
+      while (copied < length) {
+         ssize_t result = syscall(SYS_copy_file_range, srcFile, &srcPos,
+                                  dstFile, &dstPos, (size_t)(length - copied),
+                                  0);
+
+         if (result < 0) {
+            error = errno;
+            if (EINTR == error) {
+               continue;
+            }
+            break;
+         }
+         if (result == 0) {
+            break;
+         }
+         copied += result;
+      }
+
+      if (0 == error || copied != 0) {
+         *copiedSize = copied;
+         return 0;
+      }
+
+      switch (error) {
+      case ENOSYS:
+         LOG(4, "%s: copy_file_range is not available\n", __FUNCTION__);
+         gHgfsNoCopyFileRange = TRUE;
+         break;
+      case EXDEV:
+      case EINVAL:
+      case EOPNOTSUPP:
+         /* Kernels before 5.3 copy within a filesystem only. */
+         LOG(4, "%s: cannot copy in the kernel: %s\n", __FUNCTION__,
+             Err_Errno2String(error));
+         break;
+      default:
+         return error;
+      }
+   }
+#endif
+#endif
+
+   return HgfsCopyRangeBuffered(srcFile, srcOffset, dstFile, dstOffset,
+                                length, copiedSize);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformFsync --
+ *
+ *    Flushes the data of a file, and unless dataOnly also its metadata, to
+ *    storage.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformFsync(fileDesc file,   // IN: file descriptor
+                  Bool dataOnly)   // IN: like fdatasync(2)
+{
+   int ret;
+
+#if defined(__linux__)
+   ret = dataOnly ? fdatasync(file) : fsync(file);
+#else
+   ret = fsync(file);
+#endif
+   if (ret < 0) {
+      int error = errno;
+
+      LOG(4, "%s: fsync of fd %d failed: %s\n", __FUNCTION__, file,
+          Err_Errno2String(error));
+      return error;
+   }
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformFsyncAsync --
+ *
+ *    Submits a flush of a file to storage without waiting for it. The
+ *    callback is called with the result once the flush completes, possibly
+ *    before this function returns.
+ *
+ * Results:
+ *    Zero if the flush was submitted.
+ *    HGFS_ERROR_NOT_SUPPORTED if the flush can't be done asynchronously, the
+ *    caller should fall back to HgfsPlatformFsync.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformFsyncAsync(fileDesc file,                   // IN: file descriptor
+                       Bool dataOnly,                   // IN: like fdatasync(2)
+                       HgfsPlatformIoCallback callback, // IN: completion callback
+                       void *data)                      // IN: callback data
+{
+#if defined(__linux__)
+   if (!HgfsAsyncIo_Fsync(file, dataOnly, callback, data)) {
+      return HGFS_ERROR_NOT_SUPPORTED;
+   }
+   return 0;
+#else
+   return HGFS_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformFsyncDirectory --
+ *
+ *    Flushes a directory, i.e. the names of its entries, to storage.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformFsyncDirectory(const char *dirName)  // IN: directory name
+{
+   HgfsInternalStatus status;
+   int fd;
+
+   fd = Posix_Open(dirName, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   if (fd < 0) {
+      status = errno;
+      LOG(4, "%s: could not open %s: %s\n", __FUNCTION__, dirName,
+          Err_Errno2String(status));
+      return status;
+   }
+
+   status = HgfsPlatformFsync(fd, FALSE);
+   close(fd);
+   return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformAccessCheck --
+ *
+ *    Checks whether the server's effective user and groups have the given
+ *    permissions on a file, like access(2) but with the effective ids
+ *    which the server opens files with.
+ *
+ * Results:
+ *    Zero if all the permissions are granted, or if the file exists when
+ *    no permission is given.
+ *    Non-zero on failure, EACCES if a permission is not granted.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformAccessCheck(const char *fileName,    // IN: file name
+                        HgfsPermissions perms,   // IN: permissions to check
+                        Bool followSymlinks)     // IN: check the link target
+{
+   int mode = 0;
+   int flags = AT_EACCESS;
+
+   if (0 != (perms & HGFS_PERM_READ)) {
+      mode |= R_OK;
+   }
+   if (0 != (perms & HGFS_PERM_WRITE)) {
+      mode |= W_OK;
+   }
+   if (0 != (perms & HGFS_PERM_EXEC)) {
+      mode |= X_OK;
+   }
+   if (0 == mode) {
+      mode = F_OK;
+   }
+   if (!followSymlinks) {
+      /* Links are not followed out of the share, only the link is checked. */
+      flags |= AT_SYMLINK_NOFOLLOW;
+   }
+
+   if (faccessat(AT_FDCWD, fileName, mode, flags) < 0) {
+      int error = errno;
+
+      LOG(4, "%s: access %#x to %s: %s\n", __FUNCTION__, perms, fileName,
+          Err_Errno2String(error));
+      return error;
+   }
+   return 0;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -4901,7 +6319,7 @@ HgfsPlatformSymlinkCreate(char *localSymlinkName,   // IN: symbolic link file na
 /*
  *----------------------------------------------------------------------
  *
- * HgfsPlatformPathHasSymlink --
+ * HgfsPathHasSymlinkRealPath --
  *
  *      This function determines if any of the intermediate components of the
  *      fileName makes references outside the actual shared path. We do not
@@ -4942,8 +6360,8 @@ HgfsPlatformSymlinkCreate(char *localSymlinkName,   // IN: symbolic link file na
  *----------------------------------------------------------------------
  */
 
-HgfsNameStatus
-HgfsPlatformPathHasSymlink(const char *fileName,      // IN
+static HgfsNameStatus
+HgfsPathHasSymlinkRealPath(const char *fileName,      // IN
                            size_t fileNameLength,     // IN
                            const char *sharePath,     // IN
                            size_t sharePathLength)    // IN
@@ -5033,6 +6451,323 @@ exit:
 }
 
 
+#if defined(__linux__)
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsOpenBeneath --
+ *
+ *      Opens a path, which must resolve beneath a directory, with openat2(2).
+ *
+ * Results:
+ *      The file descriptor, -1 with errno set on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HgfsOpenBeneath(int dirFd,         // IN: directory
+                const char *path)  // IN: relative path
+{
+#if defined(SYS_openat2) && defined(RESOLVE_BENEATH)
+   struct open_how how;
+
+   memset(&how, 0, sizeof how);
+   how.flags = O_PATH | O_CLOEXEC;
+   how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+
+   return syscall(SYS_openat2, dirFd, path, &how, sizeof how);
+#else
+   errno = ENOSYS;
+   return -1;
+#endif
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsPathHasSymlinkBeneath --
+ *
+ *      Checks that a directory, relative to a share root, resolves beneath
+ *      the share root. Uses a single openat2(2) call, or walks the path one
+ *      component at a time with openat(2) if openat2(2) is not available.
+ *
+ *      Only the outcomes equivalent to HgfsPathHasSymlinkRealPath are
+ *      reported: paths which leave the share root while being resolved
+ *      (e.g. through an absolute symlink which may lead back into the
+ *      share) are left to it.
+ *
+ * Results:
+ *      TRUE and the name status if the path was checked, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+HgfsPathHasSymlinkBeneath(int rootFd,                  // IN: share root
+                          char *dirName,               // IN: relative directory
+                          HgfsNameStatus *nameStatus)  // OUT: name status
+{
+   int error;
+   int fd;
+
+   if (*dirName == '\0') {
+      *nameStatus = HGFS_NAME_STATUS_COMPLETE;
+      return TRUE;
+   }
+
+   if (!gHgfsNoOpenat2) {
+      fd = HgfsOpenBeneath(rootFd, dirName);
+      if (fd >= 0) {
+         close(fd);
+         *nameStatus = HGFS_NAME_STATUS_COMPLETE;
+         return TRUE;
+      }
+
+      error = errno;
+      if (ENOSYS == error || EPERM == error || E2BIG == error) {
+         LOG(4, "%s: openat2 is not available: %d\n", __FUNCTION__, error);
+         gHgfsNoOpenat2 = TRUE;
+      } else {
+         goto error;
+      }
+   }
+
+   /* Per component walk, which does not follow symlinks or "..". */
+   {
+      int dirFd = rootFd;
+      char *savePtr = NULL;
+      char *component;
+
+      error = 0;
+      for (component = strtok_r(dirName, DIRSEPS, &savePtr);
+           NULL != component;
+           component = strtok_r(NULL, DIRSEPS, &savePtr)) {
+         if (strcmp(component, ".") == 0) {
+            continue;
+         }
+         if (strcmp(component, "..") == 0) {
+            error = EXDEV;
+            break;
+         }
+
+         fd = openat(dirFd, component,
+                     O_PATH | O_NOFOLLOW | O_DIRECTORY | O_CLOEXEC);
+         error = fd < 0 ? errno : 0;
+         if (dirFd != rootFd) {
+            close(dirFd);
+         }
+         if (fd < 0) {
+            dirFd = rootFd;
+            break;
+         }
+         dirFd = fd;
+      }
+      if (dirFd != rootFd) {
+         close(dirFd);
+      }
+
+      if (0 == error) {
+         *nameStatus = HGFS_NAME_STATUS_COMPLETE;
+         return TRUE;
+      }
+      /* A symlink or a file makes O_DIRECTORY fail with ENOTDIR. */
+      if (ENOTDIR == error) {
+         return FALSE;
+      }
+   }
+
+error:
+   switch (error) {
+   case ENOENT:
+      *nameStatus = HGFS_NAME_STATUS_DOES_NOT_EXIST;
+      return TRUE;
+   case ENOTDIR:
+      *nameStatus = HGFS_NAME_STATUS_NOT_A_DIRECTORY;
+      return TRUE;
+   default:
+      /* EXDEV, ELOOP, EAGAIN...: let realpath decide. */
+      return FALSE;
+   }
+}
+#endif
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsPlatformShareRootOpen --
+ *
+ *      Opens the root directory of a share for HgfsPlatformPathHasSymlink
+ *      to resolve paths beneath. The share index opens the roots when it is
+ *      built, reopens those whose path was replaced, see
+ *      HgfsPlatformShareRootIsCurrent, and closes them when it is freed.
+ *
+ *      Shares whose path goes through a symlink are not opened, so that
+ *      their paths are checked by HgfsPathHasSymlinkRealPath, which denies
+ *      access below them.
+ *
+ * Results:
+ *      The O_PATH file descriptor, -1 on failure or if unsupported.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+fileDesc
+HgfsPlatformShareRootOpen(const char *sharePath)  // IN: share path
+{
+#if defined(__linux__)
+   fileDesc fd;
+   char *resolvedPath;
+
+   ASSERT(sharePath);
+
+   if (*sharePath == '\0') {
+      return -1;
+   }
+   fd = Posix_Open(sharePath, O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+   if (fd < 0) {
+      LOG(4, "%s: failed to open share root %s: %s\n", __FUNCTION__,
+          sharePath, Err_Errno2String(errno));
+      return -1;
+   }
+
+   /* O_NOFOLLOW only covers the last component of the share path. */
+   resolvedPath = Posix_RealPath(sharePath);
+   if (NULL == resolvedPath || Str_Strcmp(resolvedPath, sharePath) != 0) {
+      LOG(4, "%s: share root %s resolves to %s\n", __FUNCTION__, sharePath,
+          resolvedPath != NULL ? resolvedPath : "nothing");
+      close(fd);
+      fd = -1;
+   }
+   free(resolvedPath);
+
+   return fd;
+#else
+   return -1;
+#endif
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsPlatformShareRootIsCurrent --
+ *
+ *      Checks that a share root opened by HgfsPlatformShareRootOpen is
+ *      still the directory at the share path, i.e. that the share path was
+ *      not replaced since, directly or through one of its parents.
+ *
+ * Results:
+ *      TRUE if the share path refers to the share root, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Bool
+HgfsPlatformShareRootIsCurrent(fileDesc shareRootFd,   // IN: share root
+                               const char *sharePath)  // IN: share path
+{
+#if defined(__linux__)
+   struct stat st;
+   struct stat fdSt;
+
+   /* Not followed, a share path replaced by a symlink is not current. */
+   return Posix_Lstat(sharePath, &st) == 0 && fstat(shareRootFd, &fdSt) == 0 &&
+          st.st_dev == fdSt.st_dev && st.st_ino == fdSt.st_ino;
+#else
+   return TRUE;
+#endif
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsPlatformPathHasSymlink --
+ *
+ *      This function determines if any of the intermediate components of the
+ *      fileName makes references outside the actual shared path.
+ *
+ *      On Linux, the parent directory of fileName is resolved beneath the
+ *      share root fd, which takes a constant number of system calls instead
+ *      of one per path component. The caller's share root must have been
+ *      checked with HgfsPlatformShareRootIsCurrent; without one, the share
+ *      root is opened for this check only. Paths that can't be decided that
+ *      way are checked by HgfsPathHasSymlinkRealPath.
+ *
+ * Results:
+ *      HGFS_NAME_STATUS_COMPLETE if the given path has a symlink,
+ *      an appropriate name status error otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+HgfsNameStatus
+HgfsPlatformPathHasSymlink(const char *fileName,      // IN
+                           size_t fileNameLength,     // IN
+                           const char *sharePath,     // IN
+                           size_t sharePathLength,    // IN
+                           fileDesc shareRootFd)      // IN: share root or -1
+{
+#if defined(__linux__)
+   ASSERT(fileName);
+   ASSERT(sharePath);
+
+   if (sharePathLength != 0 &&
+       fileNameLength > sharePathLength + 1 &&
+       fileName[sharePathLength] == DIRSEPC &&
+       Str_Strncmp(fileName, sharePath, sharePathLength) == 0) {
+      const char *relName = fileName + sharePathLength + 1;
+      const char *lastSep = strrchr(relName, DIRSEPC);
+      fileDesc rootFd = shareRootFd;
+
+      /* Shares missing from the share index have their root opened here. */
+      if (rootFd < 0) {
+         rootFd = HgfsPlatformShareRootOpen(sharePath);
+      }
+
+      if (rootFd >= 0) {
+         char *relDirName = Util_SafeStrndup(relName,
+                                             lastSep ? lastSep - relName : 0);
+         HgfsNameStatus nameStatus;
+         Bool checked;
+
+         checked = HgfsPathHasSymlinkBeneath(rootFd, relDirName, &nameStatus);
+         free(relDirName);
+         if (rootFd != shareRootFd) {
+            close(rootFd);
+         }
+
+         if (checked) {
+            LOG(4, "%s: fileName: %s, sharePath: %s, status %d\n",
+                __FUNCTION__, fileName, sharePath, nameStatus);
+            return nameStatus;
+         }
+      }
+   }
+#endif
+
+   return HgfsPathHasSymlinkRealPath(fileName, fileNameLength,
+                                     sharePath, sharePathLength);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -167,7 +167,7 @@ HgfsHandle2ServerLock(HgfsHandle handle,        // IN: Hgfs file handle
 
    ASSERT(lock);
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForRead(session->nodeArrayLock);
    fileNode = HgfsHandle2FileNode(handle, session);
    if (fileNode == NULL) {
       goto exit;
@@ -177,7 +177,7 @@ HgfsHandle2ServerLock(HgfsHandle handle,        // IN: Hgfs file handle
    found = TRUE;
 
 exit:
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    return found;
 #else
@@ -214,7 +214,7 @@ HgfsFileHasServerLock(const char *utf8Name,             // IN: Name in UTF8
                       HgfsLockType *serverLock,         // OUT: Existing oplock
                       fileDesc   *fileDesc)             // OUT: Existing fd
 {
-#ifdef HGFS_OPLOCKS
+#if defined(HGFS_OPLOCKS) || defined(HGFS_OPLOCK_LEASES)
    unsigned int i;
    Bool found = FALSE;
    ASSERT(utf8Name);
@@ -222,14 +222,15 @@ HgfsFileHasServerLock(const char *utf8Name,             // IN: Name in UTF8
    ASSERT(session);
    ASSERT(session->nodeArray);
 
-   MXUser_AcquireExclLock(session->nodeArrayLock);
+   MXUser_AcquireForRead(session->nodeArrayLock);
 
-   for (i = 0; i < session->numNodes; i++) {
+   /* Only scan the nodes if any of them is locked. */
+   for (i = 0; session->numCachedLockedNodes != 0 && i < session->numNodes; i++) {
       HgfsFileNode *existingFileNode = &session->nodeArray[i];
 
       if ((existingFileNode->state == FILENODE_STATE_IN_USE_CACHED) &&
           (existingFileNode->serverLock != HGFS_LOCK_NONE) &&
-          (!stricmp(existingFileNode->utf8Name, utf8Name))) {
+          (!Str_Strcasecmp(existingFileNode->utf8Name, utf8Name))) {
          LOG(4, "Found file with a lock: %s\n", utf8Name);
          *serverLock = existingFileNode->serverLock;
          *fileDesc = existingFileNode->fileDesc;
@@ -238,7 +239,7 @@ HgfsFileHasServerLock(const char *utf8Name,             // IN: Name in UTF8
       }
    }
 
-   MXUser_ReleaseExclLock(session->nodeArrayLock);
+   MXUser_ReleaseRWLock(session->nodeArrayLock);
 
    return found;
 #else
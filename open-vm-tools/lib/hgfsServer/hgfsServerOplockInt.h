@@ -42,6 +42,21 @@
 #define HGFS_OPLOCKS
 #endif
 
+/*
+ * Oplocks acquired with HGFS_OP_OPLOCK_ACQUIRE_V4 are backed by file leases
+ * and broken with HGFS_OP_OPLOCK_BREAK_V4. Linux hosts only.
+ */
+#if defined(__linux__)
+#define HGFS_OPLOCK_LEASES
+#endif
+
+/*
+ * How long the client has to acknowledge an oplock break before the server
+ * downgrades the oplock itself. Must stay well below the kernel lease break
+ * time (/proc/sys/fs/lease-break-time, 45 seconds by default).
+ */
+#define HGFS_OPLOCK_BREAK_TIMEOUT_MS  10000
+
 /*
  * XXX describe the data structure
  */
@@ -91,6 +106,25 @@ HgfsAcquireAIOServerLock(fileDesc fileDesc,
                          void *data);
 void
 HgfsRemoveAIOServerLock(fileDesc fileDesc);
+Bool
+HgfsPlatformAcquireOplock(fileDesc fileDesc,
+                          HgfsHandle handle,
+                          HgfsSessionInfo *session,
+                          HgfsLockType *serverLock);
+HgfsLockType
+HgfsPlatformDowngradeOplock(fileDesc fileDesc,
+                            HgfsLockType serverLock);
+
+Bool
+HgfsServerOplockSessionGet(HgfsSessionInfo *session);
+void
+HgfsServerOplockBreakNotify(HgfsSessionInfo *session,
+                            HgfsHandle handle,
+                            HgfsLockType serverLock);
+void
+HgfsServerOplockBreakTimeout(HgfsSessionInfo *session,
+                             HgfsHandle handle,
+                             HgfsLockType serverLock);
 
 #ifdef HGFS_OPLOCKS
 void
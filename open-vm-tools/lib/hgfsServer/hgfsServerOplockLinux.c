@@ -20,8 +20,17 @@
  * hgfsServerOplockLinux.c --
  *
  *      HGFS server opportunistic lock support for the Linux platform.
+ *
+ *      Oplocks acquired with HGFS_OP_OPLOCK_ACQUIRE_V4 are backed by file
+ *      leases. The kernel queues a real-time signal when another opener
+ *      conflicts with a lease; the signals are directed at a single break
+ *      thread which waits for them synchronously, asks the client to release
+ *      or downgrade the oplock and, if the client does not acknowledge the
+ *      break in time, downgrades the lease itself so that the other opener
+ *      is not held up until the kernel lease break time.
  */
 
+#define _GNU_SOURCE // for F_SETLEASE, F_SETSIG and F_SETOWN_EX
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -38,11 +47,73 @@
 #   include "sig.h"
 #endif
 
+#ifdef HGFS_OPLOCK_LEASES
+#   include <fcntl.h>
+#   include <pthread.h>
+#   include <signal.h>
+#   include <time.h>
+#   include <unistd.h>
+#   include <sys/syscall.h>
+#   include "util.h"
+#   include "hashTable.h"
+#   include "hostinfo.h"
+#   include "userlock.h"
+#   include "mutexRankLib.h"
+#endif
+
 
 /*
  * Local data
  */
 
+#ifdef HGFS_OPLOCK_LEASES
+#define AS_KEY(_x)  ((const void *)(uintptr_t)(_x))
+
+/* Signal the kernel queues to the break thread when a lease is broken. */
+#define HGFS_OPLOCK_LEASE_SIGNAL   (SIGRTMIN + 4)
+
+typedef struct HgfsOplockLease {
+   fileDesc fd;
+   HgfsHandle handle;
+   HgfsSessionInfo *session;
+   HgfsLockType serverLock;         /* Oplock held by the client. */
+   Bool breakPending;               /* The kernel is breaking the lease. */
+   Bool breakSent;                  /* The client was asked to break. */
+   HgfsLockType breakTo;            /* Oplock allowed once broken. */
+   VmTimeType breakDeadline;        /* Broken by the server after this. */
+} HgfsOplockLease;
+
+/* A break to deliver to the client, queued by the break thread. */
+typedef struct HgfsOplockBreakItem {
+   struct HgfsOplockBreakItem *next;
+   HgfsSessionInfo *session;        /* Referenced, NULL if closing. */
+   fileDesc fd;
+   HgfsHandle handle;
+   HgfsLockType serverLock;         /* Oplock the client may keep. */
+   Bool timedOut;                   /* Downgraded without the client. */
+} HgfsOplockBreakItem;
+
+typedef struct HgfsOplockLeaseScanData {
+   VmTimeType now;
+   VmTimeType nextDeadline;         /* Of the breaks still pending. */
+   Bool checkAll;                   /* Check every lease for a break. */
+   HgfsOplockBreakItem *items;
+} HgfsOplockLeaseScanData;
+
+typedef struct HgfsOplockLeaseState {
+   MXUserExclLock *lock;
+   MXUserCondVar *started;
+   pthread_t breakThread;
+
+   /* The following are protected by the lock. */
+   pid_t breakThreadId;             /* Target of the lease signals. */
+   Bool exiting;
+   HashTable *leases;               /* File descriptor -> HgfsOplockLease. */
+} HgfsOplockLeaseState;
+
+static HgfsOplockLeaseState *gHgfsLeases = NULL;
+#endif
+
 /*
  * Global data
  */
@@ -59,6 +130,11 @@ static void HgfsServerSigOplockBreak(int sigNum,
                                      void *clientData);
 #endif
 
+#ifdef HGFS_OPLOCK_LEASES
+static Bool HgfsOplockLeaseInit(void);
+static void HgfsOplockLeaseExit(void);
+#endif
+
 
 
 /*
@@ -69,7 +145,7 @@ static void HgfsServerSigOplockBreak(int sigNum,
  *      Set up any state needed to start Linux HGFS server oplock support.
  *
  * Results:
- *      TRUE always.
+ *      TRUE on success, FALSE if the lease break thread could not be started.
  *
  * Side effects:
  *      None.
@@ -84,7 +160,11 @@ HgfsPlatformOplockInit(void)
    /* Register a signal handler to catch oplock break signals. */
    Sig_Callback(SIGIO, SIG_SAFE, HgfsServerSigOplockBreak, NULL);
 #endif
+#ifdef HGFS_OPLOCK_LEASES
+   return HgfsOplockLeaseInit();
+#else
    return TRUE;
+#endif
 }
 
 
@@ -111,6 +191,9 @@ HgfsPlatformOplockDestroy(void)
    /* Tear down oplock state, so we no longer catch signals. */
    Sig_Callback(SIGIO, SIG_NOHANDLER, NULL, NULL);
 #endif
+#ifdef HGFS_OPLOCK_LEASES
+   HgfsOplockLeaseExit();
+#endif
 }
 
 
@@ -274,6 +357,622 @@ HgfsAcquireServerLock(fileDesc fileDesc,            // IN: OS handle
 }
 
 
+#ifdef HGFS_OPLOCK_LEASES
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockTrySetLease --
+ *
+ *    Try to take the lease for the desired oplock on the file. If the client
+ *    asked for HGFS_LOCK_OPPORTUNISTIC, take the best lease available.
+ *
+ *    A read lease needs a file descriptor opened for reading only, a write
+ *    lease needs the file to have no other openers.
+ *
+ * Results:
+ *    The oplock the lease was taken for, HGFS_LOCK_NONE if none was taken.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsLockType
+HgfsOplockTrySetLease(fileDesc fd,               // IN: OS handle
+                      HgfsLockType desiredLock)  // IN: oplock asked for
+{
+   if (desiredLock == HGFS_LOCK_OPPORTUNISTIC ||
+       desiredLock == HGFS_LOCK_EXCLUSIVE) {
+      if (fcntl(fd, F_SETLEASE, F_WRLCK) == 0) {
+         return HGFS_LOCK_EXCLUSIVE;
+      }
+      LOG(4, "%s: Could not get write lease for fd %d: %s\n",
+          __FUNCTION__, fd, Err_Errno2String(errno));
+      if (desiredLock == HGFS_LOCK_EXCLUSIVE) {
+         return HGFS_LOCK_NONE;
+      }
+   }
+
+   if (fcntl(fd, F_SETLEASE, F_RDLCK) == 0) {
+      return HGFS_LOCK_SHARED;
+   }
+   LOG(4, "%s: Could not get read lease for fd %d: %s\n",
+       __FUNCTION__, fd, Err_Errno2String(errno));
+
+   return HGFS_LOCK_NONE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockLeaseDowngrade --
+ *
+ *    Downgrade the lease to the oplock the client keeps. The client cannot
+ *    keep more than the lease had, or more than a pending break allows.
+ *    A downgrade to HGFS_LOCK_NONE releases the lease.
+ *
+ *    The lease lock must be held.
+ *
+ * Results:
+ *    The oplock held after the downgrade.
+ *
+ * Side effects:
+ *    A pending break is complete.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsLockType
+HgfsOplockLeaseDowngrade(HgfsOplockLease *lease,   // IN/OUT: lease
+                         HgfsLockType serverLock)  // IN: oplock kept
+{
+   HgfsLockType allowed = lease->breakPending ? lease->breakTo :
+                                                lease->serverLock;
+   HgfsLockType newLock;
+
+   if (serverLock == HGFS_LOCK_NONE || allowed == HGFS_LOCK_NONE) {
+      newLock = HGFS_LOCK_NONE;
+   } else if (serverLock == HGFS_LOCK_SHARED || allowed == HGFS_LOCK_SHARED) {
+      newLock = HGFS_LOCK_SHARED;
+   } else {
+      newLock = allowed;
+   }
+
+   if (newLock == HGFS_LOCK_SHARED && lease->serverLock != HGFS_LOCK_SHARED &&
+       fcntl(lease->fd, F_SETLEASE, F_RDLCK) != 0) {
+      LOG(4, "%s: Could not downgrade lease on fd %d: %s\n",
+          __FUNCTION__, lease->fd, Err_Errno2String(errno));
+      newLock = HGFS_LOCK_NONE;
+   }
+   if (newLock == HGFS_LOCK_NONE &&
+       fcntl(lease->fd, F_SETLEASE, F_UNLCK) != 0) {
+      Log("%s: Could not release lease on fd %d: %s\n",
+          __FUNCTION__, lease->fd, Err_Errno2String(errno));
+   }
+
+   lease->serverLock = newLock;
+   lease->breakPending = FALSE;
+   lease->breakSent = FALSE;
+
+   return newLock;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformAcquireOplock --
+ *
+ *    Acquire an oplock for an open file by taking a lease on it. Lease
+ *    breaks are reported to the client through HgfsServerOplockBreakNotify
+ *    for the given handle and session.
+ *
+ *    If the file already has a lease, the lease is changed to the desired
+ *    oplock unless a break is pending.
+ *
+ * Results:
+ *    TRUE if the file has a lease. serverLock contains the oplock held.
+ *    FALSE otherwise. serverLock is HGFS_LOCK_NONE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsPlatformAcquireOplock(fileDesc fd,                // IN: OS handle
+                          HgfsHandle handle,          // IN: Hgfs file handle
+                          HgfsSessionInfo *session,   // IN: Session info
+                          HgfsLockType *serverLock)   // IN/OUT: Oplock asked for/granted
+{
+   HgfsOplockLeaseState *state = gHgfsLeases;
+   HgfsOplockLease *lease;
+   HgfsLockType desiredLock;
+   HgfsLockType newLock;
+   struct f_owner_ex owner;
+
+   ASSERT(serverLock);
+   ASSERT(session);
+
+   desiredLock = *serverLock;
+   *serverLock = HGFS_LOCK_NONE;
+
+   if (NULL == state) {
+      return FALSE;
+   }
+   if (desiredLock != HGFS_LOCK_OPPORTUNISTIC &&
+       desiredLock != HGFS_LOCK_EXCLUSIVE &&
+       desiredLock != HGFS_LOCK_SHARED) {
+      LOG(4, "%s: Unsupported server lock %d\n", __FUNCTION__, desiredLock);
+      return FALSE;
+   }
+
+   MXUser_AcquireExclLock(state->lock);
+
+   if (HashTable_Lookup(state->leases, AS_KEY(fd), (void **)&lease)) {
+      ASSERT(lease->handle == handle && lease->session == session);
+      if (!lease->breakPending && lease->serverLock != desiredLock) {
+         newLock = HgfsOplockTrySetLease(fd, desiredLock);
+         if (newLock != HGFS_LOCK_NONE) {
+            lease->serverLock = newLock;
+         }
+      }
+      *serverLock = lease->serverLock;
+      goto exit;
+   }
+
+   /*
+    * Queue the breaks to the break thread: a real-time signal carries the
+    * file descriptor, and a signal directed at a thread is not delivered to
+    * the other threads of the process.
+    */
+   owner.type = F_OWNER_TID;
+   owner.pid = state->breakThreadId;
+   if (fcntl(fd, F_SETSIG, HGFS_OPLOCK_LEASE_SIGNAL) != 0 ||
+       fcntl(fd, F_SETOWN_EX, &owner) != 0) {
+      Log("%s: Could not set the lease break signal for fd %d: %s\n",
+          __FUNCTION__, fd, Err_Errno2String(errno));
+      goto exit;
+   }
+
+   newLock = HgfsOplockTrySetLease(fd, desiredLock);
+   if (newLock != HGFS_LOCK_NONE) {
+      lease = Util_SafeCalloc(1, sizeof *lease);
+      lease->fd = fd;
+      lease->handle = handle;
+      lease->session = session;
+      lease->serverLock = newLock;
+      HashTable_Insert(state->leases, AS_KEY(fd), lease);
+      *serverLock = newLock;
+      LOG(4, "%s: Got lease %d for fd %d\n", __FUNCTION__, newLock, fd);
+   }
+
+exit:
+   MXUser_ReleaseExclLock(state->lock);
+
+   return *serverLock != HGFS_LOCK_NONE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformDowngradeOplock --
+ *
+ *    Downgrade the oplock of an open file, either because the client
+ *    acknowledged a break, gave up the oplock, or the file is being closed.
+ *
+ * Results:
+ *    The oplock held after the downgrade.
+ *
+ * Side effects:
+ *    The lease is forgotten when it is released.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsLockType
+HgfsPlatformDowngradeOplock(fileDesc fd,              // IN: OS handle
+                            HgfsLockType serverLock)  // IN: Oplock kept
+{
+   HgfsOplockLeaseState *state = gHgfsLeases;
+   HgfsOplockLease *lease;
+   HgfsLockType newLock = HGFS_LOCK_NONE;
+
+   if (NULL == state) {
+      return HGFS_LOCK_NONE;
+   }
+
+   MXUser_AcquireExclLock(state->lock);
+   if (HashTable_Lookup(state->leases, AS_KEY(fd), (void **)&lease)) {
+      newLock = HgfsOplockLeaseDowngrade(lease, serverLock);
+      if (newLock == HGFS_LOCK_NONE) {
+         HashTable_Delete(state->leases, AS_KEY(fd));
+      }
+   }
+   MXUser_ReleaseExclLock(state->lock);
+
+   return newLock;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockLeaseBroken --
+ *
+ *    Record a lease break reported by the kernel. F_GETLEASE returns the
+ *    lease the kernel wants us to downgrade to while a break is pending.
+ *
+ *    The lease lock must be held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    The break is sent to the client by the break thread.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsOplockLeaseBroken(HgfsOplockLease *lease)  // IN/OUT: lease
+{
+   HgfsLockType breakTo;
+   int newLease;
+
+   newLease = fcntl(lease->fd, F_GETLEASE);
+   if (newLease == F_UNLCK) {
+      breakTo = HGFS_LOCK_NONE;
+   } else if (newLease == F_RDLCK && lease->serverLock == HGFS_LOCK_EXCLUSIVE) {
+      breakTo = HGFS_LOCK_SHARED;
+   } else {
+      /* No break pending, the lease is unchanged. */
+      return;
+   }
+
+   LOG(4, "%s: Lease on fd %d breaks to %d\n", __FUNCTION__, lease->fd, breakTo);
+   if (!lease->breakPending ||
+       (breakTo == HGFS_LOCK_NONE && lease->breakTo != HGFS_LOCK_NONE)) {
+      lease->breakTo = breakTo;
+      lease->breakSent = FALSE;
+   }
+   if (!lease->breakPending) {
+      lease->breakPending = TRUE;
+      lease->breakDeadline = Hostinfo_SystemTimerMS() +
+                             HGFS_OPLOCK_BREAK_TIMEOUT_MS;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockLeaseScan --
+ *
+ *    HashTable_ForEach callback run by the break thread on every lease.
+ *    Queues a break to the client for a lease being broken and, if the
+ *    client did not acknowledge the break in time, downgrades the lease.
+ *
+ *    The lease lock must be held.
+ *
+ * Results:
+ *    0 to continue the iteration.
+ *
+ * Side effects:
+ *    Takes a reference on the session of every queued break.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsOplockLeaseScan(const char *key,   // IN: file descriptor
+                    void *value,       // IN: HgfsOplockLease
+                    void *clientData)  // IN/OUT: HgfsOplockLeaseScanData
+{
+   HgfsOplockLease *lease = value;
+   HgfsOplockLeaseScanData *scan = clientData;
+   HgfsOplockBreakItem *item;
+   Bool timedOut;
+
+   if (scan->checkAll) {
+      HgfsOplockLeaseBroken(lease);
+   }
+   if (!lease->breakPending) {
+      return 0;
+   }
+
+   timedOut = scan->now >= lease->breakDeadline;
+   if (!timedOut) {
+      scan->nextDeadline = MIN(scan->nextDeadline, lease->breakDeadline);
+      if (lease->breakSent) {
+         return 0;
+      }
+   }
+
+   item = Util_SafeCalloc(1, sizeof *item);
+   item->fd = lease->fd;
+   item->handle = lease->handle;
+   item->timedOut = timedOut;
+   if (timedOut) {
+      Log("%s: Break of the oplock on fd %d was not acknowledged\n",
+          __FUNCTION__, lease->fd);
+      item->serverLock = HgfsOplockLeaseDowngrade(lease, lease->breakTo);
+   } else {
+      item->serverLock = lease->breakTo;
+      lease->breakSent = TRUE;
+   }
+
+   /* The session is being closed if it has no references left. */
+   if (HgfsServerOplockSessionGet(lease->session)) {
+      item->session = lease->session;
+   }
+   item->next = scan->items;
+   scan->items = item;
+
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockBreakThread --
+ *
+ *    The break thread waits for the lease break signals and sends the breaks
+ *    to the clients. The signals are blocked in this thread and taken with
+ *    sigtimedwait, so no signal handler is involved. While breaks are
+ *    pending, the wait times out at the earliest break deadline.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HgfsOplockBreakThread(void *data)  // IN: HgfsOplockLeaseState
+{
+   HgfsOplockLeaseState *state = data;
+   VmTimeType waitMS = -1;
+   sigset_t signals;
+
+   sigemptyset(&signals);
+   sigaddset(&signals, HGFS_OPLOCK_LEASE_SIGNAL);
+   sigaddset(&signals, SIGIO);
+   pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+   MXUser_AcquireExclLock(state->lock);
+   state->breakThreadId = syscall(SYS_gettid);
+   MXUser_BroadcastCondVar(state->started);
+
+   while (!state->exiting) {
+      HgfsOplockLeaseScanData scan;
+      HgfsOplockBreakItem *item;
+      HgfsOplockLease *lease;
+      siginfo_t info;
+      int sigNum;
+
+      MXUser_ReleaseExclLock(state->lock);
+      if (waitMS < 0) {
+         sigNum = sigwaitinfo(&signals, &info);
+      } else {
+         struct timespec timeout;
+
+         timeout.tv_sec = waitMS / 1000;
+         timeout.tv_nsec = (waitMS % 1000) * 1000000;
+         sigNum = sigtimedwait(&signals, &info, &timeout);
+      }
+      MXUser_AcquireExclLock(state->lock);
+
+      if (state->exiting) {
+         break;
+      }
+
+      /*
+       * SIGIO is sent instead when the real-time signal queue overflows,
+       * breaks may have been lost then.
+       */
+      scan.checkAll = sigNum == SIGIO;
+      if (sigNum == HGFS_OPLOCK_LEASE_SIGNAL &&
+          HashTable_Lookup(state->leases, AS_KEY(info.si_fd), (void **)&lease)) {
+         HgfsOplockLeaseBroken(lease);
+      }
+
+      scan.now = Hostinfo_SystemTimerMS();
+      scan.nextDeadline = MAX_INT64;
+      scan.items = NULL;
+      HashTable_ForEach(state->leases, HgfsOplockLeaseScan, &scan);
+      waitMS = scan.nextDeadline == MAX_INT64 ? -1 : scan.nextDeadline - scan.now;
+
+      for (item = scan.items; item != NULL; item = item->next) {
+         if (item->timedOut && item->serverLock == HGFS_LOCK_NONE) {
+            HashTable_Delete(state->leases, AS_KEY(item->fd));
+         }
+      }
+
+      /*
+       * Deliver without the lock: dropping the session reference may close
+       * the session, which releases the leases of its files.
+       */
+      MXUser_ReleaseExclLock(state->lock);
+      while (scan.items != NULL) {
+         item = scan.items;
+         scan.items = item->next;
+         if (NULL != item->session) {
+            if (item->timedOut) {
+               HgfsServerOplockBreakTimeout(item->session, item->handle,
+                                            item->serverLock);
+            } else {
+               HgfsServerOplockBreakNotify(item->session, item->handle,
+                                           item->serverLock);
+            }
+         }
+         free(item);
+      }
+      MXUser_AcquireExclLock(state->lock);
+   }
+
+   MXUser_ReleaseExclLock(state->lock);
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockLeaseInit --
+ *
+ *    Start the lease break thread.
+ *
+ * Results:
+ *    TRUE on success, FALSE on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsOplockLeaseInit(void)
+{
+   HgfsOplockLeaseState *state;
+   int error;
+
+   ASSERT(NULL == gHgfsLeases);
+
+   state = Util_SafeCalloc(1, sizeof *state);
+   state->lock = MXUser_CreateExclLock("HgfsOplockLeaseLock",
+                                       RANK_hgfsOplockLeaseLock);
+   state->started = MXUser_CreateCondVarExclLock(state->lock);
+   state->leases = HashTable_Alloc(64, HASH_INT_KEY, free);
+
+   error = pthread_create(&state->breakThread, NULL, HgfsOplockBreakThread,
+                          state);
+   if (0 != error) {
+      Log("%s: failed to create the lease break thread: %d\n", __FUNCTION__,
+          error);
+      HashTable_Free(state->leases);
+      MXUser_DestroyCondVar(state->started);
+      MXUser_DestroyExclLock(state->lock);
+      free(state);
+      return FALSE;
+   }
+
+   /* The leases are registered with the id of the break thread. */
+   MXUser_AcquireExclLock(state->lock);
+   while (0 == state->breakThreadId) {
+      MXUser_WaitCondVarExclLock(state->lock, state->started);
+   }
+   MXUser_ReleaseExclLock(state->lock);
+
+   gHgfsLeases = state;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsOplockLeaseExit --
+ *
+ *    Stop the lease break thread and release any lease left.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsOplockLeaseExit(void)
+{
+   HgfsOplockLeaseState *state = gHgfsLeases;
+
+   if (NULL == state) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(state->lock);
+   state->exiting = TRUE;
+   MXUser_ReleaseExclLock(state->lock);
+   pthread_kill(state->breakThread, HGFS_OPLOCK_LEASE_SIGNAL);
+   pthread_join(state->breakThread, NULL);
+
+   gHgfsLeases = NULL;
+
+   /* Closing the files releases the leases, only the entries are freed. */
+   HashTable_Free(state->leases);
+   MXUser_DestroyCondVar(state->started);
+   MXUser_DestroyExclLock(state->lock);
+   free(state);
+}
+#else /* HGFS_OPLOCK_LEASES */
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformAcquireOplock --
+ *
+ *    Oplocks are not supported without leases.
+ *
+ * Results:
+ *    FALSE always. serverLock is HGFS_LOCK_NONE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsPlatformAcquireOplock(fileDesc fd,                // IN: OS handle
+                          HgfsHandle handle,          // IN: Hgfs file handle
+                          HgfsSessionInfo *session,   // IN: Session info
+                          HgfsLockType *serverLock)   // IN/OUT: Oplock asked for/granted
+{
+   *serverLock = HGFS_LOCK_NONE;
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformDowngradeOplock --
+ *
+ *    Oplocks are not supported without leases.
+ *
+ * Results:
+ *    HGFS_LOCK_NONE always.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsLockType
+HgfsPlatformDowngradeOplock(fileDesc fd,              // IN: OS handle
+                            HgfsLockType serverLock)  // IN: Oplock kept
+{
+   return HGFS_LOCK_NONE;
+}
+#endif /* HGFS_OPLOCK_LEASES */
+
+
 #ifdef HGFS_OPLOCKS
 /*
  *-----------------------------------------------------------------------------
@@ -29,6 +29,15 @@
 #include "hgfsServer.h"
 #include "hgfsServerInt.h"
 #include "util.h"
+#include "vm_atomic.h"
+
+/*
+ * Data packet bytes which were copied through an allocated buffer because
+ * the guest buffer spans several mappings, and bytes which were transferred
+ * in place.
+ */
+static Atomic_uint64 hspuDataBounceBytes;
+static Atomic_uint64 hspuDataDirectBytes;
 
 static void *HSPUGetBuf(HgfsServerChannelCallbacks *chanCb,
                         MappingType mappingType,
@@ -391,16 +400,116 @@ HSPU_GetDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
    }
 
    packet->dataMappingType = mappingType;
-   return HSPUGetBuf(chanCb,
-                     packet->dataMappingType,
-                     packet->iov,
-                     packet->iovCount,
-                     packet->dataPacketIovIndex,
-                     packet->dataPacketDataSize,
-                     packet->dataPacketSize,
-                     &packet->dataPacket,
-                     &packet->dataPacketIsAllocated,
-                     &packet->dataPacketMappedIov);
+   HSPUGetBuf(chanCb,
+              packet->dataMappingType,
+              packet->iov,
+              packet->iovCount,
+              packet->dataPacketIovIndex,
+              packet->dataPacketDataSize,
+              packet->dataPacketSize,
+              &packet->dataPacket,
+              &packet->dataPacketIsAllocated,
+              &packet->dataPacketMappedIov);
+
+   if (packet->dataPacketIsAllocated &&
+       (mappingType == BUF_READABLE || mappingType == BUF_READWRITEABLE)) {
+      Atomic_Add64(&hspuDataBounceBytes, packet->dataPacketDataSize);
+   }
+   return packet->dataPacket;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPU_GetDataPacketIov --
+ *
+ *    Get the data packet of an hgfs packet as the array of guest mappings,
+ *    so that data can be transferred to or from it without a bounce buffer.
+ *    Guest mappings are established for dataSize bytes and are released by
+ *    HSPU_PutDataPacketBuf.
+ *
+ * Results:
+ *    Pointer to the first mapped iov and the count of mapped iovs, NULL if
+ *    the guest buffer could not be mapped.
+ *
+ * Side effects:
+ *    None.
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsVmxIov *
+HSPU_GetDataPacketIov(HgfsPacket *packet,                   // IN/OUT: Hgfs Packet
+                      MappingType mappingType,              // IN: Writeable/Readable
+                      size_t dataSize,                      // IN: size to map
+                      HgfsServerChannelCallbacks *chanCb,   // IN: Channel callbacks
+                      uint32 *iovCount)                     // OUT: mapped iov count
+{
+   HgfsChannelMapVirtAddrFunc mapVa;
+
+   ASSERT(packet->dataPacket == NULL);
+   ASSERT(dataSize <= packet->dataPacketSize);
+
+   if (chanCb == NULL || dataSize == 0) {
+      return NULL;
+   }
+
+   if (mappingType == BUF_WRITEABLE ||
+       mappingType == BUF_READWRITEABLE) {
+      mapVa = chanCb->getWriteVa;
+   } else {
+      ASSERT(mappingType == BUF_READABLE);
+      mapVa = chanCb->getReadVa;
+   }
+
+   /* Looks like we are in the middle of poweroff. */
+   if (mapVa == NULL) {
+      return NULL;
+   }
+
+   if (!HSPUMapBuf(mapVa,
+                   chanCb->putVa,
+                   dataSize,
+                   packet->dataPacketIovIndex,
+                   packet->iovCount,
+                   packet->iov,
+                   &packet->dataPacketMappedIov)) {
+      /* Guest probably passed us bad physical address */
+      return NULL;
+   }
+
+   /* Held by the mappings, so that HSPU_PutDataPacketBuf releases them. */
+   packet->dataMappingType = mappingType;
+   packet->dataPacket = packet->iov[packet->dataPacketIovIndex].va;
+   packet->dataPacketIsAllocated = FALSE;
+
+   *iovCount = packet->dataPacketMappedIov;
+   return &packet->iov[packet->dataPacketIovIndex];
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HSPU_GetDataPacketStats --
+ *
+ *    Get the number of data packet bytes transferred through a bounce buffer
+ *    and directly to or from the guest mappings.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HSPU_GetDataPacketStats(uint64 *bounceBytes,   // OUT: bytes copied
+                        uint64 *directBytes)   // OUT: bytes not copied
+{
+   *bounceBytes = Atomic_Read64(&hspuDataBounceBytes);
+   *directBytes = Atomic_Read64(&hspuDataDirectBytes);
 }
 
 
@@ -587,6 +696,12 @@ HSPU_PutDataPacketBuf(HgfsPacket *packet,                   // IN/OUT: Hgfs Pack
    }
 
    LOG(4, "%s Hgfs Putting Data packet\n", __FUNCTION__);
+   if (!packet->dataPacketIsAllocated) {
+      Atomic_Add64(&hspuDataDirectBytes, packet->dataPacketDataSize);
+   } else if (packet->dataMappingType == BUF_WRITEABLE ||
+              packet->dataMappingType == BUF_READWRITEABLE) {
+      Atomic_Add64(&hspuDataBounceBytes, packet->dataPacketDataSize);
+   }
    HSPUPutBuf(chanCb,
               packet->dataMappingType,
               packet->iov,
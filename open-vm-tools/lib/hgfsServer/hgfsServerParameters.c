@@ -111,8 +111,8 @@ static HgfsOpCapability hgfsDefaultCapabilityTable[] =
    {HGFS_OP_DELETE_V4,             HGFS_OP_CAPFLAG_NOT_SUPPORTED},
    {HGFS_OP_LINKMOVE_V4,           HGFS_OP_CAPFLAG_NOT_SUPPORTED},
    {HGFS_OP_FSCTL_V4,              HGFS_OP_CAPFLAG_NOT_SUPPORTED},
-   {HGFS_OP_ACCESS_CHECK_V4,       HGFS_OP_CAPFLAG_NOT_SUPPORTED},
-   {HGFS_OP_FSYNC_V4,              HGFS_OP_CAPFLAG_NOT_SUPPORTED},
+   {HGFS_OP_ACCESS_CHECK_V4,       HGFS_OP_CAPFLAG_POSIX_IS_SUPPORTED},
+   {HGFS_OP_FSYNC_V4,              HGFS_OP_CAPFLAG_POSIX_IS_SUPPORTED},
    {HGFS_OP_QUERY_VOLUME_INFO_V4,  HGFS_OP_CAPFLAG_NOT_SUPPORTED},
    {HGFS_OP_OPLOCK_ACQUIRE_V4,     HGFS_OP_CAPFLAG_NOT_SUPPORTED},
    {HGFS_OP_OPLOCK_BREAK_V4,       HGFS_OP_CAPFLAG_NOT_SUPPORTED},
@@ -120,6 +120,9 @@ static HgfsOpCapability hgfsDefaultCapabilityTable[] =
    {HGFS_OP_UNLOCK_BYTE_RANGE_V4,  HGFS_OP_CAPFLAG_NOT_SUPPORTED},
    {HGFS_OP_QUERY_EAS_V4,          HGFS_OP_CAPFLAG_NOT_SUPPORTED},
    {HGFS_OP_SET_EAS_V4,            HGFS_OP_CAPFLAG_NOT_SUPPORTED},
+   {HGFS_OP_COMPOUND_V4,           HGFS_OP_CAPFLAG_IS_SUPPORTED},
+   {HGFS_OP_COPY_RANGE_V4,         HGFS_OP_CAPFLAG_POSIX_IS_SUPPORTED},
+   {HGFS_OP_QUERY_CHANGES_V4,      HGFS_OP_CAPFLAG_NOT_SUPPORTED},
 };
 
 
@@ -5935,6 +5938,177 @@ HgfsUnpackOplockBreakAckReply(const void *packet,            // IN: HGFS packet
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPackOplockBreakAckReply --
+ *
+ *    Pack the reply to the oplock break acknowledgement of the client.
+ *
+ * Results:
+ *    TRUE if successfully packed the reply, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsPackOplockBreakAckReply(HgfsPacket *packet,         // IN/OUT: Hgfs Packet
+                            const void *packetHeader,   // IN: packet header
+                            HgfsOp op,                  // IN: operation code
+                            HgfsHandle fileId,          // IN: file ID
+                            HgfsLockType serverLock,    // IN: lock now held
+                            size_t *payloadSize,        // OUT: size of packet
+                            HgfsSessionInfo *session)   // IN: Session info
+{
+   Bool result = TRUE;
+   HgfsReplyOplockBreakV4 *reply;
+
+   HGFS_ASSERT_PACK_PARAMS;
+
+   *payloadSize = 0;
+
+   if (HGFS_OP_OPLOCK_BREAK_V4 != op) {
+      NOT_REACHED();
+      result = FALSE;
+   } else {
+      reply = HgfsAllocInitReply(packet, packetHeader, sizeof *reply,
+                                 session);
+      reply->fid = fileId;
+      reply->serverLock = serverLock;
+      reply->reserved = 0;
+      *payloadSize = sizeof *reply;
+   }
+   return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackOplockAcquirePayloadV4 --
+ *
+ *    Unpack HGFS oplock acquire payload version 4.
+ *
+ * Results:
+ *    TRUE on success.
+ *    FALSE on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsUnpackOplockAcquirePayloadV4(const HgfsRequestServerLockChangeV2 *requestV4, // IN: request payload
+                                 size_t payloadSize,                             // IN: payload size
+                                 HgfsHandle *fileId,                             // OUT: file Id
+                                 HgfsLockType *serverLock)                       // OUT: lock type
+{
+   if (payloadSize < sizeof *requestV4) {
+      return FALSE;
+   }
+
+   *fileId     = requestV4->fid;
+   *serverLock = requestV4->serverLock;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackOplockAcquireRequest --
+ *
+ *    Unpack hgfs oplock acquire request.
+ *
+ * Results:
+ *    TRUE on success, FALSE on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsUnpackOplockAcquireRequest(const void *packet,         // IN: HGFS packet
+                               size_t packetSize,          // IN: request packet size
+                               HgfsOp op,                  // IN: operation version
+                               HgfsHandle *fileId,         // OUT: file Id
+                               HgfsLockType *serverLock)   // OUT: lock type
+{
+   const HgfsRequestServerLockChangeV2 *requestV4 = packet;
+   Bool result = FALSE;
+
+   ASSERT(fileId);
+   ASSERT(serverLock);
+
+   ASSERT(HGFS_OP_OPLOCK_ACQUIRE_V4 == op);
+
+   if (HGFS_OP_OPLOCK_ACQUIRE_V4 == op) {
+      result = HgfsUnpackOplockAcquirePayloadV4(requestV4,
+                                                packetSize,
+                                                fileId,
+                                                serverLock);
+   }
+
+   if (!result) {
+      LOG(4, "%s: Error unpacking HGFS_OP_OPLOCK_ACQUIRE_V4 packet\n",
+          __FUNCTION__);
+   }
+   return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPackOplockAcquireReply --
+ *
+ *    Pack hgfs oplock acquire reply.
+ *
+ * Results:
+ *    TRUE if successfully packed the reply, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsPackOplockAcquireReply(HgfsPacket *packet,         // IN/OUT: Hgfs Packet
+                           const void *packetHeader,   // IN: packet header
+                           HgfsOp op,                  // IN: operation code
+                           HgfsLockType serverLock,    // IN: lock granted
+                           size_t *payloadSize,        // OUT: size of packet
+                           HgfsSessionInfo *session)   // IN: Session info
+{
+   Bool result = TRUE;
+   HgfsReplyServerLockChangeV2 *reply;
+
+   HGFS_ASSERT_PACK_PARAMS;
+
+   *payloadSize = 0;
+
+   if (HGFS_OP_OPLOCK_ACQUIRE_V4 != op) {
+      NOT_REACHED();
+      result = FALSE;
+   } else {
+      reply = HgfsAllocInitReply(packet, packetHeader, sizeof *reply,
+                                 session);
+      reply->serverLock = serverLock;
+      reply->reserved = 0;
+      *payloadSize = sizeof *reply;
+   }
+   return result;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -6224,3 +6398,677 @@ HgfsPackChangeNotificationRequest(void *packet,                    // IN/OUT: Hg
 exit:
    return result;
 }
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackCompoundRequest --
+ *
+ *    Unpack hgfs compound request V4 into its chain of sub-requests.
+ *
+ *    The sub-request arguments are not copied, they point into the packet.
+ *
+ * Results:
+ *    TRUE on success, the caller frees the sub-request array.
+ *    FALSE on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsUnpackCompoundRequest(const void *packet,                   // IN: HGFS packet
+                          size_t packetSize,                    // IN: request packet size
+                          HgfsOp op,                            // IN: requested operation
+                          HgfsCompoundSubRequest **subRequests, // OUT: sub-requests
+                          uint32 *numSubRequests)               // OUT: number of them
+{
+   const HgfsRequestCompoundV4 *requestV4 = packet;
+   HgfsCompoundSubRequest *subs;
+   const char *next;
+   size_t remaining;
+   uint32 i;
+
+   ASSERT(packet);
+   ASSERT(subRequests);
+   ASSERT(numSubRequests);
+
+   ASSERT(HGFS_OP_COMPOUND_V4 == op);
+
+   if (HGFS_OP_COMPOUND_V4 != op || packetSize < sizeof *requestV4) {
+      LOG(4, "%s: Error decoding HGFS packet\n", __FUNCTION__);
+      return FALSE;
+   }
+
+   if (0 == requestV4->numRequests ||
+       requestV4->numRequests > HGFS_COMPOUND_MAX_REQUESTS) {
+      LOG(4, "%s: Invalid number of requests %u\n", __FUNCTION__,
+          requestV4->numRequests);
+      return FALSE;
+   }
+
+   subs = Util_SafeCalloc(requestV4->numRequests, sizeof *subs);
+   next = (const char *)(requestV4 + 1);
+   remaining = packetSize - sizeof *requestV4;
+
+   for (i = 0; i < requestV4->numRequests; i++) {
+      const HgfsRequestCompoundEntryV4 *entry =
+         (const HgfsRequestCompoundEntryV4 *)next;
+
+      if (remaining < sizeof *entry ||
+          remaining - sizeof *entry < entry->requestSize) {
+         LOG(4, "%s: Request %u exceeds the packet\n", __FUNCTION__, i);
+         free(subs);
+         return FALSE;
+      }
+
+      subs[i].op = entry->op;
+      subs[i].flags = entry->flags;
+      subs[i].handleOffset = entry->handleOffset;
+      subs[i].args = entry + 1;
+      subs[i].argsSize = entry->requestSize;
+
+      next += sizeof *entry + entry->requestSize;
+      remaining -= sizeof *entry + entry->requestSize;
+   }
+
+   *subRequests = subs;
+   *numSubRequests = requestV4->numRequests;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackCompoundReplyHandle --
+ *
+ *    Get the handle returned by a sub-request of a compound request, which
+ *    later sub-requests can refer to.
+ *
+ * Results:
+ *    TRUE if the sub-request returns a handle, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsUnpackCompoundReplyHandle(HgfsOp op,            // IN: sub-request operation
+                              const void *reply,    // IN: sub-request reply
+                              size_t replySize,     // IN: reply size
+                              HgfsHandle *handle)   // OUT: returned handle
+{
+   switch (op) {
+   case HGFS_OP_OPEN_V3:
+      if (replySize >= sizeof (HgfsReplyOpenV3)) {
+         *handle = ((const HgfsReplyOpenV3 *)reply)->file;
+         return TRUE;
+      }
+      break;
+   case HGFS_OP_SEARCH_OPEN_V3:
+      if (replySize >= sizeof (HgfsReplySearchOpenV3)) {
+         *handle = ((const HgfsReplySearchOpenV3 *)reply)->search;
+         return TRUE;
+      }
+      break;
+   default:
+      break;
+   }
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPackCalculateCompoundReplySize --
+ *
+ *    Calculates the size needed for a compound reply.
+ *
+ * Results:
+ *    Size of the compound reply, not including the header.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+size_t
+HgfsPackCalculateCompoundReplySize(const HgfsCompoundSubReply *subReplies, // IN:
+                                   uint32 numSubReplies)                   // IN:
+{
+   size_t result = sizeof (HgfsReplyCompoundV4);
+   uint32 i;
+
+   for (i = 0; i < numSubReplies; i++) {
+      result += sizeof (HgfsReplyCompoundEntryV4) + subReplies[i].replySize;
+   }
+   return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPackCompoundReply --
+ *
+ *    Pack hgfs compound V4 reply from the replies of the executed
+ *    sub-requests.
+ *
+ * Results:
+ *    TRUE if successfully allocated reply request, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsPackCompoundReply(HgfsPacket *packet,                      // IN/OUT: Hgfs Packet
+                      const void *packetHeader,                // IN: packet header
+                      HgfsOp op,                               // IN: operation code
+                      const HgfsCompoundSubReply *subReplies,  // IN: sub-replies
+                      uint32 numSubReplies,                    // IN: number of them
+                      size_t *payloadSize,                     // OUT: size of packet
+                      HgfsSessionInfo *session)                // IN: Session info
+{
+   HgfsReplyCompoundV4 *reply;
+   char *next;
+   uint32 i;
+
+   HGFS_ASSERT_PACK_PARAMS;
+
+   *payloadSize = 0;
+
+   if (HGFS_OP_COMPOUND_V4 != op) {
+      NOT_REACHED();
+      return FALSE;
+   }
+
+   *payloadSize = HgfsPackCalculateCompoundReplySize(subReplies, numSubReplies);
+   reply = HgfsAllocInitReply(packet, packetHeader, *payloadSize, session);
+   reply->numReplies = numSubReplies;
+   reply->flags = 0;
+   reply->reserved = 0;
+
+   next = (char *)(reply + 1);
+   for (i = 0; i < numSubReplies; i++) {
+      HgfsReplyCompoundEntryV4 *entry = (HgfsReplyCompoundEntryV4 *)next;
+
+      entry->op = subReplies[i].op;
+      entry->status = HgfsConvertFromInternalStatus(subReplies[i].status);
+      entry->replySize = (uint32)subReplies[i].replySize;
+      entry->reserved = 0;
+      if (0 != subReplies[i].replySize) {
+         memcpy(entry + 1, subReplies[i].reply, subReplies[i].replySize);
+      }
+      next += sizeof *entry + subReplies[i].replySize;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackCopyRangeRequest --
+ *
+ *    Unpack hgfs copy range V4 request.
+ *
+ * Results:
+ *    TRUE on success, FALSE on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsUnpackCopyRangeRequest(const void *packet,    // IN: HGFS packet
+                           size_t packetSize,     // IN: request packet size
+                           HgfsOp op,             // IN: operation version
+                           HgfsHandle *srcFile,   // OUT: file to copy from
+                           uint64 *srcOffset,     // OUT: offset to copy from
+                           HgfsHandle *dstFile,   // OUT: file to copy to
+                           uint64 *dstOffset,     // OUT: offset to copy to
+                           uint64 *length)        // OUT: bytes to copy
+{
+   const HgfsRequestCopyRangeV4 *requestV4 = packet;
+
+   ASSERT(srcFile);
+   ASSERT(srcOffset);
+   ASSERT(dstFile);
+   ASSERT(dstOffset);
+   ASSERT(length);
+
+   ASSERT(HGFS_OP_COPY_RANGE_V4 == op);
+
+   if (HGFS_OP_COPY_RANGE_V4 != op || packetSize < sizeof *requestV4) {
+      LOG(4, "%s: Error unpacking HGFS_OP_COPY_RANGE_V4 packet\n",
+          __FUNCTION__);
+      return FALSE;
+   }
+
+   *srcFile = requestV4->srcFile;
+   *srcOffset = requestV4->srcOffset;
+   *dstFile = requestV4->dstFile;
+   *dstOffset = requestV4->dstOffset;
+   *length = requestV4->length;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPackCopyRangeReply --
+ *
+ *    Pack hgfs copy range V4 reply.
+ *
+ * Results:
+ *    TRUE if successfully packed the reply, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsPackCopyRangeReply(HgfsPacket *packet,         // IN/OUT: Hgfs Packet
+                       const void *packetHeader,   // IN: packet header
+                       HgfsOp op,                  // IN: operation code
+                       uint64 actualSize,          // IN: bytes copied
+                       Bool cloned,                // IN: blocks are shared
+                       size_t *payloadSize,        // OUT: size of packet
+                       HgfsSessionInfo *session)   // IN: Session info
+{
+   HgfsReplyCopyRangeV4 *reply;
+
+   HGFS_ASSERT_PACK_PARAMS;
+
+   *payloadSize = 0;
+
+   if (HGFS_OP_COPY_RANGE_V4 != op) {
+      NOT_REACHED();
+      return FALSE;
+   }
+
+   reply = HgfsAllocInitReply(packet, packetHeader, sizeof *reply, session);
+   reply->actualSize = actualSize;
+   reply->flags = cloned ? HGFS_COPY_RANGE_CLONED : 0;
+   reply->reserved1 = 0;
+   reply->reserved2 = 0;
+   *payloadSize = sizeof *reply;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackFsyncRequest --
+ *
+ *    Unpack hgfs fsync V4 request.
+ *
+ * Results:
+ *    TRUE on success, FALSE on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsUnpackFsyncRequest(const void *packet,    // IN: HGFS packet
+                       size_t packetSize,     // IN: request packet size
+                       HgfsOp op,             // IN: operation version
+                       HgfsHandle *file,      // OUT: file or directory to sync
+                       Bool *dataOnly)        // OUT: only sync data
+{
+   const HgfsRequestFsyncV4 *requestV4 = packet;
+
+   ASSERT(file);
+   ASSERT(dataOnly);
+
+   ASSERT(HGFS_OP_FSYNC_V4 == op);
+
+   if (HGFS_OP_FSYNC_V4 != op || packetSize < sizeof *requestV4) {
+      LOG(4, "%s: Error unpacking HGFS_OP_FSYNC_V4 packet\n", __FUNCTION__);
+      return FALSE;
+   }
+
+   *file = requestV4->fid;
+   *dataOnly = 0 != (requestV4->flags & HGFS_FSYNC_DATA_ONLY);
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPackFsyncReply --
+ *
+ *    Pack hgfs fsync V4 reply.
+ *
+ * Results:
+ *    TRUE if successfully packed the reply, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsPackFsyncReply(HgfsPacket *packet,         // IN/OUT: Hgfs Packet
+                   const void *packetHeader,   // IN: packet header
+                   HgfsOp op,                  // IN: operation code
+                   size_t *payloadSize,        // OUT: size of packet
+                   HgfsSessionInfo *session)   // IN: Session info
+{
+   HgfsReplyFsyncV4 *reply;
+
+   HGFS_ASSERT_PACK_PARAMS;
+
+   *payloadSize = 0;
+
+   if (HGFS_OP_FSYNC_V4 != op) {
+      NOT_REACHED();
+      return FALSE;
+   }
+
+   reply = HgfsAllocInitReply(packet, packetHeader, sizeof *reply, session);
+   reply->reserved = 0;
+   *payloadSize = sizeof *reply;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackAccessCheckRequest --
+ *
+ *    Unpack hgfs access check V4 request. The request is name based only,
+ *    a file handle is rejected.
+ *
+ * Results:
+ *    TRUE on success, FALSE on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsUnpackAccessCheckRequest(const void *packet,        // IN: HGFS packet
+                             size_t packetSize,         // IN: request packet size
+                             HgfsOp op,                 // IN: operation version
+                             const char **cpName,       // OUT: cpName
+                             size_t *cpNameSize,        // OUT: cpName size
+                             uint32 *caseFlags,         // OUT: case-sensitivity flags
+                             HgfsPermissions *perms)    // OUT: permissions to check
+{
+   const HgfsRequestAccessCheckV4 *requestV4 = packet;
+   HgfsHandle file;
+   Bool useHandle;
+
+   ASSERT(cpName);
+   ASSERT(cpNameSize);
+   ASSERT(caseFlags);
+   ASSERT(perms);
+
+   ASSERT(HGFS_OP_ACCESS_CHECK_V4 == op);
+
+   if (HGFS_OP_ACCESS_CHECK_V4 != op || packetSize < sizeof *requestV4) {
+      LOG(4, "%s: Error unpacking HGFS_OP_ACCESS_CHECK_V4 packet\n",
+          __FUNCTION__);
+      return FALSE;
+   }
+
+   if (!HgfsUnpackFileNameV3(&requestV4->fileName,
+                             packetSize - sizeof *requestV4,
+                             &useHandle,
+                             cpName,
+                             cpNameSize,
+                             &file,
+                             caseFlags)) {
+      LOG(4, "%s: Error decoding HGFS packet\n", __FUNCTION__);
+      return FALSE;
+   }
+   if (useHandle) {
+      LOG(4, "%s: file handles are not supported\n", __FUNCTION__);
+      return FALSE;
+   }
+
+   /* The permissions follow the name, see HgfsRequestAccessCheckV4. */
+   *perms = *(const HgfsPermissions *)(requestV4->fileName.name + 1 +
+                                       *cpNameSize);
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPackAccessCheckReply --
+ *
+ *    Pack hgfs access check V4 reply.
+ *
+ * Results:
+ *    TRUE if successfully packed the reply, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsPackAccessCheckReply(HgfsPacket *packet,         // IN/OUT: Hgfs Packet
+                         const void *packetHeader,   // IN: packet header
+                         HgfsOp op,                  // IN: operation code
+                         size_t *payloadSize,        // OUT: size of packet
+                         HgfsSessionInfo *session)   // IN: Session info
+{
+   HgfsReplyAccessCheckV4 *reply;
+
+   HGFS_ASSERT_PACK_PARAMS;
+
+   *payloadSize = 0;
+
+   if (HGFS_OP_ACCESS_CHECK_V4 != op) {
+      NOT_REACHED();
+      return FALSE;
+   }
+
+   reply = HgfsAllocInitReply(packet, packetHeader, sizeof *reply, session);
+   reply->reserved = 0;
+   *payloadSize = sizeof *reply;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsUnpackQueryChangesRequest --
+ *
+ *    Unpack hgfs query changes V4 request. The request is name based only,
+ *    a file handle is rejected.
+ *
+ * Results:
+ *    TRUE on success, FALSE on failure.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsUnpackQueryChangesRequest(const void *packet,        // IN: HGFS packet
+                              size_t packetSize,         // IN: request packet size
+                              HgfsOp op,                 // IN: operation version
+                              const char **cpName,       // OUT: cpName
+                              size_t *cpNameSize,        // OUT: cpName size
+                              uint32 *caseFlags,         // OUT: case-sensitivity flags
+                              uint64 *token,             // OUT: changes since
+                              uint32 *maxReplySize)      // OUT: size of the changes
+{
+   const HgfsRequestQueryChangesV4 *requestV4 = packet;
+   HgfsHandle file;
+   Bool useHandle;
+
+   ASSERT(cpName);
+   ASSERT(cpNameSize);
+   ASSERT(caseFlags);
+   ASSERT(token);
+   ASSERT(maxReplySize);
+
+   ASSERT(HGFS_OP_QUERY_CHANGES_V4 == op);
+
+   if (HGFS_OP_QUERY_CHANGES_V4 != op || packetSize < sizeof *requestV4) {
+      LOG(4, "%s: Error unpacking HGFS_OP_QUERY_CHANGES_V4 packet\n",
+          __FUNCTION__);
+      return FALSE;
+   }
+
+   if (!HgfsUnpackFileNameV3(&requestV4->fileName,
+                             packetSize - sizeof *requestV4,
+                             &useHandle,
+                             cpName,
+                             cpNameSize,
+                             &file,
+                             caseFlags)) {
+      LOG(4, "%s: Error decoding HGFS packet\n", __FUNCTION__);
+      return FALSE;
+   }
+   if (useHandle) {
+      LOG(4, "%s: file handles are not supported\n", __FUNCTION__);
+      return FALSE;
+   }
+
+   *token = requestV4->token;
+   *maxReplySize = requestV4->maxReplySize;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPackQueryChangesReply --
+ *
+ *    Pack hgfs query changes V4 reply with as many of the changes as fit in
+ *    maxRecordsSize bytes. If some do not fit the returned token is the one
+ *    of the first change left out. A change with a name which cannot be
+ *    represented is replaced by a rescan.
+ *
+ * Results:
+ *    TRUE if successfully packed the reply, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsPackQueryChangesReply(HgfsPacket *packet,               // IN/OUT: Hgfs Packet
+                          const void *packetHeader,         // IN: packet header
+                          HgfsOp op,                        // IN: operation code
+                          char const *shareName,            // IN: share name
+                          const HgfsNotifyChange *changes,  // IN: changes
+                          uint32 numChanges,                // IN: number of changes
+                          uint64 token,                     // IN: token after the changes
+                          Bool resync,                      // IN: rescan needed
+                          Bool more,                        // IN: more changes
+                          size_t maxRecordsSize,            // IN: space for the changes
+                          size_t *payloadSize,              // OUT: size of packet
+                          HgfsSessionInfo *session)         // IN: Session info
+{
+   HgfsReplyQueryChangesV4 *reply;
+   HgfsChangeRecordV4 *lastRecord = NULL;
+   size_t recordsSize = 0;
+   uint32 i;
+
+   HGFS_ASSERT_PACK_PARAMS;
+   ASSERT(shareName);
+
+   *payloadSize = 0;
+
+   if (HGFS_OP_QUERY_CHANGES_V4 != op) {
+      NOT_REACHED();
+      return FALSE;
+   }
+
+   reply = HgfsAllocInitReply(packet, packetHeader,
+                              sizeof *reply + maxRecordsSize, session);
+   reply->count = 0;
+
+   for (i = 0; i < numChanges; i++) {
+      size_t offset = ROUNDUP(recordsSize, sizeof (uint64));
+      HgfsChangeRecordV4 *record =
+         (HgfsChangeRecordV4 *)((char *)(reply + 1) + offset);
+      char *cpName;
+      int cpNameSize;
+      size_t nameSize;
+      Bool packed;
+
+      if (offset + offsetof(HgfsChangeRecordV4, fileName) > maxRecordsSize) {
+         break;
+      }
+
+      cpNameSize = HgfsBuildCPName(shareName, changes[i].name, &cpName);
+      if (cpNameSize < 0) {
+         LOG(4, "%s: cannot represent \"%s\"\n", __FUNCTION__,
+             changes[i].name);
+         resync = TRUE;
+         continue;
+      }
+      packed = HgfsPackHgfsName(cpName, cpNameSize,
+                                maxRecordsSize - offset -
+                                offsetof(HgfsChangeRecordV4, fileName),
+                                &nameSize, &record->fileName);
+      free(cpName);
+      if (!packed) {
+         break;
+      }
+
+      record->seq = changes[i].seq;
+      record->nextOffset = 0;
+      record->mask = changes[i].mask;
+      if (NULL != lastRecord) {
+         lastRecord->nextOffset = (uint32)((char *)record - (char *)lastRecord);
+      }
+      lastRecord = record;
+      recordsSize = offset + offsetof(HgfsChangeRecordV4, fileName) + nameSize;
+      reply->count++;
+   }
+
+   if (i < numChanges) {
+      token = changes[i].seq;
+      more = TRUE;
+   }
+
+   reply->token = token;
+   reply->flags = (resync ? HGFS_QUERY_CHANGES_RESYNC : 0) |
+                  (more ? HGFS_QUERY_CHANGES_MORE : 0);
+   reply->reserved = 0;
+   *payloadSize = sizeof *reply + recordsSize;
+   return TRUE;
+}
@@ -30,6 +30,7 @@
 #include "hgfsProto.h"     // for the HGFS protocol request, reply and types
 #include "hgfsUtil.h"      // for HgfsInternalStatus
 #include "hgfsServerInt.h" // for HgfsSessionInfo
+#include "hgfsDirNotify.h" // for HgfsNotifyChange
 
 
 /*
@@ -350,6 +351,129 @@ HgfsPackChangeNotificationRequest(void *packet,                    // IN/OUT: Hg
                                   uint32 notifyFlags,              // IN: notify flags
                                   HgfsSessionInfo *session,        // IN: session
                                   size_t *bufferSize);             // IN/OUT: packet size
+Bool
+HgfsUnpackOplockAcquireRequest(const void *packet,        // IN: HGFS packet
+                               size_t packetSize,         // IN: request packet size
+                               HgfsOp op,                 // IN: operation version
+                               HgfsHandle *fileId,        // OUT: file Id
+                               HgfsLockType *serverLock); // OUT: lock type
+Bool
+HgfsPackOplockAcquireReply(HgfsPacket *packet,          // IN/OUT: Hgfs Packet
+                           const void *packetHeader,    // IN: packet header
+                           HgfsOp op,                   // IN: operation code
+                           HgfsLockType serverLock,     // IN: lock granted
+                           size_t *payloadSize,         // OUT: size of packet
+                           HgfsSessionInfo *session);   // IN: Session info
+size_t
+HgfsPackGetOplockBreakSize(void);
+Bool
+HgfsPackOplockBreakRequest(void *packet,                // IN/OUT: Hgfs Packet
+                           HgfsHandle fileId,           // IN: file ID
+                           HgfsLockType serverLock,     // IN: lock type
+                           uint64 sessionId,            // IN: session ID
+                           size_t *bufferSize);         // IN/OUT: size of packet
+Bool
+HgfsUnpackOplockBreakAckReply(const void *packet,         // IN: HGFS packet
+                              size_t packetSize,          // IN: reply packet size
+                              HgfsOp op,                  // IN: operation version
+                              HgfsHandle *fileId,         // OUT: file Id
+                              HgfsLockType *serverLock);  // OUT: lock type
+Bool
+HgfsPackOplockBreakAckReply(HgfsPacket *packet,         // IN/OUT: Hgfs Packet
+                            const void *packetHeader,   // IN: packet header
+                            HgfsOp op,                  // IN: operation code
+                            HgfsHandle fileId,          // IN: file ID
+                            HgfsLockType serverLock,    // IN: lock now held
+                            size_t *payloadSize,        // OUT: size of packet
+                            HgfsSessionInfo *session);  // IN: Session info
+Bool
+HgfsUnpackCompoundRequest(const void *packet,                   // IN: HGFS packet
+                          size_t packetSize,                    // IN: packet size
+                          HgfsOp op,                            // IN: operation code
+                          HgfsCompoundSubRequest **subRequests, // OUT: sub-requests
+                          uint32 *numSubRequests);              // OUT: number of them
+Bool
+HgfsUnpackCompoundReplyHandle(HgfsOp op,            // IN: sub-request operation
+                              const void *reply,    // IN: sub-request reply
+                              size_t replySize,     // IN: reply size
+                              HgfsHandle *handle);  // OUT: returned handle
+size_t
+HgfsPackCalculateCompoundReplySize(const HgfsCompoundSubReply *subReplies, // IN:
+                                   uint32 numSubReplies);                  // IN:
+Bool
+HgfsPackCompoundReply(HgfsPacket *packet,                      // IN/OUT: Hgfs Packet
+                      const void *packetHeader,                // IN: packet header
+                      HgfsOp op,                               // IN: operation code
+                      const HgfsCompoundSubReply *subReplies,  // IN: sub-replies
+                      uint32 numSubReplies,                    // IN: number of them
+                      size_t *payloadSize,                     // OUT: size of packet
+                      HgfsSessionInfo *session);               // IN: Session info
+Bool
+HgfsUnpackCopyRangeRequest(const void *packet,    // IN: HGFS packet
+                           size_t packetSize,     // IN: request packet size
+                           HgfsOp op,             // IN: operation version
+                           HgfsHandle *srcFile,   // OUT: file to copy from
+                           uint64 *srcOffset,     // OUT: offset to copy from
+                           HgfsHandle *dstFile,   // OUT: file to copy to
+                           uint64 *dstOffset,     // OUT: offset to copy to
+                           uint64 *length);       // OUT: bytes to copy
+Bool
+HgfsPackCopyRangeReply(HgfsPacket *packet,         // IN/OUT: Hgfs Packet
+                       const void *packetHeader,   // IN: packet header
+                       HgfsOp op,                  // IN: operation code
+                       uint64 actualSize,          // IN: bytes copied
+                       Bool cloned,                // IN: blocks are shared
+                       size_t *payloadSize,        // OUT: size of packet
+                       HgfsSessionInfo *session);  // IN: Session info
+Bool
+HgfsUnpackFsyncRequest(const void *packet,    // IN: HGFS packet
+                       size_t packetSize,     // IN: request packet size
+                       HgfsOp op,             // IN: operation version
+                       HgfsHandle *file,      // OUT: file or directory to sync
+                       Bool *dataOnly);       // OUT: only sync data
+Bool
+HgfsPackFsyncReply(HgfsPacket *packet,         // IN/OUT: Hgfs Packet
+                   const void *packetHeader,   // IN: packet header
+                   HgfsOp op,                  // IN: operation code
+                   size_t *payloadSize,        // OUT: size of packet
+                   HgfsSessionInfo *session);  // IN: Session info
+Bool
+HgfsUnpackAccessCheckRequest(const void *packet,        // IN: HGFS packet
+                             size_t packetSize,         // IN: request packet size
+                             HgfsOp op,                 // IN: operation version
+                             const char **cpName,       // OUT: cpName
+                             size_t *cpNameSize,        // OUT: cpName size
+                             uint32 *caseFlags,         // OUT: case-sensitivity flags
+                             HgfsPermissions *perms);   // OUT: permissions to check
+Bool
+HgfsPackAccessCheckReply(HgfsPacket *packet,         // IN/OUT: Hgfs Packet
+                         const void *packetHeader,   // IN: packet header
+                         HgfsOp op,                  // IN: operation code
+                         size_t *payloadSize,        // OUT: size of packet
+                         HgfsSessionInfo *session);  // IN: Session info
+
+Bool
+HgfsUnpackQueryChangesRequest(const void *packet,        // IN: HGFS packet
+                              size_t packetSize,         // IN: request packet size
+                              HgfsOp op,                 // IN: operation version
+                              const char **cpName,       // OUT: cpName
+                              size_t *cpNameSize,        // OUT: cpName size
+                              uint32 *caseFlags,         // OUT: case-sensitivity flags
+                              uint64 *token,             // OUT: changes since
+                              uint32 *maxReplySize);     // OUT: size of the changes
+Bool
+HgfsPackQueryChangesReply(HgfsPacket *packet,               // IN/OUT: Hgfs Packet
+                          const void *packetHeader,         // IN: packet header
+                          HgfsOp op,                        // IN: operation code
+                          char const *shareName,            // IN: share name
+                          const HgfsNotifyChange *changes,  // IN: changes
+                          uint32 numChanges,                // IN: number of changes
+                          uint64 token,                     // IN: token after the changes
+                          Bool resync,                      // IN: rescan needed
+                          Bool more,                        // IN: more changes
+                          size_t maxRecordsSize,            // IN: space for the changes
+                          size_t *payloadSize,              // OUT: size of packet
+                          HgfsSessionInfo *session);        // IN: Session info
 
 
 #endif // ifndef _HGFS_SERVER_PARAMETERS_H_
@@ -0,0 +1,726 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsServerStats.c --
+ *
+ *    Per operation and per share request statistics of the HGFS server.
+ *
+ *    Every thread recording requests is assigned one of HGFS_STATS_NUM_SLOTS
+ *    counter slots on its first request. The counters are updated with
+ *    atomic adds, which stay uncontended as long as there are no more
+ *    threads than slots, and are summed up over all slots when read.
+ */
+
+#include <string.h>
+
+#include "vmware.h"
+#include "vm_atomic.h"
+#include "dynbuf.h"
+#include "hashTable.h"
+#include "hostinfo.h"
+#include "strutil.h"
+#include "str.h"
+#include "util.h"
+#include "hgfsServerInt.h"
+#include "hgfsServerStats.h"
+
+/* Number of counter slots, see the file header. */
+#define HGFS_STATS_NUM_SLOTS           16
+
+/* Longest share name requests are attributed to. */
+#define HGFS_STATS_SHARE_NAME_MAX      256
+
+typedef struct HgfsStatsCounters {
+   Atomic_uint64 requests;
+   Atomic_uint64 errors;
+   Atomic_uint64 bytesIn;
+   Atomic_uint64 bytesOut;
+   Atomic_uint64 latencyUS;
+   Atomic_uint64 buckets[HGFS_STATS_NUM_BUCKETS];
+} HgfsStatsCounters;
+
+/* Counters of one slot, padded so that slots do not share cache lines. */
+typedef struct HgfsStatsSlot {
+   HgfsStatsCounters ops[HGFS_OP_MAX];
+   uint8 pad[64];
+} HgfsStatsSlot;
+
+struct HgfsStatsShare {
+   HgfsStatsCounters slots[HGFS_STATS_NUM_SLOTS];
+};
+
+/* Sums of counters of all slots. */
+typedef struct HgfsStatsTotals {
+   uint64 requests;
+   uint64 errors;
+   uint64 bytesIn;
+   uint64 bytesOut;
+   uint64 latencyUS;
+   uint64 buckets[HGFS_STATS_NUM_BUCKETS];
+} HgfsStatsTotals;
+
+#define HGFS_STATS_OP_NAME(_op) [_op] = #_op
+
+static const char *gHgfsStatsOpNames[HGFS_OP_MAX] = {
+   HGFS_STATS_OP_NAME(HGFS_OP_OPEN),
+   HGFS_STATS_OP_NAME(HGFS_OP_READ),
+   HGFS_STATS_OP_NAME(HGFS_OP_WRITE),
+   HGFS_STATS_OP_NAME(HGFS_OP_CLOSE),
+   HGFS_STATS_OP_NAME(HGFS_OP_SEARCH_OPEN),
+   HGFS_STATS_OP_NAME(HGFS_OP_SEARCH_READ),
+   HGFS_STATS_OP_NAME(HGFS_OP_SEARCH_CLOSE),
+   HGFS_STATS_OP_NAME(HGFS_OP_GETATTR),
+   HGFS_STATS_OP_NAME(HGFS_OP_SETATTR),
+   HGFS_STATS_OP_NAME(HGFS_OP_CREATE_DIR),
+   HGFS_STATS_OP_NAME(HGFS_OP_DELETE_FILE),
+   HGFS_STATS_OP_NAME(HGFS_OP_DELETE_DIR),
+   HGFS_STATS_OP_NAME(HGFS_OP_RENAME),
+   HGFS_STATS_OP_NAME(HGFS_OP_QUERY_VOLUME_INFO),
+   HGFS_STATS_OP_NAME(HGFS_OP_OPEN_V2),
+   HGFS_STATS_OP_NAME(HGFS_OP_GETATTR_V2),
+   HGFS_STATS_OP_NAME(HGFS_OP_SETATTR_V2),
+   HGFS_STATS_OP_NAME(HGFS_OP_SEARCH_READ_V2),
+   HGFS_STATS_OP_NAME(HGFS_OP_CREATE_SYMLINK),
+   HGFS_STATS_OP_NAME(HGFS_OP_SERVER_LOCK_CHANGE),
+   HGFS_STATS_OP_NAME(HGFS_OP_CREATE_DIR_V2),
+   HGFS_STATS_OP_NAME(HGFS_OP_DELETE_FILE_V2),
+   HGFS_STATS_OP_NAME(HGFS_OP_DELETE_DIR_V2),
+   HGFS_STATS_OP_NAME(HGFS_OP_RENAME_V2),
+   HGFS_STATS_OP_NAME(HGFS_OP_OPEN_V3),
+   HGFS_STATS_OP_NAME(HGFS_OP_READ_V3),
+   HGFS_STATS_OP_NAME(HGFS_OP_WRITE_V3),
+   HGFS_STATS_OP_NAME(HGFS_OP_CLOSE_V3),
+   HGFS_STATS_OP_NAME(HGFS_OP_SEARCH_OPEN_V3),
+   HGFS_STATS_OP_NAME(HGFS_OP_SEARCH_READ_V3),
+   HGFS_STATS_OP_NAME(HGFS_OP_SEARCH_CLOSE_V3),
+   HGFS_STATS_OP_NAME(HGFS_OP_GETATTR_V3),
+   HGFS_STATS_OP_NAME(HGFS_OP_SETATTR_V3),
+   HGFS_STATS_OP_NAME(HGFS_OP_CREATE_DIR_V3),
+   HGFS_STATS_OP_NAME(HGFS_OP_DELETE_FILE_V3),
+   HGFS_STATS_OP_NAME(HGFS_OP_DELETE_DIR_V3),
+   HGFS_STATS_OP_NAME(HGFS_OP_RENAME_V3),
+   HGFS_STATS_OP_NAME(HGFS_OP_QUERY_VOLUME_INFO_V3),
+   HGFS_STATS_OP_NAME(HGFS_OP_CREATE_SYMLINK_V3),
+   HGFS_STATS_OP_NAME(HGFS_OP_SERVER_LOCK_CHANGE_V3),
+   HGFS_STATS_OP_NAME(HGFS_OP_WRITE_WIN32_STREAM_V3),
+   HGFS_STATS_OP_NAME(HGFS_OP_CREATE_SESSION_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_DESTROY_SESSION_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_READ_FAST_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_WRITE_FAST_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_SET_WATCH_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_REMOVE_WATCH_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_NOTIFY_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_SEARCH_READ_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_OPEN_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_ENUMERATE_STREAMS_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_GETATTR_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_SETATTR_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_DELETE_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_LINKMOVE_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_FSCTL_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_ACCESS_CHECK_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_FSYNC_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_QUERY_VOLUME_INFO_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_OPLOCK_ACQUIRE_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_OPLOCK_BREAK_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_LOCK_BYTE_RANGE_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_UNLOCK_BYTE_RANGE_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_QUERY_EAS_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_SET_EAS_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_COMPOUND_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_COPY_RANGE_V4),
+   HGFS_STATS_OP_NAME(HGFS_OP_QUERY_CHANGES_V4),
+};
+
+static HgfsStatsSlot *gHgfsStatsSlots = NULL;
+static HashTable *gHgfsStatsShares = NULL;
+static Atomic_uint32 gHgfsStatsNextSlot;
+static Atomic_uint64 gHgfsStatsNextLogNS;
+
+/* Slot of the calling thread, -1 until its first request. */
+static __thread int gHgfsStatsSlot = -1;
+
+/*
+ * Share of the request the calling thread is processing, NULL if none.
+ * It points into the request, which holds the share once the request
+ * completes, possibly on another thread.
+ */
+static __thread HgfsStatsShare **gHgfsStatsCurrentShare = NULL;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsStatsGetSlot --
+ *
+ *    Returns the counter slot of the calling thread, assigning one on the
+ *    first call.
+ *
+ * Results:
+ *    The slot index.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsStatsGetSlot(void)
+{
+   if (gHgfsStatsSlot < 0) {
+      gHgfsStatsSlot = Atomic_ReadInc32(&gHgfsStatsNextSlot) %
+                       HGFS_STATS_NUM_SLOTS;
+   }
+   return gHgfsStatsSlot;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsStatsBucket --
+ *
+ *    Returns the latency histogram bucket of a request latency.
+ *
+ * Results:
+ *    The bucket index.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsStatsBucket(uint64 latencyUS)  // IN: latency in microseconds
+{
+   uint32 bucket = 0;
+
+   while (latencyUS != 0 && bucket < HGFS_STATS_NUM_BUCKETS - 1) {
+      latencyUS >>= 1;
+      bucket++;
+   }
+   return bucket;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsStatsCountersAdd --
+ *
+ *    Records a request in a set of counters.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsStatsCountersAdd(HgfsStatsCounters *counters,  // IN/OUT: counters
+                     Bool failed,                  // IN: request failed
+                     uint64 latencyUS,             // IN: request latency
+                     uint64 bytesIn,               // IN: bytes received
+                     uint64 bytesOut)              // IN: bytes sent
+{
+   Atomic_Inc64(&counters->requests);
+   if (failed) {
+      Atomic_Inc64(&counters->errors);
+   }
+   Atomic_Add64(&counters->bytesIn, bytesIn);
+   Atomic_Add64(&counters->bytesOut, bytesOut);
+   Atomic_Add64(&counters->latencyUS, latencyUS);
+   Atomic_Inc64(&counters->buckets[HgfsStatsBucket(latencyUS)]);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsStatsCountersSum --
+ *
+ *    Adds a set of counters to the totals.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsStatsCountersSum(HgfsStatsCounters *counters,  // IN: counters
+                     HgfsStatsTotals *totals)      // IN/OUT: totals
+{
+   uint32 i;
+
+   totals->requests += Atomic_Read64(&counters->requests);
+   totals->errors += Atomic_Read64(&counters->errors);
+   totals->bytesIn += Atomic_Read64(&counters->bytesIn);
+   totals->bytesOut += Atomic_Read64(&counters->bytesOut);
+   totals->latencyUS += Atomic_Read64(&counters->latencyUS);
+   for (i = 0; i < HGFS_STATS_NUM_BUCKETS; i++) {
+      totals->buckets[i] += Atomic_Read64(&counters->buckets[i]);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsStatsPercentile --
+ *
+ *    Estimates a latency percentile from the histogram as the upper bound
+ *    of the bucket it falls in, or the lower bound of the last bucket.
+ *
+ * Results:
+ *    The latency in microseconds.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+HgfsStatsPercentile(const HgfsStatsTotals *totals,  // IN: totals
+                    uint32 percent)                 // IN: percentile
+{
+   uint64 rank = (totals->requests * percent + 99) / 100;
+   uint64 count = 0;
+   uint32 i;
+
+   for (i = 0; i < HGFS_STATS_NUM_BUCKETS - 1; i++) {
+      count += totals->buckets[i];
+      if (count >= rank) {
+         break;
+      }
+   }
+   return CONST64U(1) << (i < HGFS_STATS_NUM_BUCKETS - 1 ? i : i - 1);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsStatsPrintTotals --
+ *
+ *    Appends one report line of a set of totals to a buffer.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsStatsPrintTotals(DynBuf *buf,                   // IN/OUT: report
+                     const char *kind,              // IN: "op" or "share"
+                     const char *name,              // IN: op or share name
+                     const HgfsStatsTotals *totals) // IN: totals
+{
+   uint32 i;
+
+   StrUtil_SafeDynBufPrintf(buf,
+                            "%s %s requests %"FMT64"u errors %"FMT64"u "
+                            "bytesIn %"FMT64"u bytesOut %"FMT64"u "
+                            "avgUs %"FMT64"u p50Us %"FMT64"u p99Us %"FMT64"u "
+                            "hist",
+                            kind, name, totals->requests, totals->errors,
+                            totals->bytesIn, totals->bytesOut,
+                            totals->latencyUS / totals->requests,
+                            HgfsStatsPercentile(totals, 50),
+                            HgfsStatsPercentile(totals, 99));
+   for (i = 0; i < HGFS_STATS_NUM_BUCKETS; i++) {
+      if (totals->buckets[i] != 0) {
+         StrUtil_SafeDynBufPrintf(buf, " %s%"FMT64"u:%"FMT64"u",
+                                  i < HGFS_STATS_NUM_BUCKETS - 1 ? "<" : ">=",
+                                  i < HGFS_STATS_NUM_BUCKETS - 1 ?
+                                     CONST64U(1) << i : CONST64U(1) << (i - 1),
+                                  totals->buckets[i]);
+      }
+   }
+   StrUtil_SafeDynBufPrintf(buf, "\n");
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsStatsPrintShare --
+ *
+ *    HashTable_ForEach callback appending the report line of a share.
+ *
+ * Results:
+ *    0 to continue the iteration.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsStatsPrintShare(const char *shareName,  // IN: share name
+                    void *value,            // IN: share counters
+                    void *clientData)       // IN/OUT: report
+{
+   HgfsStatsShare *share = value;
+   HgfsStatsTotals totals;
+   uint32 i;
+
+   memset(&totals, 0, sizeof totals);
+   for (i = 0; i < HGFS_STATS_NUM_SLOTS; i++) {
+      HgfsStatsCountersSum(&share->slots[i], &totals);
+   }
+   if (totals.requests != 0) {
+      HgfsStatsPrintTotals(clientData, "share", shareName, &totals);
+   }
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStats_Init --
+ *
+ *    Allocates the statistics counters.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerStats_Init(void)
+{
+   ASSERT(NULL == gHgfsStatsSlots);
+
+   gHgfsStatsSlots = Util_SafeCalloc(HGFS_STATS_NUM_SLOTS,
+                                     sizeof *gHgfsStatsSlots);
+   gHgfsStatsShares = HashTable_Alloc(64,
+                                      HASH_STRING_KEY | HASH_FLAG_ATOMIC |
+                                      HASH_FLAG_COPYKEY,
+                                      free);
+   Atomic_Write64(&gHgfsStatsNextLogNS, Hostinfo_SystemTimerNS() +
+                  HGFS_STATS_LOG_INTERVAL_SEC * CONST64U(1000000000));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStats_Exit --
+ *
+ *    Logs and frees the statistics counters.
+ *
+ *    Must not be called while requests are being processed.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerStats_Exit(void)
+{
+   if (NULL == gHgfsStatsSlots) {
+      return;
+   }
+
+   HgfsServerStats_Log();
+   /* No requests are being processed, so the atomic table can be freed. */
+   HashTable_FreeUnsafe(gHgfsStatsShares);
+   gHgfsStatsShares = NULL;
+   free(gHgfsStatsSlots);
+   gHgfsStatsSlots = NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStats_BeginRequest --
+ *
+ *    Starts the attribution of a request processed by the calling thread
+ *    to the share stored in the request, which replaces the request the
+ *    thread was processing, if any.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerStats_BeginRequest(HgfsStatsShare **share)  // OUT: share of the request
+{
+   *share = NULL;
+   gHgfsStatsCurrentShare = share;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStats_EndRequest --
+ *
+ *    Stops the attribution to the share stored in a request, which is
+ *    about to be freed, if the calling thread is processing it.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerStats_EndRequest(HgfsStatsShare **share)  // IN: share of the request
+{
+   if (gHgfsStatsCurrentShare == share) {
+      gHgfsStatsCurrentShare = NULL;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStats_SetShare --
+ *
+ *    Attributes the request processed by the calling thread to a share,
+ *    unless it is already attributed to one or the thread is not
+ *    processing a request.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    The share counters are allocated the first time the share is seen.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerStats_SetShare(const char *shareName,  // IN: share name
+                         size_t shareNameLen)    // IN: share name length
+{
+   char name[HGFS_STATS_SHARE_NAME_MAX];
+   HgfsStatsShare *share;
+
+   if (NULL == gHgfsStatsCurrentShare || NULL != *gHgfsStatsCurrentShare ||
+       NULL == gHgfsStatsShares || shareNameLen >= sizeof name) {
+      return;
+   }
+
+   memcpy(name, shareName, shareNameLen);
+   name[shareNameLen] = '\0';
+
+   if (!HashTable_Lookup(gHgfsStatsShares, name, (void **)&share)) {
+      HgfsStatsShare *newShare = Util_SafeCalloc(1, sizeof *newShare);
+
+      share = HashTable_LookupOrInsert(gHgfsStatsShares, name, newShare);
+      if (share != newShare) {
+         /* Another thread added the share first. */
+         free(newShare);
+      }
+   }
+   *gHgfsStatsCurrentShare = share;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStats_RequestDone --
+ *
+ *    Records a completed request in the counters of its operation and of
+ *    its share.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    The statistics are dumped to the log every HGFS_STATS_LOG_INTERVAL_SEC.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerStats_RequestDone(HgfsOp op,               // IN: request operation
+                            HgfsStatsShare *share,   // IN/OPT: request share
+                            Bool failed,             // IN: request failed
+                            uint64 startNS,          // IN: request start time
+                            uint64 bytesIn,          // IN: bytes received
+                            uint64 bytesOut)         // IN: bytes sent
+{
+   uint64 nowNS;
+   uint64 nextLogNS;
+   uint64 latencyUS;
+   int slot;
+
+   if (NULL == gHgfsStatsSlots || (uint32)op >= HGFS_OP_MAX) {
+      return;
+   }
+
+   nowNS = Hostinfo_SystemTimerNS();
+   latencyUS = nowNS > startNS ? (nowNS - startNS) / 1000 : 0;
+   slot = HgfsStatsGetSlot();
+
+   HgfsStatsCountersAdd(&gHgfsStatsSlots[slot].ops[op], failed, latencyUS,
+                        bytesIn, bytesOut);
+   if (NULL != share) {
+      HgfsStatsCountersAdd(&share->slots[slot], failed, latencyUS, bytesIn,
+                           bytesOut);
+   }
+
+   nextLogNS = Atomic_Read64(&gHgfsStatsNextLogNS);
+   if (nowNS >= nextLogNS &&
+       Atomic_ReadIfEqualWrite64(&gHgfsStatsNextLogNS, nextLogNS,
+                                 nowNS + HGFS_STATS_LOG_INTERVAL_SEC *
+                                         CONST64U(1000000000)) == nextLogNS) {
+      HgfsServerStats_Log();
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStats_GetReport --
+ *
+ *    Formats the statistics of all operations and shares that have seen
+ *    requests, one line each, followed by the data packet byte counters.
+ *
+ * Results:
+ *    The report, to be freed by the caller, or NULL if the statistics are
+ *    not initialized.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+char *
+HgfsServerStats_GetReport(void)
+{
+   DynBuf buf;
+   uint64 bounceBytes;
+   uint64 directBytes;
+   uint32 op;
+
+   if (NULL == gHgfsStatsSlots) {
+      return NULL;
+   }
+
+   DynBuf_Init(&buf);
+   for (op = 0; op < HGFS_OP_MAX; op++) {
+      HgfsStatsTotals totals;
+      char opName[32];
+      uint32 i;
+
+      memset(&totals, 0, sizeof totals);
+      for (i = 0; i < HGFS_STATS_NUM_SLOTS; i++) {
+         HgfsStatsCountersSum(&gHgfsStatsSlots[i].ops[op], &totals);
+      }
+      if (totals.requests == 0) {
+         continue;
+      }
+
+      if (NULL != gHgfsStatsOpNames[op]) {
+         /* Skip the "HGFS_OP_" prefix. */
+         Str_Strcpy(opName, gHgfsStatsOpNames[op] + 8, sizeof opName);
+      } else {
+         Str_Sprintf(opName, sizeof opName, "%u", op);
+      }
+      HgfsStatsPrintTotals(&buf, "op", opName, &totals);
+   }
+   HashTable_ForEach(gHgfsStatsShares, HgfsStatsPrintShare, &buf);
+
+   HSPU_GetDataPacketStats(&bounceBytes, &directBytes);
+   StrUtil_SafeDynBufPrintf(&buf,
+                            "packets data bounceBytes %"FMT64"u "
+                            "directBytes %"FMT64"u\n",
+                            bounceBytes, directBytes);
+
+   return DynBuf_DetachString(&buf);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerStats_Log --
+ *
+ *    Dumps the statistics to the log.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerStats_Log(void)
+{
+   char *report = HgfsServerStats_GetReport();
+   char *line;
+   char *next;
+
+   if (NULL == report) {
+      return;
+   }
+
+   for (line = report; *line != '\0'; line = next) {
+      next = strchr(line, '\n');
+      ASSERT(NULL != next);
+      *next++ = '\0';
+      Log("HGFS stats: %s\n", line);
+   }
+   free(report);
+}
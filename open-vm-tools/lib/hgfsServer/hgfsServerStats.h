@@ -0,0 +1,64 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsServerStats.h --
+ *
+ *    Per operation and per share request statistics of the HGFS server:
+ *    request, error and byte counters and a log2 bucketed latency histogram.
+ *
+ *    Counters are kept in per thread slots and summed up when read, so that
+ *    recording a request only touches cache lines of the calling thread.
+ *    The share of a request is whichever share the request first resolved
+ *    a name or a handle in, see HgfsServerStats_SetShare. It is kept with
+ *    the request and passed to HgfsServerStats_RequestDone, which may run
+ *    on another thread. The report also
+ *    has the data packet byte counters of HSPU_GetDataPacketStats.
+ */
+
+#ifndef _HGFS_SERVER_STATS_H_
+#define _HGFS_SERVER_STATS_H_
+
+#include "vm_basic_types.h"
+#include "hgfsProto.h"
+
+/*
+ * Latency histogram buckets: bucket 0 counts requests that took less than
+ * 1us, bucket n those that took [2^(n-1), 2^n) us and the last bucket all
+ * requests that took 2^(HGFS_STATS_NUM_BUCKETS - 2) us (~4s) or longer.
+ */
+#define HGFS_STATS_NUM_BUCKETS         24
+
+/* Interval of the periodic dump of the statistics to the log. */
+#define HGFS_STATS_LOG_INTERVAL_SEC    600
+
+/* Counters of a share, opaque. */
+typedef struct HgfsStatsShare HgfsStatsShare;
+
+void HgfsServerStats_Init(void);
+void HgfsServerStats_Exit(void);
+void HgfsServerStats_BeginRequest(HgfsStatsShare **share);
+void HgfsServerStats_EndRequest(HgfsStatsShare **share);
+void HgfsServerStats_SetShare(const char *shareName, size_t shareNameLen);
+void HgfsServerStats_RequestDone(HgfsOp op, HgfsStatsShare *share,
+                                 Bool failed, uint64 startNS,
+                                 uint64 bytesIn, uint64 bytesOut);
+char *HgfsServerStats_GetReport(void);
+void HgfsServerStats_Log(void);
+
+#endif // _HGFS_SERVER_STATS_H_
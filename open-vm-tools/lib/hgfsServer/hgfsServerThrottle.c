@@ -0,0 +1,414 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsServerThrottle.c --
+ *
+ *    Per share throttling of the asynchronous data requests of the HGFS
+ *    server.
+ *
+ *    Each share has a token bucket for bytes and one for requests, kept as
+ *    the time at which the bucket is empty again: a request is charged when
+ *    it is received, by pushing that time forward by what it costs at the
+ *    configured rate, and is delayed until the time has come back within
+ *    HGFS_THROTTLE_BURST_MS of the present. Requests are never refused: a
+ *    share going over its limits is slowed down to them, its requests being
+ *    run by the threadpool once their delay expires.
+ *
+ *    Every request is charged to the buckets of the whole share, which
+ *    decide the delay of bulk requests. The other requests are also charged
+ *    to buckets of their own which alone decide their delay: they count
+ *    towards the limits of the share, but do not queue behind its bulk
+ *    transfers.
+ */
+
+#include <string.h>
+
+#include "vmware.h"
+#include "dynbuf.h"
+#include "hashTable.h"
+#include "hostinfo.h"
+#include "strutil.h"
+#include "userlock.h"
+#include "util.h"
+#include "mutexRankLib.h"
+#include "hgfsServerThrottle.h"
+
+#define LOGLEVEL_MODULE hgfs
+#include "loglevel_user.h"
+
+/* Longest share name throttled, like the statistics. */
+#define HGFS_THROTTLE_SHARE_NAME_MAX   256
+
+typedef struct HgfsThrottleBuckets {
+   uint64 bytesEmptyNS;       /* When the byte bucket is empty again. */
+   uint64 requestsEmptyNS;    /* When the request bucket is empty again. */
+} HgfsThrottleBuckets;
+
+typedef struct HgfsThrottleShare {
+   HgfsThrottleBuckets all;       /* Buckets of all requests. */
+   HgfsThrottleBuckets nonBulk;   /* Buckets of the non bulk requests. */
+   uint64 requests;           /* Requests charged. */
+   uint64 bytes;              /* Bytes charged. */
+   uint64 bulkRequests;       /* Bulk requests charged. */
+   uint64 delayed;            /* Requests delayed. */
+   uint64 delayMs;            /* Sum of the delays of the requests. */
+} HgfsThrottleShare;
+
+typedef struct HgfsThrottleState {
+   MXUserExclLock *lock;      /* Protects the shares. */
+   HashTable *shares;         /* Share name -> HgfsThrottleShare. */
+   uint64 bytesPerSec;        /* Byte limit of each share, 0 for none. */
+   uint32 requestsPerSec;     /* Request limit of each share, 0 for none. */
+} HgfsThrottleState;
+
+static HgfsThrottleState *gHgfsThrottle = NULL;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThrottleCostNS --
+ *
+ *    Returns the time it takes to transfer an amount at a rate.
+ *
+ * Results:
+ *    The time in nanoseconds, 0 if the rate is not limited.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+HgfsThrottleCostNS(uint64 amount,   // IN: bytes or requests
+                   uint64 perSec)   // IN: rate, 0 for no limit
+{
+   if (0 == perSec) {
+      return 0;
+   }
+
+   /* Split the division so that large copies do not overflow. */
+   return amount / perSec * CONST64U(1000000000) +
+          amount % perSec * CONST64U(1000000000) / perSec;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThrottleBucketCharge --
+ *
+ *    Charges a token bucket with the cost of a request.
+ *
+ * Results:
+ *    The time the request has to wait for the bucket, in nanoseconds.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+HgfsThrottleBucketCharge(uint64 *emptyNS,  // IN/OUT: when the bucket empties
+                         uint64 costNS,    // IN: cost of the request
+                         uint64 nowNS)     // IN: current time
+{
+   uint64 burstNS = HGFS_THROTTLE_BURST_MS * CONST64U(1000000);
+
+   if (0 == costNS) {
+      return 0;
+   }
+
+   /* An idle bucket only refills up to the burst. */
+   *emptyNS = MAX(*emptyNS, nowNS - MIN(nowNS, burstNS)) + costNS;
+
+   return *emptyNS > nowNS ? *emptyNS - nowNS : 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThrottleBucketsCharge --
+ *
+ *    Charges the byte and request buckets with the costs of a request.
+ *
+ * Results:
+ *    The time the request has to wait for both buckets, in nanoseconds.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint64
+HgfsThrottleBucketsCharge(HgfsThrottleBuckets *buckets,  // IN/OUT: buckets
+                          uint64 bytesCostNS,            // IN: cost of bytes
+                          uint64 requestsCostNS,         // IN: cost of request
+                          uint64 nowNS)                  // IN: current time
+{
+   return MAX(HgfsThrottleBucketCharge(&buckets->bytesEmptyNS, bytesCostNS,
+                                       nowNS),
+              HgfsThrottleBucketCharge(&buckets->requestsEmptyNS,
+                                       requestsCostNS, nowNS));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThrottlePrintShare --
+ *
+ *    HashTable_ForEach callback appending the report line of a share.
+ *
+ * Results:
+ *    0 to continue the iteration.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsThrottlePrintShare(const char *shareName,  // IN: share name
+                       void *value,            // IN: share buckets
+                       void *clientData)       // IN/OUT: report
+{
+   HgfsThrottleShare *share = value;
+
+   StrUtil_SafeDynBufPrintf(clientData,
+                            "throttle %s requests %"FMT64"u bytes %"FMT64"u "
+                            "bulk %"FMT64"u delayed %"FMT64"u "
+                            "delayMs %"FMT64"u\n",
+                            shareName, share->requests, share->bytes,
+                            share->bulkRequests, share->delayed,
+                            share->delayMs);
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerThrottle_Init --
+ *
+ *    Starts throttling the shares to the given limits.
+ *
+ * Results:
+ *    TRUE if a limit is set, FALSE if there is nothing to throttle.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsServerThrottle_Init(uint64 bytesPerSec,     // IN: 0 for no limit
+                        uint32 requestsPerSec)  // IN: 0 for no limit
+{
+   HgfsThrottleState *throttle;
+
+   ASSERT(NULL == gHgfsThrottle);
+
+   if (0 == bytesPerSec && 0 == requestsPerSec) {
+      return FALSE;
+   }
+
+   throttle = Util_SafeCalloc(1, sizeof *throttle);
+   throttle->lock = MXUser_CreateExclLock("HgfsThrottleLock",
+                                          RANK_hgfsThrottleLock);
+   throttle->shares = HashTable_Alloc(64, HASH_STRING_KEY | HASH_FLAG_COPYKEY,
+                                      free);
+   throttle->bytesPerSec = bytesPerSec;
+   throttle->requestsPerSec = requestsPerSec;
+   gHgfsThrottle = throttle;
+
+   Log("%s: shares limited to %"FMT64"u bytes/s and %u requests/s\n",
+       __FUNCTION__, bytesPerSec, requestsPerSec);
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerThrottle_Exit --
+ *
+ *    Logs the throttle counters and stops throttling.
+ *
+ *    Must not be called while requests are being received.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsServerThrottle_Exit(void)
+{
+   HgfsThrottleState *throttle = gHgfsThrottle;
+   char *report;
+   char *line;
+   char *next;
+
+   if (NULL == throttle) {
+      return;
+   }
+
+   report = HgfsServerThrottle_GetReport();
+   for (line = report; *line != '\0'; line = next) {
+      next = strchr(line, '\n');
+      ASSERT(NULL != next);
+      *next++ = '\0';
+      Log("HGFS stats: %s\n", line);
+   }
+   free(report);
+
+   gHgfsThrottle = NULL;
+   HashTable_Free(throttle->shares);
+   MXUser_DestroyExclLock(throttle->lock);
+   free(throttle);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerThrottle_Charge --
+ *
+ *    Charges the buckets of a share with a data request. Bulk requests are
+ *    delayed by all the requests of the share, the others only by the other
+ *    non bulk requests.
+ *
+ * Results:
+ *    The delay in milliseconds after which the request may be processed, 0
+ *    if it is within the limits of the share or nothing is throttled.
+ *
+ * Side effects:
+ *    The buckets of the share are allocated the first time it is seen.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+uint32
+HgfsServerThrottle_Charge(const char *shareName,  // IN: share name
+                          size_t shareNameLen,    // IN: share name length
+                          uint64 bytes,           // IN: bytes of the request
+                          Bool bulk)              // IN: bulk transfer
+{
+   HgfsThrottleState *throttle = gHgfsThrottle;
+   char name[HGFS_THROTTLE_SHARE_NAME_MAX];
+   HgfsThrottleShare *share;
+   uint64 bytesCostNS;
+   uint64 requestsCostNS;
+   uint64 waitNS;
+   uint64 nowNS;
+   uint32 delayMs;
+
+   if (NULL == throttle || shareNameLen >= sizeof name) {
+      return 0;
+   }
+
+   memcpy(name, shareName, shareNameLen);
+   name[shareNameLen] = '\0';
+   bytesCostNS = HgfsThrottleCostNS(bytes, throttle->bytesPerSec);
+   requestsCostNS = HgfsThrottleCostNS(1, throttle->requestsPerSec);
+   nowNS = Hostinfo_SystemTimerNS();
+
+   MXUser_AcquireExclLock(throttle->lock);
+
+   if (!HashTable_Lookup(throttle->shares, name, (void **)&share)) {
+      share = Util_SafeCalloc(1, sizeof *share);
+      HashTable_Insert(throttle->shares, name, share);
+   }
+
+   waitNS = HgfsThrottleBucketsCharge(&share->all, bytesCostNS,
+                                      requestsCostNS, nowNS);
+   if (!bulk) {
+      waitNS = HgfsThrottleBucketsCharge(&share->nonBulk, bytesCostNS,
+                                         requestsCostNS, nowNS);
+   }
+   delayMs = (uint32)MIN((waitNS + 999999) / 1000000, MAX_UINT32);
+
+   share->requests++;
+   share->bytes += bytes;
+   if (bulk) {
+      share->bulkRequests++;
+   }
+   if (0 != delayMs) {
+      share->delayed++;
+      share->delayMs += delayMs;
+   }
+
+   MXUser_ReleaseExclLock(throttle->lock);
+
+   if (0 != delayMs) {
+      LOG(4, "%s: share %s request of %"FMT64"u bytes delayed %ums\n",
+          __FUNCTION__, name, bytes, delayMs);
+   }
+
+   return delayMs;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsServerThrottle_GetReport --
+ *
+ *    Formats the throttle counters of all shares that have been charged,
+ *    one line each.
+ *
+ * Results:
+ *    The report, to be freed by the caller, or NULL if nothing is
+ *    throttled.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+char *
+HgfsServerThrottle_GetReport(void)
+{
+   HgfsThrottleState *throttle = gHgfsThrottle;
+   DynBuf buf;
+
+   if (NULL == throttle) {
+      return NULL;
+   }
+
+   DynBuf_Init(&buf);
+   MXUser_AcquireExclLock(throttle->lock);
+   HashTable_ForEach(throttle->shares, HgfsThrottlePrintShare, &buf);
+   MXUser_ReleaseExclLock(throttle->lock);
+
+   return DynBuf_DetachString(&buf);
+}
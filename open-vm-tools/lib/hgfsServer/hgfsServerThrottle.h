@@ -0,0 +1,48 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsServerThrottle.h --
+ *
+ *    Per share throttling of the asynchronous data requests of the HGFS
+ *    server: token buckets limiting the bytes and the requests per second
+ *    of each share, and counters of the requests they delayed.
+ *
+ *    Bulk requests are charged to the share alone; the other requests are
+ *    also charged to buckets of their own, which alone decide their delay,
+ *    so that they do not wait behind the bulk transfers of their share.
+ */
+
+#ifndef _HGFS_SERVER_THROTTLE_H_
+#define _HGFS_SERVER_THROTTLE_H_
+
+#include "vm_basic_types.h"
+
+/*
+ * Depth of the token buckets: a share which has been idle may transfer up
+ * to this many milliseconds worth of its limits without being delayed.
+ */
+#define HGFS_THROTTLE_BURST_MS         250
+
+Bool HgfsServerThrottle_Init(uint64 bytesPerSec, uint32 requestsPerSec);
+void HgfsServerThrottle_Exit(void);
+uint32 HgfsServerThrottle_Charge(const char *shareName, size_t shareNameLen,
+                                 uint64 bytes, Bool bulk);
+char *HgfsServerThrottle_GetReport(void);
+
+#endif // _HGFS_SERVER_THROTTLE_H_
@@ -36,6 +36,17 @@
  */
 #define HGFS_THREADPOOL_MAX_COUNT 10
 
+/*
+ * Number of worker threads bulk work items cannot run on, so that the other
+ * work items do not wait for a worker behind them.
+ */
+#define HGFS_THREADPOOL_RESERVED_COUNT 2
+
+/*
+ * Work items queued with this order key are not serialized with any other.
+ */
+#define HGFS_THREADPOOL_NO_ORDER_KEY 0
+
 typedef void(*HgfsThreadpoolWorkItem)(void *data);
 
 HgfsInternalStatus HgfsThreadpool_Init(void);
@@ -45,5 +56,16 @@ void HgfsThreadpool_Deactivate(void);
 
 void HgfsThreadpool_Exit(void);
 Bool HgfsThreadpool_QueueWorkItem(HgfsThreadpoolWorkItem workItem, void *data);
+Bool HgfsThreadpool_QueueOrderedWorkItem(HgfsThreadpoolWorkItem workItem,
+                                         uint64 orderKey,
+                                         void *data);
+Bool HgfsThreadpool_QueueThrottledWorkItem(HgfsThreadpoolWorkItem workItem,
+                                           uint64 orderKey,
+                                           uint32 delayMs,
+                                           Bool bulk,
+                                           void *data);
+Bool HgfsThreadpool_QueueDelayedWorkItem(HgfsThreadpoolWorkItem workItem,
+                                         uint32 delayMs,
+                                         void *data);
 
 #endif // _HGFS_THREADPOOL_H
@@ -0,0 +1,934 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsThreadpoolLinux.c --
+ *
+ *	Threadpool support for the Linux platform.
+ *
+ *	Work items are run by up to HGFS_THREADPOOL_MAX_COUNT worker threads
+ *	which are created on demand. Work items queued with the same order key
+ *	(e.g. requests for the same file handle) are run one at a time in the
+ *	order they were queued, items with different keys run in parallel.
+ *	Delayed work items are run by an idle worker once their delay expires.
+ *
+ *	Bulk work items (e.g. large data transfers) are only run once no other
+ *	item is ready, and by at most HGFS_THREADPOOL_MAX_COUNT -
+ *	HGFS_THREADPOOL_RESERVED_COUNT workers at a time, so that the other
+ *	items never wait for a worker behind a stream of bulk ones. Throttled
+ *	work items are delayed like delayed items while keeping their order,
+ *	their delay is dropped when the threadpool is deactivated.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "vmware.h"
+#include "vm_basic_types.h"
+#include "util.h"
+#include "userlock.h"
+#include "mutexRankLib.h"
+#include "hostinfo.h"
+
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsServerInt.h"
+#include "hgfsThreadpool.h"
+
+
+/*
+ * Local data
+ */
+
+/* Number of buckets of the order key table, a power of 2. */
+#define HGFS_THREADPOOL_KEY_TABLE_SIZE 256
+
+/*
+ * A queued work item.
+ */
+typedef struct HgfsThreadpoolItem {
+   DblLnkLst_Links links;
+   HgfsThreadpoolWorkItem workItem;
+   void *data;
+   uint64 orderKey;
+   uint64 deadlineNS;     /* Delayed items: when the item becomes ready. */
+   Bool bulk;             /* Run after the other ready items. */
+   Bool throttled;        /* The delay is dropped when deactivating. */
+} HgfsThreadpoolItem;
+
+/*
+ * Serialization state of an order key. It exists while an item with the key
+ * is queued or running: the first such item is on the ready queue or being
+ * run, the following ones wait on the pending list.
+ */
+typedef struct HgfsThreadpoolKey {
+   DblLnkLst_Links links;             /* Bucket of the key table. */
+   uint64 orderKey;
+   DblLnkLst_Links pendingList;
+} HgfsThreadpoolKey;
+
+typedef struct HgfsThreadpoolState {
+   MXUserExclLock *lock;
+   MXUserCondVar *workAvailable;      /* Signalled when an item is ready. */
+   MXUserCondVar *workDone;           /* Broadcast when an item completes. */
+   DblLnkLst_Links readyList;         /* Items ready to be run. */
+   DblLnkLst_Links bulkList;          /* Bulk items ready to be run. */
+   DblLnkLst_Links delayedList;       /* Delayed items, by deadline. */
+   /* Order keys in flight, hashed on the full 64 bit key. */
+   DblLnkLst_Links keyTable[HGFS_THREADPOOL_KEY_TABLE_SIZE];
+   pthread_t threads[HGFS_THREADPOOL_MAX_COUNT];
+   uint32 numThreads;                 /* Number of worker threads created. */
+   uint32 numIdle;                    /* Number of workers waiting for items. */
+   uint32 numRunning;                 /* Number of items being run. */
+   uint32 numRunningBulk;             /* Number of bulk items being run. */
+   uint32 numDrainingWorkers;         /* Workers blocked in Deactivate. */
+   uint32 numDeactivating;            /* Threads in Deactivate. */
+   Bool exiting;                      /* Workers should terminate. */
+} HgfsThreadpoolState;
+
+static HgfsThreadpoolState *gHgfsThreadpool = NULL;
+
+/* Set in the worker threads, used to avoid waiting on ourselves. */
+static __thread Bool gHgfsThreadpoolIsWorker = FALSE;
+
+
+/*
+ * Local functions
+ */
+
+static void *HgfsThreadpoolWorker(void *data);
+static void HgfsThreadpoolPromoteDelayed(HgfsThreadpoolState *pool,
+                                         uint64 nowNS);
+static void HgfsThreadpoolLinkReady(HgfsThreadpoolState *pool,
+                                    HgfsThreadpoolItem *item);
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpoolKeyBucket --
+ *
+ *    Get the bucket of the key table holding an order key. Keys are 64 bits
+ *    on all hosts, both halves are folded into the hash.
+ *
+ * Results:
+ *    The bucket list.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static DblLnkLst_Links *
+HgfsThreadpoolKeyBucket(HgfsThreadpoolState *pool, // IN
+                        uint64 orderKey)           // IN
+{
+   uint32 hash = (uint32)(orderKey ^ (orderKey >> 32));
+
+   return &pool->keyTable[hash & (HGFS_THREADPOOL_KEY_TABLE_SIZE - 1)];
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpoolKeyLookup --
+ *
+ *    Find the serialization state of an order key. The pool lock must be
+ *    held.
+ *
+ * Results:
+ *    The key entry, NULL if no item with the key is in flight.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsThreadpoolKey *
+HgfsThreadpoolKeyLookup(HgfsThreadpoolState *pool, // IN
+                        uint64 orderKey)           // IN
+{
+   DblLnkLst_Links *bucket = HgfsThreadpoolKeyBucket(pool, orderKey);
+   DblLnkLst_Links *curr;
+
+   DblLnkLst_ForEach(curr, bucket) {
+      HgfsThreadpoolKey *key = DblLnkLst_Container(curr, HgfsThreadpoolKey,
+                                                   links);
+
+      if (key->orderKey == orderKey) {
+         return key;
+      }
+   }
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpoolKeyFree --
+ *
+ *    Remove an order key entry from the key table and free it. The pool
+ *    lock must be held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsThreadpoolKeyFree(HgfsThreadpoolKey *key) // IN
+{
+   ASSERT(!DblLnkLst_IsLinked(&key->pendingList));
+   DblLnkLst_Unlink1(&key->links);
+   free(key);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpool_Init --
+ *
+ *    Initialization of the threadpool component.
+ *
+ * Results:
+ *    0 if success, error code otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsThreadpool_Init(void)
+{
+   HgfsThreadpoolState *pool;
+   uint32 i;
+
+   if (NULL != gHgfsThreadpool) {
+      return HGFS_ERROR_SUCCESS;
+   }
+
+   pool = Util_SafeCalloc(1, sizeof *pool);
+   pool->lock = MXUser_CreateExclLock("HgfsThreadpoolLock",
+                                      RANK_hgfsThreadpoolLock);
+   pool->workAvailable = MXUser_CreateCondVarExclLock(pool->lock);
+   pool->workDone = MXUser_CreateCondVarExclLock(pool->lock);
+   DblLnkLst_Init(&pool->readyList);
+   DblLnkLst_Init(&pool->bulkList);
+   DblLnkLst_Init(&pool->delayedList);
+   for (i = 0; i < ARRAYSIZE(pool->keyTable); i++) {
+      DblLnkLst_Init(&pool->keyTable[i]);
+   }
+   gHgfsThreadpool = pool;
+
+   LOG(4, "%s: threadpool initialized\n", __FUNCTION__);
+
+   return HGFS_ERROR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpool_Activate --
+ *
+ *    Activate the threadpool. Worker threads are created on demand when
+ *    work items are queued.
+ *
+ * Results:
+ *    TRUE if the threadpool can accept work items, FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsThreadpool_Activate(void)
+{
+   Bool active;
+
+   if (NULL == gHgfsThreadpool) {
+      return FALSE;
+   }
+
+   MXUser_AcquireExclLock(gHgfsThreadpool->lock);
+   active = !gHgfsThreadpool->exiting;
+   MXUser_ReleaseExclLock(gHgfsThreadpool->lock);
+
+   return active;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpool_Deactivate --
+ *
+ *    Deactivate the threadpool: wait until all the queued work items are
+ *    done. Work items queued by the calling worker thread itself are not
+ *    waited for, so this can be safely called from a work item. Delayed
+ *    work items are not waited for either, throttled ones are run without
+ *    waiting for their delay to expire.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsThreadpool_Deactivate(void)
+{
+   HgfsThreadpoolState *pool = gHgfsThreadpool;
+   DblLnkLst_Links *curr;
+   DblLnkLst_Links *next;
+
+   if (NULL == pool) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(pool->lock);
+   if (gHgfsThreadpoolIsWorker) {
+      pool->numDrainingWorkers++;
+   }
+
+   /* No item is throttled from now on, see HgfsThreadpoolSchedule. */
+   pool->numDeactivating++;
+   DblLnkLst_ForEachSafe(curr, next, &pool->delayedList) {
+      HgfsThreadpoolItem *item = DblLnkLst_Container(curr, HgfsThreadpoolItem,
+                                                     links);
+
+      if (item->throttled) {
+         DblLnkLst_Unlink1(curr);
+         HgfsThreadpoolLinkReady(pool, item);
+      }
+   }
+
+   while (   (   (   DblLnkLst_IsLinked(&pool->readyList)
+                  || DblLnkLst_IsLinked(&pool->bulkList))
+              && pool->numThreads > pool->numDrainingWorkers)
+          || pool->numRunning > pool->numDrainingWorkers) {
+      MXUser_WaitCondVarExclLock(pool->lock, pool->workDone);
+   }
+
+   pool->numDeactivating--;
+   if (gHgfsThreadpoolIsWorker) {
+      pool->numDrainingWorkers--;
+   }
+   MXUser_ReleaseExclLock(pool->lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpool_Exit --
+ *
+ *    Exit for the threadpool component: stop the worker threads once the
+ *    queued work items are done and free the threadpool. Delayed work items
+ *    are run without waiting for their delay to expire.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+HgfsThreadpool_Exit(void)
+{
+   HgfsThreadpoolState *pool = gHgfsThreadpool;
+   uint32 i;
+
+   if (NULL == pool) {
+      return;
+   }
+
+   ASSERT(!gHgfsThreadpoolIsWorker);
+
+   HgfsThreadpool_Deactivate();
+
+   MXUser_AcquireExclLock(pool->lock);
+   HgfsThreadpoolPromoteDelayed(pool, MAX_UINT64);
+   pool->exiting = TRUE;
+   MXUser_BroadcastCondVar(pool->workAvailable);
+   MXUser_ReleaseExclLock(pool->lock);
+
+   for (i = 0; i < pool->numThreads; i++) {
+      pthread_join(pool->threads[i], NULL);
+   }
+
+   gHgfsThreadpool = NULL;
+
+   ASSERT(!DblLnkLst_IsLinked(&pool->readyList));
+   ASSERT(!DblLnkLst_IsLinked(&pool->bulkList));
+   ASSERT(!DblLnkLst_IsLinked(&pool->delayedList));
+   for (i = 0; i < ARRAYSIZE(pool->keyTable); i++) {
+      ASSERT(!DblLnkLst_IsLinked(&pool->keyTable[i]));
+   }
+   MXUser_DestroyCondVar(pool->workAvailable);
+   MXUser_DestroyCondVar(pool->workDone);
+   MXUser_DestroyExclLock(pool->lock);
+   free(pool);
+
+   LOG(4, "%s: threadpool exited\n", __FUNCTION__);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpoolStartWorker --
+ *
+ *    Create a new worker thread if all the existing ones are busy and the
+ *    maximum has not been reached yet.
+ *
+ *    The threadpool lock should be acquired prior to calling this function.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    May create a thread.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsThreadpoolStartWorker(HgfsThreadpoolState *pool) // IN: threadpool
+{
+   int error;
+
+   if (pool->numIdle > 0 || pool->numThreads >= HGFS_THREADPOOL_MAX_COUNT) {
+      return;
+   }
+
+   error = pthread_create(&pool->threads[pool->numThreads], NULL,
+                          HgfsThreadpoolWorker, pool);
+   if (error != 0) {
+      Log("%s: failed to create worker thread: %d\n", __FUNCTION__, error);
+      return;
+   }
+
+   pool->numThreads++;
+   LOG(4, "%s: %u worker threads\n", __FUNCTION__, pool->numThreads);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpoolLinkReady --
+ *
+ *    Make a work item ready to be run.
+ *
+ *    The threadpool lock should be acquired prior to calling this function.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsThreadpoolLinkReady(HgfsThreadpoolState *pool,  // IN: threadpool
+                        HgfsThreadpoolItem *item)   // IN: unlinked item
+{
+   DblLnkLst_LinkLast(item->bulk ? &pool->bulkList : &pool->readyList,
+                      &item->links);
+   MXUser_SignalCondVar(pool->workAvailable);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpoolSchedule --
+ *
+ *    Make a work item ready to be run, or put it on the delayed list if its
+ *    deadline has not passed yet. Throttled items are not delayed while the
+ *    threadpool is being deactivated or exiting.
+ *
+ *    The threadpool lock should be acquired prior to calling this function.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsThreadpoolSchedule(HgfsThreadpoolState *pool,  // IN: threadpool
+                       HgfsThreadpoolItem *item,   // IN: unlinked item
+                       uint64 nowNS)               // IN: current time
+{
+   DblLnkLst_Links *prev;
+
+   if (   item->deadlineNS <= nowNS
+       || (item->throttled && (pool->numDeactivating > 0 || pool->exiting))) {
+      HgfsThreadpoolLinkReady(pool, item);
+      return;
+   }
+
+   /* Keep the list sorted, most items are queued with the same delay. */
+   for (prev = pool->delayedList.prev;
+        prev != &pool->delayedList;
+        prev = prev->prev) {
+      HgfsThreadpoolItem *prevItem = DblLnkLst_Container(prev,
+                                                         HgfsThreadpoolItem,
+                                                         links);
+      if (prevItem->deadlineNS <= item->deadlineNS) {
+         break;
+      }
+   }
+   DblLnkLst_Link(prev->next, &item->links);
+   if (pool->delayedList.next == &item->links) {
+      /* The earliest deadline changed, an idle worker must wait less. */
+      MXUser_SignalCondVar(pool->workAvailable);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpoolQueue --
+ *
+ *    Queue a work item. Items with the same order key are run one at a time
+ *    in the order they were queued, a delayed item holds back the items
+ *    queued after it with the same key.
+ *
+ * Results:
+ *    TRUE if the work item is queued successfully,
+ *    FALSE if the work item is not queued.
+ *
+ * Side effects:
+ *    May create a worker thread.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsThreadpoolQueue(HgfsThreadpoolWorkItem workItem, // IN
+                    uint64 orderKey,                 // IN
+                    uint32 delayMs,                  // IN: 0 for none
+                    Bool bulk,                       // IN
+                    Bool throttled,                  // IN
+                    void *data)                      // IN
+{
+   HgfsThreadpoolState *pool = gHgfsThreadpool;
+   HgfsThreadpoolItem *item;
+   HgfsThreadpoolKey *key;
+   uint64 nowNS;
+   Bool queued = FALSE;
+
+   if (NULL == pool) {
+      return FALSE;
+   }
+
+   nowNS = Hostinfo_SystemTimerNS();
+   item = Util_SafeMalloc(sizeof *item);
+   DblLnkLst_Init(&item->links);
+   item->workItem = workItem;
+   item->data = data;
+   item->orderKey = orderKey;
+   item->deadlineNS = delayMs == 0 ? 0 : nowNS + (uint64)delayMs * 1000000;
+   item->bulk = bulk;
+   item->throttled = throttled;
+
+   MXUser_AcquireExclLock(pool->lock);
+
+   if (pool->exiting) {
+      goto exit;
+   }
+
+   HgfsThreadpoolStartWorker(pool);
+   if (pool->numThreads == 0) {
+      goto exit;
+   }
+
+   key = orderKey == HGFS_THREADPOOL_NO_ORDER_KEY ? NULL :
+         HgfsThreadpoolKeyLookup(pool, orderKey);
+   if (NULL != key) {
+      /* An item with the same key is in flight, run this one after it. */
+      DblLnkLst_LinkLast(&key->pendingList, &item->links);
+   } else {
+      if (orderKey != HGFS_THREADPOOL_NO_ORDER_KEY) {
+         key = Util_SafeMalloc(sizeof *key);
+         DblLnkLst_Init(&key->links);
+         key->orderKey = orderKey;
+         DblLnkLst_Init(&key->pendingList);
+         DblLnkLst_LinkLast(HgfsThreadpoolKeyBucket(pool, orderKey),
+                            &key->links);
+      }
+      HgfsThreadpoolSchedule(pool, item, nowNS);
+   }
+   queued = TRUE;
+
+exit:
+   MXUser_ReleaseExclLock(pool->lock);
+   if (!queued) {
+      free(item);
+   }
+
+   return queued;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpool_QueueWorkItem --
+ *
+ *    Queue a work item which is not ordered with respect to any other.
+ *
+ * Results:
+ *    TRUE if the work item is queued successfully,
+ *    FALSE if the work item is not queued.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsThreadpool_QueueWorkItem(HgfsThreadpoolWorkItem workItem, // IN
+                             void *data)                      // IN
+{
+   return HgfsThreadpool_QueueOrderedWorkItem(workItem,
+                                              HGFS_THREADPOOL_NO_ORDER_KEY,
+                                              data);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpool_QueueOrderedWorkItem --
+ *
+ *    Queue a work item. Items with the same order key are run one at a time
+ *    in the order they were queued.
+ *
+ * Results:
+ *    TRUE if the work item is queued successfully,
+ *    FALSE if the work item is not queued.
+ *
+ * Side effects:
+ *    May create a worker thread.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsThreadpool_QueueOrderedWorkItem(HgfsThreadpoolWorkItem workItem, // IN
+                                    uint64 orderKey,                 // IN
+                                    void *data)                      // IN
+{
+   return HgfsThreadpoolQueue(workItem, orderKey, 0, FALSE, FALSE, data);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpool_QueueThrottledWorkItem --
+ *
+ *    Queue a work item like HgfsThreadpool_QueueOrderedWorkItem, to be run
+ *    once a delay has expired. A bulk item is only run once no other item
+ *    is ready and a worker is not reserved for the other items.
+ *
+ * Results:
+ *    TRUE if the work item is queued successfully,
+ *    FALSE if the work item is not queued.
+ *
+ * Side effects:
+ *    May create a worker thread.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsThreadpool_QueueThrottledWorkItem(HgfsThreadpoolWorkItem workItem, // IN
+                                      uint64 orderKey,                 // IN
+                                      uint32 delayMs,                  // IN
+                                      Bool bulk,                       // IN
+                                      void *data)                      // IN
+{
+   return HgfsThreadpoolQueue(workItem, orderKey, delayMs, bulk, TRUE, data);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpool_QueueDelayedWorkItem --
+ *
+ *    Queue a work item to be run once a delay has expired. Delayed items are
+ *    not ordered with respect to any other item.
+ *
+ * Results:
+ *    TRUE if the work item is queued successfully,
+ *    FALSE if the work item is not queued.
+ *
+ * Side effects:
+ *    May create a worker thread.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsThreadpool_QueueDelayedWorkItem(HgfsThreadpoolWorkItem workItem, // IN
+                                    uint32 delayMs,                  // IN
+                                    void *data)                      // IN
+{
+   return HgfsThreadpoolQueue(workItem, HGFS_THREADPOOL_NO_ORDER_KEY, delayMs,
+                              FALSE, FALSE, data);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpoolPromoteDelayed --
+ *
+ *    Make the delayed items whose deadline has passed ready to be run.
+ *
+ *    The threadpool lock should be acquired prior to calling this function.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsThreadpoolPromoteDelayed(HgfsThreadpoolState *pool,  // IN: threadpool
+                             uint64 nowNS)               // IN: current time
+{
+   while (DblLnkLst_IsLinked(&pool->delayedList)) {
+      DblLnkLst_Links *next = pool->delayedList.next;
+      HgfsThreadpoolItem *item = DblLnkLst_Container(next, HgfsThreadpoolItem,
+                                                     links);
+
+      if (item->deadlineNS > nowNS) {
+         break;
+      }
+      DblLnkLst_Unlink1(next);
+      HgfsThreadpoolLinkReady(pool, item);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpoolNextItem --
+ *
+ *    Take the next work item to run off the ready lists: the first item
+ *    which is not bulk, or else the first bulk item unless the workers not
+ *    reserved for the other items all run one already.
+ *
+ *    The threadpool lock should be acquired prior to calling this function.
+ *
+ * Results:
+ *    The item, NULL if there is none to run.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsThreadpoolItem *
+HgfsThreadpoolNextItem(HgfsThreadpoolState *pool)  // IN: threadpool
+{
+   DblLnkLst_Links *next;
+
+   if (DblLnkLst_IsLinked(&pool->readyList)) {
+      next = pool->readyList.next;
+   } else if (   DblLnkLst_IsLinked(&pool->bulkList)
+              && pool->numRunningBulk < HGFS_THREADPOOL_MAX_COUNT -
+                                        HGFS_THREADPOOL_RESERVED_COUNT) {
+      next = pool->bulkList.next;
+      pool->numRunningBulk++;
+   } else {
+      return NULL;
+   }
+
+   DblLnkLst_Unlink1(next);
+   pool->numRunning++;
+
+   return DblLnkLst_Container(next, HgfsThreadpoolItem, links);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpoolItemDone --
+ *
+ *    Bookkeeping once a work item has been run: schedule the next item with
+ *    the same order key, or release the key if there is none.
+ *
+ *    The threadpool lock should be acquired prior to calling this function.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsThreadpoolItemDone(HgfsThreadpoolState *pool,  // IN: threadpool
+                       uint64 orderKey,            // IN: key of the done item
+                       Bool bulk)                  // IN: the done item is bulk
+{
+   HgfsThreadpoolKey *key;
+
+   pool->numRunning--;
+   if (bulk) {
+      pool->numRunningBulk--;
+      if (DblLnkLst_IsLinked(&pool->bulkList)) {
+         /* A bulk item may have been held back for this one. */
+         MXUser_SignalCondVar(pool->workAvailable);
+      }
+   }
+
+   key = orderKey == HGFS_THREADPOOL_NO_ORDER_KEY ? NULL :
+         HgfsThreadpoolKeyLookup(pool, orderKey);
+   if (NULL != key) {
+      if (DblLnkLst_IsLinked(&key->pendingList)) {
+         DblLnkLst_Links *next = key->pendingList.next;
+
+         DblLnkLst_Unlink1(next);
+         HgfsThreadpoolSchedule(pool,
+                                DblLnkLst_Container(next, HgfsThreadpoolItem,
+                                                    links),
+                                Hostinfo_SystemTimerNS());
+      } else {
+         HgfsThreadpoolKeyFree(key);
+      }
+   }
+
+   MXUser_BroadcastCondVar(pool->workDone);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpoolWorker --
+ *
+ *    Worker thread main loop: run ready work items until the threadpool
+ *    exits.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HgfsThreadpoolWorker(void *data) // IN: threadpool
+{
+   HgfsThreadpoolState *pool = data;
+
+   gHgfsThreadpoolIsWorker = TRUE;
+
+   MXUser_AcquireExclLock(pool->lock);
+   for (;;) {
+      HgfsThreadpoolItem *item;
+      uint64 orderKey;
+      Bool bulk;
+
+      HgfsThreadpoolPromoteDelayed(pool, Hostinfo_SystemTimerNS());
+      while (   NULL == (item = HgfsThreadpoolNextItem(pool))
+             && (!pool->exiting || DblLnkLst_IsLinked(&pool->bulkList))) {
+         pool->numIdle++;
+         if (DblLnkLst_IsLinked(&pool->delayedList)) {
+            HgfsThreadpoolItem *first =
+               DblLnkLst_Container(pool->delayedList.next, HgfsThreadpoolItem,
+                                   links);
+            uint64 nowNS = Hostinfo_SystemTimerNS();
+
+            if (first->deadlineNS > nowNS) {
+               uint64 waitMs = (first->deadlineNS - nowNS + 999999) / 1000000;
+
+               MXUser_TimedWaitCondVarExclLock(pool->lock, pool->workAvailable,
+                                               (uint32)MIN(waitMs, MAX_UINT32));
+            }
+         } else {
+            MXUser_WaitCondVarExclLock(pool->lock, pool->workAvailable);
+         }
+         pool->numIdle--;
+         HgfsThreadpoolPromoteDelayed(pool, Hostinfo_SystemTimerNS());
+      }
+
+      if (NULL == item) {
+         /* Exiting and nothing left to do. */
+         break;
+      }
+      MXUser_ReleaseExclLock(pool->lock);
+
+      orderKey = item->orderKey;
+      bulk = item->bulk;
+      item->workItem(item->data);
+      free(item);
+
+      MXUser_AcquireExclLock(pool->lock);
+      HgfsThreadpoolItemDone(pool, orderKey, bulk);
+   }
+   MXUser_ReleaseExclLock(pool->lock);
+
+   return NULL;
+}
@@ -144,3 +144,84 @@ HgfsThreadpool_QueueWorkItem(HgfsThreadpoolWorkItem workItem, // IN
    return FALSE;
 }
 
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpool_QueueOrderedWorkItem --
+ *
+ *    Execute a work item, serialized with the items of the same order key.
+ *
+ * Results:
+ *    TRUE if the work item is queued successfully,
+ *    FALSE if the work item is not queued.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsThreadpool_QueueOrderedWorkItem(HgfsThreadpoolWorkItem workItem, // IN
+                                    uint64 orderKey,                 // IN
+                                    void *data)                      // IN
+{
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpool_QueueThrottledWorkItem --
+ *
+ *    Execute a work item once a delay has expired, serialized with the items
+ *    of the same order key.
+ *
+ * Results:
+ *    TRUE if the work item is queued successfully,
+ *    FALSE if the work item is not queued.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsThreadpool_QueueThrottledWorkItem(HgfsThreadpoolWorkItem workItem, // IN
+                                      uint64 orderKey,                 // IN
+                                      uint32 delayMs,                  // IN
+                                      Bool bulk,                       // IN
+                                      void *data)                      // IN
+{
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsThreadpool_QueueDelayedWorkItem --
+ *
+ *    Execute a work item once a delay has expired.
+ *
+ * Results:
+ *    TRUE if the work item is queued successfully,
+ *    FALSE if the work item is not queued.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsThreadpool_QueueDelayedWorkItem(HgfsThreadpoolWorkItem workItem, // IN
+                                    uint32 delayMs,                  // IN
+                                    void *data)                      // IN
+{
+   return FALSE;
+}
@@ -96,8 +96,16 @@ static HgfsChannelData gHgfsChannels[] = {
    { "guest", &gGuestBackdoorOps, 0, NULL, NULL, {0} },
 };
 
+/*
+ * The threadpool runs the delayed flushes of the write-behind buffers. The
+ * backdoor channel is synchronous, so requests themselves are never queued
+ * to it and never throttled.
+ */
 static HgfsServerConfig gHgfsGuestCfgSettings = {
-   (HGFS_CONFIG_SHARE_ALL_HOST_DRIVES_ENABLED | HGFS_CONFIG_VOL_INFO_MIN),
+   (HGFS_CONFIG_SHARE_ALL_HOST_DRIVES_ENABLED | HGFS_CONFIG_VOL_INFO_MIN |
+    HGFS_CONFIG_CACHE_ENABLED | HGFS_CONFIG_SEARCH_STREAMING_ENABLED |
+    HGFS_CONFIG_READ_AHEAD_ENABLED | HGFS_CONFIG_THREADPOOL_ENABLED |
+    HGFS_CONFIG_WRITE_BEHIND_ENABLED),
    HGFS_MAX_CACHED_FILENODES
 };
 
@@ -218,6 +218,33 @@ HgfsServerManager_InvalidateInactiveSessions(HgfsServerMgrData *mgrData)  // IN:
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsServerManager_GetStats --
+ *
+ *    Returns the request statistics of the HGFS server.
+ *
+ * Results:
+ *    The statistics, to be freed by the caller, or NULL if the server is
+ *    not running.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+char *
+HgfsServerManager_GetStats(HgfsServerMgrData *mgrData)  // IN: RpcIn channel
+{
+   ASSERT(mgrData);
+
+   Debug("%s: Get statistics for %s.\n", __FUNCTION__, mgrData->appName);
+   return HgfsServer_GetStats();
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -101,6 +101,15 @@
 #define HGFS_LEGACY_LARGE_IO_MAX       (HGFS_PAGE_SIZE * HGFS_LEGACY_LARGE_IO_MAX_PAGES)
 #define HGFS_LEGACY_LARGE_PACKET_MAX   (HGFS_LEGACY_LARGE_IO_MAX + HGFS_HEADER_SIZE_MAX)
 
+/*
+ * Maximum number of bytes to read or write in a single V4 request over a
+ * channel which passes data buffers as guest page mappings. Servers only
+ * negotiate sizes above HGFS_LARGE_PACKET_MAX with such channels.
+ */
+#define HGFS_HUGE_IO_MAX_PAGES 1024
+#define HGFS_HUGE_IO_MAX       (HGFS_PAGE_SIZE * HGFS_HUGE_IO_MAX_PAGES)
+#define HGFS_HUGE_PACKET_MAX   (HGFS_HUGE_IO_MAX + HGFS_HEADER_SIZE_MAX)
+
 static size_t gHgfsLargeIoMax = 0;
 static size_t gHgfsLargePacketMax = 0;
 
@@ -346,6 +355,12 @@ typedef enum {
 #define HGFS_SYNC_REQREP_CLIENT_CMD HGFS_SYNC_REQREP_CMD " "
 #define HGFS_SYNC_REQREP_CLIENT_CMD_LEN (sizeof HGFS_SYNC_REQREP_CLIENT_CMD - 1)
 
+/*
+ * RPC command returning the request statistics of the guest HGFS server:
+ * one line of counters and latency histogram per operation and per share.
+ */
+#define HGFS_STATS_CMD "hgfs.stats"
+
 /*
  * This is just for the sake of macro naming. Since we are guaranteed
  * equal command lengths, defining command length via a generalized macro name
@@ -146,6 +146,9 @@ typedef enum {
    HGFS_OP_UNLOCK_BYTE_RANGE_V4,  /* Release byte range lock. */
    HGFS_OP_QUERY_EAS_V4,          /* Query extended attributes. */
    HGFS_OP_SET_EAS_V4,            /* Add or modify extended attributes. */
+   HGFS_OP_COMPOUND_V4,           /* Chain of requests in one round trip. */
+   HGFS_OP_COPY_RANGE_V4,         /* Copy data between files on the host. */
+   HGFS_OP_QUERY_CHANGES_V4,      /* Query the change journal of a directory. */
 
    HGFS_OP_MAX,                   /* Dummy op, must be last in enum */
    HGFS_OP_NEW_HEADER = 0xff,     /* Header op, must be unique, distinguishes packet headers. */
@@ -2009,10 +2012,17 @@ typedef struct HgfsReplyOplockBreakV4 {
 #pragma pack(push, 1)
 typedef struct HgfsRequestFsyncV4 {
    HgfsHandle fid;      /* File to sync. */
-   uint64 reserved;
+   uint32 flags;        /* HGFS_FSYNC_* flags. */
+   uint32 reserved;
 } HgfsRequestFsyncV4;
 #pragma pack(pop)
 
+/*
+ * Only flush the data and the metadata needed to read it back, like
+ * fdatasync(2). Ignored for directories.
+ */
+#define HGFS_FSYNC_DATA_ONLY  (1 << 0)
+
 #pragma pack(push, 1)
 typedef struct HgfsReplyFsyncV4 {
    uint64 reserved;
@@ -2022,6 +2032,9 @@ typedef struct HgfsReplyFsyncV4 {
 /*
  * This request is name based only.
  * Server fails this request if HGFS_FILE_E_USE_FILE_DESC is set in the fileName.
+ * As fileName is of variable length, perms and reserved follow the name
+ * and its nul terminator, like the new name of a rename request.
+ * The status of the reply tells whether all the permissions are granted.
  */
 #pragma pack(push, 1)
 typedef struct HgfsRequestAccessCheckV4 {
@@ -2451,4 +2464,148 @@ typedef struct HgfsReplyDeleteFileV4 {
 } HgfsReplyDeleteFileV4;
 #pragma pack(pop)
 
+/*
+ * Compound request: an ordered chain of V4 session requests which the server
+ * executes in one round trip. The request is an HgfsRequestCompoundV4 followed
+ * by numRequests sub-requests, each an HgfsRequestCompoundEntryV4 followed by
+ * the requestSize bytes of the operation arguments, without a header.
+ *
+ * A sub-request can use the handle returned by the most recent open or search
+ * open of the chain: if HGFS_COMPOUND_FLAG_RELATED_HANDLE is set, the server
+ * stores that handle in the operation arguments at handleOffset before it
+ * executes the sub-request.
+ *
+ * Execution stops at the first sub-request that fails. The reply is an
+ * HgfsReplyCompoundV4 followed by numReplies replies, one per executed
+ * sub-request, each an HgfsReplyCompoundEntryV4 followed by the replySize
+ * bytes of the operation reply, without a header. The last reply holds the
+ * error of a failed chain.
+ *
+ * Requests which use the shared memory data packet, session requests and
+ * compound requests cannot be sub-requests.
+ */
+
+#define HGFS_COMPOUND_MAX_REQUESTS           32
+
+#define HGFS_COMPOUND_FLAG_RELATED_HANDLE    (1 << 0)
+
+#pragma pack(push, 1)
+typedef struct HgfsRequestCompoundEntryV4 {
+   HgfsOp op;                /* Sub-request operation. */
+   uint32 flags;             /* HGFS_COMPOUND_FLAG_xxx. */
+   uint32 handleOffset;      /* Offset of the handle in the arguments. */
+   uint32 requestSize;       /* Size of the arguments which follow. */
+   uint64 reserved;          /* Reserved for future use. */
+} HgfsRequestCompoundEntryV4;
+#pragma pack(pop)
+
+#pragma pack(push, 1)
+typedef struct HgfsRequestCompoundV4 {
+   uint32 numRequests;       /* Number of sub-requests which follow. */
+   uint32 flags;             /* Reserved for future use. */
+   uint64 reserved;          /* Reserved for future use. */
+} HgfsRequestCompoundV4;
+#pragma pack(pop)
+
+#pragma pack(push, 1)
+typedef struct HgfsReplyCompoundEntryV4 {
+   HgfsOp op;                /* Sub-request operation. */
+   HgfsStatus status;        /* Sub-request status. */
+   uint32 replySize;         /* Size of the reply which follows. */
+   uint32 reserved;          /* Reserved for future use. */
+} HgfsReplyCompoundEntryV4;
+#pragma pack(pop)
+
+#pragma pack(push, 1)
+typedef struct HgfsReplyCompoundV4 {
+   uint32 numReplies;        /* Number of sub-request replies which follow. */
+   uint32 flags;             /* Reserved for future use. */
+   uint64 reserved;          /* Reserved for future use. */
+} HgfsReplyCompoundV4;
+#pragma pack(pop)
+
+/*
+ * Copy range request: copies length bytes at srcOffset of the file open as
+ * srcFile to dstOffset of the file open as dstFile. The data is copied on the
+ * host and does not cross to the client. The host copies at most
+ * HGFS_COPY_RANGE_MAX bytes per request and stops at the end of the source
+ * file, the reply has the number of bytes copied and the client sends another
+ * request for the rest. HGFS_COPY_RANGE_CLONED is set in the reply if the
+ * destination shares the blocks of the source instead of having a copy.
+ *
+ * The ranges of a copy within a file must not overlap.
+ */
+
+#define HGFS_COPY_RANGE_MAX                  (256 * 1024 * 1024)
+
+#define HGFS_COPY_RANGE_CLONED               (1 << 0)
+
+#pragma pack(push, 1)
+typedef struct HgfsRequestCopyRangeV4 {
+   HgfsHandle srcFile;       /* Handle of the file to copy from. */
+   HgfsHandle dstFile;       /* Handle of the file to copy to. */
+   uint64 srcOffset;         /* Offset to copy from. */
+   uint64 dstOffset;         /* Offset to copy to. */
+   uint64 length;            /* Number of bytes to copy. */
+   uint32 flags;             /* Reserved for future use. */
+   uint32 reserved1;         /* Reserved for future use. */
+   uint64 reserved2;         /* Reserved for future use. */
+} HgfsRequestCopyRangeV4;
+#pragma pack(pop)
+
+#pragma pack(push, 1)
+typedef struct HgfsReplyCopyRangeV4 {
+   uint64 actualSize;        /* Number of bytes copied. */
+   uint32 flags;             /* HGFS_COPY_RANGE_xxx. */
+   uint32 reserved1;         /* Reserved for future use. */
+   uint64 reserved2;         /* Reserved for future use. */
+} HgfsReplyCopyRangeV4;
+#pragma pack(pop)
+
+/*
+ * Query changes request: returns the changes recorded in the change journal
+ * of a directory tree of a share, normally the share root, since a token.
+ * The server starts the journal on the first query of the directory. That
+ * query, and any query with a token the journal no longer covers because it
+ * overflowed or was restarted, gets HGFS_QUERY_CHANGES_RESYNC and the current
+ * token: the client must rescan the tree and then query the changes since
+ * that token.
+ *
+ * The change records follow the reply, each aligned to 8 bytes, and take at
+ * most maxReplySize bytes. Their names are full cross-platform names, like
+ * those of the notification events. HGFS_QUERY_CHANGES_MORE is set in the
+ * reply if more changes follow the returned token.
+ */
+
+#define HGFS_QUERY_CHANGES_RESYNC            (1 << 0)
+#define HGFS_QUERY_CHANGES_MORE              (1 << 1)
+
+#pragma pack(push, 1)
+typedef struct HgfsRequestQueryChangesV4 {
+   uint64 token;             /* Return the changes since this token. */
+   uint32 maxReplySize;      /* Maximum size of the change records. */
+   uint32 flags;             /* Reserved for future use. */
+   uint64 reserved;          /* Reserved for future use. */
+   HgfsFileNameV3 fileName;  /* Directory of the journal. */
+} HgfsRequestQueryChangesV4;
+#pragma pack(pop)
+
+#pragma pack(push, 1)
+typedef struct HgfsChangeRecordV4 {
+   uint64 seq;               /* Sequence number of the change. */
+   uint32 nextOffset;        /* Offset of the next record, 0 if last. */
+   uint32 mask;              /* HGFS_NOTIFY_xxx events. */
+   HgfsFileName fileName;    /* Name of the changed file. */
+} HgfsChangeRecordV4;
+#pragma pack(pop)
+
+#pragma pack(push, 1)
+typedef struct HgfsReplyQueryChangesV4 {
+   uint64 token;             /* Token of the changes following these. */
+   uint32 flags;             /* HGFS_QUERY_CHANGES_xxx. */
+   uint32 count;             /* Number of change records which follow. */
+   uint64 reserved;          /* Reserved for future use. */
+} HgfsReplyQueryChangesV4;
+#pragma pack(pop)
+
 #endif /* _HGFS_PROTO_H_ */
@@ -127,10 +127,18 @@ typedef uint32 HgfsConfigFlags;
 #define HGFS_CONFIG_SHARE_ALL_HOST_DRIVES_ENABLED    (1 << 4)
 #define HGFS_CONFIG_THREADPOOL_ENABLED               (1 << 5)
 #define HGFS_CONFIG_OPLOCK_MONITOR_ENABLED           (1 << 6)
+#define HGFS_CONFIG_CACHE_ENABLED                    (1 << 7)
+#define HGFS_CONFIG_SEARCH_STREAMING_ENABLED         (1 << 8)
+#define HGFS_CONFIG_READ_AHEAD_ENABLED               (1 << 9)
+#define HGFS_CONFIG_WRITE_BEHIND_ENABLED             (1 << 10)
+#define HGFS_CONFIG_ASYNC_FILE_IO_ENABLED            (1 << 11)
 
 typedef struct HgfsServerConfig {
    HgfsConfigFlags flags;
    uint32 maxCachedOpenNodes;
+   uint32 writeBehindSize;        /* Per file handle, 0 for the default. */
+   uint64 shareBytesPerSec;       /* Data limit of each share, 0 for none. */
+   uint32 shareRequestsPerSec;    /* Data requests limit, 0 for none. */
 }HgfsServerConfig;
 
 /*
@@ -223,6 +231,8 @@ Bool HgfsServer_ShareAccessCheck(HgfsOpenMode accessMode,
 uint32 HgfsServer_GetHandleCounter(void);
 void HgfsServer_SetHandleCounter(uint32 newHandleCounter);
 
+char *HgfsServer_GetStats(void);
+
 #if defined(__cplusplus)
 }  // extern "C"
 #endif
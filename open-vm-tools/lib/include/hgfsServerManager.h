@@ -65,6 +65,7 @@ Bool HgfsServerManager_ProcessPacket(HgfsServerMgrData *mgrData,
                                      char *packetOut,
                                      size_t *packetOutSize);
 uint32 HgfsServerManager_InvalidateInactiveSessions(HgfsServerMgrData *mgrData);
+char *HgfsServerManager_GetStats(HgfsServerMgrData *mgrData);
 #endif
 
 #if defined(__cplusplus)
@@ -59,12 +59,20 @@ extern "C" {
  */
 #define RANK_hgfsSessionArrayLock    (RANK_libLockBase + 0x4010)
 #define RANK_hgfsSharedFolders       (RANK_libLockBase + 0x4030)
+#define RANK_hgfsShareIndexLock      (RANK_libLockBase + 0x4034)
 #define RANK_hgfsNotifyLock          (RANK_libLockBase + 0x4040)
 #define RANK_hgfsFileIOLock          (RANK_libLockBase + 0x4050)
 #define RANK_hgfsSearchArrayLock     (RANK_libLockBase + 0x4060)
 #define RANK_hgfsNodeArrayLock       (RANK_libLockBase + 0x4070)
+#define RANK_hgfsOplockLeaseLock     (RANK_libLockBase + 0x4072)
+#define RANK_hgfsReadAheadLock       (RANK_libLockBase + 0x4074)
+#define RANK_hgfsWriteBehindLock     (RANK_libLockBase + 0x4078)
 #define RANK_hgfsActivateLock        (RANK_libLockBase + 0x4080)
 #define RANK_hgfsThreadpoolLock      (RANK_libLockBase + 0x4090)
+#define RANK_hgfsCacheLock           (RANK_libLockBase + 0x40A0)
+#define RANK_hgfsCaseIndexLock       (RANK_libLockBase + 0x40B8)
+#define RANK_hgfsAsyncIoLock         (RANK_libLockBase + 0x40C0)
+#define RANK_hgfsThrottleLock        (RANK_libLockBase + 0x40C8)
 
 #define RANK_nfcLibAioCtxLock        (RANK_libLockBase + 0x4300)
 
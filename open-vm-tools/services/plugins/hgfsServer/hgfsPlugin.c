@@ -123,6 +123,32 @@ HgfsServerRpcDispatch(RpcInData *data)
 }
 
 
+/**
+ * Returns the request statistics of the HGFS server.
+ *
+ * @param[in]  data  RPC request data.
+ *
+ * @return TRUE on success, FALSE if the server is not running.
+ */
+
+static gboolean
+HgfsServerStatsRpc(RpcInData *data)
+{
+   HgfsServerMgrData *mgrData;
+   char *stats;
+
+   ASSERT(data->clientData != NULL);
+   mgrData = data->clientData;
+
+   stats = HgfsServerManager_GetStats(mgrData);
+   if (stats == NULL) {
+      return RPCIN_SETRETVALS(data, "HGFS server is not running", FALSE);
+   }
+
+   return RPCIN_SETRETVALSF(data, stats, TRUE);
+}
+
+
 /**
  * Sends the HGFS capability to the VMX.
  *
@@ -1133,7 +1159,8 @@ ToolsOnLoad(ToolsAppCtx *ctx)
 
    {
       RpcChannelCallback rpcs[] = {
-         { HGFS_SYNC_REQREP_CMD, HgfsServerRpcDispatch, mgrData, NULL, NULL, 0 }
+         { HGFS_SYNC_REQREP_CMD, HgfsServerRpcDispatch, mgrData, NULL, NULL, 0 },
+         { HGFS_STATS_CMD, HgfsServerStatsRpc, mgrData, NULL, NULL, 0 }
       };
       ToolsPluginSignalCb sigs[] = {
          { TOOLS_CORE_SIG_CAPABILITIES, HgfsServerCapReg, &regData },
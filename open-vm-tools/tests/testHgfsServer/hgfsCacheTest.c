@@ -0,0 +1,305 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsCacheTest.c --
+ *
+ *   Unit test for the HGFS server path cache (lib/hgfsServer/hgfsCache.c).
+ *   Checks LRU eviction, replacement, invalidation and removal, then runs
+ *   several threads against one cache and verifies that every entry was
+ *   released exactly once and that lookups never return another key's data.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "vm_basic_types.h"
+#include "vm_atomic.h"
+#include "hgfsCache.h"
+
+#define NUM_THREADS       8
+#define NUM_ITERATIONS    200000
+#define NUM_KEYS          (2 * HGFS_CACHE_MAX_ENTRIES)
+
+typedef struct TestData {
+   uint32 keyIndex;
+   uint32 check;
+} TestData;
+
+static Atomic_uint32 gRemoved;
+static Atomic_uint32 gAllocated;
+static Atomic_uint32 gInvalidated;
+static Atomic_uint32 gMismatches;
+static int gFailures;
+
+#define CHECK(_cond)                                                    \
+   do {                                                                 \
+      if (!(_cond)) {                                                   \
+         fprintf(stderr, "%s:%d: check failed: %s\n",                   \
+                 __FUNCTION__, __LINE__, #_cond);                       \
+         gFailures++;                                                   \
+      }                                                                 \
+   } while (0)
+
+
+static void
+TestRemoveCb(void *data)   // IN
+{
+   Atomic_Inc(&gRemoved);
+}
+
+
+static TestData *
+TestNewData(uint32 keyIndex)  // IN
+{
+   TestData *data = malloc(sizeof *data);
+
+   data->keyIndex = keyIndex;
+   data->check = ~keyIndex;
+   Atomic_Inc(&gAllocated);
+   return data;
+}
+
+
+static void
+TestKey(uint32 keyIndex,   // IN
+        char *buf,         // OUT
+        size_t bufSize)    // IN
+{
+   snprintf(buf, bufSize, "/share/dir%u/file%u", keyIndex % 7, keyIndex);
+}
+
+
+static void
+TestReset(void)
+{
+   Atomic_Write(&gRemoved, 0);
+   Atomic_Write(&gAllocated, 0);
+   Atomic_Write(&gInvalidated, 0);
+   Atomic_Write(&gMismatches, 0);
+}
+
+
+/*
+ * Fill the cache beyond its capacity and check that the least recently used
+ * entries are evicted, and that a lookup refreshes an entry.
+ */
+
+static void
+TestEviction(void)
+{
+   HgfsCache *cache = HgfsCache_Alloc(TestRemoveCb);
+   char key[64];
+   void *data;
+   uint32 i;
+
+   TestReset();
+
+   for (i = 0; i < HGFS_CACHE_MAX_ENTRIES; i++) {
+      TestKey(i, key, sizeof key);
+      HgfsCache_Put(cache, key, TestNewData(i));
+   }
+   CHECK(cache->numEntries == HGFS_CACHE_MAX_ENTRIES);
+   CHECK(Atomic_Read(&gRemoved) == 0);
+
+   /* Make key 0 the most recently used, key 1 is now the LRU entry. */
+   TestKey(0, key, sizeof key);
+   CHECK(HgfsCache_Get(cache, key, &data));
+
+   TestKey(HGFS_CACHE_MAX_ENTRIES, key, sizeof key);
+   HgfsCache_Put(cache, key, TestNewData(HGFS_CACHE_MAX_ENTRIES));
+   CHECK(cache->numEntries == HGFS_CACHE_MAX_ENTRIES);
+   CHECK(Atomic_Read(&gRemoved) == 1);
+
+   TestKey(0, key, sizeof key);
+   CHECK(HgfsCache_Get(cache, key, &data));
+   TestKey(1, key, sizeof key);
+   CHECK(!HgfsCache_Get(cache, key, &data));
+
+   /* Replacing an entry releases the old data. */
+   TestKey(2, key, sizeof key);
+   HgfsCache_Put(cache, key, TestNewData(2));
+   CHECK(cache->numEntries == HGFS_CACHE_MAX_ENTRIES);
+   CHECK(Atomic_Read(&gRemoved) == 2);
+
+   HgfsCache_Destroy(cache);
+   CHECK(Atomic_Read(&gRemoved) == Atomic_Read(&gAllocated));
+}
+
+
+/*
+ * Check invalidation, removal of a subtree and removal by predicate.
+ */
+
+static Bool
+TestMatchDir3(const char *key,      // IN
+              void *clientData)     // IN
+{
+   return strncmp(key, "/share/dir3/", 12) == 0;
+}
+
+
+static void
+TestInvalidation(void)
+{
+   HgfsCache *cache = HgfsCache_Alloc(TestRemoveCb);
+   static const char *keys[] = {
+      "/share/a", "/share/a/b", "/share/a/b/c", "/share/ab", "/share/b",
+   };
+   TestData copy;
+   char key[64];
+   void *data;
+   uint32 i;
+
+   TestReset();
+
+   for (i = 0; i < ARRAYSIZE(keys); i++) {
+      HgfsCache_Put(cache, keys[i], TestNewData(i));
+   }
+
+   CHECK(HgfsCache_GetCopy(cache, "/share/b", &copy, sizeof copy));
+   CHECK(copy.keyIndex == 4 && copy.check == ~4U);
+
+   /* Invalidate does not invoke the remove callback. */
+   CHECK(HgfsCache_Invalidate(cache, "/share/b"));
+   CHECK(!HgfsCache_Invalidate(cache, "/share/b"));
+   CHECK(!HgfsCache_Get(cache, "/share/b", &data));
+   CHECK(Atomic_Read(&gRemoved) == 0);
+
+   HgfsCache_Remove(cache, "/share/a/b", FALSE);
+   CHECK(Atomic_Read(&gRemoved) == 1);
+   CHECK(HgfsCache_Get(cache, "/share/a/b/c", &data));
+
+   HgfsCache_Remove(cache, "/share/a", TRUE);
+   CHECK(Atomic_Read(&gRemoved) == 3);
+   CHECK(!HgfsCache_Get(cache, "/share/a", &data));
+   CHECK(!HgfsCache_Get(cache, "/share/a/b/c", &data));
+   CHECK(HgfsCache_Get(cache, "/share/ab", &data));
+   CHECK(cache->numEntries == 1);
+
+   for (i = 0; i < 70; i++) {
+      TestKey(i, key, sizeof key);
+      HgfsCache_Put(cache, key, TestNewData(i));
+   }
+   HgfsCache_RemoveMatching(cache, TestMatchDir3, NULL);
+   CHECK(Atomic_Read(&gRemoved) == 13);
+   CHECK(cache->numEntries == 61);
+
+   HgfsCache_Destroy(cache);
+   CHECK(Atomic_Read(&gRemoved) + 1 == Atomic_Read(&gAllocated));
+}
+
+
+/*
+ * Hammer one cache from several threads.
+ */
+
+static void *
+TestWorker(void *clientData)   // IN
+{
+   HgfsCache *cache = clientData;
+   uint32 seed = (uint32)(uintptr_t)pthread_self();
+   char key[64];
+   uint32 i;
+
+   for (i = 0; i < NUM_ITERATIONS; i++) {
+      uint32 keyIndex;
+      TestData copy;
+
+      seed = seed * 1103515245 + 12345;
+      keyIndex = (seed >> 8) % NUM_KEYS;
+      TestKey(keyIndex, key, sizeof key);
+
+      switch ((seed >> 4) % 8) {
+      case 0:
+      case 1:
+      case 2:
+         HgfsCache_Put(cache, key, TestNewData(keyIndex));
+         break;
+      case 3:
+         if (HgfsCache_Invalidate(cache, key)) {
+            Atomic_Inc(&gInvalidated);
+         }
+         break;
+      case 4:
+         HgfsCache_Remove(cache, key, FALSE);
+         break;
+      case 5:
+         if (i % 64 == 0) {
+            snprintf(key, sizeof key, "/share/dir%u", keyIndex % 7);
+            HgfsCache_Remove(cache, key, TRUE);
+         }
+         break;
+      default:
+         if (HgfsCache_GetCopy(cache, key, &copy, sizeof copy) &&
+             (copy.keyIndex != keyIndex || copy.check != ~keyIndex)) {
+            Atomic_Inc(&gMismatches);
+         }
+         break;
+      }
+   }
+
+   return NULL;
+}
+
+
+static void
+TestConcurrency(void)
+{
+   HgfsCache *cache = HgfsCache_Alloc(TestRemoveCb);
+   pthread_t threads[NUM_THREADS];
+   uint32 i;
+
+   TestReset();
+
+   for (i = 0; i < NUM_THREADS; i++) {
+      CHECK(pthread_create(&threads[i], NULL, TestWorker, cache) == 0);
+   }
+   for (i = 0; i < NUM_THREADS; i++) {
+      pthread_join(threads[i], NULL);
+   }
+
+   CHECK(cache->numEntries <= HGFS_CACHE_MAX_ENTRIES);
+   CHECK(Atomic_Read(&gMismatches) == 0);
+
+   HgfsCache_Destroy(cache);
+
+   /* Every entry was released exactly once. */
+   CHECK(Atomic_Read(&gRemoved) + Atomic_Read(&gInvalidated) ==
+         Atomic_Read(&gAllocated));
+}
+
+
+int
+main(int argc,       // IN
+     char **argv)    // IN
+{
+   TestEviction();
+   TestInvalidation();
+   TestConcurrency();
+
+   if (gFailures != 0) {
+      fprintf(stderr, "%s: %d check(s) failed\n", argv[0], gFailures);
+      return EXIT_FAILURE;
+   }
+
+   printf("%s: all tests passed\n", argv[0]);
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,351 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsCompoundTest.c --
+ *
+ *   Test of HGFS compound requests through a loopback channel. Sends an
+ *   open, read and close chain using the related handle, then a chain
+ *   whose replies overflow the compound reply at an open, and checks the
+ *   replies and that no file stays open on the server after the chains.
+ *
+ *   Usage: vmware-testhgfscompound [-d directory]
+ */
+
+#include <dirent.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vmware.h"
+#include "hgfs.h"
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsTestClient.h"
+
+#define NUM_FILES            2
+#define FILE_SIZE            (2 * HGFS_LARGE_IO_MAX)
+#define READ_SIZE            4096
+
+#define TEST_CONFIG_FLAGS (HGFS_CONFIG_SHARE_ALL_HOST_DRIVES_ENABLED | \
+                           HGFS_CONFIG_VOL_INFO_MIN)
+
+static char gDir[PATH_MAX];
+static uint32 gMaxPacketSize;
+
+
+/* Open file descriptors of the process, which includes the server. */
+
+static uint32
+TestCountFds(void)
+{
+   DIR *dir = opendir("/proc/self/fd");
+   uint32 count = 0;
+
+   if (dir == NULL) {
+      return 0;
+   }
+   while (readdir(dir) != NULL) {
+      count++;
+   }
+   closedir(dir);
+   return count;
+}
+
+
+/*
+ * Starts a sub-request entry at the end of a compound request and returns
+ * its zeroed arguments of argsSize bytes, which are finished by the caller.
+ * A related handle is stored at handleOffset unless it is -1.
+ */
+
+static void *
+TestSubRequest(char **next,           // IN/OUT: end of the request
+               HgfsOp op,             // IN
+               size_t argsSize,       // IN
+               int handleOffset)      // IN
+{
+   HgfsRequestCompoundEntryV4 *entry = (HgfsRequestCompoundEntryV4 *)*next;
+
+   memset(entry, 0, sizeof *entry + argsSize);
+   entry->op = op;
+   entry->requestSize = argsSize;
+   if (handleOffset >= 0) {
+      entry->flags = HGFS_COMPOUND_FLAG_RELATED_HANDLE;
+      entry->handleOffset = handleOffset;
+   }
+   *next += sizeof *entry + argsSize;
+   return entry + 1;
+}
+
+
+static void
+TestAddOpen(char **next,          // IN/OUT
+            uint32 fileIndex)     // IN
+{
+   HgfsRequestCompoundEntryV4 *entry = (HgfsRequestCompoundEntryV4 *)*next;
+   HgfsRequestOpenV3 *request;
+   char path[PATH_MAX];
+   size_t nameLen;
+
+   request = TestSubRequest(next, HGFS_OP_OPEN_V3, sizeof *request, -1);
+   request->mask = HGFS_OPEN_VALID_MODE | HGFS_OPEN_VALID_FLAGS |
+                   HGFS_OPEN_VALID_FILE_NAME;
+   request->mode = HGFS_OPEN_MODE_READ_ONLY;
+   request->flags = HGFS_OPEN;
+   HgfsTest_Path(path, "%s/file%u", gDir, fileIndex);
+   nameLen = HgfsTest_FileName(&request->fileName, path);
+
+   /* The name follows the fixed arguments. */
+   entry->requestSize += nameLen;
+   *next += nameLen;
+}
+
+
+static void
+TestAddRead(char **next,          // IN/OUT
+            uint32 size)          // IN
+{
+   HgfsRequestReadV3 *request;
+
+   request = TestSubRequest(next, HGFS_OP_READ_V3, sizeof *request,
+                            offsetof(HgfsRequestReadV3, file));
+   request->offset = 0;
+   request->requiredSize = size;
+}
+
+
+static void
+TestAddClose(char **next)         // IN/OUT
+{
+   TestSubRequest(next, HGFS_OP_CLOSE_V3, sizeof (HgfsRequestCloseV3),
+                  offsetof(HgfsRequestCloseV3, file));
+}
+
+
+/*
+ * Sends a compound request of numRequests sub-requests ending at next and
+ * returns its reply, NULL on failure.
+ */
+
+static HgfsReplyCompoundV4 *
+TestSendCompound(HgfsTestRequest *client,   // IN/OUT
+                 uint32 numRequests,        // IN
+                 const char *next)          // IN: end of the request
+{
+   HgfsRequestCompoundV4 *request = (HgfsRequestCompoundV4 *)
+      (client->request + sizeof (HgfsHeader));
+   HgfsReplyCompoundV4 *reply;
+   uint32 status;
+
+   request->numRequests = numRequests;
+   reply = HgfsTest_Send(client, next - (const char *)request, NULL, 0,
+                         &status);
+   CHECK(status == HGFS_STATUS_SUCCESS);
+   return status == HGFS_STATUS_SUCCESS ? reply : NULL;
+}
+
+
+/* Returns the index-th reply entry of a compound reply. */
+
+static HgfsReplyCompoundEntryV4 *
+TestReplyEntry(HgfsReplyCompoundV4 *reply,   // IN
+               uint32 index)                 // IN
+{
+   HgfsReplyCompoundEntryV4 *entry = (HgfsReplyCompoundEntryV4 *)(reply + 1);
+
+   while (index-- > 0) {
+      entry = (HgfsReplyCompoundEntryV4 *)((char *)(entry + 1) +
+                                           entry->replySize);
+   }
+   return entry;
+}
+
+
+/* Checks the data of a read reply of file0, which holds byte 1. */
+
+static void
+TestCheckRead(const HgfsReplyCompoundEntryV4 *entry,   // IN
+              uint32 size)                             // IN
+{
+   const HgfsReplyReadV3 *read = (const HgfsReplyReadV3 *)(entry + 1);
+   uint32 i;
+
+   CHECK(entry->op == HGFS_OP_READ_V3);
+   CHECK(entry->status == HGFS_STATUS_SUCCESS);
+   if (entry->status != HGFS_STATUS_SUCCESS) {
+      return;
+   }
+   CHECK(read->actualSize == size);
+   for (i = 0; i < read->actualSize; i++) {
+      if (read->payload[i] != 1) {
+         CHECK(read->payload[i] == 1);
+         break;
+      }
+   }
+}
+
+
+static void
+TestOpenReadClose(HgfsTestRequest *client)   // IN/OUT
+{
+   char *next;
+   HgfsReplyCompoundV4 *reply;
+   uint32 numFds = TestCountFds();
+
+   HgfsTest_RequestInit(client, HGFS_OP_COMPOUND_V4, HGFS_PACKET_FLAG_REQUEST);
+   next = client->request + sizeof (HgfsHeader) +
+          sizeof (HgfsRequestCompoundV4);
+   memset(client->request + sizeof (HgfsHeader), 0,
+          sizeof (HgfsRequestCompoundV4));
+   TestAddOpen(&next, 0);
+   TestAddRead(&next, READ_SIZE);
+   TestAddClose(&next);
+
+   reply = TestSendCompound(client, 3, next);
+   if (reply == NULL) {
+      return;
+   }
+   CHECK(reply->numReplies == 3);
+   if (reply->numReplies == 3) {
+      CHECK(TestReplyEntry(reply, 0)->status == HGFS_STATUS_SUCCESS);
+      TestCheckRead(TestReplyEntry(reply, 1), READ_SIZE);
+      CHECK(TestReplyEntry(reply, 2)->op == HGFS_OP_CLOSE_V3);
+      CHECK(TestReplyEntry(reply, 2)->status == HGFS_STATUS_SUCCESS);
+   }
+   CHECK(TestCountFds() == numFds);
+}
+
+
+/*
+ * The read leaves room for the error entry of the second open but not for
+ * its reply, which is dropped. The server must close the file it opened.
+ */
+
+static void
+TestOverflow(HgfsTestRequest *client)   // IN/OUT
+{
+   size_t entrySize = sizeof (HgfsReplyCompoundEntryV4);
+   size_t readSize = gMaxPacketSize - sizeof (HgfsHeader) -
+                     sizeof (HgfsReplyCompoundV4) -
+                     (entrySize + sizeof (HgfsReplyOpenV3)) -
+                     (entrySize + sizeof (HgfsReplyReadV3)) - entrySize;
+   uint32 numFds = TestCountFds();
+   HgfsReplyCompoundEntryV4 *entry;
+   HgfsReplyCompoundV4 *reply;
+   HgfsRequestCloseV3 *closeRequest;
+   uint32 status;
+   char *next;
+
+   HgfsTest_RequestInit(client, HGFS_OP_COMPOUND_V4, HGFS_PACKET_FLAG_REQUEST);
+   next = client->request + sizeof (HgfsHeader) +
+          sizeof (HgfsRequestCompoundV4);
+   memset(client->request + sizeof (HgfsHeader), 0,
+          sizeof (HgfsRequestCompoundV4));
+   TestAddOpen(&next, 0);
+   TestAddRead(&next, readSize);
+   TestAddOpen(&next, 1);
+   TestAddClose(&next);
+
+   reply = TestSendCompound(client, 4, next);
+   if (reply == NULL) {
+      return;
+   }
+   CHECK(reply->numReplies == 3);
+   if (reply->numReplies != 3) {
+      return;
+   }
+   TestCheckRead(TestReplyEntry(reply, 1), readSize);
+   entry = TestReplyEntry(reply, 2);
+   CHECK(entry->op == HGFS_OP_OPEN_V3);
+   CHECK(entry->status == HGFS_STATUS_GENERIC_ERROR);
+   CHECK(entry->replySize == 0);
+
+   /* Only the first file, whose handle the client knows, is left open. */
+   entry = TestReplyEntry(reply, 0);
+   CHECK(entry->status == HGFS_STATUS_SUCCESS);
+   if (entry->status == HGFS_STATUS_SUCCESS) {
+      HgfsHandle file = ((HgfsReplyOpenV3 *)(entry + 1))->file;
+
+      closeRequest = HgfsTest_RequestInit(client, HGFS_OP_CLOSE_V3,
+                                          HGFS_PACKET_FLAG_REQUEST);
+      memset(closeRequest, 0, sizeof *closeRequest);
+      closeRequest->file = file;
+      HgfsTest_Send(client, sizeof *closeRequest, NULL, 0, &status);
+      CHECK(status == HGFS_STATUS_SUCCESS);
+   }
+   CHECK(TestCountFds() == numFds);
+}
+
+
+int
+main(int argc,       // IN
+     char **argv)    // IN
+{
+   const char *parent = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+   HgfsServerConfig config;
+   HgfsReplyCreateSessionV4 *session;
+   HgfsTestRequest *client;
+   uint32 status;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "d:")) != -1) {
+      if (opt != 'd') {
+         fprintf(stderr, "Usage: %s [-d directory]\n", argv[0]);
+         return EXIT_FAILURE;
+      }
+      parent = optarg;
+   }
+
+   HgfsTest_Path(gDir, "%s/hgfscompound.XXXXXX", parent);
+   if (!HgfsTest_CreateDir(gDir, NUM_FILES, NULL, FILE_SIZE)) {
+      HgfsTest_RemoveDir(gDir, NUM_FILES, NULL);
+      return EXIT_FAILURE;
+   }
+
+   memset(&config, 0, sizeof config);
+   config.flags = TEST_CONFIG_FLAGS;
+   config.maxCachedOpenNodes = HGFS_MAX_CACHED_FILENODES;
+
+   client = HgfsTest_RequestAlloc(HGFS_LARGE_PACKET_MAX,
+                                  HGFS_LARGE_PACKET_MAX, 0);
+   if (!HgfsTest_Connect(&config, 0, HGFS_LARGE_PACKET_MAX, NULL)) {
+      HgfsTest_RequestFree(client);
+      HgfsTest_RemoveDir(gDir, NUM_FILES, NULL);
+      return EXIT_FAILURE;
+   }
+   session = HgfsTest_CreateSession(client, HGFS_LARGE_PACKET_MAX, 0,
+                                    &status);
+   CHECK(status == HGFS_STATUS_SUCCESS);
+
+   if (status == HGFS_STATUS_SUCCESS) {
+      gMaxPacketSize = session->maxPacketSize;
+      TestOpenReadClose(client);
+      TestOverflow(client);
+   }
+
+   CHECK(HgfsTest_Disconnect(client) == HGFS_STATUS_SUCCESS);
+   HgfsTest_RequestFree(client);
+   HgfsTest_RemoveDir(gDir, NUM_FILES, NULL);
+
+   printf("%u failures\n", Atomic_Read(&gHgfsTestFailures));
+   return Atomic_Read(&gHgfsTestFailures) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,301 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsNameFormCBench.c --
+ *
+ *   Micro-benchmark for the normalization of directory entry names.
+ *   Creates a synthetic directory with many entries, mostly ASCII names
+ *   plus some Latin, Cyrillic and decomposed names, reads it once, then
+ *   compares the time to check all of its names with the full validation
+ *   and normalization (the former HgfsConvertToUtf8FormC behavior) and
+ *   with the HgfsNameFormC_IsTrivial pre-scan in front of it
+ *   (lib/hgfsServer/hgfsNameFormC.c). Also checks that every name the
+ *   pre-scan accepts passes the full check unchanged.
+ *
+ *   Usage: vmware-benchhgfsnameformc [numEntries [iterations [directory]]]
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "vmware.h"
+#include "codeset.h"
+#include "unicode.h"
+#include "hgfsDentArena.h"
+#include "hgfsNameFormC.h"
+#include "hgfsTestClient.h"
+
+#define DEFAULT_NUM_ENTRIES   100000
+#define DEFAULT_ITERATIONS    20
+
+/* Same layout as the Linux DirectoryEntry of the HGFS server. */
+typedef struct DirectoryEntry {
+   uint64 d_ino;
+   uint64 d_off;
+   uint16 d_reclen;
+   uint8  d_type;
+   char   d_name[256];
+} DirectoryEntry;
+
+typedef struct BenchResult {
+   uint64 checkNs;
+   uint32 numNames;
+   uint32 numFull;     // Names given to the full check
+   uint32 numFailed;   // Names rejected by the full check
+} BenchResult;
+
+
+/*
+ * Name of the i-th entry: one in 50 is Latin-1, one in 100 Cyrillic and
+ * one in 200 has a decomposed accent, the rest are ASCII.
+ */
+
+static void
+BenchEntryName(char *name,         // OUT
+               size_t nameSize,    // IN
+               uint32 i)           // IN
+{
+   if (i % 200 == 7) {
+      snprintf(name, nameSize, "cafe\xCC\x81-%u.txt", i);
+   } else if (i % 100 == 3) {
+      snprintf(name, nameSize, "\xD1\x84\xD0\xB0\xD0\xB9\xD0\xBB-%u.txt", i);
+   } else if (i % 50 == 1) {
+      snprintf(name, nameSize, "caf\xC3\xA9-%u.txt", i);
+   } else {
+      /* Vary the name length like a real directory would. */
+      snprintf(name, nameSize, "file-%u%.*s", i, (int)(i % 32),
+               "_abcdefghijklmnopqrstuvwxyz01234");
+   }
+}
+
+
+/*
+ * The former HgfsConvertToUtf8FormC: full normalization on Mac hosts,
+ * UTF-8 validation elsewhere.
+ */
+
+static Bool
+BenchConvertFull(char *buffer,        // IN/OUT
+                 size_t bufferSize)   // IN
+{
+#if defined(__APPLE__)
+   size_t entryNameLen;
+   char *entryName = NULL;
+   Bool result;
+
+   if (CodeSet_Utf8FormDToUtf8FormC(buffer, bufferSize, &entryName,
+                                    &entryNameLen)) {
+      result = entryNameLen < bufferSize;
+      if (result) {
+         memcpy(buffer, entryName, entryNameLen + 1);
+      }
+      free(entryName);
+   } else {
+      result = FALSE;
+   }
+
+   return result;
+#else
+   size_t size;
+
+   for (size = 0; size < bufferSize; size++) {
+      if ('\0' == buffer[size]) {
+         break;
+      }
+   }
+
+   return Unicode_IsBufferValid(buffer, size, STRING_ENCODING_UTF8);
+#endif
+}
+
+
+static void
+BenchCheckNames(HgfsDentArena *dents,    // IN/OUT
+                Bool preScan,            // IN
+                BenchResult *result)     // OUT
+{
+   uint64 start = HgfsTest_NowNs();
+   uint32 i;
+
+   for (i = 0; i < dents->numDents; i++) {
+      DirectoryEntry *dent = HgfsDentArena_Get(dents, i);
+      size_t nameSize = dent->d_reclen - offsetof(DirectoryEntry, d_name);
+
+      if (preScan && HgfsNameFormC_IsTrivial(dent->d_name, nameSize)) {
+         continue;
+      }
+      result->numFull++;
+      if (!BenchConvertFull(dent->d_name, nameSize)) {
+         result->numFailed++;
+      }
+   }
+   result->checkNs += HgfsTest_NowNs() - start;
+   result->numNames = dents->numDents;
+}
+
+
+/*
+ * Every name accepted by the pre-scan must pass the full check unchanged.
+ */
+
+static uint32
+BenchVerify(const HgfsDentArena *dents)   // IN
+{
+   uint32 mismatches = 0;
+   uint32 i;
+
+   for (i = 0; i < dents->numDents; i++) {
+      DirectoryEntry *dent = HgfsDentArena_Get(dents, i);
+      size_t nameSize = dent->d_reclen - offsetof(DirectoryEntry, d_name);
+      char name[sizeof dent->d_name];
+
+      if (!HgfsNameFormC_IsTrivial(dent->d_name, nameSize)) {
+         continue;
+      }
+      memcpy(name, dent->d_name, nameSize);
+      if (!BenchConvertFull(name, nameSize) ||
+          strcmp(name, dent->d_name) != 0) {
+         fprintf(stderr, "pre-scan accepted \"%s\"\n", dent->d_name);
+         mismatches++;
+      }
+   }
+
+   return mismatches;
+}
+
+
+static Bool
+BenchReadDir(const char *dir,          // IN
+             HgfsDentArena *dents)     // OUT
+{
+   char buffer[8192];
+   long len;
+   int fd;
+
+   fd = open(dir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+   if (fd < 0) {
+      return FALSE;
+   }
+
+   while ((len = syscall(SYS_getdents64, fd, buffer, sizeof buffer)) > 0) {
+      long offset = 0;
+
+      while (offset < len) {
+         DirectoryEntry *dent = (DirectoryEntry *)(buffer + offset);
+         void *myDent = HgfsDentArena_Alloc(dents, dent->d_reclen);
+
+         if (NULL == myDent) {
+            abort();
+         }
+         memcpy(myDent, dent, dent->d_reclen);
+         offset += dent->d_reclen;
+      }
+   }
+   close(fd);
+
+   return len == 0;
+}
+
+
+static void
+BenchReport(const char *name,            // IN
+            const BenchResult *result,   // IN
+            uint32 iterations)           // IN
+{
+   HgfsTestPhase phases[] = {
+      { "check", result->checkNs },
+   };
+
+   HgfsTest_Report(name, result->numNames, "name", phases, ARRAYSIZE(phases),
+                   iterations);
+}
+
+
+int
+main(int argc,       // IN
+     char **argv)    // IN
+{
+   uint32 numEntries = argc > 1 ? strtoul(argv[1], NULL, 0) :
+                                  DEFAULT_NUM_ENTRIES;
+   uint32 iterations = argc > 2 ? strtoul(argv[2], NULL, 0) :
+                                  DEFAULT_ITERATIONS;
+   char dir[PATH_MAX];
+   HgfsDentArena dents;
+   BenchResult full = { 0 };
+   BenchResult preScan = { 0 };
+   uint32 mismatches;
+   Bool ok;
+   uint32 i;
+
+   if (argc > 3) {
+      HgfsTest_Path(dir, "%s", argv[3]);
+   } else {
+      HgfsTest_Path(dir, "/tmp/hgfsNameFormCBench.%d", (int)getpid());
+   }
+   if (0 == iterations) {
+      iterations = 1;
+   }
+
+   if (!HgfsTest_CreateDir(dir, numEntries, BenchEntryName, 0)) {
+      HgfsTest_RemoveDir(dir, numEntries, BenchEntryName);
+      return EXIT_FAILURE;
+   }
+
+   HgfsDentArena_Init(&dents);
+   ok = BenchReadDir(dir, &dents);
+   HgfsTest_RemoveDir(dir, numEntries, BenchEntryName);
+   if (!ok || 0 == dents.numDents) {
+      fprintf(stderr, "%s: reading %s failed\n", argv[0], dir);
+      HgfsDentArena_Free(&dents);
+      return EXIT_FAILURE;
+   }
+
+   /* Normalize the names once, so both variants see the same input. */
+   BenchCheckNames(&dents, FALSE, &full);
+   memset(&full, 0, sizeof full);
+
+   mismatches = BenchVerify(&dents);
+
+   /* Interleave the variants so they see the same system state. */
+   for (i = 0; i < iterations; i++) {
+      BenchCheckNames(&dents, FALSE, &full);
+      BenchCheckNames(&dents, TRUE, &preScan);
+   }
+   HgfsDentArena_Free(&dents);
+
+   BenchReport("full", &full, iterations);
+   BenchReport("pre-scan", &preScan, iterations);
+   printf("full checks  %u of %u names with the pre-scan\n",
+          preScan.numFull / iterations, preScan.numNames);
+   printf("speedup      %.2fx\n", (double)full.checkNs / preScan.checkNs);
+
+   if (mismatches != 0 || full.numFailed != preScan.numFailed) {
+      fprintf(stderr, "%s: %u names accepted by the pre-scan fail the full "
+              "check\n", argv[0], mismatches);
+      return EXIT_FAILURE;
+   }
+
+   return EXIT_SUCCESS;
+}
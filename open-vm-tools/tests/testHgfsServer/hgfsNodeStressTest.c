@@ -0,0 +1,272 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsNodeStressTest.c --
+ *
+ *   Stress test of the HGFS server file node array. Several threads send
+ *   mixed open, read and close requests on one session through a loopback
+ *   channel. The node cache is kept much smaller than the number of open
+ *   handles, so reads keep evicting and reopening nodes while other threads
+ *   look handles up. Checks that every read returns the data of the file
+ *   its handle was opened for and that closed handles are rejected.
+ *
+ *   Usage: vmware-testhgfsnodes [-d directory]
+ */
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vmware.h"
+#include "vm_atomic.h"
+#include "hgfs.h"
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsTestClient.h"
+
+#define NUM_THREADS          16
+#define NUM_ITERATIONS       20000
+#define NUM_FILES            32
+#define FILE_SIZE            (64 * 1024)
+#define READ_SIZE            512
+#define HANDLES_PER_THREAD   8
+#define MAX_CACHED_NODES     4
+
+#define TEST_CONFIG_FLAGS (HGFS_CONFIG_SHARE_ALL_HOST_DRIVES_ENABLED | \
+                           HGFS_CONFIG_VOL_INFO_MIN |                  \
+                           HGFS_CONFIG_CACHE_ENABLED |                 \
+                           HGFS_CONFIG_READ_AHEAD_ENABLED)
+
+/* Per thread request state. */
+typedef struct TestClient {
+   HgfsTestRequest *request;
+   unsigned int seed;
+   HgfsHandle handles[HANDLES_PER_THREAD];
+   uint32 files[HANDLES_PER_THREAD];
+} TestClient;
+
+static char gDir[PATH_MAX];
+
+static Atomic_uint32 gOpens;
+static Atomic_uint32 gReads;
+static Atomic_uint32 gCloses;
+
+
+static HgfsHandle
+TestOpen(TestClient *client,   // IN/OUT
+         uint32 fileIndex)     // IN
+{
+   HgfsRequestOpenV3 *request;
+   HgfsReplyOpenV3 *reply;
+   char path[PATH_MAX];
+   size_t nameLen;
+   uint32 status;
+
+   request = HgfsTest_RequestInit(client->request, HGFS_OP_OPEN_V3,
+                                  HGFS_PACKET_FLAG_REQUEST);
+
+   memset(request, 0, sizeof *request);
+   request->mask = HGFS_OPEN_VALID_MODE | HGFS_OPEN_VALID_FLAGS |
+                   HGFS_OPEN_VALID_FILE_NAME;
+   request->mode = HGFS_OPEN_MODE_READ_ONLY;
+   request->flags = HGFS_OPEN;
+   HgfsTest_Path(path, "%s/file%u", gDir, fileIndex);
+   nameLen = HgfsTest_FileName(&request->fileName, path);
+
+   reply = HgfsTest_Send(client->request, sizeof *request + nameLen, NULL, 0,
+                         &status);
+   CHECK(status == HGFS_STATUS_SUCCESS);
+   Atomic_Inc(&gOpens);
+   return status == HGFS_STATUS_SUCCESS ? reply->file : HGFS_INVALID_HANDLE;
+}
+
+
+/* Reads from the handle and checks the data belongs to fileIndex. */
+
+static uint32
+TestRead(TestClient *client,   // IN/OUT
+         HgfsHandle file,      // IN
+         uint32 fileIndex)     // IN
+{
+   HgfsRequestReadV3 *request;
+   HgfsReplyReadV3 *reply;
+   uint32 status;
+   uint32 offset = rand_r(&client->seed) % (FILE_SIZE / READ_SIZE) * READ_SIZE;
+
+   request = HgfsTest_RequestInit(client->request, HGFS_OP_READ_V3,
+                                  HGFS_PACKET_FLAG_REQUEST);
+
+   memset(request, 0, sizeof *request);
+   request->file = file;
+   request->offset = offset;
+   request->requiredSize = READ_SIZE;
+
+   reply = HgfsTest_Send(client->request, sizeof *request, NULL, 0, &status);
+   if (status == HGFS_STATUS_SUCCESS) {
+      uint32 i;
+
+      CHECK(reply->actualSize == READ_SIZE);
+      for (i = 0; i < reply->actualSize; i++) {
+         if ((uint8)reply->payload[i] != (uint8)(fileIndex + 1)) {
+            CHECK((uint8)reply->payload[i] == (uint8)(fileIndex + 1));
+            break;
+         }
+      }
+      Atomic_Inc(&gReads);
+   }
+   return status;
+}
+
+
+static void
+TestClose(TestClient *client,   // IN/OUT
+          HgfsHandle file)      // IN
+{
+   HgfsRequestCloseV3 *request;
+   uint32 status;
+
+   request = HgfsTest_RequestInit(client->request, HGFS_OP_CLOSE_V3,
+                                  HGFS_PACKET_FLAG_REQUEST);
+   memset(request, 0, sizeof *request);
+   request->file = file;
+   HgfsTest_Send(client->request, sizeof *request, NULL, 0, &status);
+   CHECK(status == HGFS_STATUS_SUCCESS);
+   Atomic_Inc(&gCloses);
+}
+
+
+static void *
+TestWorker(void *clientData)   // IN
+{
+   TestClient *client = clientData;
+   uint32 i;
+
+   for (i = 0; i < HANDLES_PER_THREAD; i++) {
+      client->handles[i] = HGFS_INVALID_HANDLE;
+   }
+
+   for (i = 0; i < NUM_ITERATIONS; i++) {
+      uint32 slot = rand_r(&client->seed) % HANDLES_PER_THREAD;
+      uint32 choice = rand_r(&client->seed) % 8;
+
+      if (client->handles[slot] == HGFS_INVALID_HANDLE) {
+         client->files[slot] = rand_r(&client->seed) % NUM_FILES;
+         client->handles[slot] = TestOpen(client, client->files[slot]);
+      } else if (choice == 0) {
+         HgfsHandle closed = client->handles[slot];
+
+         TestClose(client, closed);
+         client->handles[slot] = HGFS_INVALID_HANDLE;
+
+         /* The handle must stay invalid even if its slot is reused. */
+         CHECK(TestRead(client, closed, client->files[slot]) !=
+               HGFS_STATUS_SUCCESS);
+      } else {
+         CHECK(TestRead(client, client->handles[slot],
+                        client->files[slot]) == HGFS_STATUS_SUCCESS);
+      }
+   }
+
+   for (i = 0; i < HANDLES_PER_THREAD; i++) {
+      if (client->handles[i] != HGFS_INVALID_HANDLE) {
+         TestClose(client, client->handles[i]);
+      }
+   }
+   return NULL;
+}
+
+
+static Bool
+TestConnect(HgfsTestRequest *request)   // IN/OUT
+{
+   HgfsServerConfig config;
+   uint32 status;
+
+   memset(&config, 0, sizeof config);
+   config.flags = TEST_CONFIG_FLAGS;
+   config.maxCachedOpenNodes = MAX_CACHED_NODES;
+
+   if (!HgfsTest_Connect(&config, 0, HGFS_LARGE_PACKET_MAX, NULL)) {
+      return FALSE;
+   }
+   HgfsTest_CreateSession(request, HGFS_LARGE_PACKET_MAX, 0, &status);
+   CHECK(status == HGFS_STATUS_SUCCESS);
+   return status == HGFS_STATUS_SUCCESS;
+}
+
+
+int
+main(int argc,       // IN
+     char **argv)    // IN
+{
+   const char *parent = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+   pthread_t threads[NUM_THREADS];
+   HgfsTestRequest *request;
+   TestClient *clients;
+   int opt;
+   int i;
+
+   while ((opt = getopt(argc, argv, "d:")) != -1) {
+      if (opt != 'd') {
+         fprintf(stderr, "Usage: %s [-d directory]\n", argv[0]);
+         return EXIT_FAILURE;
+      }
+      parent = optarg;
+   }
+
+   HgfsTest_Path(gDir, "%s/hgfsnodes.XXXXXX", parent);
+   if (!HgfsTest_CreateDir(gDir, NUM_FILES, NULL, FILE_SIZE)) {
+      HgfsTest_RemoveDir(gDir, NUM_FILES, NULL);
+      return EXIT_FAILURE;
+   }
+   request = HgfsTest_RequestAlloc(HGFS_LARGE_PACKET_MAX,
+                                   HGFS_LARGE_PACKET_MAX, 0);
+   if (!TestConnect(request)) {
+      HgfsTest_RequestFree(request);
+      HgfsTest_RemoveDir(gDir, NUM_FILES, NULL);
+      return EXIT_FAILURE;
+   }
+
+   clients = calloc(NUM_THREADS, sizeof *clients);
+   for (i = 0; i < NUM_THREADS; i++) {
+      clients[i].seed = i + 1;
+      clients[i].request = HgfsTest_RequestAlloc(HGFS_LARGE_PACKET_MAX,
+                                                 HGFS_LARGE_PACKET_MAX, 0);
+      pthread_create(&threads[i], NULL, TestWorker, &clients[i]);
+   }
+   for (i = 0; i < NUM_THREADS; i++) {
+      pthread_join(threads[i], NULL);
+      HgfsTest_RequestFree(clients[i].request);
+   }
+   free(clients);
+
+   CHECK(Atomic_Read(&gOpens) == Atomic_Read(&gCloses));
+
+   CHECK(HgfsTest_Disconnect(request) == HGFS_STATUS_SUCCESS);
+   HgfsTest_RequestFree(request);
+   HgfsTest_RemoveDir(gDir, NUM_FILES, NULL);
+
+   printf("%u opens, %u reads, %u closes, %u failures\n",
+          Atomic_Read(&gOpens), Atomic_Read(&gReads), Atomic_Read(&gCloses),
+          Atomic_Read(&gHgfsTestFailures));
+   return Atomic_Read(&gHgfsTestFailures) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
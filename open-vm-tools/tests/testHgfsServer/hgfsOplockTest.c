@@ -0,0 +1,440 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsOplockTest.c --
+ *
+ *   Test of the HGFS server oplocks. A client acquires oplocks on open files
+ *   through a loopback channel, then the files are opened directly on the
+ *   host. Checks that the opens break the oplocks: the server sends the
+ *   breaks to the client, the opens wait until the client acknowledges them,
+ *   and the server downgrades the oplocks itself if the client does not.
+ *
+ *   Leases need the owner of the files or CAP_LEASE, and a file system that
+ *   supports them. The test is skipped if no oplock is granted.
+ *
+ *   Usage: vmware-testhgfsoplock [-d directory]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "vmware.h"
+#include "vm_atomic.h"
+#include "hgfs.h"
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsTestClient.h"
+
+#define NUM_FILES            2
+#define BREAK_WAIT_SECS      5
+
+/* Timeout of the server for unacknowledged breaks, plus some slack. */
+#define BREAK_TIMEOUT_SECS   15
+
+#define TEST_CONFIG_FLAGS (HGFS_CONFIG_SHARE_ALL_HOST_DRIVES_ENABLED | \
+                           HGFS_CONFIG_VOL_INFO_MIN |                  \
+                           HGFS_CONFIG_OPLOCK_ENABLED)
+
+/* A direct open of a file on the host, done by another thread. */
+typedef struct TestOpener {
+   pthread_t thread;
+   uint32 fileIndex;
+   int flags;
+   int error;
+   time_t elapsed;
+} TestOpener;
+
+static char gDir[PATH_MAX];
+static HgfsTestRequest *gRequest;
+
+/* The oplock breaks sent by the server. */
+static pthread_mutex_t gBreakMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gBreakCond = PTHREAD_COND_INITIALIZER;
+static uint32 gNumBreaks;
+static HgfsHandle gBreakFile;
+static HgfsLockType gBreakServerLock;
+
+
+/* Records a break sent by the server. */
+
+static void
+TestServerRequest(const HgfsHeader *header)   // IN
+{
+   const HgfsRequestOplockBreakV4 *request =
+      (const HgfsRequestOplockBreakV4 *)(header + 1);
+
+   CHECK(header->op == HGFS_OP_OPLOCK_BREAK_V4);
+   CHECK(header->flags == HGFS_PACKET_FLAG_REQUEST);
+   CHECK(header->sessionId == HgfsTest_SessionId());
+   pthread_mutex_lock(&gBreakMutex);
+   gNumBreaks++;
+   gBreakFile = request->fid;
+   gBreakServerLock = request->serverLock;
+   pthread_cond_broadcast(&gBreakCond);
+   pthread_mutex_unlock(&gBreakMutex);
+}
+
+
+static HgfsHandle
+TestOpen(uint32 fileIndex,     // IN
+         HgfsOpenMode mode,    // IN
+         uint32 *status)       // OUT
+{
+   HgfsRequestOpenV3 *request = HgfsTest_RequestInit(gRequest,
+                                                     HGFS_OP_OPEN_V3,
+                                                     HGFS_PACKET_FLAG_REQUEST);
+   HgfsReplyOpenV3 *reply;
+   char path[PATH_MAX];
+   size_t nameLen;
+
+   memset(request, 0, sizeof *request);
+   request->mask = HGFS_OPEN_VALID_MODE | HGFS_OPEN_VALID_FLAGS |
+                   HGFS_OPEN_VALID_FILE_NAME;
+   request->mode = mode;
+   request->flags = HGFS_OPEN;
+   HgfsTest_Path(path, "%s/file%u", gDir, fileIndex);
+   nameLen = HgfsTest_FileName(&request->fileName, path);
+
+   reply = HgfsTest_Send(gRequest, sizeof *request + nameLen, NULL, 0, status);
+   return *status == HGFS_STATUS_SUCCESS ? reply->file : HGFS_INVALID_HANDLE;
+}
+
+
+static void
+TestClose(HgfsHandle file)      // IN
+{
+   HgfsRequestCloseV3 *request = HgfsTest_RequestInit(gRequest,
+                                                      HGFS_OP_CLOSE_V3,
+                                                      HGFS_PACKET_FLAG_REQUEST);
+   uint32 status;
+
+   memset(request, 0, sizeof *request);
+   request->file = file;
+   HgfsTest_Send(gRequest, sizeof *request, NULL, 0, &status);
+   CHECK(status == HGFS_STATUS_SUCCESS);
+}
+
+
+/* Asks for an oplock and returns the oplock granted. */
+
+static HgfsLockType
+TestAcquire(HgfsHandle file,           // IN
+            HgfsLockType serverLock)   // IN
+{
+   HgfsRequestServerLockChangeV2 *request;
+   HgfsReplyServerLockChangeV2 *reply;
+   uint32 status;
+
+   request = HgfsTest_RequestInit(gRequest, HGFS_OP_OPLOCK_ACQUIRE_V4,
+                                  HGFS_PACKET_FLAG_REQUEST);
+   memset(request, 0, sizeof *request);
+   request->fid = file;
+   request->serverLock = serverLock;
+   reply = HgfsTest_Send(gRequest, sizeof *request, NULL, 0, &status);
+   CHECK(status == HGFS_STATUS_SUCCESS);
+   return status == HGFS_STATUS_SUCCESS ? reply->serverLock : HGFS_LOCK_NONE;
+}
+
+
+/* Acknowledges a break and returns the oplock kept. */
+
+static HgfsLockType
+TestAcknowledge(HgfsHandle file,           // IN
+                HgfsLockType serverLock)   // IN
+{
+   HgfsReplyOplockBreakV4 *request;
+   HgfsReplyOplockBreakV4 *reply;
+   uint32 status;
+
+   request = HgfsTest_RequestInit(gRequest, HGFS_OP_OPLOCK_BREAK_V4,
+                                  HGFS_PACKET_FLAG_REPLY);
+   memset(request, 0, sizeof *request);
+   request->fid = file;
+   request->serverLock = serverLock;
+   reply = HgfsTest_Send(gRequest, sizeof *request, NULL, 0, &status);
+   CHECK(status == HGFS_STATUS_SUCCESS);
+   if (status != HGFS_STATUS_SUCCESS) {
+      return HGFS_LOCK_NONE;
+   }
+   CHECK(reply->fid == file);
+   return reply->serverLock;
+}
+
+
+/* Waits for the next break, returns FALSE if none came in time. */
+
+static Bool
+TestWaitBreak(uint32 numBreaks,           // IN: breaks seen so far
+              int seconds,                // IN
+              HgfsHandle *file,           // OUT
+              HgfsLockType *serverLock)   // OUT
+{
+   struct timespec deadline;
+   Bool received;
+
+   clock_gettime(CLOCK_REALTIME, &deadline);
+   deadline.tv_sec += seconds;
+
+   pthread_mutex_lock(&gBreakMutex);
+   while (gNumBreaks == numBreaks &&
+          pthread_cond_timedwait(&gBreakCond, &gBreakMutex, &deadline) == 0) {
+   }
+   received = gNumBreaks != numBreaks;
+   *file = gBreakFile;
+   *serverLock = gBreakServerLock;
+   pthread_mutex_unlock(&gBreakMutex);
+
+   return received;
+}
+
+
+static uint32
+TestNumBreaks(void)
+{
+   uint32 numBreaks;
+
+   pthread_mutex_lock(&gBreakMutex);
+   numBreaks = gNumBreaks;
+   pthread_mutex_unlock(&gBreakMutex);
+   return numBreaks;
+}
+
+
+static void *
+TestOpenerThread(void *clientData)   // IN
+{
+   TestOpener *opener = clientData;
+   char path[PATH_MAX];
+   time_t start = time(NULL);
+   int fd;
+
+   HgfsTest_Path(path, "%s/file%u", gDir, opener->fileIndex);
+   fd = open(path, opener->flags);
+   opener->error = fd < 0 ? errno : 0;
+   opener->elapsed = time(NULL) - start;
+   if (fd >= 0) {
+      close(fd);
+   }
+   return NULL;
+}
+
+
+static void
+TestOpenerStart(TestOpener *opener,   // OUT
+                uint32 fileIndex,     // IN
+                int flags)            // IN
+{
+   opener->fileIndex = fileIndex;
+   opener->flags = flags;
+   pthread_create(&opener->thread, NULL, TestOpenerThread, opener);
+}
+
+
+/*
+ * A shared oplock is broken by an open for writing, which waits until the
+ * client acknowledges the break.
+ */
+
+static void
+TestSharedBreak(HgfsHandle file)   // IN
+{
+   uint32 numBreaks = TestNumBreaks();
+   HgfsHandle breakFile;
+   HgfsLockType breakLock;
+   TestOpener opener;
+
+   TestOpenerStart(&opener, 0, O_WRONLY);
+   CHECK(TestWaitBreak(numBreaks, BREAK_WAIT_SECS, &breakFile, &breakLock));
+   CHECK(breakFile == file);
+   CHECK(breakLock == HGFS_LOCK_NONE);
+
+   CHECK(TestAcknowledge(file, HGFS_LOCK_NONE) == HGFS_LOCK_NONE);
+   pthread_join(opener.thread, NULL);
+   CHECK(opener.error == 0);
+   CHECK(opener.elapsed < BREAK_WAIT_SECS);
+}
+
+
+/*
+ * An exclusive oplock is downgraded by an open for reading, the client may
+ * keep a shared oplock if the lease can be downgraded.
+ */
+
+static void
+TestExclusiveBreak(HgfsHandle file)   // IN
+{
+   uint32 numBreaks = TestNumBreaks();
+   HgfsHandle breakFile;
+   HgfsLockType breakLock;
+   HgfsLockType kept;
+   TestOpener opener;
+
+   TestOpenerStart(&opener, 1, O_RDONLY);
+   CHECK(TestWaitBreak(numBreaks, BREAK_WAIT_SECS, &breakFile, &breakLock));
+   CHECK(breakFile == file);
+   CHECK(breakLock == HGFS_LOCK_SHARED);
+
+   /* The client cannot keep more than the break allows. */
+   kept = TestAcknowledge(file, HGFS_LOCK_EXCLUSIVE);
+   CHECK(kept == HGFS_LOCK_SHARED || kept == HGFS_LOCK_NONE);
+   pthread_join(opener.thread, NULL);
+   CHECK(opener.error == 0);
+   CHECK(opener.elapsed < BREAK_WAIT_SECS);
+
+   CHECK(TestAcquire(file, HGFS_LOCK_NONE) == HGFS_LOCK_NONE);
+}
+
+
+/*
+ * The server breaks the oplock itself when the client does not acknowledge
+ * the break, and tells the client.
+ */
+
+static void
+TestBreakTimeout(HgfsHandle file)   // IN
+{
+   uint32 numBreaks = TestNumBreaks();
+   HgfsHandle breakFile;
+   HgfsLockType breakLock;
+   TestOpener opener;
+
+   TestOpenerStart(&opener, 0, O_WRONLY);
+   CHECK(TestWaitBreak(numBreaks, BREAK_WAIT_SECS, &breakFile, &breakLock));
+   CHECK(TestWaitBreak(numBreaks + 1, BREAK_TIMEOUT_SECS, &breakFile,
+                       &breakLock));
+   CHECK(breakFile == file);
+   CHECK(breakLock == HGFS_LOCK_NONE);
+
+   pthread_join(opener.thread, NULL);
+   CHECK(opener.error == 0);
+   CHECK(opener.elapsed < BREAK_TIMEOUT_SECS);
+
+   /* The late acknowledgement finds no oplock left. */
+   CHECK(TestAcknowledge(file, HGFS_LOCK_NONE) == HGFS_LOCK_NONE);
+}
+
+
+static Bool
+TestConnect(void)
+{
+   HgfsServerConfig config;
+   HgfsReplyCreateSessionV4 *reply;
+   uint32 status;
+   uint32 i;
+
+   memset(&config, 0, sizeof config);
+   config.flags = TEST_CONFIG_FLAGS;
+   config.maxCachedOpenNodes = HGFS_MAX_CACHED_FILENODES;
+
+   if (!HgfsTest_Connect(&config, HGFS_CHANNEL_SHARED_MEM,
+                         HGFS_LARGE_PACKET_MAX, TestServerRequest)) {
+      return FALSE;
+   }
+
+   reply = HgfsTest_CreateSession(gRequest, HGFS_LARGE_PACKET_MAX,
+                                  HGFS_SESSION_OPLOCK_ENABLED, &status);
+   CHECK(status == HGFS_STATUS_SUCCESS);
+   if (status != HGFS_STATUS_SUCCESS) {
+      return FALSE;
+   }
+
+   CHECK(0 != (reply->flags & HGFS_SESSION_OPLOCK_ENABLED));
+   for (i = 0; i < reply->numCapabilities; i++) {
+      if (reply->capabilities[i].op == HGFS_OP_OPLOCK_ACQUIRE_V4 ||
+          reply->capabilities[i].op == HGFS_OP_OPLOCK_BREAK_V4) {
+         CHECK(reply->capabilities[i].flags & HGFS_OP_CAPFLAG_IS_SUPPORTED);
+      }
+   }
+   return TRUE;
+}
+
+
+int
+main(int argc,       // IN
+     char **argv)    // IN
+{
+   const char *parent = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+   HgfsHandle readFile;
+   HgfsHandle writeFile;
+   uint32 status;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "d:")) != -1) {
+      if (opt != 'd') {
+         fprintf(stderr, "Usage: %s [-d directory]\n", argv[0]);
+         return EXIT_FAILURE;
+      }
+      parent = optarg;
+   }
+
+   HgfsTest_Path(gDir, "%s/hgfsoplock.XXXXXX", parent);
+   if (!HgfsTest_CreateDir(gDir, NUM_FILES, NULL, 0)) {
+      HgfsTest_RemoveDir(gDir, NUM_FILES, NULL);
+      return EXIT_FAILURE;
+   }
+   gRequest = HgfsTest_RequestAlloc(HGFS_LARGE_PACKET_MAX,
+                                    HGFS_LARGE_PACKET_MAX, 0);
+   if (!TestConnect()) {
+      HgfsTest_RequestFree(gRequest);
+      HgfsTest_RemoveDir(gDir, NUM_FILES, NULL);
+      return EXIT_FAILURE;
+   }
+
+   readFile = TestOpen(0, HGFS_OPEN_MODE_READ_ONLY, &status);
+   CHECK(status == HGFS_STATUS_SUCCESS);
+   writeFile = TestOpen(1, HGFS_OPEN_MODE_READ_WRITE, &status);
+   CHECK(status == HGFS_STATUS_SUCCESS);
+
+   if (TestAcquire(readFile, HGFS_LOCK_SHARED) != HGFS_LOCK_SHARED) {
+      printf("no oplock granted, leases are not supported in %s\n", gDir);
+   } else {
+      /* The server fails opens that would break its own oplocks. */
+      TestOpen(0, HGFS_OPEN_MODE_READ_ONLY, &status);
+      CHECK(status != HGFS_STATUS_SUCCESS);
+
+      TestSharedBreak(readFile);
+
+      CHECK(TestAcquire(writeFile, HGFS_LOCK_OPPORTUNISTIC) ==
+            HGFS_LOCK_EXCLUSIVE);
+      TestExclusiveBreak(writeFile);
+
+      CHECK(TestAcquire(readFile, HGFS_LOCK_SHARED) == HGFS_LOCK_SHARED);
+      TestBreakTimeout(readFile);
+
+      /* Closing the file releases the oplock. */
+      CHECK(TestAcquire(readFile, HGFS_LOCK_SHARED) == HGFS_LOCK_SHARED);
+   }
+
+   TestClose(readFile);
+   TestClose(writeFile);
+   CHECK(HgfsTest_Disconnect(gRequest) == HGFS_STATUS_SUCCESS);
+   HgfsTest_RequestFree(gRequest);
+   HgfsTest_RemoveDir(gDir, NUM_FILES, NULL);
+
+   printf("%u breaks, %u failures\n", TestNumBreaks(),
+          Atomic_Read(&gHgfsTestFailures));
+   return Atomic_Read(&gHgfsTestFailures) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
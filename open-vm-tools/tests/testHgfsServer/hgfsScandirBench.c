@@ -0,0 +1,247 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsScandirBench.c --
+ *
+ *   Micro-benchmark for directory snapshots of HGFS searches. Creates a
+ *   synthetic directory with many entries, then compares the time to read
+ *   and release its entries with one allocation per dirent (the former
+ *   HgfsPlatformScandir behavior) and with the search dirent arena
+ *   (lib/hgfsServer/hgfsDentArena.c).
+ *
+ *   Usage: vmware-benchhgfsscandir [numEntries [iterations [directory]]]
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "vm_basic_types.h"
+#include "hgfsDentArena.h"
+#include "hgfsTestClient.h"
+
+#define DEFAULT_NUM_ENTRIES   100000
+#define DEFAULT_ITERATIONS    20
+
+/* Same layout as the Linux DirectoryEntry of the HGFS server. */
+typedef struct DirectoryEntry {
+   uint64 d_ino;
+   uint64 d_off;
+   uint16 d_reclen;
+   uint8  d_type;
+   char   d_name[256];
+} DirectoryEntry;
+
+typedef struct BenchResult {
+   uint64 scanNs;
+   uint64 freeNs;
+   uint32 numDents;
+} BenchResult;
+
+
+/* Vary the name length like a real directory would. */
+
+static void
+BenchEntryName(char *name,         // OUT
+               size_t nameSize,    // IN
+               uint32 i)           // IN
+{
+   snprintf(name, nameSize, "file-%u%.*s", i, (int)(i % 32),
+            "_abcdefghijklmnopqrstuvwxyz01234");
+}
+
+
+/*
+ * One malloc per dirent and one realloc of the pointer array per dirent,
+ * released entry by entry.
+ */
+
+static Bool
+BenchScanPerEntry(const char *dir,        // IN
+                  BenchResult *result)    // OUT
+{
+   DirectoryEntry **dents = NULL;
+   uint32 numDents = 0;
+   char buffer[8192];
+   uint64 start = HgfsTest_NowNs();
+   long len;
+   uint32 i;
+   int fd;
+
+   fd = open(dir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+   if (fd < 0) {
+      return FALSE;
+   }
+
+   while ((len = syscall(SYS_getdents64, fd, buffer, sizeof buffer)) > 0) {
+      long offset = 0;
+
+      while (offset < len) {
+         DirectoryEntry *dent = (DirectoryEntry *)(buffer + offset);
+         DirectoryEntry **newDents;
+
+         newDents = realloc(dents, sizeof *dents * (numDents + 1));
+         if (NULL == newDents) {
+            abort();
+         }
+         dents = newDents;
+         dents[numDents] = malloc(dent->d_reclen);
+         if (NULL == dents[numDents]) {
+            abort();
+         }
+         memcpy(dents[numDents], dent, dent->d_reclen);
+         numDents++;
+         offset += dent->d_reclen;
+      }
+   }
+   close(fd);
+   result->scanNs += HgfsTest_NowNs() - start;
+   result->numDents = numDents;
+
+   start = HgfsTest_NowNs();
+   for (i = 0; i < numDents; i++) {
+      free(dents[i]);
+   }
+   free(dents);
+   result->freeNs += HgfsTest_NowNs() - start;
+
+   return len == 0;
+}
+
+
+/*
+ * Dirents packed into the search dirent arena, released at once.
+ */
+
+static Bool
+BenchScanArena(const char *dir,        // IN
+               BenchResult *result)    // OUT
+{
+   HgfsDentArena dents;
+   char buffer[8192];
+   uint64 start = HgfsTest_NowNs();
+   long len;
+   int fd;
+
+   HgfsDentArena_Init(&dents);
+
+   fd = open(dir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+   if (fd < 0) {
+      return FALSE;
+   }
+
+   while ((len = syscall(SYS_getdents64, fd, buffer, sizeof buffer)) > 0) {
+      long offset = 0;
+
+      while (offset < len) {
+         DirectoryEntry *dent = (DirectoryEntry *)(buffer + offset);
+         void *myDent = HgfsDentArena_Alloc(&dents, dent->d_reclen);
+
+         if (NULL == myDent) {
+            abort();
+         }
+         memcpy(myDent, dent, dent->d_reclen);
+         offset += dent->d_reclen;
+      }
+   }
+   close(fd);
+   result->scanNs += HgfsTest_NowNs() - start;
+   result->numDents = dents.numDents;
+
+   start = HgfsTest_NowNs();
+   HgfsDentArena_Free(&dents);
+   result->freeNs += HgfsTest_NowNs() - start;
+
+   return len == 0;
+}
+
+
+static void
+BenchReport(const char *name,            // IN
+            const BenchResult *result,   // IN
+            uint32 iterations)           // IN
+{
+   HgfsTestPhase phases[] = {
+      { "scan", result->scanNs },
+      { "free", result->freeNs },
+   };
+
+   HgfsTest_Report(name, result->numDents, "dent", phases, ARRAYSIZE(phases),
+                   iterations);
+}
+
+
+int
+main(int argc,       // IN
+     char **argv)    // IN
+{
+   uint32 numEntries = argc > 1 ? strtoul(argv[1], NULL, 0) :
+                                  DEFAULT_NUM_ENTRIES;
+   uint32 iterations = argc > 2 ? strtoul(argv[2], NULL, 0) :
+                                  DEFAULT_ITERATIONS;
+   char dir[PATH_MAX];
+   BenchResult perEntry = { 0 };
+   BenchResult arena = { 0 };
+   Bool ok = TRUE;
+   uint32 i;
+
+   if (argc > 3) {
+      HgfsTest_Path(dir, "%s", argv[3]);
+   } else {
+      HgfsTest_Path(dir, "/tmp/hgfsScandirBench.%d", (int)getpid());
+   }
+   if (0 == iterations) {
+      iterations = 1;
+   }
+
+   if (!HgfsTest_CreateDir(dir, numEntries, BenchEntryName, 0)) {
+      HgfsTest_RemoveDir(dir, numEntries, BenchEntryName);
+      return EXIT_FAILURE;
+   }
+
+   /* Warm up the dentry cache so both variants read from memory. */
+   ok = BenchScanPerEntry(dir, &perEntry) && BenchScanArena(dir, &arena);
+   memset(&perEntry, 0, sizeof perEntry);
+   memset(&arena, 0, sizeof arena);
+
+   /* Interleave the variants so they see the same system state. */
+   for (i = 0; ok && i < iterations; i++) {
+      ok = BenchScanPerEntry(dir, &perEntry) && BenchScanArena(dir, &arena);
+   }
+
+   HgfsTest_RemoveDir(dir, numEntries, BenchEntryName);
+
+   if (!ok) {
+      fprintf(stderr, "%s: reading %s failed\n", argv[0], dir);
+      return EXIT_FAILURE;
+   }
+
+   BenchReport("per-entry", &perEntry, iterations);
+   BenchReport("arena", &arena, iterations);
+   printf("speedup      %.2fx\n",
+          (double)(perEntry.scanNs + perEntry.freeNs) /
+             (arena.scanNs + arena.freeNs));
+
+   return EXIT_SUCCESS;
+}
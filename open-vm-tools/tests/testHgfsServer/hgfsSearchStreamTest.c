@@ -0,0 +1,276 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsSearchStreamTest.c --
+ *
+ *   Test of the streaming searches of the Linux HGFS server, which hold a
+ *   window of the directory entries and go back to an earlier entry from
+ *   the directory position recorded at the start of its window. Lists a
+ *   directory spanning several windows through a loopback channel, first
+ *   in order and then jumping past window boundaries and back, and checks
+ *   that every index returns the name a single full scan of the directory
+ *   has at that index.
+ *
+ *   Usage: vmware-testhgfssearch [-d directory]
+ */
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vmware.h"
+#include "hgfs.h"
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsTestClient.h"
+
+/* Must match HGFS_SEARCH_STREAM_WINDOW in hgfsServerLinux.c. */
+#define SEARCH_WINDOW        4096
+#define NUM_FILES            (2 * SEARCH_WINDOW + 1000)
+
+#define TEST_CONFIG_FLAGS (HGFS_CONFIG_SHARE_ALL_HOST_DRIVES_ENABLED | \
+                           HGFS_CONFIG_VOL_INFO_MIN |                  \
+                           HGFS_CONFIG_SEARCH_STREAMING_ENABLED)
+
+static char gDir[PATH_MAX];
+
+/* Names of the directory entries in the order of a single full scan. */
+static char **gNames;
+static uint32 gNumNames;
+
+
+static Bool
+TestFullScan(void)
+{
+   DIR *dir = opendir(gDir);
+   struct dirent *dent;
+
+   if (dir == NULL) {
+      return FALSE;
+   }
+   while ((dent = readdir(dir)) != NULL) {
+      gNames = realloc(gNames, (gNumNames + 1) * sizeof *gNames);
+      if (gNames == NULL ||
+          (gNames[gNumNames] = strdup(dent->d_name)) == NULL) {
+         fprintf(stderr, "out of memory\n");
+         exit(EXIT_FAILURE);
+      }
+      gNumNames++;
+   }
+   closedir(dir);
+   return TRUE;
+}
+
+
+static HgfsHandle
+TestSearchOpen(HgfsTestRequest *client)   // IN/OUT
+{
+   HgfsRequestSearchOpenV3 *request;
+   HgfsReplySearchOpenV3 *reply;
+   size_t nameLen;
+   uint32 status;
+
+   request = HgfsTest_RequestInit(client, HGFS_OP_SEARCH_OPEN_V3,
+                                  HGFS_PACKET_FLAG_REQUEST);
+   memset(request, 0, sizeof *request);
+   nameLen = HgfsTest_FileName(&request->dirName, gDir);
+
+   reply = HgfsTest_Send(client, sizeof *request + nameLen, NULL, 0,
+                         &status);
+   CHECK(status == HGFS_STATUS_SUCCESS);
+   return status == HGFS_STATUS_SUCCESS ? reply->search : HGFS_INVALID_HANDLE;
+}
+
+
+/*
+ * Reads the entry at index and checks it has the name of the full scan,
+ * or that there is none past the end. Returns whether there was one.
+ */
+
+static Bool
+TestSearchRead(HgfsTestRequest *client,   // IN/OUT
+               HgfsHandle search,         // IN
+               uint32 index)              // IN
+{
+   HgfsRequestSearchReadV3 *request;
+   HgfsReplySearchReadV3 *reply;
+   const HgfsDirEntry *entry;
+   uint32 status;
+
+   request = HgfsTest_RequestInit(client, HGFS_OP_SEARCH_READ_V3,
+                                  HGFS_PACKET_FLAG_REQUEST);
+   memset(request, 0, sizeof *request);
+   request->search = search;
+   request->offset = index;
+
+   reply = HgfsTest_Send(client, sizeof *request, NULL, 0, &status);
+   CHECK(status == HGFS_STATUS_SUCCESS);
+   if (status != HGFS_STATUS_SUCCESS) {
+      return FALSE;
+   }
+
+   entry = (const HgfsDirEntry *)reply->payload;
+   if (reply->count == 0 || entry->fileName.length == 0) {
+      CHECK(index >= gNumNames);
+      return FALSE;
+   }
+
+   CHECK(index < gNumNames);
+   if (index < gNumNames &&
+       (entry->fileName.length != strlen(gNames[index]) ||
+        memcmp(entry->fileName.name, gNames[index],
+               entry->fileName.length) != 0)) {
+      fprintf(stderr, "entry %u is %.*s instead of %s\n", index,
+              (int)entry->fileName.length, entry->fileName.name,
+              gNames[index]);
+      CHECK(FALSE);
+   }
+   return TRUE;
+}
+
+
+static void
+TestSearchClose(HgfsTestRequest *client,   // IN/OUT
+                HgfsHandle search)         // IN
+{
+   HgfsRequestSearchCloseV3 *request;
+   uint32 status;
+
+   request = HgfsTest_RequestInit(client, HGFS_OP_SEARCH_CLOSE_V3,
+                                  HGFS_PACKET_FLAG_REQUEST);
+   memset(request, 0, sizeof *request);
+   request->search = search;
+   HgfsTest_Send(client, sizeof *request, NULL, 0, &status);
+   CHECK(status == HGFS_STATUS_SUCCESS);
+}
+
+
+/* Lists the whole directory in order, moving the window forward. */
+
+static void
+TestSequential(HgfsTestRequest *client)   // IN/OUT
+{
+   HgfsHandle search = TestSearchOpen(client);
+   uint32 index = 0;
+
+   if (search == HGFS_INVALID_HANDLE) {
+      return;
+   }
+   while (TestSearchRead(client, search, index)) {
+      index++;
+   }
+   CHECK(index == gNumNames);
+   TestSearchClose(client, search);
+}
+
+
+/*
+ * Reads past window boundaries, then earlier entries which have to be
+ * reread from a resume point, in and out of the current window.
+ */
+
+static void
+TestResume(HgfsTestRequest *client)   // IN/OUT
+{
+   const uint32 indices[] = {
+      SEARCH_WINDOW + 10,        /* Past the first window. */
+      3,                         /* Back to the start of the directory. */
+      2 * SEARCH_WINDOW + 1,     /* Past the second window. */
+      SEARCH_WINDOW - 1,         /* Last entry of the first window. */
+      SEARCH_WINDOW,             /* First entry of the second window. */
+      2 * SEARCH_WINDOW - 1,
+      SEARCH_WINDOW + 10,        /* From a later window. */
+      NUM_FILES - 1,
+      0,
+   };
+   HgfsHandle search = TestSearchOpen(client);
+   uint32 i;
+
+   if (search == HGFS_INVALID_HANDLE) {
+      return;
+   }
+   for (i = 0; i < ARRAYSIZE(indices); i++) {
+      CHECK(TestSearchRead(client, search, indices[i]));
+   }
+   CHECK(!TestSearchRead(client, search, gNumNames));
+   CHECK(TestSearchRead(client, search, gNumNames - 1));
+   TestSearchClose(client, search);
+}
+
+
+int
+main(int argc,       // IN
+     char **argv)    // IN
+{
+   const char *parent = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+   HgfsServerConfig config;
+   HgfsTestRequest *client;
+   uint32 status;
+   uint32 i;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "d:")) != -1) {
+      if (opt != 'd') {
+         fprintf(stderr, "Usage: %s [-d directory]\n", argv[0]);
+         return EXIT_FAILURE;
+      }
+      parent = optarg;
+   }
+
+   HgfsTest_Path(gDir, "%s/hgfssearch.XXXXXX", parent);
+   if (!HgfsTest_CreateDir(gDir, NUM_FILES, NULL, 0) || !TestFullScan()) {
+      HgfsTest_RemoveDir(gDir, NUM_FILES, NULL);
+      return EXIT_FAILURE;
+   }
+
+   memset(&config, 0, sizeof config);
+   config.flags = TEST_CONFIG_FLAGS;
+   config.maxCachedOpenNodes = HGFS_MAX_CACHED_FILENODES;
+
+   client = HgfsTest_RequestAlloc(HGFS_LARGE_PACKET_MAX,
+                                  HGFS_LARGE_PACKET_MAX, 0);
+   if (!HgfsTest_Connect(&config, 0, HGFS_LARGE_PACKET_MAX, NULL)) {
+      HgfsTest_RequestFree(client);
+      HgfsTest_RemoveDir(gDir, NUM_FILES, NULL);
+      return EXIT_FAILURE;
+   }
+   HgfsTest_CreateSession(client, HGFS_LARGE_PACKET_MAX, 0, &status);
+   CHECK(status == HGFS_STATUS_SUCCESS);
+
+   if (status == HGFS_STATUS_SUCCESS) {
+      TestSequential(client);
+      TestResume(client);
+   }
+
+   CHECK(HgfsTest_Disconnect(client) == HGFS_STATUS_SUCCESS);
+   HgfsTest_RequestFree(client);
+   HgfsTest_RemoveDir(gDir, NUM_FILES, NULL);
+
+   for (i = 0; i < gNumNames; i++) {
+      free(gNames[i]);
+   }
+   free(gNames);
+
+   printf("%u entries, %u failures\n", gNumNames,
+          Atomic_Read(&gHgfsTestFailures));
+   return Atomic_Read(&gHgfsTestFailures) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
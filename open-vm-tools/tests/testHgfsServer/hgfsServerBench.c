@@ -0,0 +1,1718 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsServerBench.c --
+ *
+ *   In-process benchmark of the HGFS server (lib/hgfsServer). Connects to
+ *   the server through the loopback channel of hgfsTestClient.c, creates a
+ *   V4 session and sends the same request packets as a guest client to a
+ *   scratch directory reached through the guest "root" share.
+ *
+ *   Data of the fast read and write and of the V4 directory reads is
+ *   transferred through page sized data packet iovs like on the VMCI
+ *   channel. Latencies are measured per request from the server receive
+ *   callback to the reply. Requests are asynchronous, i.e. replied from
+ *   server threads, when the configuration enables the thread pool.
+ *
+ *   Workloads:
+ *      smallfile  create, stat and delete small files
+ *      seqio      sequential write and read of a large file
+ *      deeptree   stat a file at the bottom of a deep directory tree
+ *      dirlist    list a directory with many entries
+ *      randread   random page sized reads of a file, with several requests
+ *                 in flight
+ *      copy       copy of a large file by the server, and by the client
+ *                 with reads and writes
+ *      fsync      writes each followed by a fsync, and by a close and
+ *                 reopen as done by clients without fsync
+ *      access     access checks of small files, compared with the stat and
+ *                 the open and close clients use instead
+ *      journal    queries of the changes to a directory of files since the
+ *                 previous query, compared with a rescan of the directory;
+ *                 needs change notifications in the configuration flags
+ *      throttle   stats and page sized reads of a small file while large
+ *                 reads of another file stream through the same share;
+ *                 the share limits are set with -B and -I and need the
+ *                 thread pool in the configuration flags
+ *
+ *   Usage: vmware-benchhgfsserver [-w workload[,workload...]] [-d directory]
+ *                                 [-n files] [-s fileSizeMB] [-b blockSize]
+ *                                 [-t treeDepth] [-l lookups] [-e entries]
+ *                                 [-r reads] [-q queueDepth] [-f configFlags]
+ *                                 [-B shareMBPerSec] [-I shareRequestsPerSec]
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vmware.h"
+#include "hgfs.h"
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+#include "hgfsTestClient.h"
+
+#define BENCH_PAGE_SIZE         HGFS_TEST_PAGE_SIZE
+#define BENCH_MAX_DATA_PAGES    (64 * 1024 * 1024 / BENCH_PAGE_SIZE)
+
+#define DEFAULT_NUM_FILES       2000
+#define DEFAULT_FILE_SIZE_MB    256
+#define DEFAULT_BLOCK_SIZE      HGFS_LARGE_IO_MAX
+#define DEFAULT_TREE_DEPTH      32
+#define DEFAULT_NUM_LOOKUPS     20000
+#define DEFAULT_NUM_ENTRIES     20000
+#define DEFAULT_NUM_READS       20000
+#define DEFAULT_QUEUE_DEPTH     32
+#define BENCH_MAX_QUEUE_DEPTH   256
+#define BENCH_CHANGES_SIZE      (64 * 1024)
+#define BENCH_JOURNAL_ROUNDS    10
+#define BENCH_BULK_DEPTH        8
+
+#define BENCH_CONFIG_FLAGS (HGFS_CONFIG_SHARE_ALL_HOST_DRIVES_ENABLED | \
+                            HGFS_CONFIG_NOTIFY_ENABLED |                \
+                            HGFS_CONFIG_VOL_INFO_MIN |                  \
+                            HGFS_CONFIG_CACHE_ENABLED |                 \
+                            HGFS_CONFIG_SEARCH_STREAMING_ENABLED |      \
+                            HGFS_CONFIG_READ_AHEAD_ENABLED)
+
+/* Latency samples of one request type. */
+typedef struct BenchOp {
+   const char *name;
+   uint64 *samplesNs;
+   size_t numSamples;
+   size_t maxSamples;
+   uint64 totalNs;
+   uint32 errors;
+} BenchOp;
+
+/* Client state. */
+typedef struct BenchClient {
+   HgfsTestRequest *request;      /* Request sent synchronously. */
+   char *data;                    /* Data packets of all requests. */
+   uint32 maxPacketSize;
+} BenchClient;
+
+typedef struct BenchParams {
+   const char *workloads;
+   const char *dir;
+   uint32 numFiles;
+   uint64 fileSize;
+   uint32 blockSize;
+   uint32 treeDepth;
+   uint32 numLookups;
+   uint32 numEntries;
+   uint32 numReads;
+   uint32 queueDepth;
+   uint32 configFlags;
+   uint64 shareBytesPerSec;
+   uint32 shareRequestsPerSec;
+} BenchParams;
+
+static BenchClient gClient;
+
+
+static void
+BenchOpInit(BenchOp *op,        // OUT
+            const char *name)   // IN
+{
+   memset(op, 0, sizeof *op);
+   op->name = name;
+}
+
+
+static void
+BenchOpRecord(BenchOp *op,      // IN/OUT
+              uint64 ns,        // IN
+              Bool failed)      // IN
+{
+   if (op->numSamples == op->maxSamples) {
+      op->maxSamples = op->maxSamples == 0 ? 1024 : 2 * op->maxSamples;
+      op->samplesNs = realloc(op->samplesNs,
+                              op->maxSamples * sizeof *op->samplesNs);
+      if (op->samplesNs == NULL) {
+         fprintf(stderr, "out of memory\n");
+         exit(EXIT_FAILURE);
+      }
+   }
+   op->samplesNs[op->numSamples++] = ns;
+   op->totalNs += ns;
+   if (failed) {
+      op->errors++;
+   }
+}
+
+
+static int
+BenchCompareNs(const void *a,   // IN
+               const void *b)   // IN
+{
+   uint64 x = *(const uint64 *)a;
+   uint64 y = *(const uint64 *)b;
+
+   return x < y ? -1 : x > y;
+}
+
+
+static double
+BenchPercentileUs(const BenchOp *op,  // IN: sorted samples
+                  double percent)     // IN
+{
+   size_t index = (size_t)(percent / 100.0 * (op->numSamples - 1) + 0.5);
+
+   return op->samplesNs[index] / 1000.0;
+}
+
+
+static void
+BenchOpReport(BenchOp *op,          // IN/OUT
+              uint64 bytes)         // IN: bytes transferred, 0 if none
+{
+   double seconds;
+
+   if (op->numSamples == 0) {
+      return;
+   }
+
+   qsort(op->samplesNs, op->numSamples, sizeof *op->samplesNs,
+         BenchCompareNs);
+   seconds = op->totalNs / 1e9;
+
+   printf("  %-12s %8zu ops %10.0f ops/s  p50 %8.1f us  p90 %8.1f us  "
+          "p99 %8.1f us  max %9.1f us",
+          op->name, op->numSamples, op->numSamples / seconds,
+          BenchPercentileUs(op, 50), BenchPercentileUs(op, 90),
+          BenchPercentileUs(op, 99), BenchPercentileUs(op, 100));
+   if (bytes != 0) {
+      printf("  %8.1f MB/s", bytes / seconds / (1024 * 1024));
+   }
+   if (op->errors != 0) {
+      printf("  %u errors", op->errors);
+   }
+   printf("\n");
+
+   free(op->samplesNs);
+   op->samplesNs = NULL;
+}
+
+
+static void *
+BenchRequestInit(HgfsOp op)   // IN
+{
+   return HgfsTest_RequestInit(gClient.request, op, HGFS_PACKET_FLAG_REQUEST);
+}
+
+
+/*
+ * Sends the request, with dataSize bytes of the data buffer as data packet,
+ * and returns the reply arguments.
+ */
+
+static void *
+BenchSend(size_t argsSize,     // IN: size of the op arguments
+          size_t dataSize,     // IN: data packet size, 0 for none
+          uint32 *status,      // OUT: reply status
+          uint64 *ns)          // OUT: request latency
+{
+   void *reply = HgfsTest_Send(gClient.request, argsSize, gClient.data,
+                               dataSize, status);
+
+   *ns = HgfsTest_NowNs() - gClient.request->startNs;
+   return reply;
+}
+
+
+static Bool
+BenchConnect(const BenchParams *params)   // IN
+{
+   HgfsServerConfig config;
+   HgfsReplyCreateSessionV4 *reply;
+   uint32 status;
+
+   memset(&config, 0, sizeof config);
+   config.flags = params->configFlags;
+   config.maxCachedOpenNodes = HGFS_MAX_CACHED_FILENODES;
+   config.shareBytesPerSec = params->shareBytesPerSec;
+   config.shareRequestsPerSec = params->shareRequestsPerSec;
+
+   if (!HgfsTest_Connect(&config,
+                         HGFS_CHANNEL_SHARED_MEM | HGFS_CHANNEL_ASYNC,
+                         HGFS_HUGE_PACKET_MAX, NULL)) {
+      return FALSE;
+   }
+
+   gClient.request = HgfsTest_RequestAlloc(HGFS_LARGE_PACKET_MAX,
+                                           HGFS_LARGE_PACKET_MAX,
+                                           BENCH_MAX_DATA_PAGES *
+                                           BENCH_PAGE_SIZE);
+   if (posix_memalign((void **)&gClient.data, BENCH_PAGE_SIZE,
+                      BENCH_MAX_DATA_PAGES * BENCH_PAGE_SIZE) != 0) {
+      fprintf(stderr, "out of memory\n");
+      return FALSE;
+   }
+   memset(gClient.data, 0xa5, BENCH_MAX_DATA_PAGES * BENCH_PAGE_SIZE);
+
+   reply = HgfsTest_CreateSession(gClient.request, HGFS_HUGE_PACKET_MAX,
+                                  HGFS_SESSION_ASYNC_IO_ENABLED, &status);
+   if (reply == NULL) {
+      return FALSE;
+   }
+   gClient.maxPacketSize = reply->maxPacketSize;
+   return TRUE;
+}
+
+
+static void
+BenchDisconnect(void)
+{
+   HgfsTest_Disconnect(gClient.request);
+   HgfsTest_RequestFree(gClient.request);
+   free(gClient.data);
+}
+
+
+/*
+ * Request wrappers. Each records the request latency in op and returns
+ * the reply status.
+ */
+
+static uint32
+BenchOpen(BenchOp *op,             // IN/OUT
+          const char *path,        // IN
+          HgfsOpenMode mode,       // IN
+          HgfsOpenFlags flags,     // IN
+          HgfsHandle *file)        // OUT
+{
+   HgfsRequestOpenV3 *request = BenchRequestInit(HGFS_OP_OPEN_V3);
+   HgfsReplyOpenV3 *reply;
+   size_t nameLen;
+   uint32 status;
+   uint64 ns;
+
+   memset(request, 0, sizeof *request);
+   request->mask = HGFS_OPEN_VALID_MODE | HGFS_OPEN_VALID_FLAGS |
+                   HGFS_OPEN_VALID_OWNER_PERMS | HGFS_OPEN_VALID_FILE_NAME;
+   request->mode = mode;
+   request->flags = flags;
+   request->ownerPerms = HGFS_PERM_READ | HGFS_PERM_WRITE;
+   nameLen = HgfsTest_FileName(&request->fileName, path);
+
+   reply = BenchSend(sizeof *request + nameLen, 0, &status, &ns);
+   BenchOpRecord(op, ns, status != HGFS_STATUS_SUCCESS);
+   *file = status == HGFS_STATUS_SUCCESS ? reply->file : HGFS_INVALID_HANDLE;
+   return status;
+}
+
+
+static uint32
+BenchClose(BenchOp *op,        // IN/OUT
+           HgfsHandle file)    // IN
+{
+   HgfsRequestCloseV3 *request = BenchRequestInit(HGFS_OP_CLOSE_V3);
+   uint32 status;
+   uint64 ns;
+
+   memset(request, 0, sizeof *request);
+   request->file = file;
+   BenchSend(sizeof *request, 0, &status, &ns);
+   BenchOpRecord(op, ns, status != HGFS_STATUS_SUCCESS);
+   return status;
+}
+
+
+static uint32
+BenchWrite(BenchOp *op,        // IN/OUT
+           HgfsHandle file,    // IN
+           uint64 offset,      // IN
+           uint32 size)        // IN
+{
+   HgfsRequestWriteV3 *request = BenchRequestInit(HGFS_OP_WRITE_FAST_V4);
+   HgfsReplyWriteV3 *reply;
+   uint32 status;
+   uint64 ns;
+
+   memset(request, 0, sizeof *request);
+   request->file = file;
+   request->offset = offset;
+   request->requiredSize = size;
+
+   reply = BenchSend(sizeof *request, size, &status, &ns);
+   if (status == HGFS_STATUS_SUCCESS && reply->actualSize != size) {
+      status = HGFS_STATUS_GENERIC_ERROR;
+   }
+   BenchOpRecord(op, ns, status != HGFS_STATUS_SUCCESS);
+   return status;
+}
+
+
+static uint32
+BenchRead(BenchOp *op,         // IN/OUT
+          HgfsHandle file,     // IN
+          uint64 offset,       // IN
+          uint32 size,         // IN
+          uint32 *actualSize)  // OUT
+{
+   HgfsRequestReadV3 *request = BenchRequestInit(HGFS_OP_READ_FAST_V4);
+   HgfsReplyReadV3 *reply;
+   uint32 status;
+   uint64 ns;
+
+   memset(request, 0, sizeof *request);
+   request->file = file;
+   request->offset = offset;
+   request->requiredSize = size;
+
+   reply = BenchSend(sizeof *request, size, &status, &ns);
+   BenchOpRecord(op, ns, status != HGFS_STATUS_SUCCESS);
+   *actualSize = status == HGFS_STATUS_SUCCESS ? reply->actualSize : 0;
+   return status;
+}
+
+
+static uint32
+BenchCopyRange(BenchOp *op,          // IN/OUT
+               HgfsHandle srcFile,   // IN
+               HgfsHandle dstFile,   // IN
+               uint64 offset,        // IN: same in both files
+               uint64 length,        // IN
+               uint64 *actualSize)   // OUT
+{
+   HgfsRequestCopyRangeV4 *request = BenchRequestInit(HGFS_OP_COPY_RANGE_V4);
+   HgfsReplyCopyRangeV4 *reply;
+   uint32 status;
+   uint64 ns;
+
+   memset(request, 0, sizeof *request);
+   request->srcFile = srcFile;
+   request->dstFile = dstFile;
+   request->srcOffset = offset;
+   request->dstOffset = offset;
+   request->length = length;
+
+   reply = BenchSend(sizeof *request, 0, &status, &ns);
+   BenchOpRecord(op, ns, status != HGFS_STATUS_SUCCESS);
+   *actualSize = status == HGFS_STATUS_SUCCESS ? reply->actualSize : 0;
+   return status;
+}
+
+
+static uint32
+BenchFsync(BenchOp *op,          // IN/OUT
+           HgfsHandle file,      // IN: file or search handle
+           Bool dataOnly)        // IN
+{
+   HgfsRequestFsyncV4 *request = BenchRequestInit(HGFS_OP_FSYNC_V4);
+   uint32 status;
+   uint64 ns;
+
+   memset(request, 0, sizeof *request);
+   request->fid = file;
+   request->flags = dataOnly ? HGFS_FSYNC_DATA_ONLY : 0;
+   BenchSend(sizeof *request, 0, &status, &ns);
+   BenchOpRecord(op, ns, status != HGFS_STATUS_SUCCESS);
+   return status;
+}
+
+
+static uint32
+BenchGetattr(BenchOp *op,          // IN/OUT
+             const char *path)     // IN
+{
+   HgfsRequestGetattrV3 *request = BenchRequestInit(HGFS_OP_GETATTR_V3);
+   size_t nameLen;
+   uint32 status;
+   uint64 ns;
+
+   memset(request, 0, sizeof *request);
+   nameLen = HgfsTest_FileName(&request->fileName, path);
+   BenchSend(sizeof *request + nameLen, 0, &status, &ns);
+   BenchOpRecord(op, ns, status != HGFS_STATUS_SUCCESS);
+   return status;
+}
+
+
+static uint32
+BenchAccessCheck(BenchOp *op,            // IN/OUT
+                 const char *path,       // IN
+                 HgfsPermissions perms)  // IN
+{
+   HgfsRequestAccessCheckV4 *request =
+      BenchRequestInit(HGFS_OP_ACCESS_CHECK_V4);
+   char *tail;
+   size_t nameLen;
+   uint32 status;
+   uint64 ns;
+
+   memset(request, 0, sizeof *request);
+   nameLen = HgfsTest_FileName(&request->fileName, path);
+
+   /* The permissions and reserved field follow the name. */
+   tail = request->fileName.name + nameLen + 1;
+   memset(tail, 0, sizeof request->perms + sizeof request->reserved);
+   *tail = perms;
+
+   BenchSend(sizeof *request + nameLen, 0, &status, &ns);
+   BenchOpRecord(op, ns, status != HGFS_STATUS_SUCCESS);
+   return status;
+}
+
+
+static uint32
+BenchQueryChanges(BenchOp *op,                            // IN/OUT
+                  const char *path,                       // IN: directory
+                  uint64 token,                           // IN
+                  const HgfsReplyQueryChangesV4 **reply)  // OUT: valid until
+                                                          //      the next request
+{
+   HgfsRequestQueryChangesV4 *request =
+      BenchRequestInit(HGFS_OP_QUERY_CHANGES_V4);
+   size_t nameLen;
+   uint32 status;
+   uint64 ns;
+
+   memset(request, 0, sizeof *request);
+   request->token = token;
+   request->maxReplySize = BENCH_CHANGES_SIZE;
+   nameLen = HgfsTest_FileName(&request->fileName, path);
+
+   *reply = BenchSend(sizeof *request + nameLen, 0, &status, &ns);
+   BenchOpRecord(op, ns, status != HGFS_STATUS_SUCCESS);
+   return status;
+}
+
+
+static uint32
+BenchDelete(BenchOp *op,           // IN/OUT
+            const char *path,      // IN
+            Bool dir)              // IN
+{
+   HgfsRequestDeleteV3 *request =
+      BenchRequestInit(dir ? HGFS_OP_DELETE_DIR_V3 : HGFS_OP_DELETE_FILE_V3);
+   size_t nameLen;
+   uint32 status;
+   uint64 ns;
+
+   memset(request, 0, sizeof *request);
+   nameLen = HgfsTest_FileName(&request->fileName, path);
+   BenchSend(sizeof *request + nameLen, 0, &status, &ns);
+   BenchOpRecord(op, ns, status != HGFS_STATUS_SUCCESS);
+   return status;
+}
+
+
+static uint32
+BenchCreateDir(BenchOp *op,        // IN/OUT
+               const char *path)   // IN
+{
+   HgfsRequestCreateDirV3 *request = BenchRequestInit(HGFS_OP_CREATE_DIR_V3);
+   size_t nameLen;
+   uint32 status;
+   uint64 ns;
+
+   memset(request, 0, sizeof *request);
+   request->mask = HGFS_CREATE_DIR_VALID_OWNER_PERMS |
+                   HGFS_CREATE_DIR_VALID_FILE_NAME;
+   request->ownerPerms = HGFS_PERM_READ | HGFS_PERM_WRITE | HGFS_PERM_EXEC;
+   nameLen = HgfsTest_FileName(&request->fileName, path);
+   BenchSend(sizeof *request + nameLen, 0, &status, &ns);
+   BenchOpRecord(op, ns, status != HGFS_STATUS_SUCCESS);
+   return status;
+}
+
+
+static uint32
+BenchSearchOpen(BenchOp *op,           // IN/OUT
+                const char *path,      // IN
+                HgfsHandle *search)    // OUT
+{
+   HgfsRequestSearchOpenV3 *request =
+      BenchRequestInit(HGFS_OP_SEARCH_OPEN_V3);
+   HgfsReplySearchOpenV3 *reply;
+   size_t nameLen;
+   uint32 status;
+   uint64 ns;
+
+   memset(request, 0, sizeof *request);
+   nameLen = HgfsTest_FileName(&request->dirName, path);
+   reply = BenchSend(sizeof *request + nameLen, 0, &status, &ns);
+   BenchOpRecord(op, ns, status != HGFS_STATUS_SUCCESS);
+   *search = status == HGFS_STATUS_SUCCESS ? reply->search
+                                           : HGFS_INVALID_HANDLE;
+   return status;
+}
+
+
+static uint32
+BenchSearchRead(BenchOp *op,           // IN/OUT
+                HgfsHandle search,     // IN
+                uint32 index,          // IN
+                uint32 *numEntries,    // OUT
+                Bool *done)            // OUT
+{
+   HgfsRequestSearchReadV4 *request =
+      BenchRequestInit(HGFS_OP_SEARCH_READ_V4);
+   HgfsReplySearchReadV4 *reply;
+   uint32 status;
+   uint64 ns;
+
+   memset(request, 0, sizeof *request);
+   request->mask = HGFS_SEARCH_READ_NAME | HGFS_SEARCH_READ_FILE_SIZE |
+                   HGFS_SEARCH_READ_TIME_STAMP |
+                   HGFS_SEARCH_READ_FILE_ATTRIBUTES |
+                   HGFS_SEARCH_READ_FILE_NODE_TYPE;
+   request->fid = search;
+   request->replyDirEntryMaxSize = HGFS_LARGE_IO_MAX;
+   request->restartIndex = index;
+
+   reply = BenchSend(sizeof *request, HGFS_LARGE_IO_MAX, &status, &ns);
+   BenchOpRecord(op, ns, status != HGFS_STATUS_SUCCESS);
+   if (status == HGFS_STATUS_SUCCESS) {
+      *numEntries = reply->numberEntriesReturned;
+      *done = reply->numberEntriesReturned == 0 ||
+              0 != (reply->flags & HGFS_SEARCH_READ_REPLY_FINAL_ENTRY);
+   } else {
+      *numEntries = 0;
+      *done = TRUE;
+   }
+   return status;
+}
+
+
+static uint32
+BenchSearchClose(BenchOp *op,          // IN/OUT
+                 HgfsHandle search)    // IN
+{
+   HgfsRequestSearchCloseV3 *request =
+      BenchRequestInit(HGFS_OP_SEARCH_CLOSE_V3);
+   uint32 status;
+   uint64 ns;
+
+   memset(request, 0, sizeof *request);
+   request->search = search;
+   BenchSend(sizeof *request, 0, &status, &ns);
+   BenchOpRecord(op, ns, status != HGFS_STATUS_SUCCESS);
+   return status;
+}
+
+
+/*
+ * Workloads.
+ */
+
+static void
+BenchSmallFiles(const BenchParams *params,   // IN
+                const char *dir)             // IN: scratch directory
+{
+   BenchOp create, write, close, stat, delete, setup;
+   char path[PATH_MAX];
+   uint32 i;
+
+   BenchOpInit(&create, "create");
+   BenchOpInit(&write, "write 4K");
+   BenchOpInit(&close, "close");
+   BenchOpInit(&stat, "stat");
+   BenchOpInit(&delete, "delete");
+   BenchOpInit(&setup, "mkdir");
+
+   HgfsTest_Path(path, "%s/small", dir);
+   BenchCreateDir(&setup, path);
+
+   for (i = 0; i < params->numFiles; i++) {
+      HgfsHandle file;
+
+      HgfsTest_Path(path, "%s/small/file%u", dir, i);
+      if (BenchOpen(&create, path, HGFS_OPEN_MODE_READ_WRITE,
+                    HGFS_OPEN_CREATE_EMPTY, &file) == HGFS_STATUS_SUCCESS) {
+         BenchWrite(&write, file, 0, BENCH_PAGE_SIZE);
+         BenchClose(&close, file);
+      }
+   }
+   for (i = 0; i < params->numFiles; i++) {
+      HgfsTest_Path(path, "%s/small/file%u", dir, i);
+      BenchGetattr(&stat, path);
+   }
+   for (i = 0; i < params->numFiles; i++) {
+      HgfsTest_Path(path, "%s/small/file%u", dir, i);
+      BenchDelete(&delete, path, FALSE);
+   }
+
+   HgfsTest_Path(path, "%s/small", dir);
+   BenchDelete(&setup, path, TRUE);
+
+   printf("smallfile: %u files\n", params->numFiles);
+   BenchOpReport(&create, 0);
+   BenchOpReport(&write, (uint64)write.numSamples * BENCH_PAGE_SIZE);
+   BenchOpReport(&close, 0);
+   BenchOpReport(&stat, 0);
+   BenchOpReport(&delete, 0);
+   free(setup.samplesNs);
+}
+
+
+static void
+BenchSequentialIo(const BenchParams *params,   // IN
+                  const char *dir)             // IN: scratch directory
+{
+   BenchOp write, read, other;
+   char path[PATH_MAX];
+   HgfsHandle file;
+   uint64 offset;
+   uint64 bytesRead = 0;
+
+   BenchOpInit(&write, "write");
+   BenchOpInit(&read, "read");
+   BenchOpInit(&other, "other");
+
+   HgfsTest_Path(path, "%s/sequential", dir);
+   if (BenchOpen(&other, path, HGFS_OPEN_MODE_READ_WRITE,
+                 HGFS_OPEN_CREATE_EMPTY, &file) != HGFS_STATUS_SUCCESS) {
+      fprintf(stderr, "seqio: cannot create %s\n", path);
+      return;
+   }
+   for (offset = 0; offset < params->fileSize; offset += params->blockSize) {
+      BenchWrite(&write, file, offset, params->blockSize);
+   }
+   BenchClose(&other, file);
+
+   if (BenchOpen(&other, path, HGFS_OPEN_MODE_READ_ONLY, HGFS_OPEN,
+                 &file) == HGFS_STATUS_SUCCESS) {
+      for (offset = 0; offset < params->fileSize; ) {
+         uint32 actualSize;
+
+         if (BenchRead(&read, file, offset, params->blockSize,
+                       &actualSize) != HGFS_STATUS_SUCCESS ||
+             actualSize == 0) {
+            break;
+         }
+         offset += actualSize;
+         bytesRead += actualSize;
+      }
+      BenchClose(&other, file);
+   }
+   BenchDelete(&other, path, FALSE);
+
+   printf("seqio: %"FMT64"u MB file, %u byte blocks\n",
+          params->fileSize / (1024 * 1024), params->blockSize);
+   BenchOpReport(&write, (uint64)write.numSamples * params->blockSize);
+   BenchOpReport(&read, bytesRead);
+   free(other.samplesNs);
+}
+
+
+static void
+BenchDeepTree(const BenchParams *params,   // IN
+              const char *dir)             // IN: scratch directory
+{
+   BenchOp stat, setup;
+   char path[PATH_MAX];
+   char leaf[PATH_MAX];
+   size_t len;
+   HgfsHandle file;
+   uint32 i;
+
+   BenchOpInit(&stat, "stat");
+   BenchOpInit(&setup, "setup");
+
+   HgfsTest_Path(path, "%s/tree", dir);
+   len = strlen(path);
+   BenchCreateDir(&setup, path);
+   for (i = 0; i < params->treeDepth && len + 16 < sizeof path; i++) {
+      len += snprintf(path + len, sizeof path - len, "/level%u", i);
+      BenchCreateDir(&setup, path);
+   }
+   HgfsTest_Path(leaf, "%s/leaf", path);
+   if (BenchOpen(&setup, leaf, HGFS_OPEN_MODE_READ_WRITE,
+                 HGFS_OPEN_CREATE_EMPTY, &file) == HGFS_STATUS_SUCCESS) {
+      BenchClose(&setup, file);
+   }
+
+   for (i = 0; i < params->numLookups; i++) {
+      BenchGetattr(&stat, leaf);
+   }
+
+   BenchDelete(&setup, leaf, FALSE);
+   while (len > strlen(dir)) {
+      BenchDelete(&setup, path, TRUE);
+      while (path[--len] != '/') {
+      }
+      path[len] = '\0';
+   }
+
+   printf("deeptree: depth %u, %u lookups\n", i == 0 ? 0 : params->treeDepth,
+          params->numLookups);
+   BenchOpReport(&stat, 0);
+   free(setup.samplesNs);
+}
+
+
+static void
+BenchDirList(const BenchParams *params,   // IN
+             const char *dir)             // IN: scratch directory
+{
+   BenchOp open, read, close, setup;
+   char path[PATH_MAX];
+   HgfsHandle search;
+   uint32 listed = 0;
+   uint32 i;
+
+   BenchOpInit(&open, "search open");
+   BenchOpInit(&read, "search read");
+   BenchOpInit(&close, "search close");
+   BenchOpInit(&setup, "setup");
+
+   HgfsTest_Path(path, "%s/list", dir);
+   BenchCreateDir(&setup, path);
+   for (i = 0; i < params->numEntries; i++) {
+      HgfsHandle file;
+
+      HgfsTest_Path(path, "%s/list/entry-with-a-longer-name-%u", dir, i);
+      if (BenchOpen(&setup, path, HGFS_OPEN_MODE_READ_WRITE,
+                    HGFS_OPEN_CREATE_EMPTY, &file) == HGFS_STATUS_SUCCESS) {
+         BenchClose(&setup, file);
+      }
+   }
+
+   HgfsTest_Path(path, "%s/list", dir);
+   if (BenchSearchOpen(&open, path, &search) == HGFS_STATUS_SUCCESS) {
+      Bool done = FALSE;
+
+      while (!done) {
+         uint32 numEntries;
+
+         BenchSearchRead(&read, search, listed, &numEntries, &done);
+         listed += numEntries;
+      }
+      BenchSearchClose(&close, search);
+   }
+
+   for (i = 0; i < params->numEntries; i++) {
+      HgfsTest_Path(path, "%s/list/entry-with-a-longer-name-%u", dir, i);
+      BenchDelete(&setup, path, FALSE);
+   }
+   HgfsTest_Path(path, "%s/list", dir);
+   BenchDelete(&setup, path, TRUE);
+
+   printf("dirlist: %u entries, %u listed\n", params->numEntries, listed);
+   BenchOpReport(&open, 0);
+   BenchOpReport(&read, 0);
+   BenchOpReport(&close, 0);
+   free(setup.samplesNs);
+}
+
+
+/*
+ * Allocates the requests in flight of a workload, with room for data
+ * packets of up to maxDataSize bytes.
+ */
+
+static HgfsTestRequest **
+BenchSlotsAlloc(uint32 depth,          // IN
+                size_t maxDataSize)    // IN
+{
+   HgfsTestRequest **slots = calloc(depth, sizeof *slots);
+   uint32 i;
+
+   if (slots == NULL) {
+      fprintf(stderr, "out of memory\n");
+      exit(EXIT_FAILURE);
+   }
+   for (i = 0; i < depth; i++) {
+      slots[i] = HgfsTest_RequestAlloc(BENCH_PAGE_SIZE, BENCH_PAGE_SIZE,
+                                       maxDataSize);
+   }
+   return slots;
+}
+
+
+static void
+BenchSlotsFree(HgfsTestRequest **slots,   // IN
+               uint32 depth)              // IN
+{
+   uint32 i;
+
+   for (i = 0; i < depth; i++) {
+      HgfsTest_RequestFree(slots[i]);
+   }
+   free(slots);
+}
+
+
+/*
+ * Sends a random page sized read of a file from a slot, without waiting
+ * for the reply.
+ */
+
+static void
+BenchRandomReadSubmit(HgfsTestRequest *slot,   // IN/OUT
+                      HgfsHandle file,         // IN
+                      uint64 numPages,         // IN: file size in pages
+                      char *data)              // IN: page for the data
+{
+   HgfsRequestReadV3 *request = HgfsTest_RequestInit(slot,
+                                                     HGFS_OP_READ_FAST_V4,
+                                                     HGFS_PACKET_FLAG_REQUEST);
+
+   memset(request, 0, sizeof *request);
+   request->file = file;
+   request->offset = (uint64)(random() % numPages) * BENCH_PAGE_SIZE;
+   request->requiredSize = BENCH_PAGE_SIZE;
+   HgfsTest_Submit(slot, sizeof *request, data, BENCH_PAGE_SIZE);
+}
+
+
+static void
+BenchRandomRead(const BenchParams *params,   // IN
+                const char *dir)             // IN: scratch directory
+{
+   BenchOp read, other;
+   char path[PATH_MAX];
+   HgfsTestRequest **slots;
+   HgfsHandle file;
+   uint64 numPages = params->fileSize / BENCH_PAGE_SIZE;
+   uint32 depth = MIN(params->queueDepth, params->numReads);
+   uint32 issued = 0;
+   uint32 completed = 0;
+   uint64 offset;
+   uint64 start;
+   uint64 wallNs;
+   uint32 i;
+
+   if (numPages == 0 || depth == 0) {
+      return;
+   }
+
+   BenchOpInit(&read, "read 4K");
+   BenchOpInit(&other, "other");
+
+   HgfsTest_Path(path, "%s/random", dir);
+   if (BenchOpen(&other, path, HGFS_OPEN_MODE_READ_WRITE,
+                 HGFS_OPEN_CREATE_EMPTY, &file) != HGFS_STATUS_SUCCESS) {
+      fprintf(stderr, "randread: cannot create %s\n", path);
+      return;
+   }
+   for (offset = 0; offset < params->fileSize; offset += params->blockSize) {
+      BenchWrite(&other, file, offset, params->blockSize);
+   }
+   BenchClose(&other, file);
+
+   if (BenchOpen(&other, path, HGFS_OPEN_MODE_READ_ONLY, HGFS_OPEN,
+                 &file) != HGFS_STATUS_SUCCESS) {
+      BenchDelete(&other, path, FALSE);
+      free(other.samplesNs);
+      return;
+   }
+
+   slots = BenchSlotsAlloc(depth, BENCH_PAGE_SIZE);
+
+   srandom(1);
+   start = HgfsTest_NowNs();
+   for (; issued < depth; issued++) {
+      BenchRandomReadSubmit(slots[issued], file, numPages,
+                            gClient.data + issued * BENCH_PAGE_SIZE);
+   }
+   while (completed < params->numReads) {
+      HgfsReplyReadV3 *reply;
+      uint32 status;
+
+      i = HgfsTest_ReapAny(slots, depth);
+      reply = HgfsTest_Reply(slots[i], sizeof *reply, &status);
+      BenchOpRecord(&read, HgfsTest_NowNs() - slots[i]->startNs,
+                    status != HGFS_STATUS_SUCCESS ||
+                    reply->actualSize != BENCH_PAGE_SIZE);
+      completed++;
+
+      if (issued < params->numReads) {
+         BenchRandomReadSubmit(slots[i], file, numPages,
+                               gClient.data + i * BENCH_PAGE_SIZE);
+         issued++;
+      }
+   }
+   wallNs = HgfsTest_NowNs() - start;
+
+   BenchSlotsFree(slots, depth);
+
+   BenchClose(&other, file);
+   BenchDelete(&other, path, FALSE);
+
+   printf("randread: %"FMT64"u MB file, %u reads, queue depth %u, "
+          "%.0f reads/s\n", params->fileSize / (1024 * 1024),
+          params->numReads, depth, params->numReads / (wallNs / 1e9));
+   BenchOpReport(&read, 0);
+   free(other.samplesNs);
+}
+
+
+/*
+ * Checks that two files on the host have the same contents.
+ */
+
+static Bool
+BenchSameContents(const char *path1,   // IN
+                  const char *path2)   // IN
+{
+   static char buf1[64 * 1024];
+   static char buf2[64 * 1024];
+   int fd1 = open(path1, O_RDONLY);
+   int fd2 = open(path2, O_RDONLY);
+   Bool same = fd1 >= 0 && fd2 >= 0;
+
+   while (same) {
+      ssize_t len1 = read(fd1, buf1, sizeof buf1);
+      ssize_t len2 = read(fd2, buf2, sizeof buf2);
+
+      same = len1 == len2 && len1 >= 0 && memcmp(buf1, buf2, len1) == 0;
+      if (len1 <= 0) {
+         break;
+      }
+   }
+   if (fd1 >= 0) {
+      close(fd1);
+   }
+   if (fd2 >= 0) {
+      close(fd2);
+   }
+   return same;
+}
+
+
+static void
+BenchCopy(const BenchParams *params,   // IN
+          const char *dir)             // IN: scratch directory
+{
+   BenchOp copy, read, write, other;
+   char srcPath[PATH_MAX];
+   char dstPath[PATH_MAX];
+   HgfsHandle srcFile;
+   HgfsHandle dstFile;
+   uint64 offset;
+   uint64 actualSize;
+   uint64 copied = 0;
+   uint64 serverNs = 0;
+   uint64 clientNs = 0;
+   Bool same = FALSE;
+
+   BenchOpInit(&copy, "copy range");
+   BenchOpInit(&read, "read");
+   BenchOpInit(&write, "write");
+   BenchOpInit(&other, "other");
+
+   HgfsTest_Path(srcPath, "%s/copysrc", dir);
+   HgfsTest_Path(dstPath, "%s/copydst", dir);
+   if (BenchOpen(&other, srcPath, HGFS_OPEN_MODE_READ_WRITE,
+                 HGFS_OPEN_CREATE_EMPTY, &srcFile) != HGFS_STATUS_SUCCESS) {
+      fprintf(stderr, "copy: cannot create %s\n", srcPath);
+      return;
+   }
+   for (offset = 0; offset < params->fileSize; offset += params->blockSize) {
+      BenchWrite(&other, srcFile, offset, params->blockSize);
+   }
+   BenchClose(&other, srcFile);
+
+   if (BenchOpen(&other, srcPath, HGFS_OPEN_MODE_READ_ONLY, HGFS_OPEN,
+                 &srcFile) != HGFS_STATUS_SUCCESS) {
+      goto exit;
+   }
+
+   /* Copied by the server. */
+   if (BenchOpen(&other, dstPath, HGFS_OPEN_MODE_READ_WRITE,
+                 HGFS_OPEN_CREATE_EMPTY, &dstFile) == HGFS_STATUS_SUCCESS) {
+      uint64 start = HgfsTest_NowNs();
+
+      /* To the end of the file, which may be past fileSize. */
+      for (offset = 0; ; offset += actualSize) {
+         if (BenchCopyRange(&copy, srcFile, dstFile, offset,
+                            HGFS_COPY_RANGE_MAX,
+                            &actualSize) != HGFS_STATUS_SUCCESS ||
+             actualSize == 0) {
+            break;
+         }
+      }
+      serverNs = HgfsTest_NowNs() - start;
+      copied = offset;
+      BenchClose(&other, dstFile);
+      same = BenchSameContents(srcPath, dstPath);
+      BenchDelete(&other, dstPath, FALSE);
+   }
+
+   /* Copied by the client through its own buffer. */
+   if (BenchOpen(&other, dstPath, HGFS_OPEN_MODE_READ_WRITE,
+                 HGFS_OPEN_CREATE_EMPTY, &dstFile) == HGFS_STATUS_SUCCESS) {
+      uint64 start = HgfsTest_NowNs();
+
+      for (offset = 0; ; ) {
+         uint32 actualSize;
+
+         if (BenchRead(&read, srcFile, offset, params->blockSize,
+                       &actualSize) != HGFS_STATUS_SUCCESS ||
+             actualSize == 0 ||
+             BenchWrite(&write, dstFile, offset,
+                        actualSize) != HGFS_STATUS_SUCCESS) {
+            break;
+         }
+         offset += actualSize;
+      }
+      clientNs = HgfsTest_NowNs() - start;
+      BenchClose(&other, dstFile);
+      BenchDelete(&other, dstPath, FALSE);
+   }
+   BenchClose(&other, srcFile);
+
+   printf("copy: %"FMT64"u MB file, %s, server %.1f ms, client %.1f ms\n",
+          params->fileSize / (1024 * 1024),
+          same ? "copy matches" : "COPY MISMATCH",
+          serverNs / 1e6, clientNs / 1e6);
+   BenchOpReport(&copy, copied);
+   BenchOpReport(&read, (uint64)read.numSamples * params->blockSize);
+   BenchOpReport(&write, (uint64)write.numSamples * params->blockSize);
+
+exit:
+   BenchDelete(&other, srcPath, FALSE);
+   free(other.samplesNs);
+}
+
+
+static void
+BenchFlush(const BenchParams *params,   // IN
+           const char *dir)             // IN: scratch directory
+{
+   BenchOp fsync, fdatasync, dirSync, reopen, other;
+   char path[PATH_MAX];
+   HgfsHandle file;
+   HgfsHandle search;
+   uint64 offset;
+
+   BenchOpInit(&fsync, "fsync");
+   BenchOpInit(&fdatasync, "fdatasync");
+   BenchOpInit(&dirSync, "fsync dir");
+   BenchOpInit(&reopen, "close+open");
+   BenchOpInit(&other, "other");
+
+   HgfsTest_Path(path, "%s/flush", dir);
+   if (BenchOpen(&other, path, HGFS_OPEN_MODE_READ_WRITE,
+                 HGFS_OPEN_CREATE_EMPTY, &file) != HGFS_STATUS_SUCCESS) {
+      fprintf(stderr, "fsync: cannot create %s\n", path);
+      return;
+   }
+   for (offset = 0; offset < params->fileSize; offset += params->blockSize) {
+      BenchWrite(&other, file, offset, params->blockSize);
+      BenchFsync(&fsync, file, FALSE);
+      BenchWrite(&other, file, offset, params->blockSize);
+      BenchFsync(&fdatasync, file, TRUE);
+   }
+
+   /* What clients without fsync do to get their data written. */
+   for (offset = 0;
+        offset < params->fileSize && file != HGFS_INVALID_HANDLE;
+        offset += params->blockSize) {
+      uint64 start;
+      uint32 status;
+
+      BenchWrite(&other, file, offset, params->blockSize);
+      start = HgfsTest_NowNs();
+      status = BenchClose(&other, file);
+      if (status == HGFS_STATUS_SUCCESS) {
+         status = BenchOpen(&other, path, HGFS_OPEN_MODE_READ_WRITE,
+                            HGFS_OPEN, &file);
+      }
+      BenchOpRecord(&reopen, HgfsTest_NowNs() - start,
+                    status != HGFS_STATUS_SUCCESS);
+   }
+   if (file != HGFS_INVALID_HANDLE) {
+      BenchClose(&other, file);
+   }
+
+   if (BenchSearchOpen(&other, dir, &search) == HGFS_STATUS_SUCCESS) {
+      BenchFsync(&dirSync, search, FALSE);
+      BenchSearchClose(&other, search);
+   }
+   BenchDelete(&other, path, FALSE);
+
+   printf("fsync: %"FMT64"u MB file, %u byte blocks\n",
+          params->fileSize / (1024 * 1024), params->blockSize);
+   BenchOpReport(&fsync, 0);
+   BenchOpReport(&fdatasync, 0);
+   BenchOpReport(&dirSync, 0);
+   BenchOpReport(&reopen, 0);
+   free(other.samplesNs);
+}
+
+
+static void
+BenchAccess(const BenchParams *params,   // IN
+            const char *dir)             // IN: scratch directory
+{
+   BenchOp access, stat, openClose, denied, other;
+   char path[PATH_MAX];
+   Bool execDenied = TRUE;
+   Bool missingNotFound;
+   uint32 i;
+
+   BenchOpInit(&access, "access");
+   BenchOpInit(&stat, "stat");
+   BenchOpInit(&openClose, "open+close");
+   BenchOpInit(&denied, "denied");
+   BenchOpInit(&other, "other");
+
+   HgfsTest_Path(path, "%s/access", dir);
+   BenchCreateDir(&other, path);
+   for (i = 0; i < params->numFiles; i++) {
+      HgfsHandle file;
+
+      HgfsTest_Path(path, "%s/access/file%u", dir, i);
+      if (BenchOpen(&other, path, HGFS_OPEN_MODE_READ_WRITE,
+                    HGFS_OPEN_CREATE_EMPTY, &file) == HGFS_STATUS_SUCCESS) {
+         BenchClose(&other, file);
+      }
+   }
+
+   /* The ways clients can tell whether they may read a file. */
+   for (i = 0; i < params->numFiles; i++) {
+      HgfsHandle file;
+      uint64 start;
+      uint32 status;
+
+      HgfsTest_Path(path, "%s/access/file%u", dir, i);
+      BenchAccessCheck(&access, path, HGFS_PERM_READ | HGFS_PERM_WRITE);
+      BenchGetattr(&stat, path);
+
+      start = HgfsTest_NowNs();
+      status = BenchOpen(&other, path, HGFS_OPEN_MODE_READ_WRITE, HGFS_OPEN,
+                         &file);
+      if (status == HGFS_STATUS_SUCCESS) {
+         status = BenchClose(&other, file);
+      }
+      BenchOpRecord(&openClose, HgfsTest_NowNs() - start,
+                    status != HGFS_STATUS_SUCCESS);
+
+      /* The files are created without any execute permission. */
+      execDenied &= BenchAccessCheck(&denied, path, HGFS_PERM_EXEC) ==
+                    HGFS_STATUS_ACCESS_DENIED;
+   }
+
+   HgfsTest_Path(path, "%s/access/missing", dir);
+   missingNotFound = BenchAccessCheck(&denied, path, HGFS_PERM_EXISTS) ==
+                     HGFS_STATUS_NO_SUCH_FILE_OR_DIR;
+
+   for (i = 0; i < params->numFiles; i++) {
+      HgfsTest_Path(path, "%s/access/file%u", dir, i);
+      BenchDelete(&other, path, FALSE);
+   }
+   HgfsTest_Path(path, "%s/access", dir);
+   BenchDelete(&other, path, TRUE);
+
+   printf("access: %u files, %s, %s\n", params->numFiles,
+          execDenied ? "exec denied" : "EXEC NOT DENIED",
+          missingNotFound ? "missing not found" : "MISSING FOUND");
+   BenchOpReport(&access, 0);
+   BenchOpReport(&stat, 0);
+   BenchOpReport(&openClose, 0);
+   free(denied.samplesNs);
+   free(other.samplesNs);
+}
+
+
+/*
+ * Marks the files of the journal directory named by the change records of
+ * a query reply as seen. Returns the number of records.
+ */
+
+static uint32
+BenchJournalSeen(const HgfsReplyQueryChangesV4 *reply,   // IN
+                 Bool *seen,                             // IN/OUT
+                 uint32 numFiles)                        // IN
+{
+   const char *next = (const char *)(reply + 1);
+   uint32 i;
+
+   for (i = 0; i < reply->count; i++) {
+      const HgfsChangeRecordV4 *record = (const HgfsChangeRecordV4 *)next;
+      const char *name = record->fileName.name;
+      const char *last = name + record->fileName.length;
+      char component[NAME_MAX + 1];
+      uint32 index;
+
+      /* The cross-platform name separates its components with NULs. */
+      while (last > name && last[-1] != '\0') {
+         last--;
+      }
+      snprintf(component, sizeof component, "%.*s",
+               (int)(name + record->fileName.length - last), last);
+      if (sscanf(component, "file%u", &index) == 1 && index < numFiles) {
+         seen[index] = TRUE;
+      }
+      next += record->nextOffset;
+   }
+   return reply->count;
+}
+
+
+static void
+BenchJournal(const BenchParams *params,   // IN
+             const char *dir)             // IN: scratch directory
+{
+   BenchOp query, idle, rescan, other;
+   const HgfsReplyQueryChangesV4 *reply;
+   char path[PATH_MAX];
+   char journalDir[PATH_MAX];
+   uint32 numChanged = MAX(1, params->numFiles / 100);
+   uint32 numRecords = 0;
+   uint32 missed = 0;
+   Bool resync;
+   Bool *seen;
+   uint64 token;
+   uint32 status;
+   uint32 round;
+   uint32 i;
+
+   BenchOpInit(&query, "query");
+   BenchOpInit(&idle, "query idle");
+   BenchOpInit(&rescan, "rescan");
+   BenchOpInit(&other, "other");
+
+   seen = calloc(params->numFiles, sizeof *seen);
+   HgfsTest_Path(journalDir, "%s/journal", dir);
+   BenchCreateDir(&other, journalDir);
+   for (i = 0; i < params->numFiles; i++) {
+      HgfsHandle file;
+
+      HgfsTest_Path(path, "%s/file%u", journalDir, i);
+      if (BenchOpen(&other, path, HGFS_OPEN_MODE_READ_WRITE,
+                    HGFS_OPEN_CREATE_EMPTY, &file) == HGFS_STATUS_SUCCESS) {
+         BenchClose(&other, file);
+      }
+   }
+
+   /* The first query starts the journal and asks for a rescan. */
+   status = BenchQueryChanges(&other, journalDir, 0, &reply);
+   if (status != HGFS_STATUS_SUCCESS) {
+      printf("journal: query failed with %u, are notifications enabled?\n",
+             status);
+      goto exit;
+   }
+   resync = 0 != (reply->flags & HGFS_QUERY_CHANGES_RESYNC);
+   token = reply->token;
+
+   for (round = 0; round < BENCH_JOURNAL_ROUNDS; round++) {
+      HgfsHandle search;
+      uint32 attempts;
+      uint32 numSeen = 0;
+      uint64 start;
+
+      memset(seen, 0, params->numFiles * sizeof *seen);
+      for (i = 0; i < numChanged; i++) {
+         HgfsHandle file;
+
+         HgfsTest_Path(path, "%s/file%u", journalDir,
+                   (round * numChanged + i) % params->numFiles);
+         if (BenchOpen(&other, path, HGFS_OPEN_MODE_READ_WRITE, HGFS_OPEN,
+                       &file) == HGFS_STATUS_SUCCESS) {
+            BenchWrite(&other, file, 0, BENCH_PAGE_SIZE);
+            BenchClose(&other, file);
+         }
+      }
+
+      /* The changes reach the journal asynchronously, through inotify. */
+      for (attempts = 0; numSeen < numChanged && attempts < 1000; attempts++) {
+         if (BenchQueryChanges(&query, journalDir, token,
+                               &reply) != HGFS_STATUS_SUCCESS) {
+            break;
+         }
+         resync |= round > 0 && 0 != (reply->flags & HGFS_QUERY_CHANGES_RESYNC);
+         numRecords += BenchJournalSeen(reply, seen, params->numFiles);
+         token = reply->token;
+         for (numSeen = 0, i = 0; i < params->numFiles; i++) {
+            numSeen += seen[i];
+         }
+         if (numSeen < numChanged && reply->count == 0) {
+            usleep(1000);
+         }
+      }
+      missed += numChanged - numSeen;
+
+      if (BenchQueryChanges(&idle, journalDir, token,
+                            &reply) == HGFS_STATUS_SUCCESS) {
+         token = reply->token;
+      }
+
+      /* What a client without the journal does to find the changes. */
+      start = HgfsTest_NowNs();
+      status = BenchSearchOpen(&other, journalDir, &search);
+      if (status == HGFS_STATUS_SUCCESS) {
+         uint32 listed = 0;
+         Bool done = FALSE;
+
+         while (!done) {
+            uint32 numEntries;
+
+            status = BenchSearchRead(&other, search, listed, &numEntries,
+                                     &done);
+            listed += numEntries;
+         }
+         BenchSearchClose(&other, search);
+      }
+      BenchOpRecord(&rescan, HgfsTest_NowNs() - start,
+                    status != HGFS_STATUS_SUCCESS);
+   }
+
+   printf("journal: %u files, %u changed per round, %u records, %s, %s\n",
+          params->numFiles, numChanged, numRecords,
+          missed == 0 ? "all changes seen" : "CHANGES MISSED",
+          resync ? "resync first" : "NO FIRST RESYNC");
+   BenchOpReport(&query, 0);
+   BenchOpReport(&idle, 0);
+   BenchOpReport(&rescan, 0);
+
+exit:
+   for (i = 0; i < params->numFiles; i++) {
+      HgfsTest_Path(path, "%s/file%u", journalDir, i);
+      BenchDelete(&other, path, FALSE);
+   }
+   BenchDelete(&other, journalDir, TRUE);
+   free(seen);
+   free(query.samplesNs);
+   free(idle.samplesNs);
+   free(rescan.samplesNs);
+   free(other.samplesNs);
+}
+
+
+/*
+ * Sends a read of a block of the bulk file from a slot, without waiting for
+ * the reply.
+ */
+
+static void
+BenchBulkReadSubmit(HgfsTestRequest *slot,   // IN/OUT
+                    HgfsHandle file,         // IN
+                    uint64 offset,           // IN
+                    uint32 size,             // IN
+                    char *data)              // IN: buffer for the data
+{
+   HgfsRequestReadV3 *request = HgfsTest_RequestInit(slot,
+                                                     HGFS_OP_READ_FAST_V4,
+                                                     HGFS_PACKET_FLAG_REQUEST);
+
+   memset(request, 0, sizeof *request);
+   request->file = file;
+   request->offset = offset;
+   request->requiredSize = size;
+   HgfsTest_Submit(slot, sizeof *request, data, size);
+}
+
+
+/*
+ * Records the replies of the bulk reads that have completed, and sends the
+ * next ones from their slots unless draining.
+ */
+
+static uint32
+BenchBulkReadReap(BenchOp *op,                // IN/OUT
+                  HgfsTestRequest **slots,    // IN/OUT
+                  uint32 depth,               // IN
+                  HgfsHandle file,       // IN
+                  uint64 fileSize,       // IN
+                  uint32 blockSize,      // IN
+                  uint64 *offset,        // IN/OUT: of the next read
+                  Bool drain,            // IN: wait for a reply, do not send
+                  uint64 *bytes)         // IN/OUT: bytes read
+{
+   uint32 reaped = 0;
+   uint32 i;
+
+   for (i = 0; i < depth; i++) {
+      HgfsReplyReadV3 *reply;
+      uint32 status;
+
+      if (!HgfsTest_Reap(slots[i], drain)) {
+         continue;
+      }
+
+      reply = HgfsTest_Reply(slots[i], sizeof *reply, &status);
+      BenchOpRecord(op, HgfsTest_NowNs() - slots[i]->startNs,
+                    status != HGFS_STATUS_SUCCESS);
+      if (status == HGFS_STATUS_SUCCESS) {
+         *bytes += reply->actualSize;
+      }
+      reaped++;
+
+      if (!drain) {
+         BenchBulkReadSubmit(slots[i], file, *offset, blockSize,
+                             gClient.data + (i + 1) * (size_t)blockSize);
+         *offset = (*offset + blockSize) % fileSize;
+      }
+   }
+   return reaped;
+}
+
+
+static void
+BenchThrottle(const BenchParams *params,   // IN
+              const char *dir)             // IN: scratch directory
+{
+   BenchOp stat, read, bulk, other;
+   char bulkPath[PATH_MAX];
+   char smallPath[PATH_MAX];
+   HgfsTestRequest **slots;
+   HgfsHandle bulkFile;
+   HgfsHandle smallFile;
+   uint64 maxData = (uint64)BENCH_MAX_DATA_PAGES * BENCH_PAGE_SIZE;
+   uint64 fileSize;
+   uint32 depth;
+   uint64 offset;
+   uint64 bytes = 0;
+   uint64 start;
+   uint64 wallNs;
+   char *stats;
+   char *line;
+   char *next;
+   uint32 i;
+
+   /* The first block of the data buffer is for the small reads. */
+   depth = (uint32)MIN(BENCH_BULK_DEPTH, maxData / params->blockSize - 1);
+   fileSize = params->fileSize / params->blockSize * params->blockSize;
+   if (depth == 0 || fileSize == 0) {
+      return;
+   }
+
+   BenchOpInit(&stat, "stat");
+   BenchOpInit(&read, "read 4K");
+   BenchOpInit(&bulk, "bulk read");
+   BenchOpInit(&other, "other");
+
+   HgfsTest_Path(bulkPath, "%s/bulk", dir);
+   HgfsTest_Path(smallPath, "%s/small", dir);
+   if (BenchOpen(&other, bulkPath, HGFS_OPEN_MODE_READ_WRITE,
+                 HGFS_OPEN_CREATE_EMPTY, &bulkFile) != HGFS_STATUS_SUCCESS) {
+      fprintf(stderr, "throttle: cannot create %s\n", bulkPath);
+      return;
+   }
+   for (offset = 0; offset < fileSize; offset += params->blockSize) {
+      BenchWrite(&other, bulkFile, offset, params->blockSize);
+   }
+   BenchClose(&other, bulkFile);
+   if (BenchOpen(&other, smallPath, HGFS_OPEN_MODE_READ_WRITE,
+                 HGFS_OPEN_CREATE_EMPTY, &smallFile) == HGFS_STATUS_SUCCESS) {
+      BenchWrite(&other, smallFile, 0, BENCH_PAGE_SIZE);
+      BenchClose(&other, smallFile);
+   }
+
+   if (BenchOpen(&other, bulkPath, HGFS_OPEN_MODE_READ_ONLY, HGFS_OPEN,
+                 &bulkFile) != HGFS_STATUS_SUCCESS) {
+      goto exit;
+   }
+   if (BenchOpen(&other, smallPath, HGFS_OPEN_MODE_READ_ONLY, HGFS_OPEN,
+                 &smallFile) != HGFS_STATUS_SUCCESS) {
+      BenchClose(&other, bulkFile);
+      goto exit;
+   }
+
+   slots = BenchSlotsAlloc(depth, params->blockSize);
+
+   start = HgfsTest_NowNs();
+   for (offset = 0, i = 0; i < depth; i++) {
+      BenchBulkReadSubmit(slots[i], bulkFile, offset,
+                          params->blockSize,
+                          gClient.data + (i + 1) * (size_t)params->blockSize);
+      offset = (offset + params->blockSize) % fileSize;
+   }
+
+   /* The interactive requests, sent while the bulk reads are in flight. */
+   for (i = 0; i < params->numReads; i++) {
+      uint32 actualSize;
+
+      BenchGetattr(&stat, smallPath);
+      BenchRead(&read, smallFile, 0, BENCH_PAGE_SIZE, &actualSize);
+      BenchBulkReadReap(&bulk, slots, depth, bulkFile, fileSize,
+                        params->blockSize, &offset, FALSE, &bytes);
+   }
+   BenchBulkReadReap(&bulk, slots, depth, bulkFile, fileSize,
+                     params->blockSize, &offset, TRUE, &bytes);
+   wallNs = HgfsTest_NowNs() - start;
+
+   BenchSlotsFree(slots, depth);
+
+   BenchClose(&other, smallFile);
+   BenchClose(&other, bulkFile);
+
+   printf("throttle: %u interactive rounds, %u bulk reads of %u bytes in "
+          "flight, bulk %.1f MB/s\n", params->numReads, depth,
+          params->blockSize, bytes / (wallNs / 1e9) / (1024 * 1024));
+   BenchOpReport(&stat, 0);
+   BenchOpReport(&read, 0);
+   BenchOpReport(&bulk, 0);
+
+   /* The throttle counters of the server. */
+   stats = HgfsServer_GetStats();
+   for (line = stats; line != NULL && *line != '\0'; line = next) {
+      next = strchr(line, '\n');
+      if (next != NULL) {
+         *next++ = '\0';
+      }
+      if (strncmp(line, "throttle ", 9) == 0) {
+         printf("  %s\n", line);
+      }
+   }
+   free(stats);
+
+exit:
+   BenchDelete(&other, smallPath, FALSE);
+   BenchDelete(&other, bulkPath, FALSE);
+   free(other.samplesNs);
+}
+
+
+static Bool
+BenchHasWorkload(const BenchParams *params,   // IN
+                 const char *name)            // IN
+{
+   const char *p = params->workloads;
+   size_t len = strlen(name);
+
+   if (strcmp(p, "all") == 0) {
+      return TRUE;
+   }
+   while ((p = strstr(p, name)) != NULL) {
+      if ((p == params->workloads || p[-1] == ',') &&
+          (p[len] == '\0' || p[len] == ',')) {
+         return TRUE;
+      }
+      p += len;
+   }
+   return FALSE;
+}
+
+
+static void
+BenchUsage(const char *prog)   // IN
+{
+   fprintf(stderr,
+           "Usage: %s [-w workload[,workload...]] [-d directory] [-n files]\n"
+           "          [-s fileSizeMB] [-b blockSize] [-t treeDepth]\n"
+           "          [-l lookups] [-e entries] [-r reads] [-q queueDepth]\n"
+           "          [-f configFlags] [-B shareMBPerSec]\n"
+           "          [-I shareRequestsPerSec]\n"
+           "Workloads: smallfile, seqio, deeptree, dirlist, randread, copy,\n"
+           "           fsync, access, journal, throttle, all (default)\n",
+           prog);
+   exit(EXIT_FAILURE);
+}
+
+
+int
+main(int argc,       // IN
+     char **argv)    // IN
+{
+   BenchParams params;
+   char dir[PATH_MAX];
+   int opt;
+
+   params.workloads = "all";
+   params.dir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+   params.numFiles = DEFAULT_NUM_FILES;
+   params.fileSize = (uint64)DEFAULT_FILE_SIZE_MB * 1024 * 1024;
+   params.blockSize = DEFAULT_BLOCK_SIZE;
+   params.treeDepth = DEFAULT_TREE_DEPTH;
+   params.numLookups = DEFAULT_NUM_LOOKUPS;
+   params.numEntries = DEFAULT_NUM_ENTRIES;
+   params.numReads = DEFAULT_NUM_READS;
+   params.queueDepth = DEFAULT_QUEUE_DEPTH;
+   params.configFlags = BENCH_CONFIG_FLAGS;
+   params.shareBytesPerSec = 0;
+   params.shareRequestsPerSec = 0;
+
+   while ((opt = getopt(argc, argv, "w:d:n:s:b:t:l:e:r:q:f:B:I:")) != -1) {
+      switch (opt) {
+      case 'w': params.workloads = optarg; break;
+      case 'd': params.dir = optarg; break;
+      case 'n': params.numFiles = strtoul(optarg, NULL, 0); break;
+      case 's': params.fileSize = strtoull(optarg, NULL, 0) * 1024 * 1024; break;
+      case 'b': params.blockSize = strtoul(optarg, NULL, 0); break;
+      case 't': params.treeDepth = strtoul(optarg, NULL, 0); break;
+      case 'l': params.numLookups = strtoul(optarg, NULL, 0); break;
+      case 'e': params.numEntries = strtoul(optarg, NULL, 0); break;
+      case 'r': params.numReads = strtoul(optarg, NULL, 0); break;
+      case 'q': params.queueDepth = strtoul(optarg, NULL, 0); break;
+      case 'f': params.configFlags = strtoul(optarg, NULL, 0); break;
+      case 'B':
+         params.shareBytesPerSec = strtoull(optarg, NULL, 0) * 1024 * 1024;
+         break;
+      case 'I': params.shareRequestsPerSec = strtoul(optarg, NULL, 0); break;
+      default: BenchUsage(argv[0]);
+      }
+   }
+   if (params.blockSize == 0 ||
+       params.blockSize > BENCH_MAX_DATA_PAGES * BENCH_PAGE_SIZE) {
+      fprintf(stderr, "block size must be between 1 and %u\n",
+              BENCH_MAX_DATA_PAGES * BENCH_PAGE_SIZE);
+      return EXIT_FAILURE;
+   }
+   if (params.queueDepth == 0 || params.queueDepth > BENCH_MAX_QUEUE_DEPTH) {
+      fprintf(stderr, "queue depth must be between 1 and %u\n",
+              BENCH_MAX_QUEUE_DEPTH);
+      return EXIT_FAILURE;
+   }
+
+   HgfsTest_Path(dir, "%s/hgfsbench.XXXXXX", params.dir);
+   if (!HgfsTest_CreateDir(dir, 0, NULL, 0)) {
+      return EXIT_FAILURE;
+   }
+   if (!BenchConnect(&params)) {
+      rmdir(dir);
+      return EXIT_FAILURE;
+   }
+
+   printf("HGFS server loopback benchmark in %s, config flags %#x, "
+          "max packet %u\n", dir, params.configFlags, gClient.maxPacketSize);
+   if (BenchHasWorkload(&params, "smallfile")) {
+      BenchSmallFiles(&params, dir);
+   }
+   if (BenchHasWorkload(&params, "seqio")) {
+      BenchSequentialIo(&params, dir);
+   }
+   if (BenchHasWorkload(&params, "deeptree")) {
+      BenchDeepTree(&params, dir);
+   }
+   if (BenchHasWorkload(&params, "dirlist")) {
+      BenchDirList(&params, dir);
+   }
+   if (BenchHasWorkload(&params, "randread")) {
+      BenchRandomRead(&params, dir);
+   }
+   if (BenchHasWorkload(&params, "copy")) {
+      BenchCopy(&params, dir);
+   }
+   if (BenchHasWorkload(&params, "fsync")) {
+      BenchFlush(&params, dir);
+   }
+   if (BenchHasWorkload(&params, "access")) {
+      BenchAccess(&params, dir);
+   }
+   if (BenchHasWorkload(&params, "journal")) {
+      BenchJournal(&params, dir);
+   }
+   if (BenchHasWorkload(&params, "throttle")) {
+      BenchThrottle(&params, dir);
+   }
+
+   BenchDisconnect();
+   rmdir(dir);
+   return EXIT_SUCCESS;
+}
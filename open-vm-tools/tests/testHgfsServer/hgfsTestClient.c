@@ -0,0 +1,625 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsTestClient.c --
+ *
+ *   Loopback client of the HGFS server shared by the tests and benchmarks
+ *   in this directory. See hgfsTestClient.h.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "vmware.h"
+#include "hgfs.h"
+#include "hgfsServerPolicy.h"
+#include "hgfsTestClient.h"
+
+/* Loopback channel and session state. */
+typedef struct HgfsTestClient {
+   const HgfsServerCallbacks *serverCb;
+   HgfsServerChannelCallbacks channelCb;
+   HgfsServerChannelData channelData;
+   HgfsServerMgrCallbacks mgrCb;
+   void *transportSession;
+   uint64 sessionId;
+   Atomic_uint32 requestId;
+   HgfsTestServerRequestFunc serverRequest;
+   pthread_mutex_t lock;          /* Protects the replied flags. */
+   pthread_cond_t replyCond;      /* Broadcast when a reply arrives. */
+} HgfsTestClient;
+
+static HgfsTestClient gClient = {
+   .lock = PTHREAD_MUTEX_INITIALIZER,
+   .replyCond = PTHREAD_COND_INITIALIZER,
+};
+
+Atomic_uint32 gHgfsTestFailures;
+
+
+/*
+ * Loopback channel callbacks. Iovs carry the client buffer address in pa,
+ * mapping them is the identity.
+ */
+
+static void *
+HgfsTestChannelMapVa(HgfsVmxIov *iov)   // IN
+{
+   return (void *)(uintptr_t)iov->pa;
+}
+
+
+static void
+HgfsTestChannelUnmapVa(void *context)   // IN
+{
+}
+
+
+static Bool
+HgfsTestChannelSend(void *opaqueSession,    // IN
+                    HgfsPacket *packet,     // IN
+                    HgfsSendFlags flags)    // IN
+{
+   HgfsTestRequest *request;
+   size_t replySize = packet->replyPacketDataSize;
+
+   /* Requests of the server have no client request behind them. */
+   if (0 == (packet->state & HGFS_STATE_CLIENT_REQUEST)) {
+      if (gClient.serverRequest != NULL) {
+         gClient.serverRequest(packet->metaPacket);
+      }
+      if (!(flags & HGFS_SEND_NO_COMPLETE)) {
+         gClient.serverCb->session.sendComplete(packet,
+                                                gClient.transportSession);
+      }
+      return TRUE;
+   }
+
+   /* The request may be reused as soon as it is marked replied. */
+   if (!(flags & HGFS_SEND_NO_COMPLETE)) {
+      gClient.serverCb->session.sendComplete(packet, gClient.transportSession);
+   }
+
+   request = (HgfsTestRequest *)((char *)packet -
+                                 offsetof(HgfsTestRequest, packet));
+   pthread_mutex_lock(&gClient.lock);
+   request->replyDataSize = replySize;
+   request->replied = TRUE;
+   pthread_cond_broadcast(&gClient.replyCond);
+   pthread_mutex_unlock(&gClient.lock);
+   return TRUE;
+}
+
+
+/*
+ * Initializes the server with the configuration and connects the loopback
+ * channel to it. serverRequest, if any, receives the requests sent by the
+ * server.
+ */
+
+Bool
+HgfsTest_Connect(HgfsServerConfig *config,                   // IN
+                 uint32 channelFlags,                        // IN
+                 uint32 maxPacketSize,                       // IN
+                 HgfsTestServerRequestFunc serverRequest)    // IN
+{
+   gClient.serverRequest = serverRequest;
+   gClient.channelCb.getReadVa = HgfsTestChannelMapVa;
+   gClient.channelCb.getWriteVa = HgfsTestChannelMapVa;
+   gClient.channelCb.putVa = HgfsTestChannelUnmapVa;
+   gClient.channelCb.send = HgfsTestChannelSend;
+   gClient.channelData.flags = channelFlags;
+   gClient.channelData.maxPacketSize = maxPacketSize;
+
+   if (!HgfsServerPolicy_Init(NULL, &gClient.mgrCb.enumResources) ||
+       !HgfsServer_InitState(&gClient.serverCb, config, &gClient.mgrCb) ||
+       !gClient.serverCb->session.connect(&gClient, &gClient.channelCb,
+                                          &gClient.channelData,
+                                          &gClient.transportSession)) {
+      fprintf(stderr, "cannot connect to the server\n");
+      return FALSE;
+   }
+   return TRUE;
+}
+
+
+/*
+ * Creates the session of the client and returns the reply, NULL on
+ * failure. Later requests are sent on this session.
+ */
+
+HgfsReplyCreateSessionV4 *
+HgfsTest_CreateSession(HgfsTestRequest *request,   // IN/OUT
+                       uint32 maxPacketSize,       // IN
+                       uint32 flags,               // IN
+                       uint32 *status)             // OUT
+{
+   HgfsRequestCreateSessionV4 *args;
+   HgfsReplyCreateSessionV4 *reply;
+
+   args = HgfsTest_RequestInit(request, HGFS_OP_CREATE_SESSION_V4,
+                               HGFS_PACKET_FLAG_REQUEST);
+   memset(args, 0, sizeof *args);
+   args->maxPacketSize = maxPacketSize;
+   args->flags = flags;
+
+   reply = HgfsTest_Send(request, sizeof *args, NULL, 0, status);
+   if (*status != HGFS_STATUS_SUCCESS) {
+      fprintf(stderr, "create session failed: %u\n", *status);
+      return NULL;
+   }
+   gClient.sessionId = reply->sessionId;
+   return reply;
+}
+
+
+uint64
+HgfsTest_SessionId(void)
+{
+   return gClient.sessionId;
+}
+
+
+/*
+ * Destroys the session, disconnects the channel and shuts the server down.
+ * Returns the status of the session destruction.
+ */
+
+uint32
+HgfsTest_Disconnect(HgfsTestRequest *request)   // IN/OUT
+{
+   HgfsRequestDestroySessionV4 *args;
+   uint32 status;
+
+   args = HgfsTest_RequestInit(request, HGFS_OP_DESTROY_SESSION_V4,
+                               HGFS_PACKET_FLAG_REQUEST);
+   memset(args, 0, sizeof *args);
+   HgfsTest_Send(request, sizeof *args, NULL, 0, &status);
+
+   gClient.serverCb->session.disconnect(gClient.transportSession);
+   gClient.serverCb->session.close(gClient.transportSession);
+   HgfsServer_ExitState();
+   HgfsServerPolicy_Cleanup();
+   return status;
+}
+
+
+/*
+ * Allocates a request with room for requestSize bytes of request, replySize
+ * bytes of reply and the iovs of a data packet of up to maxDataSize bytes.
+ * Exits when out of memory.
+ */
+
+HgfsTestRequest *
+HgfsTest_RequestAlloc(size_t requestSize,    // IN
+                      size_t replySize,      // IN
+                      size_t maxDataSize)    // IN
+{
+   uint32 maxIovs = (requestSize + HGFS_TEST_PAGE_SIZE - 1) /
+                    HGFS_TEST_PAGE_SIZE +
+                    (maxDataSize + HGFS_TEST_PAGE_SIZE - 1) /
+                    HGFS_TEST_PAGE_SIZE;
+   HgfsTestRequest *request;
+
+   request = calloc(1, sizeof *request +
+                       maxIovs * sizeof request->packet.iov[0]);
+   if (request == NULL ||
+       (request->reply = malloc(replySize)) == NULL ||
+       posix_memalign((void **)&request->request, HGFS_TEST_PAGE_SIZE,
+                      ROUNDUP(requestSize, HGFS_TEST_PAGE_SIZE)) != 0) {
+      fprintf(stderr, "out of memory\n");
+      exit(EXIT_FAILURE);
+   }
+   request->requestSize = requestSize;
+   request->replySize = replySize;
+   request->maxIovs = maxIovs;
+   return request;
+}
+
+
+void
+HgfsTest_RequestFree(HgfsTestRequest *request)   // IN
+{
+   if (request != NULL) {
+      free(request->request);
+      free(request->reply);
+      free(request);
+   }
+}
+
+
+/*
+ * Builds the header of a session request or reply and returns the op
+ * arguments following it.
+ */
+
+void *
+HgfsTest_RequestInit(HgfsTestRequest *request,   // IN/OUT
+                     HgfsOp op,                  // IN
+                     uint32 packetFlags)         // IN
+{
+   HgfsHeader *header = (HgfsHeader *)request->request;
+
+   memset(header, 0, sizeof *header);
+   header->version = HGFS_HEADER_VERSION;
+   header->dummy = HGFS_OP_NEW_HEADER;
+   header->headerSize = sizeof *header;
+   header->requestId = Atomic_ReadInc32(&gClient.requestId) + 1;
+   header->op = op;
+   header->flags = packetFlags;
+   header->sessionId = gClient.sessionId;
+   return header + 1;
+}
+
+
+/*
+ * Sends the request with argsSize bytes of op arguments, and dataSize bytes
+ * of the page aligned data buffer as data packet, without waiting for the
+ * reply. Like a guest channel, the iovs do not cross pages so that
+ * asynchronous requests can be remapped.
+ */
+
+void
+HgfsTest_Submit(HgfsTestRequest *request,   // IN/OUT
+                size_t argsSize,            // IN
+                char *data,                 // IN: data buffer
+                size_t dataSize)            // IN: data packet size, 0 for none
+{
+   HgfsHeader *header = (HgfsHeader *)request->request;
+   HgfsPacket *packet = &request->packet;
+   uint32 numMetaPages;
+   uint32 numDataPages;
+   uint32 i;
+
+   header->packetSize = sizeof *header + argsSize;
+   numMetaPages = (header->packetSize + HGFS_TEST_PAGE_SIZE - 1) /
+                  HGFS_TEST_PAGE_SIZE;
+   numDataPages = (dataSize + HGFS_TEST_PAGE_SIZE - 1) / HGFS_TEST_PAGE_SIZE;
+   VERIFY(header->packetSize <= request->requestSize &&
+          numMetaPages + numDataPages <= request->maxIovs);
+
+   memset(packet, 0, sizeof *packet);
+   packet->metaPacket = request->request;
+   packet->metaPacketSize = header->packetSize;
+   packet->metaPacketDataSize = header->packetSize;
+   for (i = 0; i < numMetaPages; i++) {
+      packet->iov[i].va = NULL;
+      packet->iov[i].pa = (uintptr_t)(request->request +
+                                      i * HGFS_TEST_PAGE_SIZE);
+      packet->iov[i].len = MIN(HGFS_TEST_PAGE_SIZE,
+                               header->packetSize - i * HGFS_TEST_PAGE_SIZE);
+   }
+   for (i = 0; i < numDataPages; i++) {
+      packet->iov[numMetaPages + i].va = NULL;
+      packet->iov[numMetaPages + i].pa =
+         (uintptr_t)(data + i * HGFS_TEST_PAGE_SIZE);
+      packet->iov[numMetaPages + i].len = HGFS_TEST_PAGE_SIZE;
+   }
+   packet->iovCount = numMetaPages + numDataPages;
+   packet->dataPacketIovIndex = numMetaPages;
+   packet->dataPacketSize = dataSize;
+   packet->dataPacketDataSize = dataSize;
+   packet->replyPacket = request->reply;
+   packet->replyPacketSize = request->replySize;
+   packet->state |= HGFS_STATE_CLIENT_REQUEST;
+
+   request->replyDataSize = 0;
+   request->replied = FALSE;
+   request->inFlight = TRUE;
+   request->startNs = HgfsTest_NowNs();
+   gClient.serverCb->session.receive(packet, gClient.transportSession);
+}
+
+
+/*
+ * Reaps the reply of a submitted request, waiting for it if asked to.
+ * Returns FALSE if the request is not in flight or has no reply yet.
+ */
+
+Bool
+HgfsTest_Reap(HgfsTestRequest *request,   // IN/OUT
+              Bool wait)                  // IN
+{
+   Bool replied;
+
+   pthread_mutex_lock(&gClient.lock);
+   while (wait && request->inFlight && !request->replied) {
+      pthread_cond_wait(&gClient.replyCond, &gClient.lock);
+   }
+   replied = request->inFlight && request->replied;
+   if (replied) {
+      request->inFlight = FALSE;
+   }
+   pthread_mutex_unlock(&gClient.lock);
+   return replied;
+}
+
+
+/*
+ * Waits for the reply of any of the requests in flight and reaps it.
+ * Returns the index of the request, -1 if none is in flight.
+ */
+
+int
+HgfsTest_ReapAny(HgfsTestRequest **requests,   // IN/OUT
+                 uint32 numRequests)           // IN
+{
+   int index = -1;
+
+   pthread_mutex_lock(&gClient.lock);
+   for (;;) {
+      Bool inFlight = FALSE;
+      uint32 i;
+
+      for (i = 0; i < numRequests && index < 0; i++) {
+         inFlight |= requests[i]->inFlight;
+         if (requests[i]->inFlight && requests[i]->replied) {
+            requests[i]->inFlight = FALSE;
+            index = i;
+         }
+      }
+      if (index >= 0 || !inFlight) {
+         break;
+      }
+      pthread_cond_wait(&gClient.replyCond, &gClient.lock);
+   }
+   pthread_mutex_unlock(&gClient.lock);
+   return index;
+}
+
+
+/*
+ * Returns the op arguments of a reaped reply, NULL with a protocol error
+ * status if the reply is shorter than its header and argsSize.
+ */
+
+void *
+HgfsTest_Reply(HgfsTestRequest *request,   // IN
+               size_t argsSize,            // IN: minimal size of the reply
+               uint32 *status)             // OUT: reply status
+{
+   HgfsHeader *header = (HgfsHeader *)request->reply;
+
+   if (request->replyDataSize < sizeof *header + argsSize) {
+      *status = HGFS_STATUS_PROTOCOL_ERROR;
+      return NULL;
+   }
+   *status = header->status;
+   return header + 1;
+}
+
+
+/*
+ * Sends the request, waits for the reply and returns its op arguments,
+ * NULL on failure.
+ */
+
+void *
+HgfsTest_Send(HgfsTestRequest *request,   // IN/OUT
+              size_t argsSize,            // IN
+              char *data,                 // IN: data buffer
+              size_t dataSize,            // IN: data packet size, 0 for none
+              uint32 *status)             // OUT: reply status
+{
+   HgfsTest_Submit(request, argsSize, data, dataSize);
+   HgfsTest_Reap(request, TRUE);
+   return HgfsTest_Reply(request, 0, status);
+}
+
+
+/*
+ * Fills a V3 file name with the cross-platform name of a path below the
+ * root share and returns the size it takes in the request.
+ */
+
+size_t
+HgfsTest_FileName(HgfsFileNameV3 *fileName,   // OUT
+                  const char *path)           // IN: absolute path
+{
+   char *out = fileName->name;
+   size_t len;
+
+   memset(fileName, 0, sizeof *fileName);
+   fileName->fid = HGFS_INVALID_HANDLE;
+   fileName->caseType = HGFS_FILE_NAME_CASE_SENSITIVE;
+
+   len = strlen(HGFS_SERVER_POLICY_ROOT_SHARE_NAME);
+   memcpy(out, HGFS_SERVER_POLICY_ROOT_SHARE_NAME, len);
+   out += len;
+   for (; *path != '\0'; path++) {
+      if (*path == '/') {
+         while (path[1] == '/') {
+            path++;
+         }
+         if (path[1] != '\0') {
+            *out++ = '\0';
+         }
+      } else {
+         *out++ = *path;
+      }
+   }
+   *out = '\0';
+   fileName->length = out - fileName->name;
+   return fileName->length;
+}
+
+
+/*
+ * Formats a path into a PATH_MAX buffer, exiting if it does not fit.
+ */
+
+void
+HgfsTest_Path(char *path,          // OUT: PATH_MAX buffer
+              const char *format,  // IN
+              ...)
+{
+   va_list args;
+   int len;
+
+   va_start(args, format);
+   len = vsnprintf(path, PATH_MAX, format, args);
+   va_end(args);
+
+   if (len < 0 || len >= PATH_MAX) {
+      fprintf(stderr, "path too long\n");
+      exit(EXIT_FAILURE);
+   }
+}
+
+
+static void
+HgfsTestFilePath(char *path,                  // OUT: PATH_MAX buffer
+                 const char *dir,             // IN
+                 HgfsTestNameFunc nameFunc,   // IN: NULL for "file<index>"
+                 uint32 fileIndex)            // IN
+{
+   char name[NAME_MAX + 1];
+
+   if (nameFunc != NULL) {
+      nameFunc(name, sizeof name, fileIndex);
+   } else {
+      snprintf(name, sizeof name, "file%u", fileIndex);
+   }
+   HgfsTest_Path(path, "%s/%s", dir, name);
+}
+
+
+/*
+ * Creates a scratch directory with numFiles files named by nameFunc, or
+ * "file<index>" if NULL. A dir ending in XXXXXX is made unique like by
+ * mkdtemp. The i-th file holds fileSize bytes of value i + 1, so readers
+ * can tell which file data came from.
+ */
+
+Bool
+HgfsTest_CreateDir(char *dir,                   // IN/OUT
+                   uint32 numFiles,             // IN
+                   HgfsTestNameFunc nameFunc,   // IN
+                   size_t fileSize)             // IN
+{
+   size_t len = strlen(dir);
+   char path[PATH_MAX];
+   char *buf = NULL;
+   Bool success = TRUE;
+   uint32 i;
+
+   if (len >= 6 && strcmp(dir + len - 6, "XXXXXX") == 0) {
+      success = mkdtemp(dir) != NULL;
+   } else {
+      success = mkdir(dir, 0700) == 0;
+   }
+   if (!success) {
+      fprintf(stderr, "mkdir %s failed: %s\n", dir, strerror(errno));
+      return FALSE;
+   }
+
+   if (fileSize != 0 && (buf = malloc(fileSize)) == NULL) {
+      fprintf(stderr, "out of memory\n");
+      return FALSE;
+   }
+   for (i = 0; success && i < numFiles; i++) {
+      int fd;
+
+      HgfsTestFilePath(path, dir, nameFunc, i);
+      fd = open(path, O_CREAT | O_WRONLY | O_EXCL, 0600);
+      if (fd < 0) {
+         fprintf(stderr, "create %s failed: %s\n", path, strerror(errno));
+         success = FALSE;
+      } else {
+         if (buf != NULL) {
+            memset(buf, i + 1, fileSize);
+            if (write(fd, buf, fileSize) != (ssize_t)fileSize) {
+               fprintf(stderr, "write %s failed\n", path);
+               success = FALSE;
+            }
+         }
+         close(fd);
+      }
+   }
+   free(buf);
+
+   return success;
+}
+
+
+/*
+ * Removes a scratch directory created by HgfsTest_CreateDir.
+ */
+
+void
+HgfsTest_RemoveDir(const char *dir,             // IN
+                   uint32 numFiles,             // IN
+                   HgfsTestNameFunc nameFunc)   // IN
+{
+   char path[PATH_MAX];
+   uint32 i;
+
+   for (i = 0; i < numFiles; i++) {
+      HgfsTestFilePath(path, dir, nameFunc, i);
+      unlink(path);
+   }
+   rmdir(dir);
+}
+
+
+uint64
+HgfsTest_NowNs(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/*
+ * Prints one result line of a micro-benchmark: the time per iteration of
+ * each phase, and the time per item of all phases.
+ */
+
+void
+HgfsTest_Report(const char *name,              // IN
+                uint32 numItems,               // IN: per iteration
+                const char *itemName,          // IN
+                const HgfsTestPhase *phases,   // IN
+                uint32 numPhases,              // IN
+                uint32 iterations)             // IN
+{
+   uint64 totalNs = 0;
+   uint32 i;
+
+   printf("%-12s %8u %ss", name, numItems, itemName);
+   for (i = 0; i < numPhases; i++) {
+      printf("  %s %9.3f ms", phases[i].name,
+             phases[i].ns / 1e6 / iterations);
+      totalNs += phases[i].ns;
+   }
+   printf("  per %s %6.1f ns\n", itemName,
+          (double)totalNs / iterations / MAX(numItems, 1));
+}
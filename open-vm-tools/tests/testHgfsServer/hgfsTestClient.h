@@ -0,0 +1,141 @@
+/*********************************************************
+ * Copyright (c) 2026 The open-vm-tools authors.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsTestClient.h --
+ *
+ *    Loopback client of the HGFS server shared by the tests and benchmarks
+ *    in this directory, plus their scratch directory and timing helpers.
+ *
+ *    The loopback channel hands request packets to the server in process.
+ *    Like on the VMCI channel, packets are described by page sized iovs
+ *    holding the client buffer address in pa, and replies may come from
+ *    server threads. A request is owned by the client until its reply has
+ *    been reaped.
+ */
+
+#ifndef _HGFS_TEST_CLIENT_H_
+#define _HGFS_TEST_CLIENT_H_
+
+#include <stdio.h>
+
+#include "vm_basic_types.h"
+#include "vm_atomic.h"
+#include "hgfsProto.h"
+#include "hgfsServer.h"
+
+#define HGFS_TEST_PAGE_SIZE   4096
+
+/* Failed checks of the test. */
+extern Atomic_uint32 gHgfsTestFailures;
+
+#define CHECK(_cond)                                                    \
+   do {                                                                 \
+      if (!(_cond)) {                                                   \
+         fprintf(stderr, "%s:%d: check failed: %s\n",                   \
+                 __FUNCTION__, __LINE__, #_cond);                       \
+         Atomic_Inc(&gHgfsTestFailures);                                \
+      }                                                                 \
+   } while (0)
+
+/* A request of the client and the buffer for its reply. */
+typedef struct HgfsTestRequest {
+   char *request;          /* Page aligned request buffer. */
+   size_t requestSize;
+   char *reply;
+   size_t replySize;
+   size_t replyDataSize;   /* Size of the reply received. */
+   uint32 maxIovs;
+   Bool inFlight;          /* Submitted and not reaped yet. */
+   Bool replied;           /* Protected by the client lock. */
+   uint64 startNs;         /* Submit time. */
+   HgfsPacket packet;      /* Must be last, its iovs follow. */
+} HgfsTestRequest;
+
+/* Handles a request sent by the server to the client, e.g. a break. */
+typedef void (*HgfsTestServerRequestFunc)(const HgfsHeader *header);
+
+/* Name of the fileIndex-th file of a scratch directory. */
+typedef void (*HgfsTestNameFunc)(char *name,
+                                 size_t nameSize,
+                                 uint32 fileIndex);
+
+Bool HgfsTest_Connect(HgfsServerConfig *config,
+                      uint32 channelFlags,
+                      uint32 maxPacketSize,
+                      HgfsTestServerRequestFunc serverRequest);
+HgfsReplyCreateSessionV4 *HgfsTest_CreateSession(HgfsTestRequest *request,
+                                                 uint32 maxPacketSize,
+                                                 uint32 flags,
+                                                 uint32 *status);
+uint64 HgfsTest_SessionId(void);
+uint32 HgfsTest_Disconnect(HgfsTestRequest *request);
+
+HgfsTestRequest *HgfsTest_RequestAlloc(size_t requestSize,
+                                       size_t replySize,
+                                       size_t maxDataSize);
+void HgfsTest_RequestFree(HgfsTestRequest *request);
+void *HgfsTest_RequestInit(HgfsTestRequest *request,
+                           HgfsOp op,
+                           uint32 packetFlags);
+void HgfsTest_Submit(HgfsTestRequest *request,
+                     size_t argsSize,
+                     char *data,
+                     size_t dataSize);
+Bool HgfsTest_Reap(HgfsTestRequest *request,
+                   Bool wait);
+int HgfsTest_ReapAny(HgfsTestRequest **requests,
+                     uint32 numRequests);
+void *HgfsTest_Reply(HgfsTestRequest *request,
+                     size_t argsSize,
+                     uint32 *status);
+void *HgfsTest_Send(HgfsTestRequest *request,
+                    size_t argsSize,
+                    char *data,
+                    size_t dataSize,
+                    uint32 *status);
+
+size_t HgfsTest_FileName(HgfsFileNameV3 *fileName,
+                         const char *path);
+void HgfsTest_Path(char *path,
+                   const char *format,
+                   ...) PRINTF_DECL(2, 3);
+Bool HgfsTest_CreateDir(char *dir,
+                        uint32 numFiles,
+                        HgfsTestNameFunc nameFunc,
+                        size_t fileSize);
+void HgfsTest_RemoveDir(const char *dir,
+                        uint32 numFiles,
+                        HgfsTestNameFunc nameFunc);
+
+uint64 HgfsTest_NowNs(void);
+
+/* Time spent in one phase of a benchmark. */
+typedef struct HgfsTestPhase {
+   const char *name;
+   uint64 ns;
+} HgfsTestPhase;
+
+void HgfsTest_Report(const char *name,
+                     uint32 numItems,
+                     const char *itemName,
+                     const HgfsTestPhase *phases,
+                     uint32 numPhases,
+                     uint32 iterations);
+
+#endif // ifndef _HGFS_TEST_CLIENT_H_